@@ -0,0 +1,562 @@
+//
+// bench.c - Storage and display benchmarks
+//
+// sdbench times raw block transfers through the SD driver and file reads
+// and writes through FatFS, and prints the throughput and latency
+// percentiles of each test. Results can be appended to a CSV file on the
+// card to compare cards, clock rates and cache settings between builds.
+//
+// displaybench runs each LCD and terminal test several times and reports
+// the median, fastest and slowest run as CSV, in the same way, to compare
+// rendering changes between builds.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/rand.h"
+#include "pico/time.h"
+#include "fatfs/ff.h"
+#include "fatfs/sd_card.h"
+#include "fatfs/sdfs.h"
+#include "drivers/display.h"
+#include "drivers/font.h"
+#include "drivers/lcd.h"
+#include "bench.h"
+
+#ifndef PICO_PROGRAM_VERSION_STRING
+#define PICO_PROGRAM_VERSION_STRING "unknown"
+#endif
+
+#define BENCH_FILE      "/sdbench.tmp"
+#define CSV_TEXT_SIZE   (4096)  // CSV rows collected until the tests finish
+
+extern volatile bool user_interrupt;
+
+static const uint32_t raw_block_counts[] = {1, 8, 64, 256};
+
+static bench_result_t result;
+static char csv_text[CSV_TEXT_SIZE];
+static size_t csv_len;
+
+// RAM taken by the results, for the mem command
+const uint32_t bench_static_bytes = sizeof(result) + sizeof(csv_text);
+
+// ---------------------------------------------------------------------------
+// Timing
+// ---------------------------------------------------------------------------
+
+void bench_start(bench_result_t *result, const char *name, uint32_t unit)
+{
+    memset(result, 0, sizeof(*result));
+    result->name = name;
+    result->unit = unit;
+}
+
+void bench_record(bench_result_t *result, uint32_t latency_us, uint32_t bytes)
+{
+    // Keep a uniform sample of the latencies once there are too many to keep
+    uint32_t slot = result->ops;
+    if (slot >= BENCH_SAMPLES) slot = get_rand_32() % (result->ops + 1);
+    if (slot < BENCH_SAMPLES) result->samples[slot] = latency_us;
+
+    if (latency_us > result->max_us) result->max_us = latency_us;
+    result->bytes += bytes;
+    result->ops++;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile; sorts the samples in place
+uint32_t bench_percentile(bench_result_t *result, uint32_t percent)
+{
+    uint32_t n = result->ops < BENCH_SAMPLES ? result->ops : BENCH_SAMPLES;
+    if (n == 0) return 0;
+
+    qsort(result->samples, n, sizeof(result->samples[0]), compare_u32);
+    uint32_t rank = (percent * n + 99) / 100;
+    return result->samples[rank > 0 ? rank - 1 : 0];
+}
+
+uint32_t bench_kb_per_second(const bench_result_t *result)
+{
+    if (result->elapsed_us == 0) return 0;
+    return (uint32_t)(result->bytes * 1000000 / 1024 / result->elapsed_us);
+}
+
+// ---------------------------------------------------------------------------
+// Reporting
+// ---------------------------------------------------------------------------
+
+static void report(bench_result_t *result)
+{
+    uint32_t kbps = bench_kb_per_second(result);
+    uint32_t p50 = bench_percentile(result, 50);
+    uint32_t p99 = bench_percentile(result, 99);
+
+    printf("%-10s %6lu %8lu KB/s\n", result->name, result->unit, kbps);
+    printf("  p50 %lu  p99 %lu  max %lu us\n", p50, p99, result->max_us);
+
+    int len = snprintf(csv_text + csv_len, sizeof(csv_text) - csv_len,
+                       "%s,%s,%lu,%ux%u,%s,%lu,%llu,%lu,%lu,%lu,%lu\n",
+                       PICO_PROGRAM_VERSION_STRING, sd_is_sdhc() ? "SDHC" : "SDSC",
+                       sd_get_baudrate(), SDFS_CACHE_SETS, SDFS_CACHE_WAYS,
+                       result->name, result->unit, (unsigned long long)result->bytes,
+                       kbps, p50, p99, result->max_us);
+    if (len > 0 && csv_len + len < sizeof(csv_text)) csv_len += len;
+}
+
+static void append_csv(const char *path, const char *header)
+{
+    FIL file;
+    UINT written;
+
+    if (f_open(&file, path, FA_OPEN_APPEND | FA_WRITE) != FR_OK)
+    {
+        printf("Error: cannot open %s\n", path);
+        return;
+    }
+
+    FRESULT res = FR_OK;
+    if (f_size(&file) == 0)
+    {
+        res = f_write(&file, header, strlen(header), &written);
+    }
+    if (res == FR_OK) res = f_write(&file, csv_text, csv_len, &written);
+    if (f_close(&file) != FR_OK || res != FR_OK)
+    {
+        printf("Error: cannot write %s\n", path);
+        return;
+    }
+    printf("Results appended to %s\n", path);
+}
+
+// ---------------------------------------------------------------------------
+// Raw block transfers
+// ---------------------------------------------------------------------------
+
+// Transfer BENCH_RAW_BYTES in runs of `blocks` sectors, cycling through the
+// sectors of the preallocated benchmark file
+static bool bench_raw(bool write, uint32_t blocks, uint32_t first, uint32_t sectors)
+{
+    const char *name = write ? "raw-write" : "raw-read";
+    uint8_t *buf = malloc(blocks * 512);
+    if (!buf)
+    {
+        printf("%-10s %6lu  skipped (no memory)\n", name, blocks);
+        return true;
+    }
+    memset(buf, 0xA5, blocks * 512);
+
+    bench_start(&result, name, blocks);
+    uint32_t ops = BENCH_RAW_BYTES / (blocks * 512);
+    uint32_t span = sectors / blocks * blocks;
+    sd_error_t err = SD_ERR_NONE;
+    uint64_t start = time_us_64();
+
+    for (uint32_t i = 0; i < ops && err == SD_ERR_NONE && !user_interrupt; i++)
+    {
+        uint32_t sector = first + (i * blocks) % span;
+        uint64_t t = time_us_64();
+        err = write ? sd_write_blocks(sector, blocks, buf) : sd_read_blocks(sector, blocks, buf);
+        bench_record(&result, (uint32_t)(time_us_64() - t), blocks * 512);
+    }
+    result.elapsed_us = time_us_64() - start;
+    free(buf);
+
+    if (err != SD_ERR_NONE)
+    {
+        printf("%s: SD error %d\n", name, (int)err);
+        return false;
+    }
+    if (user_interrupt) return false;
+    report(&result);
+    return true;
+}
+
+static bool bench_raw_all(uint32_t size_kb)
+{
+    FIL file;
+    bool ok = true;
+
+    // The raw tests only touch sectors of a file of their own
+    FRESULT res = f_open(&file, BENCH_FILE, FA_CREATE_ALWAYS | FA_WRITE);
+    if (res != FR_OK)
+    {
+        printf("Error: cannot create %s (%d)\n", BENCH_FILE, (int)res);
+        return false;
+    }
+    res = f_expand(&file, (FSIZE_t)size_kb * 1024, 1);
+    if (res != FR_OK)
+    {
+        printf("Error: no contiguous %lu KB free (%d)\n", size_kb, (int)res);
+        f_close(&file);
+        f_unlink(BENCH_FILE);
+        return false;
+    }
+
+    FATFS *fs = file.obj.fs;
+    uint32_t first = (uint32_t)(fs->database + (LBA_t)(file.obj.sclust - 2) * fs->csize);
+    uint32_t sectors = size_kb * 2;
+
+    for (int w = 0; w <= 1 && ok; w++)
+    {
+        for (size_t i = 0; i < sizeof(raw_block_counts) / sizeof(raw_block_counts[0]) && ok; i++)
+        {
+            ok = bench_raw(w, raw_block_counts[i], first, sectors);
+        }
+    }
+
+    // The sector cache may hold copies of what was written over
+    sdfs_cache_discard(first, sectors);
+    f_close(&file);
+    f_unlink(BENCH_FILE);
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// FatFS file transfers
+// ---------------------------------------------------------------------------
+
+static bool fs_failed(const char *name, FRESULT res)
+{
+    if (res != FR_OK) printf("%s: FatFS result %d\n", name, (int)res);
+    return res != FR_OK || user_interrupt;
+}
+
+// Sequential writes grow the file, so cluster allocation is part of the time
+static FRESULT bench_sequential(FIL *file, bool write, FSIZE_t size, uint8_t *buf)
+{
+    FRESULT res = f_lseek(file, 0);
+    uint64_t start = time_us_64();
+
+    for (FSIZE_t pos = 0; pos < size && res == FR_OK && !user_interrupt; pos += BENCH_CHUNK)
+    {
+        UINT done;
+        uint64_t t = time_us_64();
+        res = write ? f_write(file, buf, BENCH_CHUNK, &done) : f_read(file, buf, BENCH_CHUNK, &done);
+        if (res == FR_OK && done != BENCH_CHUNK) res = FR_DENIED; // card full or file short
+        bench_record(&result, (uint32_t)(time_us_64() - t), done);
+    }
+    if (res == FR_OK && write) res = f_sync(file);
+    result.elapsed_us = time_us_64() - start;
+    return res;
+}
+
+static FRESULT bench_random(FIL *file, bool write, FSIZE_t size, uint8_t *buf)
+{
+    FRESULT res = FR_OK;
+    uint32_t chunks = (uint32_t)(size / BENCH_CHUNK);
+    uint64_t start = time_us_64();
+
+    for (int i = 0; i < BENCH_RANDOM_OPS && res == FR_OK && !user_interrupt; i++)
+    {
+        UINT done = 0;
+        FSIZE_t pos = (FSIZE_t)(get_rand_32() % chunks) * BENCH_CHUNK;
+        uint64_t t = time_us_64();
+        res = f_lseek(file, pos);
+        if (res == FR_OK)
+        {
+            res = write ? f_write(file, buf, BENCH_CHUNK, &done) : f_read(file, buf, BENCH_CHUNK, &done);
+        }
+        bench_record(&result, (uint32_t)(time_us_64() - t), done);
+    }
+    if (res == FR_OK && write) res = f_sync(file);
+    result.elapsed_us = time_us_64() - start;
+    return res;
+}
+
+static bool bench_files(uint32_t size_kb)
+{
+    FIL file;
+    FSIZE_t size = (FSIZE_t)size_kb * 1024;
+    uint8_t *buf = malloc(BENCH_CHUNK);
+    if (!buf)
+    {
+        printf("Error: out of memory\n");
+        return false;
+    }
+    memset(buf, 0x5A, BENCH_CHUNK);
+
+    FRESULT res = f_open(&file, BENCH_FILE, FA_CREATE_ALWAYS | FA_WRITE | FA_READ);
+    bool ok = !fs_failed("open", res);
+
+    if (ok)
+    {
+        bench_start(&result, "seq-write", BENCH_CHUNK);
+        ok = !fs_failed(result.name, bench_sequential(&file, true, size, buf));
+        if (ok) report(&result);
+    }
+    if (ok)
+    {
+        bench_start(&result, "seq-read", BENCH_CHUNK);
+        ok = !fs_failed(result.name, bench_sequential(&file, false, size, buf));
+        if (ok) report(&result);
+    }
+    if (ok)
+    {
+        bench_start(&result, "rand-read", BENCH_CHUNK);
+        ok = !fs_failed(result.name, bench_random(&file, false, size, buf));
+        if (ok) report(&result);
+    }
+    if (ok)
+    {
+        bench_start(&result, "rand-write", BENCH_CHUNK);
+        ok = !fs_failed(result.name, bench_random(&file, true, size, buf));
+        if (ok) report(&result);
+    }
+
+    if (res == FR_OK) f_close(&file);
+    f_unlink(BENCH_FILE);
+    free(buf);
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// sdbench
+// ---------------------------------------------------------------------------
+
+void sdbench(uint32_t size_kb, const char *csv_path)
+{
+    if (!sdfs_is_ready())
+    {
+        printf("SD card not ready.\n");
+        return;
+    }
+    if (size_kb < BENCH_MIN_KB) size_kb = BENCH_MIN_KB;
+
+    printf("SD card benchmark, %lu KB file\n", size_kb);
+    printf("SPI clock %.1f MHz, cache %ux%u sectors\n",
+           sd_get_baudrate() / 1000000.0f, SDFS_CACHE_SETS, SDFS_CACHE_WAYS);
+    printf("Press BREAK to stop.\n\n");
+    printf("%-10s %6s %13s\n", "test", "size", "speed");
+
+    csv_len = 0;
+    user_interrupt = false;
+    sdfs_cache_stats_t stats;
+    sdfs_get_cache_stats(&stats, true);
+
+    bool ok = bench_raw_all(size_kb) && bench_files(size_kb);
+
+    sdfs_get_cache_stats(&stats, false);
+    printf("Sector cache: %lu hits, %lu misses\n", stats.hits, stats.misses);
+
+    if (user_interrupt)
+    {
+        printf("\nBenchmark interrupted by user.\n");
+        return;
+    }
+    if (ok && csv_path)
+    {
+        append_csv(csv_path, "version,card,baud,cache,test,unit,bytes,kbps,p50_us,p99_us,max_us\n");
+    }
+}
+
+// ---------------------------------------------------------------------------
+// displaybench
+// ---------------------------------------------------------------------------
+
+static const struct {
+    const char *name;
+    const font_t *font;
+} display_fonts[] = {
+    {"8x10", &font_8x10},
+    {"5x10", &font_5x10},
+};
+
+static uint8_t display_attrs;       // DISPLAY_BOLD etc. for the attribute tests
+
+#define DISPLAY_BOLD        (0x01)
+#define DISPLAY_UNDERLINE   (0x02)
+#define DISPLAY_REVERSE     (0x04)
+
+// A screen line of text that changes every row, so nothing is drawn twice
+static void display_line(char *line, uint8_t cols, uint32_t row)
+{
+    for (uint8_t i = 0; i < cols; i++)
+    {
+        line[i] = (char)(' ' + 1 + (row + i) % 94);
+    }
+    line[cols] = '\0';
+}
+
+// Each test draws once and returns the number of operations it timed
+
+static uint32_t display_putc(void)
+{
+    uint8_t cols = lcd_get_columns();
+    for (uint8_t row = 0; row < ROWS; row++)
+    {
+        for (uint8_t col = 0; col < cols; col++)
+        {
+            lcd_putc(col, row, ' ' + 1 + (row + col) % 94);
+        }
+    }
+    return (uint32_t)ROWS * cols;
+}
+
+static uint32_t display_putstr(void)
+{
+    char line[DISPLAY_MAX_COLUMNS + 1];
+    uint8_t cols = lcd_get_columns();
+    lcd_set_bold(display_attrs & DISPLAY_BOLD);
+    lcd_set_underscore(display_attrs & DISPLAY_UNDERLINE);
+    lcd_set_reverse(display_attrs & DISPLAY_REVERSE);
+    for (uint8_t row = 0; row < ROWS; row++)
+    {
+        display_line(line, cols, row);
+        lcd_putstr(0, row, line);
+    }
+    lcd_set_bold(false);
+    lcd_set_underscore(false);
+    lcd_set_reverse(false);
+    return (uint32_t)ROWS * cols;
+}
+
+static uint32_t display_clear(void)
+{
+    lcd_clear_screen();
+    return 1;
+}
+
+static uint32_t display_scroll(void)
+{
+    for (int i = 0; i < ROWS; i++)
+    {
+        lcd_scroll_up();
+    }
+    return ROWS;
+}
+
+static uint32_t display_erase(void)
+{
+    for (int row = 1; row <= ROWS; row++)
+    {
+        printf("\033[%d;1H\033[K", row);
+    }
+    return ROWS;
+}
+
+static uint32_t display_sgr(void)
+{
+    printf("\033[H");
+    for (int i = 0; i < 256; i++)
+    {
+        printf("\033[38;5;%d;48;5;%dm*", i, 255 - i);
+    }
+    printf("\033[m");
+    return 256;
+}
+
+static uint32_t display_printf(void)
+{
+    char line[DISPLAY_MAX_COLUMNS + 1];
+    uint8_t cols = lcd_get_columns();
+    printf("\033[%d;1H", ROWS);
+    for (uint32_t row = 0; row < ROWS; row++)
+    {
+        display_line(line, cols - 1, row);
+        printf("%s\n", line);
+    }
+    return ROWS;
+}
+
+typedef struct {
+    const char *name;
+    uint32_t (*run)(void);
+    uint8_t attrs;
+} display_test_t;
+
+static const display_test_t display_tests[] = {
+    {"putc", display_putc, 0},
+    {"putstr", display_putstr, 0},
+    {"putstr-b", display_putstr, DISPLAY_BOLD},
+    {"putstr-u", display_putstr, DISPLAY_UNDERLINE},
+    {"putstr-r", display_putstr, DISPLAY_REVERSE},
+    {"putstr-bu", display_putstr, DISPLAY_BOLD | DISPLAY_UNDERLINE},
+    {"putstr-br", display_putstr, DISPLAY_BOLD | DISPLAY_REVERSE},
+    {"putstr-ur", display_putstr, DISPLAY_UNDERLINE | DISPLAY_REVERSE},
+    {"putstr-bur", display_putstr, DISPLAY_BOLD | DISPLAY_UNDERLINE | DISPLAY_REVERSE},
+    {"clear", display_clear, 0},
+    {"scroll", display_scroll, 0},
+    {"erase-line", display_erase, 0},
+    {"sgr-256", display_sgr, 0},
+    {"printf", display_printf, 0},
+};
+
+// Time `runs` runs of a test, each one until the screen has been drawn
+static void display_bench_test(const display_test_t *test, const char *font, uint32_t runs)
+{
+    uint32_t ops = 0;
+    display_attrs = test->attrs;
+    bench_start(&result, test->name, 0);
+
+    for (uint32_t i = 0; i < runs && !user_interrupt; i++)
+    {
+        display_flush();
+        lcd_wait_idle();
+        uint64_t t = time_us_64();
+        ops = test->run();
+        display_flush();
+        lcd_wait_idle();
+        bench_record(&result, (uint32_t)(time_us_64() - t), 0);
+    }
+    if (user_interrupt) return;
+
+    uint32_t max_us = result.max_us;
+    uint32_t median = bench_percentile(&result, 50);
+    uint32_t min_us = bench_percentile(&result, 0);
+    uint32_t per_second = median ? (uint32_t)((uint64_t)ops * 1000000 / median) : 0;
+
+    int len = snprintf(csv_text + csv_len, sizeof(csv_text) - csv_len,
+                       "%s,%s,%s,%lu,%lu,%lu,%lu,%lu,%lu\n",
+                       PICO_PROGRAM_VERSION_STRING, font, test->name, runs, ops,
+                       median, min_us, max_us, per_second);
+    if (len > 0 && csv_len + len < sizeof(csv_text)) csv_len += len;
+}
+
+void displaybench(uint32_t runs, const char *csv_path)
+{
+    if (runs < 1) runs = 1;
+    if (runs > BENCH_SAMPLES) runs = BENCH_SAMPLES;
+
+    // Put the font back afterwards
+    const font_t *saved_font = lcd_get_glyph_width() == font_8x10.width ? &font_8x10 : &font_5x10;
+
+    csv_len = 0;
+    user_interrupt = false;
+    printf("\033[?25l\033[2J\033[H");
+
+    for (size_t f = 0; f < count_of(display_fonts) && !user_interrupt; f++)
+    {
+        display_flush();
+        lcd_set_font(display_fonts[f].font);
+        for (size_t i = 0; i < count_of(display_tests) && !user_interrupt; i++)
+        {
+            display_bench_test(&display_tests[i], display_fonts[f].name, runs);
+        }
+    }
+
+    display_flush();
+    lcd_set_font(saved_font);
+    printf("\033[m\033[2J\033[H\033[?25h");
+
+    if (user_interrupt)
+    {
+        printf("Benchmark interrupted by user.\n");
+        return;
+    }
+
+    printf("version,font,test,runs,ops,median_us,min_us,max_us,ops_per_s\n");
+    fwrite(csv_text, 1, csv_len, stdout);
+    if (csv_path)
+    {
+        append_csv(csv_path, "version,font,test,runs,ops,median_us,min_us,max_us,ops_per_s\n");
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BENCH_SAMPLES       (256)       // latencies kept per test for percentiles
+#define BENCH_DEFAULT_KB    (1024)      // default benchmark file size
+#define BENCH_MIN_KB        (128)       // smallest file, holds the largest raw transfer
+#define BENCH_RAW_BYTES     (512 * 1024) // bytes moved per raw block count
+#define BENCH_CHUNK         (4096)      // bytes per FatFS read/write call
+#define BENCH_RANDOM_OPS    (256)       // FatFS random reads/writes per test
+#define BENCH_DISPLAY_RUNS  (5)         // default runs of each display test
+
+// Timing of one benchmark test
+typedef struct {
+    const char *name;           // test name, used in the CSV
+    uint32_t unit;              // blocks or bytes per operation
+    uint64_t bytes;             // bytes transferred
+    uint64_t elapsed_us;        // wall time of the whole test
+    uint32_t ops;               // operations timed
+    uint32_t max_us;            // slowest operation
+    uint32_t samples[BENCH_SAMPLES]; // operation latencies, sampled if ops > BENCH_SAMPLES
+} bench_result_t;
+
+void bench_start(bench_result_t *result, const char *name, uint32_t unit);
+void bench_record(bench_result_t *result, uint32_t latency_us, uint32_t bytes);
+uint32_t bench_percentile(bench_result_t *result, uint32_t percent);
+uint32_t bench_kb_per_second(const bench_result_t *result);
+
+void sdbench(uint32_t size_kb, const char *csv_path);
+void displaybench(uint32_t runs, const char *csv_path);
+
+extern const uint32_t bench_static_bytes;
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <strings.h>
 #include <sys/stat.h>
 #include <errno.h>
 
@@ -8,15 +9,28 @@
 #include "pico/float.h"
 #include "pico/util/datetime.h"
 #include "pico/time.h"
+#include "hardware/clocks.h"
+#include "hardware/spi.h"
 
 #include "drivers/southbridge.h"
 #include "drivers/audio.h"
+#include "drivers/clib.h"
+#include "drivers/clock.h"
 #include "fatfs/sd_card.h"
 #include "fatfs/ff.h"
 #include "fatfs/sdfs.h"
 #include "drivers/lcd.h"
+#include "drivers/display.h"
+#include "drivers/mem.h"
+#include "drivers/mixer.h"
+#include "drivers/picocalc.h"
+#include "drivers/power.h"
+#include "drivers/serial.h"
+#include "drivers/trace.h"
 #include "songs.h"
 #include "tests.h"
+#include "bench.h"
+#include "ymodem.h"
 #include "commands.h"
 
 volatile bool user_interrupt = false;
@@ -28,25 +42,35 @@ static const command_t commands[] = {
     {"backlight", backlight, "Show/set the backlight"},
     {"battery", battery, "Show the battery level"},
     {"beep", beep, "Play a simple beep sound"},
+    {"boot", boot, "Show the boot time of each stage"},
     {"box", box, "Draw a box on the screen"},
     {"bye", bye, "Reboot into BOOTSEL mode"},
     {"cls", clearscreen, "Clear the screen"},
     {"cd", cd, "Change directory ('/' path sep.)"},
+    {"clock", cpu_clock, "Show/set the clock profile"},
     {"dir", dir, "List files on the SD card"},
+    {"displaybench", display_bench, "Benchmark the display"},
     {"free", sd_free, "Show free space on the SD card"},
+    {"mem", mem, "Show memory usage"},
     {"mkdir", sd_mkdir, "Create a new directory"},
     {"mkfile", sd_mkfile, "Create a new file"},
     {"mv", sd_mv, "Move or rename a file/directory"},
     {"more", sd_more, "Page through a file"},
+    {"pause", song_pause, "Pause or resume the song"},
+    {"perf", perf, "Show the performance trace"},
     {"play", play, "Play a song"},
     {"poweroff", power_off, "Power off the device"},
     {"pwd", sd_pwd, "Print working directory"},
+    {"receive", sd_receive, "Receive files over serial (YMODEM)"},
     {"reset", reset, "Reset the device"},
     {"rm", sd_rm, "Remove a file"},
     {"rmdir", sd_rmdir, "Remove a directory"},
     {"rmrf", sd_rmrf, "Recursively remove a directory"},
+    {"sdbench", sd_bench, "Benchmark the SD card"},
     {"sdcard", sd_status, "Show SD card status"},
+    {"send", sd_send, "Send a file over serial (YMODEM)"},
     {"songs", show_song_library, "Show song library"},
+    {"stop", song_stop, "Stop the song"},
     {"test", test, "Run a test"},
     {"tests", show_test_library, "Show test library"},
     {"width", width, "Set number of columns"},
@@ -114,6 +138,25 @@ char *basename(const char *path)
 // Extended song command that takes a parameter
 static void play_named_song(const char *song_name)
 {
+    const char *extension = strrchr(song_name, '.');
+    if (extension && strcasecmp(extension, ".wav") == 0)
+    {
+        printf("Playing %s\n", song_name);
+        printf("Press BREAK key to stop...\n");
+        user_interrupt = false;
+        if (!audio_play_wav_blocking(song_name))
+        {
+            printf("Cannot play '%s'.\n", song_name);
+            printf("Only PCM WAV files, 8 or 16 bit,\n");
+            printf("8-48 kHz, mono or stereo.\n");
+        }
+        else if (user_interrupt)
+        {
+            printf("\nPlayback interrupted by user.\n");
+        }
+        return;
+    }
+
     const audio_song_t *song = find_song(song_name);
     if (!song)
     {
@@ -122,22 +165,24 @@ static void play_named_song(const char *song_name)
         return;
     }
 
+    if (audio_song_is_playing())
+    {
+        if (!audio_song_queue(song))
+        {
+            printf("Cannot queue %s now.\n", song->name);
+            return;
+        }
+        printf("Queued %s\n", song->name);
+        return;
+    }
+
     printf("\nNow playing:\n%s\n\n", song->description);
-    printf("Press BREAK key to stop...\n");
+    printf("Use 'pause' and 'stop' to control.\n");
 
-    // Reset user interrupt flag
+    // Reset user interrupt flag, BREAK stops the song
     user_interrupt = false;
 
-    audio_play_song_blocking(song);
-
-    if (user_interrupt)
-    {
-        printf("\nPlayback interrupted by user.\n");
-    }
-    else
-    {
-        printf("\nSong finished!\n");
-    }
+    audio_song_play(song, NULL, NULL);
 }
 
 static void run_named_test(const char *test_name)
@@ -246,10 +291,38 @@ void run_command(const char *command)
             {
                 sd_mv_filename(condense(cmd_args[1]), condense(cmd_args[2]));
             }
+            else if (strcmp(cmd_args[0], "sdbench") == 0 && cmd_args[1] != NULL)
+            {
+                sd_bench_set(condense(cmd_args[1]), cmd_args[2] ? condense(cmd_args[2]) : NULL);
+            }
+            else if (strcmp(cmd_args[0], "receive") == 0 && cmd_args[1] != NULL)
+            {
+                sd_receive_set(condense(cmd_args[1]));
+            }
+            else if (strcmp(cmd_args[0], "send") == 0 && cmd_args[1] != NULL)
+            {
+                sd_send_filename(condense(cmd_args[1]), cmd_args[2] ? condense(cmd_args[2]) : NULL);
+            }
+            else if (strcmp(cmd_args[0], "mem") == 0 && cmd_args[1] != NULL)
+            {
+                mem_set(condense(cmd_args[1]));
+            }
+            else if (strcmp(cmd_args[0], "perf") == 0 && cmd_args[1] != NULL)
+            {
+                perf_set(condense(cmd_args[1]));
+            }
+            else if (strcmp(cmd_args[0], "displaybench") == 0 && cmd_args[1] != NULL)
+            {
+                display_bench_set(condense(cmd_args[1]), cmd_args[2] ? condense(cmd_args[2]) : NULL);
+            }
             else if (strcmp(cmd_args[0], "width") == 0 && cmd_args[1] != NULL)
             {
                 width_set(condense(cmd_args[1]));
             }
+            else if (strcmp(cmd_args[0], "clock") == 0 && cmd_args[1] != NULL)
+            {
+                cpu_clock_set(condense(cmd_args[1]));
+            }
             else if (strcmp(cmd_args[0], "poweroff") == 0 && cmd_args[1] != NULL)
             {
                 power_off_set(condense(cmd_args[1]));
@@ -278,6 +351,181 @@ void run_command(const char *command)
     user_interrupt = false;
 }
 
+// Static buffers of each subsystem, sizes worked out where they are declared
+static const struct
+{
+    const char *name;
+    const uint32_t *bytes;
+} static_buffers[] = {
+    {"display", &display_static_bytes},
+    {"lcd", &lcd_static_bytes},
+    {"serial", &serial_static_bytes},
+    {"mixer", &mixer_static_bytes},
+    {"trace", &trace_static_bytes},
+    {"clib files", &clib_static_bytes},
+    {"sector cache", &sdfs_cache_static_bytes},
+    {"free map", &sdfs_freemap_static_bytes},
+    {"dir cache", &sdfs_dircache_static_bytes},
+    {"sd card", &sd_static_bytes},
+    {"ymodem", &ymodem_static_bytes},
+    {"bench", &bench_static_bytes},
+};
+
+void mem()
+{
+    mem_heap_stats_t heap;
+    mem_get_heap_stats(&heap);
+    printf("Heap: %lu in use, %lu high water\n", heap.in_use, heap.high_water);
+    printf("  arena %lu of %lu bytes\n", heap.arena, heap.size);
+
+    for (uint core = 0; core < 2; core++)
+    {
+        mem_stack_stats_t stack;
+        mem_get_stack_stats(core, &stack);
+        printf("Stack core %u: %lu of %lu%s\n", core, stack.used, stack.size,
+               stack.used >= stack.size ? " (overflowed)" : "");
+    }
+
+    printf("Static: %lu\n", mem_get_static_bytes());
+    for (size_t i = 0; i < count_of(static_buffers); i++)
+    {
+        if (*static_buffers[i].bytes != 0)
+        {
+            printf("  %-13s %6lu\n", static_buffers[i].name, *static_buffers[i].bytes);
+        }
+    }
+
+    mem_alloc_site_t sites[8];
+    uint8_t count = mem_get_alloc_sites(sites, count_of(sites));
+    if (count == 0)
+    {
+        printf("No allocations traced (MEM_TRACE_ALLOC).\n");
+        return;
+    }
+    printf("\033[4mCaller        Calls    Bytes\033[0m\n");
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (sites[i].caller == 0)
+        {
+            printf("%-10s %8lu %8lu\n", "others", sites[i].calls, sites[i].bytes);
+        }
+        else
+        {
+            printf("0x%08lx %8lu %8lu\n", (unsigned long)sites[i].caller, sites[i].calls, sites[i].bytes);
+        }
+    }
+}
+
+void mem_set(const char *arg)
+{
+    if (strcmp(arg, "reset") != 0)
+    {
+        printf("Usage: mem [reset]\n");
+        return;
+    }
+    mem_reset_alloc_sites();
+    printf("Allocation counts cleared.\n");
+}
+
+void boot()
+{
+    const picocalc_boot_stage_t *stages;
+    uint8_t count = picocalc_get_boot_stages(&stages);
+
+    printf("\033[4mStage          At ms Took ms\033[0m\n");
+    uint32_t last_us = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint32_t took_us = stages[i].us - last_us;
+        printf("%-12s %5lu.%lu %5lu.%lu\n", stages[i].name,
+               stages[i].us / 1000, (stages[i].us / 100) % 10,
+               took_us / 1000, (took_us / 100) % 10);
+        last_us = stages[i].us;
+    }
+}
+
+void perf()
+{
+    trace_stats_t stats;
+    if (!trace_get_stats(TRACE_LCD_LOCKED, &stats))
+    {
+        printf("Tracing is not built in (set TRACE_ENABLED).\n");
+        return;
+    }
+
+    printf("\033[4mEvent            Count  Total ms  Avg us  Max us\033[0m\n");
+    for (int i = 0; i < TRACE_EVENT_COUNT; i++)
+    {
+        trace_get_stats((trace_event_t)i, &stats);
+        if (stats.count == 0)
+        {
+            continue;
+        }
+        printf("%-15s %7lu %9llu %7llu %7lu\n", trace_event_name((trace_event_t)i), stats.count,
+               (unsigned long long)(stats.total_us / 1000), (unsigned long long)(stats.total_us / stats.count),
+               stats.max_us);
+    }
+
+    trace_get_stats(TRACE_LCD_LOCKED, &stats);
+    printf("Longest interrupts-disabled window: %lu us\n", stats.max_us);
+}
+
+void perf_set(const char *arg)
+{
+    if (strcmp(arg, "reset") == 0)
+    {
+        trace_reset();
+        printf("Trace cleared.\n");
+        return;
+    }
+
+    trace_stats_t stats;
+    if (!trace_get_stats(TRACE_LCD_LOCKED, &stats))
+    {
+        printf("Tracing is not built in (set TRACE_ENABLED).\n");
+        return;
+    }
+    if (!sdfs_is_ready())
+    {
+        printf("SD card not ready.\n");
+        return;
+    }
+
+    // Saving the trace would trace the SD card; stop recording until done
+    trace_set_paused(true);
+    FILE *fp = fopen(arg, "w");
+    if (fp == NULL)
+    {
+        trace_set_paused(false);
+        printf("Cannot create file '%s':\n%s\n", arg, strerror(errno));
+        return;
+    }
+
+    fprintf(fp, "start_us,duration_us,event,arg,core\n");
+    trace_record_t records[32];
+    uint32_t saved = 0;
+    uint32_t count;
+    while ((count = trace_get_records(records, saved, count_of(records))) > 0)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            fprintf(fp, "%lu,%lu,%s,%lu,%u\n", records[i].start_us, records[i].duration_us,
+                    trace_event_name((trace_event_t)records[i].event), records[i].arg, records[i].core);
+        }
+        saved += count;
+    }
+    bool failed = ferror(fp) != 0;
+    failed |= fclose(fp) != 0;
+    trace_set_paused(false);
+
+    if (failed)
+    {
+        printf("Error: Cannot write '%s'.\n", arg);
+        return;
+    }
+    printf("Saved %lu events to %s\n", saved, arg);
+}
+
 void show_command_library()
 {
     printf("\033[?25l\033[4mCommand Library\033[0m\n\n");
@@ -378,6 +626,17 @@ void battery()
     {
         printf("Battery level: %d%%\n", battery_level);
     }
+
+    // How much of the time the core has been asleep, for comparing battery life
+    power_stats_t stats;
+    power_get_stats(&stats);
+    uint64_t uptime_us = MAX(time_us_64(), 1);
+    printf("Asleep: %.1f%% since boot, %lu wakeups/s\n",
+           100.0f * stats.asleep_us / uptime_us,
+           (unsigned long)(stats.wakeups * 1000000ull / uptime_us));
+    printf("Clock: %lu MHz, %lu MHz for %.1f%% of the time\n",
+           (unsigned long)(stats.sys_hz / 1000000), (unsigned long)(stats.idle_hz / 1000000),
+           100.0f * stats.idle_us / uptime_us);
 }
 
 void beep()
@@ -426,6 +685,34 @@ void bye()
     rom_reset_usb_boot(0, 0);
 }
 
+void cpu_clock()
+{
+    printf("Clock profile: %s, %lu MHz\n", clock_profile_name(clock_get_profile()),
+           (unsigned long)(clock_get_hz(clk_sys) / 1000000));
+    printf("  LCD SPI: %.1f MHz\n", spi_get_baudrate(LCD_SPI) / 1000000.0f);
+    printf("  SD SPI: %.1f MHz\n", sd_get_baudrate() / 1000000.0f);
+    printf("  Southbridge I2C: %lu kHz\n", (unsigned long)(sb_get_baudrate() / 1000));
+    printf("Usage: clock <eco|normal|turbo>\n");
+}
+
+void cpu_clock_set(const char *name)
+{
+    clock_profile_t profile;
+    if (!clock_find_profile(name, &profile))
+    {
+        printf("Error: Unknown clock profile '%s'.\n", name);
+        printf("Valid profiles are eco, normal or turbo.\n");
+        return;
+    }
+
+    if (!clock_set_profile(profile))
+    {
+        printf("Error: The %s clock cannot be generated.\n", name);
+        return;
+    }
+    cpu_clock();
+}
+
 void clearscreen()
 {
     printf("\033[2J\033[H"); // ANSI escape code to clear the screen
@@ -438,6 +725,29 @@ void play()
     printf("Use 'songs' command to see available\nsongs.\n");
 }
 
+void song_pause()
+{
+    if (!audio_song_is_playing())
+    {
+        printf("No song is playing.\n");
+    }
+    else if (audio_song_is_paused())
+    {
+        audio_song_resume();
+        printf("Resumed.\n");
+    }
+    else
+    {
+        audio_song_pause();
+        printf("Paused.\n");
+    }
+}
+
+void song_stop()
+{
+    audio_song_stop();
+}
+
 void test()
 {
     printf("Error: No test specified.\n");
@@ -462,6 +772,8 @@ void width_set(const char *width)
         return;
     }
 
+    display_flush(); // draw anything buffered in the current font
+
     if (strcmp(width, "40") == 0)
     {
         columns = 40;
@@ -593,6 +905,154 @@ void sd_status()
     printf("  Type: %s\n", sd_is_sdhc() ? "SDHC" : "SDSC");
     get_str_size(buffer, sizeof(buffer), cluster_size);
     printf("  Cluster size: %s\n", buffer);
+    printf("  SPI clock: %.1f MHz\n", sd_get_baudrate() / 1000000.0f);
+    get_str_size(buffer, sizeof(buffer), (uint64_t)sd_get_erase_sectors() * 512);
+    printf("  Erase block: %s\n", buffer);
+
+    sdfs_cache_stats_t stats;
+    sdfs_get_cache_stats(&stats, false);
+    printf("  Sector cache: %lu hits, %lu misses\n", stats.hits, stats.misses);
+    printf("  Write-back: %lu sectors in %lu writes\n", stats.writebacks, stats.write_cmds);
+}
+
+void sd_bench()
+{
+    sdbench(BENCH_DEFAULT_KB, NULL);
+}
+
+void sd_bench_set(const char *size_kb, const char *csv_path)
+{
+    char *end;
+    long size = strtol(size_kb, &end, 10);
+    if (*end != '\0' || size < BENCH_MIN_KB || size > 1024 * 1024)
+    {
+        printf("Error: Invalid file size.\n");
+        printf("Usage: sdbench [size_kb] [csv_file]\n");
+        printf("Example: sdbench 4096 bench.csv\n");
+        return;
+    }
+
+    sdbench((uint32_t)size, csv_path);
+}
+
+// Parse an optional baud rate argument, UART_BAUDRATE if absent
+static bool parse_baudrate(const char *text, uint32_t *baudrate)
+{
+    *baudrate = UART_BAUDRATE;
+    if (text == NULL)
+    {
+        return true;
+    }
+
+    char *end;
+    long value = strtol(text, &end, 10);
+    if (*end != '\0' || value < 1200 || value > UART_BAUDRATE_MAX)
+    {
+        return false;
+    }
+    *baudrate = (uint32_t)value;
+    return true;
+}
+
+static void report_transfer(ymodem_result_t result, const ymodem_stats_t *stats)
+{
+    switch (result)
+    {
+    case YMODEM_OK:
+    {
+        char size_buffer[32];
+        get_str_size(size_buffer, sizeof(size_buffer), stats->bytes);
+        uint64_t rate = stats->elapsed_us ? stats->bytes * 1000000 / stats->elapsed_us : 0;
+        printf("%lu file(s), %s in %.1f s (%llu KB/s)\n", stats->files, size_buffer,
+               stats->elapsed_us / 1000000.0f, (unsigned long long)(rate / 1024));
+        break;
+    }
+    case YMODEM_CANCELLED:
+        printf("Transfer cancelled.\n");
+        break;
+    case YMODEM_TIMEOUT:
+        printf("Error: Transfer timed out.\n");
+        break;
+    case YMODEM_FILE_ERROR:
+        printf("Error: Cannot read or write the file.\n");
+        break;
+    }
+}
+
+void sd_receive()
+{
+    sd_receive_set(NULL);
+}
+
+void sd_receive_set(const char *baudrate)
+{
+    uint32_t baud;
+    if (!parse_baudrate(baudrate, &baud))
+    {
+        printf("Error: Invalid baud rate.\n");
+        printf("Usage: receive [baud]\n");
+        printf("Example: receive 921600\n");
+        return;
+    }
+    if (!sdfs_is_ready())
+    {
+        printf("SD card not ready.\n");
+        return;
+    }
+
+    printf("Waiting for YMODEM sender at %lu baud...\n", baud);
+    ymodem_stats_t stats;
+    ymodem_result_t result = ymodem_receive(baud, &stats);
+    report_transfer(result, &stats);
+}
+
+void sd_send()
+{
+    printf("Error: No file specified.\n");
+    printf("Usage: send <filename> [baud]\n");
+    printf("Example: send song.txt 921600\n");
+}
+
+void sd_send_filename(const char *filename, const char *baudrate)
+{
+    uint32_t baud;
+    if (!parse_baudrate(baudrate, &baud))
+    {
+        printf("Error: Invalid baud rate.\n");
+        printf("Usage: send <filename> [baud]\n");
+        printf("Example: send song.txt 921600\n");
+        return;
+    }
+    if (!sdfs_is_ready())
+    {
+        printf("SD card not ready.\n");
+        return;
+    }
+
+    printf("Waiting for YMODEM receiver at %lu baud...\n", baud);
+    ymodem_stats_t stats;
+    ymodem_result_t result = ymodem_send(filename, baud, &stats);
+    report_transfer(result, &stats);
+}
+
+void display_bench()
+{
+    displaybench(BENCH_DISPLAY_RUNS, NULL);
+}
+
+void display_bench_set(const char *runs, const char *csv_path)
+{
+    char *end;
+    long count = strtol(runs, &end, 10);
+    if (*end != '\0' || count < 1 || count > BENCH_SAMPLES)
+    {
+        printf("Error: Invalid number of runs.\n");
+        printf("Usage: displaybench [runs] [csv_file]\n");
+        printf("Example: displaybench 9 display.csv\n");
+        return;
+    }
+
+    displaybench((uint32_t)count, csv_path);
 }
 
 void sd_free()
@@ -783,7 +1243,7 @@ void sd_read_filename(const char *filename)
             if (line_count > 30)
             {
                 printf("More?");
-                char ch = getchar();
+                char ch = picocalc_getchar();
                 if (ch == 'q' || ch == 'Q')
                 {
                     user_quit = true;
@@ -946,57 +1406,10 @@ void sd_rmrf()
     printf("Example: rmrf tests\n");
 }
 
-// Recursive helper: delete all contents of path, then path itself.
-// Returns FR_OK on success, or the first FatFS error encountered.
-// depth_limit prevents runaway recursion on deeply nested structures.
-static FRESULT rmrf_recursive(const char *path, int depth_limit)
+// Show how much has been removed so far, each time f_rmtree() frees a batch
+static void rmrf_progress(const RMTREE_STAT *st)
 {
-    if (depth_limit <= 0)
-    {
-        printf("Error: Directory too deeply nested.\n");
-        return FR_INT_ERR;
-    }
-
-    DIR dj;
-    FILINFO finfo;
-    FRESULT result = f_opendir(&dj, path);
-    if (result != FR_OK) return result;
-
-    // path (FF_LFN_BUF) + "/" (1) + fname (FF_LFN_BUF) + NUL (1)
-    char child[FF_LFN_BUF + FF_LFN_BUF + 2];
-    for (;;)
-    {
-        result = f_readdir(&dj, &finfo);
-        if (result != FR_OK || finfo.fname[0] == '\0') break;
-
-        // Build child path manually to avoid snprintf truncation warnings.
-        // Explicit length check catches paths that somehow exceed our bounds.
-        size_t plen = strlen(path);
-        bool need_sep = (plen > 0 && path[plen - 1] != '/');
-        size_t flen = strlen(finfo.fname);
-        if (plen + need_sep + flen >= sizeof(child))
-        {
-            printf("Error: Path too long.\n");
-            result = FR_INT_ERR;
-            break;
-        }
-        memcpy(child, path, plen);
-        if (need_sep) child[plen++] = '/';
-        memcpy(child + plen, finfo.fname, flen + 1); // +1 copies the NUL
-
-        if (finfo.fattrib & AM_DIR)
-            result = rmrf_recursive(child, depth_limit - 1);
-        else
-            result = f_unlink(child);
-
-        if (result != FR_OK) break;
-    }
-
-    f_closedir(&dj);
-    if (result != FR_OK) return result;
-
-    // Directory is now empty — remove it
-    return f_unlink(path);
+    printf("\r%lu file(s), %lu dir(s)", st->files, st->dirs);
 }
 
 void sd_rmrf_dirname(const char *dirname)
@@ -1016,14 +1429,30 @@ void sd_rmrf_dirname(const char *dirname)
         return;
     }
 
-    FRESULT result = rmrf_recursive(dirname, 16);
+    RMTREE_STAT st;
+    uint64_t start_us = time_us_64();
+    FRESULT result = f_rmtree(dirname, &st, rmrf_progress);
+    uint64_t elapsed_us = time_us_64() - start_us;
+    if (st.files + st.dirs > 0)
+    {
+        printf("\n");
+    }
+    if (result == FR_NOT_ENOUGH_CORE)
+    {
+        printf("Error: Directory too deeply nested.\n");
+        return;
+    }
     if (result != FR_OK)
     {
         printf("Error: FatFS result %d\n", (int)result);
         return;
     }
 
-    printf("'%s' removed.\n", dirname);
+    char size_buffer[32];
+    get_str_size(size_buffer, sizeof(size_buffer), st.bytes);
+    uint64_t rate = elapsed_us ? (uint64_t)(st.files + st.dirs) * 1000000 / elapsed_us : 0;
+    printf("'%s' removed: %s in %.1f s (%llu entries/s)\n", dirname, size_buffer,
+           elapsed_us / 1000000.0f, (unsigned long long)rate);
 }
 
 void sd_mv(void)
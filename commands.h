@@ -16,14 +16,25 @@ void backlight(void);
 void backlight_set(const char *display_level, const char *keyboard_level);
 void battery(void);
 void beep(void);
+void boot(void);
 void box(void);
 void bye(void);
 void cd(void);
 void clearscreen(void);
+void cpu_clock(void);
+void cpu_clock_set(const char *name);
 void dir(void);
+void display_bench(void);
+void display_bench_set(const char *runs, const char *csv_path);
+void mem(void);
+void mem_set(const char *arg);
+void perf(void);
+void perf_set(const char *arg);
 void play(void);
 void run_command(const char *command);
 void show_command_library(void);
+void song_pause(void);
+void song_stop(void);
 void test(void);
 void width(void);
 void width_set(const char *width_str);
@@ -35,11 +46,15 @@ void reset_set(const char *seconds);
 
 // SD card commands
 void sd_pwd(void);
+void sd_bench(void);
+void sd_bench_set(const char *size_kb, const char *csv_path);
 void cd_dirname(const char *dirname);
 void sd_dir_dirname(const char *dirname);
 void sd_free(void);
 void sd_more(void);
 void sd_read_filename(const char *filename);
+void sd_receive(void);
+void sd_receive_set(const char *baudrate);
 void sd_status(void);
 void sd_mkfile(void);
 void sd_mkfile_filename(const char *filename);
@@ -53,4 +68,6 @@ void sd_rmdir(void);
 void sd_rmdir_dirname(const char *dirname);
 void sd_rmrf(void);
 void sd_rmrf_dirname(const char *dirname);
+void sd_send(void);
+void sd_send_filename(const char *filename, const char *baudrate);
 
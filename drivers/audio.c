@@ -6,28 +6,45 @@
 //  each controlled by separate PIO state machines for independent frequency
 //  generation, enabling true stereo audio output.
 //
+//  PCM samples are played by switching both state machines to a fixed
+//  period PWM program and feeding them from ping-pong DMA buffers, paced
+//  by a DMA timer at the sample rate.
+//
+
+#include <stdlib.h>
+#include <string.h>
 
 #include "pico/stdlib.h"
 #include "hardware/pio.h"
 #include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
 #include "pico/time.h"
 
+#include "fatfs/ff.h"
 #include "audio.h"
+#include "mixer.h"
 #include "audio.pio.h"
 
 static bool audio_initialised = false;
 PIO pio = pio0;
+static uint tone_offset;     // audio_pwm program in PIO instruction memory
+static uint pcm_offset;      // audio_pcm program in PIO instruction memory
 
 static bool is_playing = false;
 static alarm_id_t tone_alarm_id = -1;
+static uint32_t tone_frequency[2] = {SILENCE, SILENCE}; // tone on each channel, kept if clk_sys changes
 
 // Forward declaration for the alarm callback
 static int64_t tone_stop_callback(alarm_id_t id, void *user_data);
+static void song_cancel(void);
 
 // Calculate PWM parameters for a given frequency
 static void set_pwm_frequency(uint8_t channel, uint32_t frequency)
 {
     audio_pwm_set_frequency(pio, channel, frequency);
+    tone_frequency[channel] = frequency;
     is_playing = true;
 }
 
@@ -39,12 +56,13 @@ void audio_play_sound_blocking(uint32_t left_frequency, uint32_t right_frequency
         return;
     }
 
-    // Cancel any existing tone alarm
+    // Cancel any existing tone alarm and song
     if (tone_alarm_id >= 0)
     {
         cancel_alarm(tone_alarm_id);
         tone_alarm_id = -1;
     }
+    song_cancel();
 
     set_pwm_frequency(LEFT_CHANNEL, left_frequency);
     set_pwm_frequency(RIGHT_CHANNEL, right_frequency);
@@ -77,12 +95,13 @@ void audio_play_sound(uint32_t left_frequency, uint32_t right_frequency)
         return;
     }
 
-    // Cancel any existing tone alarm
+    // Cancel any existing tone alarm and song
     if (tone_alarm_id >= 0)
     {
         cancel_alarm(tone_alarm_id);
         tone_alarm_id = -1;
     }
+    song_cancel();
 
     set_pwm_frequency(LEFT_CHANNEL, left_frequency);
     set_pwm_frequency(RIGHT_CHANNEL, right_frequency);
@@ -103,6 +122,8 @@ void audio_stop(void)
         tone_alarm_id = -1;
     }
 
+    audio_pcm_stop();
+    song_cancel();
     set_pwm_frequency(LEFT_CHANNEL, SILENCE);
     set_pwm_frequency(RIGHT_CHANNEL, SILENCE);
     is_playing = false;
@@ -114,7 +135,7 @@ bool audio_is_playing(void)
     return is_playing;
 }
 
-// Function to play a stereo song from the stereo song array
+// Play a song and wait for it to finish or for the BREAK key
 void audio_play_song_blocking(const audio_song_t *song)
 {
     if (!audio_initialised || !song)
@@ -122,37 +143,286 @@ void audio_play_song_blocking(const audio_song_t *song)
         return;
     }
 
-    int note_index = 0;
-    audio_note_t* notes = (audio_note_t*)song->notes;
-    while (notes[note_index].duration_ms != 0)
+    audio_song_play(song, NULL, NULL);
+    while (audio_song_is_playing())
     {
-        audio_play_sound_blocking(
-            notes[note_index].left_frequency,
-            notes[note_index].right_frequency,
-            notes[note_index].duration_ms);
-
-        // Small gap between notes for clarity (except for silence notes)
-        if (notes[note_index].left_frequency != SILENCE ||
-            notes[note_index].right_frequency != SILENCE)
-        {
-            sleep_ms(20);
-        }
-
-        note_index++;
-
-        // Check for user interrupt (BREAK key)
         extern volatile bool user_interrupt;
         if (user_interrupt)
         {
-            audio_stop();
             break;
         }
+        sleep_ms(10);
     }
 
     audio_stop(); // Ensure audio is stopped at the end
 }
 
 
+//
+// Song sequencer
+//
+// Notes are advanced from a hardware alarm. Each alarm callback starts the
+// next note (or the gap after one) and reschedules itself relative to when
+// it was due, so the timing does not drift however late a callback runs.
+// Multi-track songs are handed to the mixer, which sequences them itself
+// and comes back for the next queued song when one ends.
+//
+
+static const audio_song_t *song_queue[AUDIO_SONG_QUEUE]; // songs waiting after the current one
+static uint8_t song_queue_head = 0;
+static uint8_t song_queue_count = 0;
+static const audio_song_t *song_current = NULL;  // NULL when no song is playing
+static uint32_t song_note = 0;                   // next note of the current song
+static bool song_gap = false;                    // the gap after a note comes next
+static bool song_paused = false;
+static bool song_mixed = false;                  // songs are multi-track, played by the mixer
+static int64_t song_remaining_us = 0;            // left of the event that was paused
+static absolute_time_t song_due;                 // when the next event starts
+static uint32_t song_left = SILENCE;             // frequencies of the current event
+static uint32_t song_right = SILENCE;
+static alarm_id_t song_alarm_id = -1;
+static audio_song_callback_t song_callback = NULL;
+static void *song_callback_data = NULL;
+
+static void song_set_frequency(uint32_t left_frequency, uint32_t right_frequency)
+{
+    song_left = left_frequency;
+    song_right = right_frequency;
+    set_pwm_frequency(LEFT_CHANNEL, left_frequency);
+    set_pwm_frequency(RIGHT_CHANNEL, right_frequency);
+}
+
+// End the current song and move on to the next queued one
+static void song_finish(void)
+{
+    const audio_song_t *finished = song_current;
+    song_current = NULL;
+    if (song_queue_count > 0)
+    {
+        song_current = song_queue[song_queue_head];
+        song_queue_head = (song_queue_head + 1) % AUDIO_SONG_QUEUE;
+        song_queue_count--;
+        song_note = 0;
+    }
+    if (song_callback)
+    {
+        song_callback(finished, song_callback_data);
+    }
+}
+
+// Start the next event of the sequence and return how long it lasts in
+// microseconds, or 0 when the last queued song has finished
+static int64_t song_advance(void)
+{
+    while (song_current)
+    {
+        if (song_gap)
+        {
+            // Small gap between notes for clarity (except for silence notes)
+            song_gap = false;
+            song_set_frequency(SILENCE, SILENCE);
+            return AUDIO_NOTE_GAP_MS * 1000;
+        }
+
+        const audio_note_t *note = &song_current->notes[song_note];
+        if (note->duration_ms != 0)
+        {
+            song_note++;
+            song_gap = note->left_frequency != SILENCE || note->right_frequency != SILENCE;
+            song_set_frequency(note->left_frequency, note->right_frequency);
+            return (int64_t)note->duration_ms * 1000;
+        }
+
+        song_finish();
+    }
+
+    song_set_frequency(SILENCE, SILENCE);
+    is_playing = false;
+    return 0;
+}
+
+static int64_t song_alarm_callback(alarm_id_t id, void *user_data)
+{
+    // BREAK stops a song playing in the background
+    extern volatile bool user_interrupt;
+    if (user_interrupt)
+    {
+        song_current = NULL;
+        song_queue_count = 0;
+    }
+
+    int64_t duration_us = song_advance();
+    if (duration_us == 0)
+    {
+        song_alarm_id = -1;
+        return 0;
+    }
+    song_due = delayed_by_us(song_due, duration_us);
+    return -duration_us; // rescheduled from when this event was due
+}
+
+// Start the sequence at the current note and keep it going from the alarm
+static void song_start(void)
+{
+    song_due = get_absolute_time();
+    int64_t duration_us = song_advance();
+    if (duration_us > 0)
+    {
+        song_due = delayed_by_us(song_due, duration_us);
+        song_alarm_id = add_alarm_at(song_due, song_alarm_callback, NULL, true);
+    }
+}
+
+// Stop the sequencer and forget the queue; does not touch the outputs
+static void song_cancel(void)
+{
+    if (song_alarm_id >= 0)
+    {
+        cancel_alarm(song_alarm_id);
+        song_alarm_id = -1;
+    }
+    song_current = NULL;
+    song_queue_count = 0;
+    song_paused = false;
+    song_mixed = false;
+}
+
+// Called by the mixer from the DMA interrupt when a multi-track song ends;
+// returns the next song to play, or NULL when the queue is empty
+const audio_song_t *audio_song_next(void)
+{
+    if (song_current)
+    {
+        song_finish();
+    }
+    return song_current;
+}
+
+// Play a song in the background, replacing anything playing or queued.
+// `callback`, if given, is called from the alarm interrupt as each song
+// finishes.
+void audio_song_play(const audio_song_t *song, audio_song_callback_t callback, void *user_data)
+{
+    if (!audio_initialised || !song)
+    {
+        return;
+    }
+
+    audio_stop();
+    if (song->tracks && !mixer_start())
+    {
+        return;
+    }
+    song_callback = callback;
+    song_callback_data = user_data;
+    song_current = song;
+    song_note = 0;
+    song_gap = false;
+    if (song->tracks)
+    {
+        song_mixed = true;
+        mixer_play_song(song);
+    }
+    else
+    {
+        song_start();
+    }
+}
+
+// Add a song to play after the current one, or start it if nothing is
+// playing; returns false if the queue is full, or if the song is not the
+// same kind (multi-track or not) as the one playing
+bool audio_song_queue(const audio_song_t *song)
+{
+    if (!audio_initialised || !song)
+    {
+        return false;
+    }
+    if (!song_current)
+    {
+        audio_song_play(song, song_callback, song_callback_data);
+        return true;
+    }
+
+    if ((song->tracks != NULL) != song_mixed)
+    {
+        return false;
+    }
+
+    // Keep the alarm or mixer from moving the queue while it changes
+    uint32_t save = save_and_disable_interrupts();
+    bool queued = song_queue_count < AUDIO_SONG_QUEUE;
+    if (queued)
+    {
+        song_queue[(song_queue_head + song_queue_count) % AUDIO_SONG_QUEUE] = song;
+        song_queue_count++;
+    }
+    restore_interrupts(save);
+    return queued;
+}
+
+void audio_song_pause(void)
+{
+    if (!song_current || song_paused)
+    {
+        return;
+    }
+    if (song_mixed)
+    {
+        mixer_set_paused(true);
+        song_paused = true;
+        return;
+    }
+
+    if (song_alarm_id >= 0)
+    {
+        cancel_alarm(song_alarm_id);
+        song_alarm_id = -1;
+    }
+    song_remaining_us = MAX(absolute_time_diff_us(get_absolute_time(), song_due), 0);
+    song_paused = true;
+
+    uint32_t left = song_left, right = song_right;
+    set_pwm_frequency(LEFT_CHANNEL, SILENCE);
+    set_pwm_frequency(RIGHT_CHANNEL, SILENCE);
+    song_left = left; // resumed as it was
+    song_right = right;
+}
+
+void audio_song_resume(void)
+{
+    if (!song_current || !song_paused)
+    {
+        return;
+    }
+
+    song_paused = false;
+    if (song_mixed)
+    {
+        mixer_set_paused(false);
+        return;
+    }
+    song_set_frequency(song_left, song_right);
+    song_due = make_timeout_time_us(song_remaining_us);
+    song_alarm_id = add_alarm_at(song_due, song_alarm_callback, NULL, true);
+}
+
+void audio_song_stop(void)
+{
+    audio_stop();
+}
+
+bool audio_song_is_playing(void)
+{
+    return song_current != NULL;
+}
+
+bool audio_song_is_paused(void)
+{
+    return song_current != NULL && song_paused;
+}
+
+
 // Alarm callback function to stop tone
 static int64_t tone_stop_callback(alarm_id_t id, void *user_data)
 {
@@ -170,10 +440,587 @@ void audio_init(void)
         return; // Already initialized
     }
 
-    uint offset = pio_add_program(pio, &audio_pwm_program);
+    tone_offset = pio_add_program(pio, &audio_pwm_program);
+    pcm_offset = pio_add_program(pio, &audio_pcm_program);
 
-    audio_pwm_program_init(pio, LEFT_CHANNEL, offset, 26);
-    audio_pwm_program_init(pio, RIGHT_CHANNEL, offset, 27);
+    audio_pwm_program_init(pio, LEFT_CHANNEL, tone_offset, AUDIO_LEFT_PIN);
+    audio_pwm_program_init(pio, RIGHT_CHANNEL, tone_offset, AUDIO_RIGHT_PIN);
 
     audio_initialised = true;
 }
+
+
+//
+// PCM sample playback
+//
+// Each channel has two DMA buffers of AUDIO_PCM_FRAMES duties, played by
+// two DMA channels chained to each other. When one buffer finishes, the IRQ
+// re-arms its channel and hands the buffer back to audio_pcm_write(), or
+// has the render callback fill it, while the other buffer plays. All four channels are paced by one DMA timer, so
+// the left and right channels stay in step.
+//
+
+#define PCM_BUFFERS (2)
+
+typedef enum
+{
+    PCM_FREE,    // may be filled by audio_pcm_write()
+    PCM_READY,   // filled, waiting for the DMA
+    PCM_PLAYING, // being read by the DMA
+} pcm_state_t;
+
+static int pcm_timer = -1;                       // DMA pacing timer, -1 if not claimed
+static int pcm_dma[2][PCM_BUFFERS] = {{-1, -1}, {-1, -1}}; // DMA channel per channel and buffer
+static uint16_t *pcm_data = NULL;                // duties, [buffer][channel][frame]
+static volatile pcm_state_t pcm_state[PCM_BUFFERS];
+static volatile uint8_t pcm_done[PCM_BUFFERS];   // channels finished with each buffer
+static volatile bool pcm_running = false;        // DMA started and not drained
+static volatile bool pcm_draining = false;       // no more buffers will be written
+static volatile uint32_t pcm_underrun_count = 0; // buffers replayed because none was ready
+static bool pcm_active = false;                  // state machines set up for PCM
+static uint8_t pcm_bits;
+static uint8_t pcm_channels;
+static uint32_t pcm_rate;                        // sample rate, kept if clk_sys changes
+static audio_pcm_render_t pcm_render = NULL;     // fills buffers from the IRQ, NULL if written
+static uint pcm_fill;                            // buffer audio_pcm_write() fills next
+static uint32_t pcm_fill_frames;                 // frames already in it
+
+static inline uint16_t *pcm_buffer(uint buffer, uint channel)
+{
+    return pcm_data + (buffer * 2 + channel) * AUDIO_PCM_FRAMES;
+}
+
+static void pcm_dma_irq_handler(void)
+{
+    for (uint buffer = 0; buffer < PCM_BUFFERS; buffer++)
+    {
+        for (uint channel = 0; channel < 2; channel++)
+        {
+            int dma = pcm_dma[channel][buffer];
+            if (dma < 0 || !dma_channel_get_irq1_status(dma))
+            {
+                continue;
+            }
+            dma_channel_acknowledge_irq1(dma);
+
+            // Re-arm for the next time the other buffer's channel chains to it
+            dma_channel_set_read_addr(dma, pcm_buffer(buffer, channel), false);
+            pcm_done[buffer] |= 1u << channel;
+        }
+
+        if (pcm_done[buffer] != 3)
+        {
+            continue;
+        }
+        pcm_done[buffer] = 0;
+        pcm_state[buffer] = PCM_FREE;
+
+        // The other buffer has already started
+        uint next = buffer ^ 1;
+        if (pcm_state[next] == PCM_READY)
+        {
+            pcm_state[next] = PCM_PLAYING;
+        }
+        else if (pcm_draining)
+        {
+            dma_timer_set_fraction(pcm_timer, 0, 0); // stall the DMA, the output holds silence
+            pcm_running = false;
+            is_playing = false;
+            continue;
+        }
+        else
+        {
+            pcm_underrun_count++;
+        }
+
+        if (pcm_render && !pcm_draining)
+        {
+            if (!pcm_render(pcm_buffer(buffer, LEFT_CHANNEL), pcm_buffer(buffer, RIGHT_CHANNEL), AUDIO_PCM_FRAMES))
+            {
+                pcm_draining = true; // play out this buffer, then stall
+            }
+            pcm_state[buffer] = PCM_READY;
+        }
+    }
+}
+
+// Claim the DMA timer and channels the first time PCM is played
+static bool pcm_claim(void)
+{
+    if (pcm_timer >= 0)
+    {
+        return true;
+    }
+
+    int timer = dma_claim_unused_timer(false);
+    if (timer < 0)
+    {
+        return false;
+    }
+
+    for (uint channel = 0; channel < 2; channel++)
+    {
+        for (uint buffer = 0; buffer < PCM_BUFFERS; buffer++)
+        {
+            pcm_dma[channel][buffer] = dma_claim_unused_channel(false);
+            if (pcm_dma[channel][buffer] < 0)
+            {
+                for (uint c = 0; c < 2; c++)
+                {
+                    for (uint b = 0; b < PCM_BUFFERS; b++)
+                    {
+                        if (pcm_dma[c][b] >= 0)
+                        {
+                            dma_channel_unclaim(pcm_dma[c][b]);
+                        }
+                        pcm_dma[c][b] = -1;
+                    }
+                }
+                dma_timer_unclaim(timer);
+                return false;
+            }
+        }
+    }
+
+    pcm_timer = timer;
+    irq_add_shared_handler(DMA_IRQ_1, pcm_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+    return true;
+}
+
+// The DMA timer runs at clk_sys * X / Y with 16-bit X and Y; pick the
+// fraction closest to the sample rate
+static void pcm_set_rate(uint32_t sample_rate)
+{
+    uint32_t sys = clock_get_hz(clk_sys);
+    uint32_t best_x = 1, best_y = 0xFFFF, best_error = UINT32_MAX;
+
+    for (uint32_t x = 1; x <= 0xFFFF; x++)
+    {
+        uint32_t y = (uint32_t)(((uint64_t)sys * x + sample_rate / 2) / sample_rate);
+        if (y > 0xFFFF)
+        {
+            break;
+        }
+        uint32_t actual = (uint32_t)((uint64_t)sys * x / y);
+        uint32_t error = actual > sample_rate ? actual - sample_rate : sample_rate - actual;
+        if (error < best_error)
+        {
+            best_error = error;
+            best_x = x;
+            best_y = y;
+        }
+    }
+    dma_timer_set_fraction(pcm_timer, best_x, best_y);
+}
+
+static void pcm_dma_configure(void)
+{
+    for (uint channel = 0; channel < 2; channel++)
+    {
+        for (uint buffer = 0; buffer < PCM_BUFFERS; buffer++)
+        {
+            int dma = pcm_dma[channel][buffer];
+            dma_channel_config c = dma_channel_get_default_config(dma);
+            channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+            channel_config_set_read_increment(&c, true);
+            channel_config_set_write_increment(&c, false);
+            channel_config_set_dreq(&c, dma_get_timer_dreq(pcm_timer));
+            channel_config_set_chain_to(&c, pcm_dma[channel][buffer ^ 1]);
+            dma_channel_configure(dma, &c, &pio->txf[channel], pcm_buffer(buffer, channel), AUDIO_PCM_FRAMES, false);
+            dma_channel_acknowledge_irq1(dma);
+            dma_channel_set_irq1_enabled(dma, true);
+        }
+    }
+}
+
+// Start the DMA once the first buffer is ready
+static void pcm_kick(void)
+{
+    if (pcm_running || pcm_state[0] != PCM_READY)
+    {
+        return;
+    }
+    pcm_state[0] = PCM_PLAYING;
+    pcm_running = true;
+    dma_start_channel_mask((1u << pcm_dma[LEFT_CHANNEL][0]) | (1u << pcm_dma[RIGHT_CHANNEL][0]));
+}
+
+// Scale sample `index` of the caller's data to a PWM duty
+static inline uint16_t pcm_level(const void *samples, uint32_t index)
+{
+    if (pcm_bits == 8)
+    {
+        return (uint16_t)((((const uint8_t *)samples)[index] << AUDIO_PCM_BITS) >> 8);
+    }
+    return (uint16_t)((((const int16_t *)samples)[index] + 32768) >> (16 - AUDIO_PCM_BITS));
+}
+
+// Start PCM playback; samples are unsigned 8-bit or signed 16-bit,
+// interleaved left/right for stereo
+bool audio_pcm_start(uint32_t sample_rate, uint8_t bits, uint8_t channels)
+{
+    if (!audio_initialised ||
+        sample_rate < AUDIO_PCM_MIN_RATE || sample_rate > AUDIO_PCM_MAX_RATE ||
+        (bits != 8 && bits != 16) || (channels != 1 && channels != 2))
+    {
+        return false;
+    }
+
+    audio_stop(); // tones or earlier PCM playback
+    if (!pcm_claim())
+    {
+        return false;
+    }
+    pcm_data = malloc(PCM_BUFFERS * 2 * AUDIO_PCM_FRAMES * sizeof(uint16_t));
+    if (!pcm_data)
+    {
+        return false;
+    }
+
+    pcm_render = NULL;
+    pcm_bits = bits;
+    pcm_channels = channels;
+    pcm_fill = 0;
+    pcm_fill_frames = 0;
+    pcm_running = false;
+    pcm_draining = false;
+    pcm_underrun_count = 0;
+    for (uint buffer = 0; buffer < PCM_BUFFERS; buffer++)
+    {
+        pcm_state[buffer] = PCM_FREE;
+        pcm_done[buffer] = 0;
+    }
+
+    pcm_rate = sample_rate;
+    pcm_set_rate(sample_rate);
+    pcm_dma_configure();
+
+    static const uint pins[2] = {AUDIO_LEFT_PIN, AUDIO_RIGHT_PIN};
+    for (uint channel = 0; channel < 2; channel++)
+    {
+        audio_pcm_program_init(pio, channel, pcm_offset, pins[channel], AUDIO_PCM_LEVELS - 1);
+        pio_sm_put(pio, channel, AUDIO_PCM_SILENCE);
+    }
+    pio_set_sm_mask_enabled(pio, (1u << LEFT_CHANNEL) | (1u << RIGHT_CHANNEL), true);
+
+    pcm_active = true;
+    is_playing = true;
+    return true;
+}
+
+// Start PCM playback with buffers filled by `render` from the DMA
+// interrupt as they come free. Both buffers start out silent. Rendering
+// continues until the callback returns false.
+bool audio_pcm_start_render(uint32_t sample_rate, audio_pcm_render_t render)
+{
+    if (!render || !audio_pcm_start(sample_rate, 16, 2))
+    {
+        return false;
+    }
+
+    for (uint buffer = 0; buffer < PCM_BUFFERS; buffer++)
+    {
+        for (uint channel = 0; channel < 2; channel++)
+        {
+            uint16_t *duty = pcm_buffer(buffer, channel);
+            for (uint32_t i = 0; i < AUDIO_PCM_FRAMES; i++)
+            {
+                duty[i] = AUDIO_PCM_SILENCE;
+            }
+        }
+        pcm_state[buffer] = PCM_READY;
+    }
+    pcm_render = render;
+    pcm_kick();
+    return true;
+}
+
+// Queue frames for playback without blocking; returns the number of frames
+// taken, fewer than `frames` when both buffers are full
+uint32_t audio_pcm_write(const void *samples, uint32_t frames)
+{
+    if (!pcm_active || pcm_draining || pcm_render)
+    {
+        return 0;
+    }
+
+    uint32_t done = 0;
+    while (done < frames && pcm_state[pcm_fill] == PCM_FREE)
+    {
+        uint32_t n = MIN(frames - done, AUDIO_PCM_FRAMES - pcm_fill_frames);
+        uint16_t *left = pcm_buffer(pcm_fill, LEFT_CHANNEL) + pcm_fill_frames;
+        uint16_t *right = pcm_buffer(pcm_fill, RIGHT_CHANNEL) + pcm_fill_frames;
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            uint32_t index = (done + i) * pcm_channels;
+            left[i] = pcm_level(samples, index);
+            right[i] = pcm_channels == 2 ? pcm_level(samples, index + 1) : left[i];
+        }
+        done += n;
+        pcm_fill_frames += n;
+
+        if (pcm_fill_frames == AUDIO_PCM_FRAMES)
+        {
+            pcm_state[pcm_fill] = PCM_READY;
+            pcm_fill ^= 1;
+            pcm_fill_frames = 0;
+            if (pcm_state[0] == PCM_READY && pcm_state[1] == PCM_READY)
+            {
+                pcm_kick(); // both buffers primed
+            }
+        }
+    }
+    return done;
+}
+
+// Play out everything written so far, then stop (blocking)
+void audio_pcm_drain(void)
+{
+    if (!pcm_active)
+    {
+        return;
+    }
+
+    // Pad the last buffer with silence
+    if (pcm_fill_frames > 0)
+    {
+        for (uint channel = 0; channel < 2; channel++)
+        {
+            uint16_t *duty = pcm_buffer(pcm_fill, channel);
+            for (uint32_t i = pcm_fill_frames; i < AUDIO_PCM_FRAMES; i++)
+            {
+                duty[i] = AUDIO_PCM_SILENCE;
+            }
+        }
+        pcm_state[pcm_fill] = PCM_READY;
+    }
+    pcm_draining = true;
+    pcm_kick();
+
+    // At most two buffers are left to play
+    absolute_time_t deadline = make_timeout_time_ms(1000);
+    while (pcm_running && !time_reached(deadline))
+    {
+        tight_loop_contents();
+    }
+    audio_pcm_stop();
+}
+
+// Stop PCM playback at once and return the outputs to tone generation
+void audio_pcm_stop(void)
+{
+    if (!pcm_active)
+    {
+        return;
+    }
+    pcm_active = false;
+
+    dma_timer_set_fraction(pcm_timer, 0, 0);
+    for (uint channel = 0; channel < 2; channel++)
+    {
+        for (uint buffer = 0; buffer < PCM_BUFFERS; buffer++)
+        {
+            // Unchain before aborting so the abort cannot start the other buffer
+            int dma = pcm_dma[channel][buffer];
+            dma_channel_set_irq1_enabled(dma, false);
+            dma_channel_config c = dma_get_channel_config(dma);
+            channel_config_set_chain_to(&c, dma);
+            dma_channel_set_config(dma, &c, false);
+        }
+    }
+    for (uint channel = 0; channel < 2; channel++)
+    {
+        for (uint buffer = 0; buffer < PCM_BUFFERS; buffer++)
+        {
+            dma_channel_abort(pcm_dma[channel][buffer]);
+            dma_channel_acknowledge_irq1(pcm_dma[channel][buffer]);
+        }
+    }
+    pcm_running = false;
+
+    pio_set_sm_mask_enabled(pio, (1u << LEFT_CHANNEL) | (1u << RIGHT_CHANNEL), false);
+    pio_sm_clear_fifos(pio, LEFT_CHANNEL);
+    pio_sm_clear_fifos(pio, RIGHT_CHANNEL);
+    audio_pwm_program_init(pio, LEFT_CHANNEL, tone_offset, AUDIO_LEFT_PIN);
+    audio_pwm_program_init(pio, RIGHT_CHANNEL, tone_offset, AUDIO_RIGHT_PIN);
+
+    free(pcm_data);
+    pcm_data = NULL;
+    is_playing = false;
+}
+
+bool audio_pcm_is_playing(void)
+{
+    return pcm_running;
+}
+
+uint32_t audio_pcm_underruns(void)
+{
+    return pcm_underrun_count;
+}
+
+// Time the playing tones or the PCM sample rate again after clk_sys has
+// changed; the PWM period of PCM playback follows clk_sys
+void audio_clock_changed(void)
+{
+    if (!audio_initialised)
+    {
+        return;
+    }
+
+    if (pcm_active)
+    {
+        pcm_set_rate(pcm_rate);
+    }
+    else if (is_playing)
+    {
+        // A song alarm may change the tone at any time
+        uint32_t save = save_and_disable_interrupts();
+        audio_pwm_set_frequency(pio, LEFT_CHANNEL, tone_frequency[LEFT_CHANNEL]);
+        audio_pwm_set_frequency(pio, RIGHT_CHANNEL, tone_frequency[RIGHT_CHANNEL]);
+        restore_interrupts(save);
+    }
+}
+
+
+//
+// WAV file streaming
+//
+
+static inline uint16_t wav_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t wav_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Read the RIFF header up to the start of the sample data
+static bool wav_read_header(FIL *file, uint32_t *sample_rate, uint8_t *bits, uint8_t *channels, uint32_t *data_size)
+{
+    uint8_t header[16];
+    UINT n;
+    bool have_format = false;
+
+    if (f_read(file, header, 12, &n) != FR_OK || n != 12 ||
+        memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0)
+    {
+        return false;
+    }
+
+    for (;;)
+    {
+        if (f_read(file, header, 8, &n) != FR_OK || n != 8)
+        {
+            return false;
+        }
+        uint32_t size = wav_u32(header + 4);
+        uint32_t skip = size + (size & 1); // chunks are padded to an even length
+
+        if (memcmp(header, "data", 4) == 0)
+        {
+            *data_size = size;
+            return have_format;
+        }
+        if (memcmp(header, "fmt ", 4) == 0)
+        {
+            if (size < 16 || f_read(file, header, 16, &n) != FR_OK || n != 16)
+            {
+                return false;
+            }
+            if (wav_u16(header) != 1)
+            {
+                return false; // compressed formats are not supported
+            }
+            *channels = (uint8_t)wav_u16(header + 2);
+            *sample_rate = wav_u32(header + 4);
+            *bits = (uint8_t)wav_u16(header + 14);
+            have_format = true;
+            skip -= 16;
+        }
+        if (f_lseek(file, f_tell(file) + skip) != FR_OK)
+        {
+            return false;
+        }
+    }
+}
+
+// Play a PCM WAV file from the SD card (blocking); returns false if the
+// file cannot be read or its format cannot be played
+bool audio_play_wav_blocking(const char *path)
+{
+    extern volatile bool user_interrupt;
+    FIL file;
+    uint32_t sample_rate, data_size;
+    uint8_t bits, channels;
+
+    if (f_open(&file, path, FA_READ) != FR_OK)
+    {
+        return false;
+    }
+    if (!wav_read_header(&file, &sample_rate, &bits, &channels, &data_size) ||
+        !audio_pcm_start(sample_rate, bits, channels))
+    {
+        f_close(&file);
+        return false;
+    }
+
+    uint8_t *chunk = malloc(AUDIO_WAV_CHUNK);
+    if (!chunk)
+    {
+        audio_pcm_stop();
+        f_close(&file);
+        return false;
+    }
+
+    uint32_t frame_bytes = channels * bits / 8;
+    bool ok = true;
+    while (data_size >= frame_bytes && !user_interrupt)
+    {
+        // The first read ends on a sector boundary so the rest are whole
+        // sectors that FatFS reads straight into the chunk
+        UINT want = AUDIO_WAV_CHUNK - (UINT)(f_tell(&file) % 512);
+        want = MIN(want, data_size);
+        want -= want % frame_bytes;
+
+        UINT n;
+        if (f_read(&file, chunk, want, &n) != FR_OK)
+        {
+            ok = false;
+            break;
+        }
+        if (n < frame_bytes)
+        {
+            break; // file shorter than its header says
+        }
+        data_size -= n;
+
+        // Hand the chunk over while the DMA drains the buffers
+        uint32_t frames = n / frame_bytes;
+        uint32_t done = 0;
+        while (done < frames && !user_interrupt)
+        {
+            done += audio_pcm_write(chunk + done * frame_bytes, frames - done);
+            if (done < frames)
+            {
+                tight_loop_contents();
+            }
+        }
+    }
+
+    if (user_interrupt)
+    {
+        audio_pcm_stop();
+    }
+    else
+    {
+        audio_pcm_drain();
+    }
+    free(chunk);
+    f_close(&file);
+    return ok;
+}
@@ -116,13 +116,70 @@ typedef struct {
     uint32_t duration_ms; // Duration in milliseconds
 } audio_note_t;
 
+// Oscillators of the software mixer
+typedef enum {
+    AUDIO_WAVE_SQUARE,
+    AUDIO_WAVE_TRIANGLE,
+    AUDIO_WAVE_SAWTOOTH,
+    AUDIO_WAVE_SINE,
+    AUDIO_WAVE_NOISE,
+} audio_wave_t;
+
+// Sound of a mixer voice
+typedef struct {
+    audio_wave_t wave;
+    uint8_t volume;       // 0-255
+    uint16_t attack_ms;   // time to rise to full level
+    uint16_t decay_ms;    // time to fall from full level to silence, stopping at sustain
+    uint8_t sustain;      // level held while the note lasts, 0-255
+    uint16_t release_ms;  // time to fall from full level to silence after the note
+} audio_instrument_t;
+
+// Pan positions of a track
+#define AUDIO_PAN_LEFT   (0)
+#define AUDIO_PAN_CENTRE (128)
+#define AUDIO_PAN_RIGHT  (255)
+
+typedef struct {
+    uint16_t frequency;   // Frequency in Hz, SILENCE releases the note
+    uint32_t duration_ms; // Duration in milliseconds, 0 ends the track
+} audio_track_note_t;
+
+// One part of a multi-track song, played by one mixer voice
+typedef struct {
+    const audio_track_note_t* notes;
+    const audio_instrument_t* instrument;
+    uint8_t pan;                // AUDIO_PAN_LEFT to AUDIO_PAN_RIGHT
+} audio_track_t;
+
 // Structure to hold song information
 typedef struct {
     const char* name;           // Short name for command reference
-    const audio_note_t* notes;  // Pointer to the song data
+    const audio_note_t* notes;  // Pointer to the song data, two-voice songs
     const char* description;    // Full song title and artist
+    const audio_track_t* tracks; // Multi-track songs played by the mixer, or NULL
+    uint8_t track_count;
 } audio_song_t;
 
+// Called from the alarm interrupt when a song queued on the sequencer finishes
+typedef void (*audio_song_callback_t)(const audio_song_t *song, void *user_data);
+
+// Song sequencer
+#define AUDIO_SONG_QUEUE    (4)     // songs that can wait behind the current one
+#define AUDIO_NOTE_GAP_MS   (20)    // silence after each note, for clarity
+
+// PCM sample playback
+#define AUDIO_PCM_BITS      (9)     // PWM resolution of a sample, sets the carrier frequency
+#define AUDIO_PCM_LEVELS    (1 << AUDIO_PCM_BITS)
+#define AUDIO_PCM_SILENCE   (AUDIO_PCM_LEVELS / 2)
+#define AUDIO_PCM_FRAMES    (1024)  // frames per DMA buffer, two buffers per channel
+#define AUDIO_PCM_MIN_RATE  (8000)  // lowest sample rate in Hz
+#define AUDIO_PCM_MAX_RATE  (48000) // highest sample rate in Hz
+#define AUDIO_WAV_CHUNK     (4096)  // bytes read from a WAV file at a time
+
+// Fills a pair of DMA buffers with PWM duties from the DMA interrupt
+typedef bool (*audio_pcm_render_t)(uint16_t *left, uint16_t *right, uint32_t frames);
+
 // Audio driver function prototypes
 void audio_init(void);
 
@@ -135,3 +192,22 @@ void audio_play_song_blocking(const audio_song_t *song);
 void audio_stop(void);
 bool audio_is_playing(void);
 
+void audio_song_play(const audio_song_t *song, audio_song_callback_t callback, void *user_data);
+bool audio_song_queue(const audio_song_t *song);
+void audio_song_pause(void);
+void audio_song_resume(void);
+void audio_song_stop(void);
+bool audio_song_is_playing(void);
+bool audio_song_is_paused(void);
+const audio_song_t *audio_song_next(void);
+
+bool audio_pcm_start(uint32_t sample_rate, uint8_t bits, uint8_t channels);
+bool audio_pcm_start_render(uint32_t sample_rate, audio_pcm_render_t render);
+uint32_t audio_pcm_write(const void *samples, uint32_t frames);
+void audio_pcm_drain(void);
+void audio_pcm_stop(void);
+bool audio_pcm_is_playing(void);
+uint32_t audio_pcm_underruns(void);
+bool audio_play_wav_blocking(const char *path);
+
+void audio_clock_changed(void);
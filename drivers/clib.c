@@ -3,6 +3,14 @@
 //
 // Provides file operations using FatFS.
 //
+// Reads that continue where the previous one stopped switch a descriptor to
+// read-ahead: the file is then read in large sector-aligned chunks, which
+// FatFS turns into multi-block reads, and small reads are served from memory.
+// Reads of whole sectors at a sector boundary skip the window: FatFS moves
+// them straight between the card and the caller's buffer.
+//
+// Files opened with O_FASTSEEK get a cluster link map from a shared pool.
+//
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,12 +20,36 @@
 #include <errno.h>
 #include "pico/stdlib.h"
 #include "../fatfs/ff.h"
+#include "clib.h"
 
 #define FD_FLAG_MASK    0x4000
 #define MAX_OPEN_FILES  16
+#define READAHEAD_SIZE  8192    // read-ahead window per sequential descriptor
+#define READAHEAD_AFTER 2       // sequential reads before read-ahead starts
+#define BLOCK_SIZE      4096    // st_blksize, newlib sizes FILE buffers from it
+
+// Read-ahead window. While it holds data, the FatFS file pointer is at
+// pos + len and the caller's position is pos + index.
+typedef struct {
+    char   *buf;     // allocated when the descriptor turns sequential
+    FSIZE_t pos;     // file offset of buf[0]
+    UINT    len;     // bytes in buf
+    UINT    index;   // next byte to return
+    FSIZE_t next;    // where the next sequential read starts
+    uint8_t run;     // sequential reads so far
+} readahead_t;
 
 static FIL  files[MAX_OPEN_FILES];
 static bool file_open[MAX_OPEN_FILES];
+static readahead_t readahead[MAX_OPEN_FILES];
+static DWORD clmt_pool[FASTSEEK_POOL_ITEMS];
+static uint16_t clmt_start[MAX_OPEN_FILES];
+static uint16_t clmt_items[MAX_OPEN_FILES];  // 0 = no link map
+
+// RAM taken by the descriptors, for the mem command; read-ahead windows
+// are allocated from the heap
+const uint32_t clib_static_bytes = sizeof(files) + sizeof(file_open) + sizeof(readahead) +
+                                  sizeof(clmt_pool) + sizeof(clmt_start) + sizeof(clmt_items);
 static int  initialized = 0;
 
 static void init(void)
@@ -28,6 +60,68 @@ static void init(void)
     }
 }
 
+static FSIZE_t file_tell(int fd)
+{
+    readahead_t *ra = &readahead[fd];
+    return ra->len ? ra->pos + ra->index : f_tell(&files[fd]);
+}
+
+// Find the largest unused part of the link map pool
+static void fastseek_largest_gap(DWORD *start, DWORD *items)
+{
+    *start = *items = 0;
+    for (int i = -1; i < MAX_OPEN_FILES; i++) {
+        if (i >= 0 && !clmt_items[i]) continue;
+        DWORD from = i < 0 ? 0 : clmt_start[i] + clmt_items[i];
+        DWORD to = FASTSEEK_POOL_ITEMS;
+        for (int j = 0; j < MAX_OPEN_FILES; j++) {
+            if (clmt_items[j] && clmt_start[j] >= from && clmt_start[j] < to)
+                to = clmt_start[j];
+        }
+        if (to - from > *items) {
+            *start = from;
+            *items = to - from;
+        }
+    }
+}
+
+static void fastseek_enable(int fd)
+{
+    FIL *fp = &files[fd];
+    DWORD start, items;
+    fastseek_largest_gap(&start, &items);
+    if (items < 4) return; // pool exhausted: plain seeks
+
+    fp->cltbl = &clmt_pool[start];
+    fp->cltbl[0] = items;
+    if (f_lseek(fp, CREATE_LINKMAP) != FR_OK) {
+        fp->cltbl = NULL; // too fragmented for the space left
+        return;
+    }
+    clmt_start[fd] = (uint16_t)start;
+    clmt_items[fd] = (uint16_t)fp->cltbl[0];
+}
+
+static void fastseek_disable(int fd)
+{
+    files[fd].cltbl = NULL;
+    clmt_items[fd] = 0;
+}
+
+// Give back unread window data by moving the FatFS file pointer to the
+// caller's position
+static FRESULT readahead_drop(int fd)
+{
+    readahead_t *ra = &readahead[fd];
+    FRESULT res = FR_OK;
+    if (ra->len) {
+        if (ra->index != ra->len)
+            res = f_lseek(&files[fd], ra->pos + ra->index);
+        ra->len = ra->index = 0;
+    }
+    return res;
+}
+
 static int fresult_to_errno(FRESULT r)
 {
     switch (r) {
@@ -79,6 +173,9 @@ int _open(const char *filename, int oflag, ...)
                 return -1;
             }
             file_open[i] = true;
+            readahead[i] = (readahead_t){0};
+            if ((oflag & O_FASTSEEK) && f_size(&files[i]) >= FASTSEEK_MIN_SIZE)
+                fastseek_enable(i);
             return i | FD_FLAG_MASK;
         }
     }
@@ -94,6 +191,9 @@ int _close(int fd)
 
     FRESULT res = f_close(&files[fd]);
     file_open[fd] = false;
+    clmt_items[fd] = 0;
+    free(readahead[fd].buf);
+    readahead[fd].buf = NULL;
     if (res != FR_OK) { errno = fresult_to_errno(res); return -1; }
     return 0;
 }
@@ -105,11 +205,23 @@ off_t _lseek(int fd, off_t offset, int whence)
     if (fd < 0 || fd >= MAX_OPEN_FILES || !file_open[fd]) { errno = EBADF; return -1; }
 
     FIL *fp = &files[fd];
+    readahead_t *ra = &readahead[fd];
     FSIZE_t new_pos;
     if (whence == SEEK_SET)       new_pos = (FSIZE_t)offset;
-    else if (whence == SEEK_CUR)  new_pos = f_tell(fp) + (FSIZE_t)offset;
+    else if (whence == SEEK_CUR)  new_pos = file_tell(fd) + (FSIZE_t)offset;
     else /* SEEK_END */           new_pos = f_size(fp) + (FSIZE_t)offset;
 
+    // Seeking inside the window only moves the read position
+    if (ra->len && new_pos >= ra->pos && new_pos <= ra->pos + ra->len) {
+        ra->index = (UINT)(new_pos - ra->pos);
+        return (off_t)new_pos;
+    }
+    ra->len = ra->index = 0;
+    if (new_pos != ra->next) ra->run = 0;
+
+    // The link map cannot follow the file past its end
+    if (fp->cltbl && new_pos > f_size(fp)) fastseek_disable(fd);
+
     FRESULT res = f_lseek(fp, new_pos);
     if (res != FR_OK) { errno = fresult_to_errno(res); return -1; }
     return (off_t)f_tell(fp);
@@ -125,10 +237,62 @@ int _read(int fd, char *buffer, int length)
     fd &= ~FD_FLAG_MASK;
     if (fd < 0 || fd >= MAX_OPEN_FILES || !file_open[fd]) { errno = EBADF; return -1; }
 
-    UINT br = 0;
-    FRESULT res = f_read(&files[fd], buffer, (UINT)length, &br);
-    if (res != FR_OK) { errno = fresult_to_errno(res); return -1; }
-    return (int)br;
+    FIL *fp = &files[fd];
+    readahead_t *ra = &readahead[fd];
+    int total = 0;
+
+    if (!ra->len) {
+        if (f_tell(fp) == ra->next) {
+            if (ra->run < READAHEAD_AFTER) ra->run++;
+        } else {
+            ra->run = 0;
+        }
+    }
+
+    while (total < length) {
+        if (ra->index < ra->len) {
+            UINT n = MIN((UINT)(length - total), ra->len - ra->index);
+            memcpy(buffer + total, ra->buf + ra->index, n);
+            ra->index += n;
+            total += n;
+            continue;
+        }
+
+        UINT br = 0;
+        FRESULT res;
+        UINT want = (UINT)(length - total);
+        bool window = ra->run >= READAHEAD_AFTER && want < READAHEAD_SIZE;
+        if (window && f_tell(fp) % 512 == 0 && want >= 512) {
+            want &= ~511u; // whole sectors need no window
+            window = false;
+        }
+        if (window && !ra->buf)
+            ra->buf = malloc(READAHEAD_SIZE); // no read-ahead if this fails
+
+        ra->len = ra->index = 0;
+        if (!window || !ra->buf) {
+            // Not sequential, whole sectors or already large enough: read
+            // straight into the caller's buffer
+            res = f_read(fp, buffer + total, want, &br);
+            total += br;
+        } else {
+            // Refill the window, ending on a sector boundary so the next
+            // refill starts with whole sectors
+            ra->pos = f_tell(fp);
+            res = f_read(fp, ra->buf, READAHEAD_SIZE - (UINT)(ra->pos % 512), &br);
+            ra->len = br;
+        }
+        if (res != FR_OK) {
+            ra->len = 0;
+            if (total) break;
+            errno = fresult_to_errno(res);
+            return -1;
+        }
+        if (br == 0) break; // end of file
+    }
+
+    ra->next = file_tell(fd);
+    return total;
 }
 
 int _write(int fd, const char *buffer, int length)
@@ -144,8 +308,16 @@ int _write(int fd, const char *buffer, int length)
     fd &= ~FD_FLAG_MASK;
     if (fd < 0 || fd >= MAX_OPEN_FILES || !file_open[fd]) { errno = EBADF; return -1; }
 
+    FRESULT res = readahead_drop(fd);
+    if (res != FR_OK) { errno = fresult_to_errno(res); return -1; }
+    readahead[fd].run = 0;
+
+    // The link map cannot follow the file past its end
+    if (files[fd].cltbl && f_tell(&files[fd]) + (FSIZE_t)length > f_size(&files[fd]))
+        fastseek_disable(fd);
+
     UINT bw = 0;
-    FRESULT res = f_write(&files[fd], buffer, (UINT)length, &bw);
+    res = f_write(&files[fd], buffer, (UINT)length, &bw);
     if (res != FR_OK) { errno = fresult_to_errno(res); return -1; }
     if (bw == 0) { errno = EIO; return -1; }
     return (int)bw;
@@ -167,6 +339,7 @@ int _fstat(int fd, struct stat *buf)
     buf->st_mtime = 0;
     buf->st_ctime = 0;
     buf->st_ino   = 0;
+    buf->st_blksize = BLOCK_SIZE;
     return 0;
 }
 
@@ -188,6 +361,7 @@ int _stat(const char *path, struct stat *buf)
     buf->st_mtime = 0;
     buf->st_ctime = 0;
     buf->st_ino   = 0;
+    buf->st_blksize = BLOCK_SIZE;
     return 0;
 }
 
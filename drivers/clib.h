@@ -0,0 +1,12 @@
+#pragma once
+
+#include <fcntl.h>
+
+// Extra open() flag: for files of at least FASTSEEK_MIN_SIZE, build a cluster
+// link map so that seeks cost one step per fragment instead of one FAT
+// lookup per cluster. Fast seek ends if the file has to grow.
+#define O_FASTSEEK          (0x10000000)
+#define FASTSEEK_MIN_SIZE   (1024 * 1024)   // smaller files seek fast enough
+#define FASTSEEK_POOL_ITEMS (1024)          // DWORDs shared by all link maps
+
+extern const uint32_t clib_static_bytes;
@@ -0,0 +1,116 @@
+//
+//  PicoCalc clock profiles
+//
+//  A profile sets clk_sys and the core voltage it needs. clk_peri follows
+//  clk_sys, so the SPI, I2C and UART dividers are all set again for the new
+//  clock: each bus goes back to the fastest rate it can generate that is no
+//  faster than the rate it was asked for, or found to work at start up.
+//
+//  The switch waits until no transfer is on the LCD SPI bus or the
+//  southbridge I2C bus, and the clock and the dividers are then changed
+//  with interrupts disabled, so no transfer sees a half changed bus. The
+//  voltage is raised before the clock goes up and lowered after it comes
+//  down. Playing tones and PCM sample rates are timed again at the end.
+//
+
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "hardware/vreg.h"
+
+#include "clock.h"
+#include "audio.h"
+#include "lcd.h"
+#include "power.h"
+#include "serial.h"
+#include "southbridge.h"
+#include "../fatfs/sd_card.h"
+
+typedef struct
+{
+    const char *name;
+    uint32_t khz;                   // clk_sys
+    enum vreg_voltage voltage;      // core voltage at that clock
+} clock_profile_info_t;
+
+static const clock_profile_info_t clock_profiles[CLOCK_PROFILE_COUNT] = {
+    [CLOCK_PROFILE_ECO] = {"eco", CLOCK_ECO_KHZ, CLOCK_ECO_VOLTAGE},
+    [CLOCK_PROFILE_NORMAL] = {"normal", CLOCK_NORMAL_KHZ, CLOCK_NORMAL_VOLTAGE},
+    [CLOCK_PROFILE_TURBO] = {"turbo", CLOCK_TURBO_KHZ, CLOCK_TURBO_VOLTAGE},
+};
+
+static clock_profile_t clock_profile = CLOCK_PROFILE_NORMAL;
+
+// Switch to a profile; returns false if its clock cannot be generated
+bool clock_set_profile(clock_profile_t profile)
+{
+    uint vco, post_div1, post_div2;
+    if (profile >= CLOCK_PROFILE_COUNT ||
+        !check_sys_clock_khz(clock_profiles[profile].khz, &vco, &post_div1, &post_div2))
+    {
+        return false;
+    }
+
+    enum vreg_voltage from = clock_profiles[clock_profile].voltage;
+    enum vreg_voltage to = clock_profiles[profile].voltage;
+    if (to > from)
+    {
+        vreg_set_voltage(to);
+        sleep_ms(CLOCK_VREG_SETTLE_MS);
+    }
+
+    serial_flush(); // characters still going out would change speed
+
+    // Wait for the I2C transfer in flight, its completion is an interrupt
+    uint32_t save = save_and_disable_interrupts();
+    while (!sb_is_idle())
+    {
+        restore_interrupts(save);
+        tight_loop_contents();
+        save = save_and_disable_interrupts();
+    }
+    lcd_wait_idle(); // polls the DMA to the end, interrupts stay disabled
+
+    set_sys_clock_pll(vco, post_div1, post_div2);
+    lcd_clock_changed();
+    sd_clock_changed();
+    sb_clock_changed();
+    serial_clock_changed();
+    power_clock_changed();
+    restore_interrupts(save);
+
+    if (to < from)
+    {
+        vreg_set_voltage(to);
+    }
+
+    audio_clock_changed();
+    clock_profile = profile;
+    return true;
+}
+
+clock_profile_t clock_get_profile()
+{
+    return clock_profile;
+}
+
+const char *clock_profile_name(clock_profile_t profile)
+{
+    return profile < CLOCK_PROFILE_COUNT ? clock_profiles[profile].name : NULL;
+}
+
+// Look up a profile by its name
+bool clock_find_profile(const char *name, clock_profile_t *profile)
+{
+    for (clock_profile_t p = 0; p < CLOCK_PROFILE_COUNT; p++)
+    {
+        if (strcmp(name, clock_profiles[p].name) == 0)
+        {
+            *profile = p;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "pico/stdlib.h"
+#include "hardware/vreg.h"
+
+#define CLOCK_ECO_KHZ           (48000)               // slowest clock every bus still runs at
+#define CLOCK_ECO_VOLTAGE       (VREG_VOLTAGE_1_10)
+#define CLOCK_NORMAL_KHZ        (SYS_CLK_KHZ)         // the clock the SDK starts at
+#define CLOCK_NORMAL_VOLTAGE    (VREG_VOLTAGE_1_15)   // enough for the SDK's clock, up to 200 MHz
+#define CLOCK_TURBO_KHZ         (250000)              // overclocked
+#define CLOCK_TURBO_VOLTAGE     (VREG_VOLTAGE_1_20)
+#define CLOCK_VREG_SETTLE_MS    (10)                  // wait after raising the voltage
+
+typedef enum
+{
+    CLOCK_PROFILE_ECO,
+    CLOCK_PROFILE_NORMAL,
+    CLOCK_PROFILE_TURBO,
+    CLOCK_PROFILE_COUNT
+} clock_profile_t;
+
+// Function prototypes
+bool clock_set_profile(clock_profile_t profile);
+clock_profile_t clock_get_profile(void);
+const char *clock_profile_name(clock_profile_t profile);
+bool clock_find_profile(const char *name, clock_profile_t *profile);
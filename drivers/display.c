@@ -14,6 +14,7 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "pico/stdlib.h"
@@ -100,8 +101,11 @@ const uint16_t xterm_palette[256] = {
 //
 
 bool tab_stops[64] = {0};
-uint8_t debug[64] = {0};
+
+#if DISPLAY_DEBUG_CAPTURE
+uint8_t debug[64] = {0}; // last escape sequence received
 int debug_index = 0;
+#endif
 
 uint8_t state = STATE_NORMAL; // initial state of escape sequence processing
 uint8_t column = 0;           // cursor x position
@@ -109,9 +113,13 @@ uint8_t row = 0;              // cursor y position
 
 uint16_t parameters[16]; // buffer for selective parameters
 uint8_t p_index = 0;    // index into the buffer
+uint8_t intermediate = 0;   // intermediate character of the sequence, 0 if none
+uint8_t private_marker = 0; // private marker of the control sequence (e.g. ?), 0 if none
 
 uint8_t save_column = 0; // saved cursor x position for DECSC/DECRC
 uint8_t save_row = 0;    // saved cursor y position for DECSC/DECRC
+uint8_t margin_top = 0;          // top row of the scrolling region (DECSTBM)
+uint8_t margin_bottom = MAX_ROW; // bottom row of the scrolling region (DECSTBM)
 uint8_t leds = 0;        // current LED state
 
 uint8_t g0_charset = CHARSET_ASCII; // G0 character set (default ASCII)
@@ -169,695 +177,1814 @@ static void report(const char *msg)
     }
 }
 
-static void reset_terminal()
+//
+//  Shadow text buffer
+//
+//  With DISPLAY_SHADOW_BUFFER enabled, printable characters are written into a buffer of
+//  character cells rather than straight to the LCD. Each row keeps a single dirty span and
+//  flushing draws every dirty span with one lcd_putcells() call, so a line of text costs one
+//  window setup and one blit instead of one per character.
+//
+//  The buffer is flushed on explicit cursor movement, before reading from stdin (see
+//  picocalc.c) and by an alarm DISPLAY_FLUSH_MS after the first cell is dirtied.
+//
+//  Erasing updates the buffer and the LCD together, so erased cells are not redrawn by the
+//  next flush. Scrolling moves the lines in the buffer straight away but the LCD is only
+//  scrolled by the next flush, so a burst of line feeds becomes one hardware scroll and
+//  the lines that scroll off before the flush are never drawn. Until then the LCD cursor
+//  is left where it was.
+//
+
+#if DISPLAY_SHADOW_BUFFER
+typedef struct
 {
-    // Reset terminal state
-    lcd_set_reverse(false);
-    lcd_set_foreground(FOREGROUND);
-    lcd_set_background(BACKGROUND);
-    lcd_set_underscore(false);
-    lcd_enable_cursor(true);
-    set_g0_charset(CHARSET_ASCII); // reset character set to ASCII
-    set_g1_charset(CHARSET_ASCII);
-    lcd_define_scrolling(0, 0); // no scrolling area defined
-    lcd_clear_screen();
-    leds = 0;          // reset LED state
-    update_leds(leds); // reset LEDs
+    lcd_cell_t cells[DISPLAY_MAX_COLUMNS];
+    uint8_t dirty_start;       // first dirty column
+    uint8_t dirty_end;         // last dirty column, clean if less than dirty_start
+} shadow_line_t;
+
+static shadow_line_t shadow_lines[ROWS];
+static uint8_t shadow_map[ROWS];        // screen row to shadow line
+static uint8_t shadow_columns = 0;      // number of columns the buffer was filled for
+static bool shadow_dirty = false;       // at least one line has a dirty span
+static volatile bool shadow_busy = false; // the buffer is being updated, do not flush
+static volatile alarm_id_t flush_alarm = 0;
+static int16_t shadow_scroll_pending = 0; // lines scrolled in the buffer but not on the LCD
+static uint16_t shadow_scroll_colour;     // background colour of the pending scroll
+static bool shadow_scroll_mixed = false;  // the pending scroll blanked lines in several colours
+
+static void shadow_clean(shadow_line_t *line)
+{
+    line->dirty_start = 0xFF;
+    line->dirty_end = 0;
+}
+
+// Fill a range of cells in a line with blanks in the current background colour
+static void shadow_blank(shadow_line_t *line, uint8_t col_start, uint8_t col_end)
+{
+    lcd_cell_t blank = lcd_make_cell(' ');
+    blank.attrs = 0;
+    for (uint8_t c = col_start; c <= col_end && c < DISPLAY_MAX_COLUMNS; c++)
+    {
+        line->cells[c] = blank;
+    }
 }
 
 //
-// Display API
+//  Text history
+//
+//  With DISPLAY_SCROLLBACK enabled, every line that scrolls off the top of the whole screen
+//  is added to a ring of DISPLAY_HISTORY_BYTES. A line is stored as runs of cells with the
+//  same attributes and colours, each run a count, the attributes, the foreground and the
+//  background (low byte first) and then its glyphs; trailing blanks are dropped. Lines are
+//  numbered in the order they scrolled off, so screen row r is line history_count + r.
+//
+//  The LCD frame memory is FRAME_HEIGHT rows, so the lines above the visible screen still
+//  hold the last lines that scrolled off. frame_lines records which line each text line of
+//  the frame memory holds, if any, so the scrollback view only draws the lines that are not
+//  already there. As the LCD scroll is deferred, a line only counts as being in the frame
+//  memory if it was fully drawn when it scrolled off and the LCD scrolled it off in turn.
 //
 
-bool display_emit_available()
+#if DISPLAY_SCROLLBACK
+#define FRAME_LINES     (FRAME_HEIGHT / GLYPH_HEIGHT) // text lines in the frame memory
+#define NO_LINE         (UINT32_MAX)    // frame memory line that holds no history line
+#define RUN_HEADER      (6)             // bytes before the glyphs of a run
+
+static uint8_t history[DISPLAY_HISTORY_BYTES];
+static uint32_t history_pos[DISPLAY_HISTORY_LINES]; // where each line starts, by line number
+static uint32_t history_head = 0;           // bytes ever added to the ring
+static uint32_t history_count = 0;          // lines ever added
+static uint32_t history_oldest = 0;         // oldest line still in the ring
+static uint32_t frame_lines[FRAME_LINES];   // line held by each frame memory line
+static uint8_t history_unscrolled = 0;      // lines added since the LCD last scrolled
+
+// Forget what the frame memory holds, its lines have been cleared or moved
+static void frame_forget()
 {
-    return true; // always available for output in this implementation
+    for (uint8_t i = 0; i < FRAME_LINES; i++)
+    {
+        frame_lines[i] = NO_LINE;
+    }
+    history_unscrolled = 0;
 }
 
-void display_emit(char ch)
+static bool history_same_run(const lcd_cell_t *a, const lcd_cell_t *b)
 {
-    int max_row = MAX_ROW;
-    int max_col = lcd_get_columns() - 1;
+    return a->attrs == b->attrs && a->foreground == b->foreground && a->background == b->background;
+}
 
-    lcd_erase_cursor(); // erase the cursor before processing the character
+// Add the line at the top of the screen to the history, it is about to scroll off
+static void history_push(const shadow_line_t *line)
+{
+    uint8_t record[DISPLAY_MAX_COLUMNS * (RUN_HEADER + 1)];
+    uint16_t size = 0;
 
-    // State machine for processing incoming characters
-    switch (state)
-    {
-    case STATE_ESCAPE:        // ESC character received, process the next character
-        state = STATE_NORMAL; // reset state by default
-        switch (ch)
-        {
-        case CHR_CAN:                      // cancel the current escape sequence
-        case CHR_SUB:                      // same as CAN
-            lcd_putc(column++, row, 0x02); // print a error character
-            break;
-        case CHR_ESC:
-            state = STATE_ESCAPE; // stay in escape state
-            break;
-        case '7': // DECSC – Save Cursor
-            save_column = column;
-            save_row = row;
-            break;
-        case '8': // DECRC – Restore Cursor
-            column = save_column;
-            row = save_row;
-            break;
-        case 'D': // IND – Index
-            row++;
-            break;
-        case 'E': // NEL – Next Line
-            column = 0;
-            row++;
-            break;
-        case 'H': // HTS – Horizontal Tabulation Set
-            if (column < sizeof(tab_stops))
-            {
-                tab_stops[column] = true; // Set a tab stop at the current column
-            }
-            break;
-        case 'M':         // RI – Reverse Index
-            if (row == 0) // scroll at top of the screen
-            {
-                lcd_scroll_down();
-            }
-            else
-            {
-                row--;
-            }
-            break;
-        case 'c': // RIS – Reset To Initial State
-            column = row = 0;
-            reset_terminal();
-            break;
-        case '[': // CSI - Control Sequence Introducer
-            p_index = 0;
-            memset(parameters, 0, sizeof(parameters));
-            memset(debug, 0, sizeof(debug));
-            debug[0] = '\033';
-            debug[1] = ch;
-            debug_index = 2;
-            state = STATE_CS;
-            break;
-        case ']': // OSC - Operating System Command
-        case 'X': // SOS - Start of String (treat as OSC)
-        case '^': // PM - Privacy Message (treat as OSC)
-        case '_': // APC - Application Program Command (treat as OSC)
-        case 'P': // DCS - Device Control String (treat as OSC)
-            state = STATE_OSC;
-            break;
-        case '(': // SCS - G0 character set selection
-            state = STATE_G0_SET;
-            break;
-        case ')': // SCS - G1 character set selection
-            state = STATE_G1_SET;
-            break;
-        default:
-            // not a valid escape sequence, should we print an error?
-            break;
-        }
-        break;
-
-    case STATE_CS: // in Control Sequence
-        debug[debug_index++] = ch;
-        if (ch == CHR_ESC)
-        {
-            state = STATE_ESCAPE;
-            break; // reset to escape state
-        }
-        else if (ch == '?') // DEC private mode
-        {
-            state = STATE_DEC;
-        }
-        else if (ch == '!') // TMC
-        {
-            state = STATE_TMC;
-        }
-        else if (ch >= '0' && ch <= '9')
-        {
-            parameters[p_index] *= 10; // accumulate digits
-            parameters[p_index] += ch - '0';
-        }
-        else if (ch == ';') // delimiter
-        {
-            if (p_index < sizeof(parameters) - 1)
-            {
-                p_index++;
-            }
-        }
-        else // final character in control sequence
-        {
-            state = STATE_NORMAL; // reset state after processing the control sequence
-            switch (ch)
-            {
-            case 'A': // CUU – Cursor Up
-                row = MAX(0, row - parameters[0]);
-                break;
-            case 'B': // CUD – Cursor Down
-                row = MIN(row + parameters[0], max_row);
-                break;
-            case 'C': // CUF – Cursor Forward
-                column = MIN(column + parameters[0], max_col);
-                break;
-            case 'D': // CUB - Cursor Backward
-                column = MAX(0, column - parameters[0]);
-                break;
-            case 'E': // CNL – CursorNext Line
-                if (parameters[0] == 0)
-                {
-                    parameters[0] = 1; // default to 1 if not specified
-                }
-                row = MIN(row + parameters[0], max_row);
-                column = 0;
-                break;
-            case 'F': // CPL – Cursor Previous Line
-                if (parameters[0] == 0)
-                {
-                    parameters[0] = 1; // default to 1 if not specified
-                }
-                row = MAX(0, row - parameters[0]);
-                column = 0;
-                break;
-            case 'G': // CHA - Cursor Horizontal Absolute
-                if (parameters[0] == 0)
-                {
-                    parameters[0] = 1; // default to 1 if not specified
-                }
-                column = MIN(parameters[0] - 1, max_col);
-                column = MAX(0, column);
-                break;
-
-            case 'H': // CUP – Cursor Position
-            case 'f': // HVP – Horizontal and Vertical Position
-                if (parameters[0] == 0)
-                {
-                    parameters[0] = 1; // default to 1 if not specified
-                }
-                if (parameters[1] == 0)
-                {
-                    parameters[1] = 1; // default to 1 if not specified
-                }
-                row = MIN(parameters[0] - 1, max_row);
-                column = MIN(parameters[1] - 1, max_col);
-                break;
-            case 'J': // ED – Erase In Display
-                if (parameters[0] == 0)
-                {
-                    // Erase from cursor to end of screen
-                    lcd_erase_line(row, column, max_col);
-                    for (uint8_t r = row + 1; r <= max_row; r++)
-                    {
-                        lcd_erase_line(r, 0, max_col);
-                    }
-                }
-                else if (parameters[0] == 1)
-                {
-                    // Erase from start of screen to cursor
-                    for (uint8_t r = 0; r < row; r++)
-                    {
-                        lcd_erase_line(r, 0, max_col);
-                    }
-                    lcd_erase_line(row, 0, column);
-                }
-                else if (parameters[0] == 2) // clear entire screen
-                {
-                    lcd_clear_screen();
-                }
-                break;
-            case 'K': // EL – Erase In Line
-                if (parameters[0] == 0)
-                {
-                    // Erase from cursor to end of line
-                    lcd_erase_line(row, column, max_col);
-                }
-                else if (parameters[0] == 1)
-                {
-                    // Erase from start of line to cursor
-                    lcd_erase_line(row, 0, column);
-                }
-                else if (parameters[0] == 2) // clear entire line
-                {
-                    lcd_erase_line(row, 0, max_col);
-                }
-                break;
-            case 'S': // SU - Scroll Up
-                if (parameters[0] == 0)
-                {
-                    parameters[0] = 1; // default to 1 if not specified
-                }
-                while (parameters[0]-- > 0)
-                {
-                    lcd_scroll_up();
-                }
-                break;
-            case 'T': // SD - Scroll Down
-                if (parameters[0] == 0)
-                {
-                    parameters[0] = 1; // default to 1 if not specified
-                }
-                while (parameters[0]-- > 0)
-                {
-                    lcd_scroll_down();
-                }
-                break;
-            case 'c': // DA - Device Attributes
-                report("\033[?1;c");
-                break;
-            case 'd': // VPA - Vertical Position Absolute
-                if (parameters[0] == 0)
-                {
-                    parameters[0] = 1; // default to 1 if not specified
-                }
-                row = MIN(parameters[0] - 1, max_row);
-                break;
-            case 'e': // VPR - Vertical Position Relative
-                if (parameters[0] == 0)
-                {
-                    parameters[0] = 1; // default to 1 if not specified
-                }
-                row = MIN(row + parameters[0], max_row);
-                break;
-            case 'g': // TBC – Tabulation Clear
-                if (parameters[0] == 3)
-                {
-                    // Clear all tab stops
-                    memset(tab_stops, 0, sizeof(tab_stops));
-                }
-                else if (parameters[0] == 0)
-                {
-                    // Clear tab stop at current column
-                    if (column < sizeof(tab_stops))
-                    {
-                        tab_stops[column] = false;
-                    }
-                }
-                break;
-            case 'l': // RM – Reset Mode
-            case 'h': // SM – Set Mode
-                break;
-            case 'm': // SGR – Select Graphic Rendition
-                for (uint8_t i = 0; i <= p_index; i++)
-                {
-                    if (parameters[i] == 0) // attributes off
-                    {
-                        lcd_set_foreground(FOREGROUND);
-                        lcd_set_background(BACKGROUND);
-                        lcd_set_underscore(false);
-                        lcd_set_reverse(false);
-                        lcd_set_bold(false);
-                    }
-                    else if (parameters[i] == 1) // bold
-                    {
-                        lcd_set_bold(true);
-                    }
-                    else if (parameters[i] == 2) // dim
-                    {
-                        lcd_set_foreground(DIM);
-                    }
-                    // No support for italic (3)
-                    else if (parameters[i] == 4) // underline
-                    {
-                        lcd_set_underscore(true);
-                    }
-                    // No support for blink (5, 6)
-                    else if (parameters[i] == 7) // negative (reverse) image
-                    {
-                        lcd_set_reverse(true);
-                    }
-                    else if (parameters[i] == 22) // normal intensity/weight
-                    {
-                        lcd_set_foreground(FOREGROUND);
-                        lcd_set_bold(false);
-                    }
-                    else if (parameters[i] == 24) // not underlined
-                    {
-                        lcd_set_underscore(false);
-                    }
-                    else if (parameters[i] == 27) // positive image
-                    {
-                        lcd_set_reverse(false);
-                    }
-                    else if (parameters[i] >= 30 && parameters[i] <= 37) // foreground colour
-                    {
-                        lcd_set_foreground(palette[parameters[i] - 30]);
-                    }
-                    else if (parameters[i] == 38 && i + 4 <= p_index && parameters[i + 1] == 2) // foreground truecolor
-                    {
-                        uint8_t r = parameters[i + 2];
-                        uint8_t g = parameters[i + 3];
-                        uint8_t b = parameters[i + 4];
-                        uint16_t colour = RGB(r, g, b);
-                        lcd_set_foreground(colour);
-                        i += 4; // Skip the next four parameters (2, r, g, b)
-                    }
-                    else if (parameters[i] == 38 && i + 2 <= p_index && parameters[i + 1] == 5) // foreground 256-colour
-                    {
-                        uint8_t colour = parameters[i + 2];
-                        lcd_set_foreground(xterm_palette[colour]);
-                        i += 2; // Skip the next two parameters (5 and colour)
-                    }
-                    else if (parameters[i] == 39) // default foreground colour
-                    {
-                        lcd_set_foreground(FOREGROUND);
-                    }
-                    else if (parameters[i] >= 40 && parameters[i] <= 47) // background colour
-                    {
-                        lcd_set_background(palette[parameters[i] - 40]);
-                    }
-                    else if (parameters[i] == 48 && i + 4 <= p_index && parameters[i + 1] == 2) // background truecolor
-                    {
-                        uint8_t r = parameters[i + 2];
-                        uint8_t g = parameters[i + 3];
-                        uint8_t b = parameters[i + 4];
-                        uint16_t colour = RGB(r, g, b);
-                        lcd_set_background(colour);
-                        i += 4; // Skip the next four parameters (2, r, g, b)
-                    }
-                    else if (parameters[i] == 48 && i + 2 <= p_index && parameters[i + 1] == 5) // background 256-colour
-                    {
-                        uint8_t colour = parameters[i + 2];
-                        lcd_set_background(xterm_palette[colour]);
-                        i += 2; // Skip the next two parameters (5 and colour)
-                    }
-                    else if (parameters[i] == 49) // default background colour
-                    {
-                        lcd_set_background(BACKGROUND);
-                    }
-                    else if (parameters[i] >= 90 && parameters[i] <= 97) // bright foreground colour
-                    {
-                        uint8_t index = parameters[i] - 90;
-                        if (index < 8) // ensure index is within bounds
-                        {
-                            lcd_set_foreground(bright_palette[index]);
-                        }
-                    }
-                    else if (parameters[i] >= 100 && parameters[i] <= 107) // bright background colour
-                    {
-                        uint8_t index = parameters[i] - 100;
-                        if (index < 8) // ensure index is within bounds
-                        {
-                            lcd_set_background(bright_palette[index]);
-                        }
-                    }
-                }
-                break;
-            case 'n':                   // Device Status Report
-                if (parameters[0] == 5) // DSR - Device Status Report
-                {
-                    report("\033[0n");
-                }
-                else if (parameters[0] == 6) // DSR - Device Status Report
-                {
-                    char buf[16];
-                    snprintf(buf, sizeof(buf), "\033[%d;%dR", row + 1, column + 1);
-                    report(buf);
-                }
-                break;
-            case CHR_CAN:                      // cancel the current escape sequence
-            case CHR_SUB:                      // same as CAN
-                lcd_putc(column++, row, 0x02); // print a error character
-                break;
-            case 'q': // DECLL – Load LEDS (DEC Private)
-                for (uint8_t i = 0; i <= p_index; i++)
-                {
-                    if (parameters[i] == 0) // turn off all LEDs
-                    {
-                        leds = 0; // reset LED state
-                    }
-                    else if (parameters[i] > 0 && parameters[i] <= 8)
-                    {
-                        leds |= (1 << (parameters[i] - 1));
-                    }
-                }
-                update_leds(leds); // update the LEDs
-                break;
-            case 'r': // DECSTBM – Set Top and Bottom Margins
-                if (parameters[0] == 0)
-                {
-                    parameters[0] = 1; // default to 1 if not specified
-                }
-                if (parameters[1] == 0)
-                {
-                    parameters[1] = 1; // default to 1 if not specified
-                }
-                uint8_t top_row = MIN(parameters[0] - 1, max_row);
-                uint8_t bottom_row = MIN(parameters[1] - 1, max_row);
-                if (bottom_row > top_row)
-                {
-                    lcd_define_scrolling(top_row, max_row - bottom_row);
-                }
-                else
-                {
-                    lcd_scroll_reset();
-                }
-                row = top_row;
-                column = 0;
-                break;
-            case 's': // DECSC – Save Cursor (ANSI)
-                save_column = column;
-                save_row = row;
-                break;
-            case 't': // - Lines per page
-                // Not supported, ignore
-                break;
-            case 'u': // DECRC – Restore Cursor (ANSI)
-                column = save_column;
-                row = save_row;
-                break;
-            default:
-                lcd_putc(column++, row, 0x02); // print a error character
-                break;                         // ignore unknown sequences
-            }
-        }
-        break;
+    uint8_t count = shadow_columns;
+    while (count > 0 && line->cells[count - 1].glyph == ' ' && line->cells[count - 1].attrs == 0 &&
+           line->cells[count - 1].background == BACKGROUND)
+    {
+        count--;
+    }
 
-    case STATE_TMC:
-        switch (ch)
+    for (uint8_t c = 0; c < count;)
+    {
+        const lcd_cell_t *first = &line->cells[c];
+        uint8_t run = 1;
+        while (c + run < count && history_same_run(first, &line->cells[c + run]))
         {
-        case 'p': // Soft reset
-            reset_terminal();
-
-            break;
+            run++;
         }
-        state = STATE_NORMAL;
-        break;
 
-    case STATE_DEC: // in DEC private mode sequence
-        debug[debug_index++] = ch;
-        if (ch == CHR_ESC)
+        record[size++] = run;
+        record[size++] = first->attrs;
+        record[size++] = LOWER8(first->foreground);
+        record[size++] = UPPER8(first->foreground);
+        record[size++] = LOWER8(first->background);
+        record[size++] = UPPER8(first->background);
+        for (uint8_t i = 0; i < run; i++)
         {
-            state = STATE_ESCAPE;
-            break; // reset to escape state
+            record[size++] = line->cells[c++].glyph;
         }
-        else if (ch >= '0' && ch <= '9')
-        {
-            parameters[p_index] *= 10; // accumulate digits
-            parameters[p_index] += ch - '0';
-        }
-        else if (ch == ';') // delimiter
+    }
+
+    for (uint16_t i = 0; i < size; i++)
+    {
+        history[(history_head + i) & (DISPLAY_HISTORY_BYTES - 1)] = record[i];
+    }
+    history_pos[history_count % DISPLAY_HISTORY_LINES] = history_head;
+    history_head += size;
+
+    // The line was on row history_unscrolled of the LCD when it last scrolled, so the next
+    // LCD scroll moves it into the frame memory above the screen
+    if (history_unscrolled < ROWS)
+    {
+        uint8_t slot = (lcd_get_scroll_offset() / GLYPH_HEIGHT + history_unscrolled) % FRAME_LINES;
+        frame_lines[slot] = line->dirty_start <= line->dirty_end ? NO_LINE : history_count;
+        history_unscrolled++;
+    }
+    history_count++;
+
+    // Drop the oldest lines that no longer fit
+    while (history_oldest < history_count &&
+           (history_count - history_oldest > DISPLAY_HISTORY_LINES ||
+            history_head - history_pos[history_oldest % DISPLAY_HISTORY_LINES] > DISPLAY_HISTORY_BYTES))
+    {
+        history_oldest++;
+    }
+}
+
+// Expand a line from the history into a row of cells, padded with blanks
+static void history_get(uint32_t n, lcd_cell_t *cells, uint8_t count)
+{
+    uint32_t pos = history_pos[n % DISPLAY_HISTORY_LINES];
+    uint32_t end = n + 1 < history_count ? history_pos[(n + 1) % DISPLAY_HISTORY_LINES] : history_head;
+    uint8_t c = 0;
+
+    while (pos != end)
+    {
+        uint8_t header[RUN_HEADER];
+        for (uint8_t i = 0; i < RUN_HEADER; i++)
         {
-            if (p_index < sizeof(parameters) - 1)
-            {
-                p_index++;
-            }
+            header[i] = history[pos++ & (DISPLAY_HISTORY_BYTES - 1)];
         }
-        else // final character in DEC private mode sequence
+
+        lcd_cell_t cell = {
+            .attrs = header[1],
+            .foreground = header[2] | header[3] << 8,
+            .background = header[4] | header[5] << 8,
+        };
+        for (uint8_t i = 0; i < header[0]; i++)
         {
-            state = STATE_NORMAL; // reset state after processing
-            switch (ch)
+            cell.glyph = history[pos++ & (DISPLAY_HISTORY_BYTES - 1)];
+            if (c < count)
             {
-            case 'h':                    // DECSET - DEC Private Mode Set
-                if (parameters[0] == 25) // DECTCEM - Text Cursor Enable Mode
-                {
-                    lcd_enable_cursor(true);
-                    lcd_draw_cursor();
-                }
-                else if (parameters[0] == 4264)
-                {
-                    // set 64 column mode
-                    lcd_set_font(&font_5x10);
-                }
-                break;
-            case 'l':                    // DECRST - DEC Private Mode Reset
-                if (parameters[0] == 25) // DECTCEM - Text Cursor Enable Mode
-                {
-                    lcd_enable_cursor(false);
-                    lcd_erase_cursor(); // immediately hide cursor
-                }
-                else if (parameters[0] == 4264)
-                {
-                    // set 64 column mode
-                    lcd_set_font(&font_8x10);
-                }
-                break;
-            case 'm':
-                // Ignore for now
-                break;
-            default:
-                lcd_putc(column++, row, 0x01); // print a error character
-                break;                         // ignore unknown DEC private mode sequences
+                cells[c++] = cell; // lines from a narrower font are cut short
             }
         }
-        break;
+    }
 
-    case STATE_G0_SET:        // Setting G0 character set
-        state = STATE_NORMAL; // return to normal state after processing
-        switch (ch)
-        {
-        case 'A': // UK character set
-            set_g0_charset(CHARSET_UK);
-            break;
-        case 'B': // ASCII character set
-            set_g0_charset(CHARSET_ASCII);
-            break;
-        case '0': // DEC Special Character Set
-            set_g0_charset(CHARSET_DEC);
-            break;
-        default:
-            // Unknown character set, ignore
-            break;
-        }
-        break;
+    lcd_cell_t blank = {.glyph = ' ', .attrs = 0, .foreground = FOREGROUND, .background = BACKGROUND};
+    while (c < count)
+    {
+        cells[c++] = blank;
+    }
+}
+#endif
 
-    case STATE_G1_SET:        // Setting G1 character set
-        state = STATE_NORMAL; // return to normal state after processing
-        switch (ch)
-        {
-        case 'A': // UK character set
-            set_g1_charset(CHARSET_UK);
-            break;
-        case 'B': // ASCII character set
-            set_g1_charset(CHARSET_ASCII);
-            break;
-        case '0': // DEC Special Character Set
-            set_g1_charset(CHARSET_DEC);
-            break;
-        default:
-            // Unknown character set, ignore
-            break;
-        }
-        break;
+// Blank the whole buffer, it matches a cleared screen
+static void shadow_reset()
+{
+    for (uint8_t r = 0; r < ROWS; r++)
+    {
+        shadow_map[r] = r;
+        shadow_blank(&shadow_lines[r], 0, DISPLAY_MAX_COLUMNS - 1);
+        shadow_clean(&shadow_lines[r]);
+    }
+    shadow_columns = lcd_get_columns();
+    shadow_dirty = false;
+    shadow_scroll_pending = 0;
+    shadow_scroll_mixed = false;
+#if DISPLAY_SCROLLBACK
+    frame_forget();
+#endif
+}
 
-    case STATE_OSC: // in Operating System Command
-        if (ch == CHR_ESC)
-        {
-            state = STATE_OSC_ESC;
-        }
-        else if (ch == '\007' || ch == 0x9C)
+static int64_t on_flush_alarm(alarm_id_t id, void *user_data);
+
+static void shadow_schedule_flush()
+{
+    if (flush_alarm == 0 && !DISPLAY_CORE1)
+    {
+        // On core 1 the pipeline loop flushes the buffer when it runs out of work
+        flush_alarm = add_alarm_in_ms(DISPLAY_FLUSH_MS, on_flush_alarm, NULL, true);
+    }
+}
+
+// Mark every line as dirty so that the next flush redraws the whole screen
+static void shadow_touch_all()
+{
+    for (uint8_t r = 0; r < ROWS; r++)
+    {
+        shadow_lines[r].dirty_start = 0;
+        shadow_lines[r].dirty_end = shadow_columns - 1;
+    }
+    shadow_dirty = true;
+}
+
+// Scroll the LCD by the lines already scrolled in the buffer, returns true if it scrolled
+static bool shadow_sync_scroll()
+{
+    if (shadow_scroll_pending == 0)
+    {
+        return false;
+    }
+
+    lcd_erase_cursor(); // the cursor was drawn before the scroll, so remove it first
+    lcd_scroll_lines(shadow_scroll_pending);
+#if DISPLAY_SCROLLBACK
+    if (shadow_scroll_pending < 0)
+    {
+        frame_forget(); // the bottom lines moved into the frame memory above the screen
+    }
+    history_unscrolled = 0;
+#endif
+
+    if (shadow_scroll_mixed || shadow_scroll_colour != lcd_get_background())
+    {
+        // The LCD cleared the new lines in the wrong colour, redraw them from the buffer
+        uint8_t lines = abs(shadow_scroll_pending);
+        uint8_t first = shadow_scroll_pending > 0 ? margin_bottom + 1 - lines : margin_top;
+        for (uint8_t r = first; r < first + lines; r++)
         {
-            state = STATE_NORMAL; // reset state after processing the OSC sequence
+            shadow_line_t *line = &shadow_lines[shadow_map[r]];
+            line->dirty_start = 0;
+            line->dirty_end = shadow_columns - 1;
         }
-        break;
+        shadow_dirty = true;
+        shadow_schedule_flush();
+    }
 
-    case STATE_OSC_ESC: // in OSC escape sequence
-        state = ch == '\\' ? STATE_NORMAL : STATE_OSC;
-        break;
+    shadow_scroll_pending = 0;
+    shadow_scroll_mixed = false;
+    lcd_move_cursor(column, row);
+    return true;
+}
 
-    case STATE_NORMAL:
-    default:
-        // Normal/default state, process characters directly
-        switch (ch)
-        {
-        case CHR_BS:
-            column = MAX(0, column - 1); // move cursor back one space (but not before the start of the line)
-            break;
-        case CHR_BEL:
-            ring_bell(); // ring the bell
-            break;
-        case CHR_HT:
-            column = MIN(((column + 8) & ~7), lcd_get_columns() - 1); // move cursor to next tabstop (but not beyond the end of the line)
-            break;
-        case CHR_LF:
-        case CHR_VT:
-        case CHR_FF:
-            row++; // move cursor down one line
-            break;
-        case CHR_CR:
-            column = 0; // move cursor to the start of the line
-            break;
-        case CHR_SO: // Shift Out - select G1 character set
-            set_charset(G1_CHARSET);
-            break;
-        case CHR_SI: // Shift In - select G0 character set
-            set_charset(G0_CHARSET);
-            break;
-        case CHR_ESC:
-            state = STATE_ESCAPE;
-            break;
-        default:
-            if (ch >= 0x20 && ch < 0x7F) // printable characters
-            {
-                // Translate character based on active character set
-                if (get_charset() == CHARSET_UK && ch == '#')
-                {
-                    // Replace '#' with the pound sign in UK character set
-                    ch = 0x1E;
-                }
-                else if (get_charset() == CHARSET_DEC && ch >= 0x5F && ch <= 0x7E)
-                {
-                    // Maps characters 0x5F - 0x7E to DEC Special Character Set
-                    ch -= 0x5F;
-                }
-
-                lcd_putc(column++, row, ch);
-            }
-            break;
-        }
-        break;
+// Draw the dirty span of every line, returns true if anything was drawn
+static bool shadow_flush()
+{
+    bool scrolled = shadow_sync_scroll();
+    if (!shadow_dirty)
+    {
+        return scrolled;
     }
 
-    // Handle wrapping and scrolling
-    if (column > max_col) // wrap around at end of the line
+    if (shadow_columns != lcd_get_columns())
     {
-        column = 0;
-        row++;
+        // The font changed, the buffer no longer matches the display
+        shadow_reset();
+        return scrolled;
     }
 
-    if (row > max_row) // scroll at bottom of the screen
+    for (uint8_t r = 0; r < ROWS; r++)
     {
-        while (row > max_row) // scroll until y is within bounds
+        shadow_line_t *line = &shadow_lines[shadow_map[r]];
+        if (line->dirty_start <= line->dirty_end)
         {
-            lcd_scroll_up(); // scroll up to make space at the bottom
-            row--;
+            lcd_putcells(line->dirty_start, r, &line->cells[line->dirty_start],
+                         line->dirty_end - line->dirty_start + 1);
+            shadow_clean(line);
         }
     }
+    shadow_dirty = false;
+    return true;
+}
 
-    // Update cursor position
-    lcd_move_cursor(column, row);
-    lcd_draw_cursor(); // draw the cursor at the new position
+#if DISPLAY_SCROLLBACK
+static void scrollback_update(void);
+#endif
+
+static int64_t on_flush_alarm(alarm_id_t id, void *user_data)
+{
+    if (shadow_busy)
+    {
+        return DISPLAY_FLUSH_MS * 1000; // the buffer is being updated, try again later
+    }
+
+    flush_alarm = 0;
+    if (shadow_flush())
+    {
+        lcd_draw_cursor(); // the flush may have drawn over the cursor
+    }
+#if DISPLAY_SCROLLBACK
+    scrollback_update();
+#endif
+    return 0;
+}
+
+static void shadow_putc(uint8_t col, uint8_t r, uint8_t ch)
+{
+    if (shadow_columns != lcd_get_columns())
+    {
+        // The font changed, the buffer no longer matches the display
+        shadow_reset();
+    }
+
+    shadow_line_t *line = &shadow_lines[shadow_map[r]];
+    line->cells[col] = lcd_make_cell(ch);
+    line->dirty_start = MIN(line->dirty_start, col);
+    line->dirty_end = MAX(line->dirty_end, col);
+    shadow_dirty = true;
+    shadow_schedule_flush();
+}
+
+static void shadow_erase(uint8_t r, uint8_t col_start, uint8_t col_end)
+{
+    shadow_line_t *line = &shadow_lines[shadow_map[r]];
+    shadow_blank(line, col_start, col_end);
+    if (col_start <= line->dirty_start && col_end >= line->dirty_end)
+    {
+        shadow_clean(line); // the whole dirty span was erased
+    }
+}
+
+// Rotate the lines between top and bottom (inclusive) up one, blanking the bottom line
+static void shadow_scroll_up(uint8_t top, uint8_t bottom)
+{
+    uint8_t first = shadow_map[top];
+#if DISPLAY_SCROLLBACK
+    if (top == 0 && bottom == MAX_ROW)
+    {
+        history_push(&shadow_lines[first]);
+    }
+#endif
+    memmove(&shadow_map[top], &shadow_map[top + 1], bottom - top);
+    shadow_map[bottom] = first;
+    shadow_blank(&shadow_lines[first], 0, DISPLAY_MAX_COLUMNS - 1);
+    shadow_clean(&shadow_lines[first]);
+}
+
+// Rotate the lines between top and bottom (inclusive) down one, blanking the top line
+static void shadow_scroll_down(uint8_t top, uint8_t bottom)
+{
+    uint8_t last = shadow_map[bottom];
+    memmove(&shadow_map[top + 1], &shadow_map[top], bottom - top);
+    shadow_map[top] = last;
+    shadow_blank(&shadow_lines[last], 0, DISPLAY_MAX_COLUMNS - 1);
+    shadow_clean(&shadow_lines[last]);
 }
+#endif
 
 //
-//  Display Callback Setters
+//  Drawing
+//
+//  The terminal emulator draws through these functions, which use the shadow text buffer
+//  if it is enabled or the LCD directly if not.
 //
 
-void display_set_led_callback(led_callback_t callback)
+static bool text_flow = false; // the cursor was moved by printing or a line feed
+
+// Draw a glyph at the cursor and advance the cursor
+static void put_glyph(uint8_t ch)
 {
-    display_led_callback = callback;
+    text_flow = true;
+#if DISPLAY_SHADOW_BUFFER
+    shadow_putc(column++, row, ch);
+#else
+    lcd_putc(column++, row, ch);
+#endif
 }
 
-void display_set_bell_callback(bell_callback_t callback)
+// Make sure everything written so far is on the display
+static void flush()
 {
-    display_bell_callback = callback;
+#if DISPLAY_SHADOW_BUFFER
+    shadow_flush();
+#endif
 }
 
-void display_set_report_callback(report_callback_t callback)
+// Make sure the LCD has been scrolled before drawing on it directly
+static void sync_scroll()
 {
-    display_report_callback = callback;
+#if DISPLAY_SHADOW_BUFFER
+    shadow_sync_scroll();
+#endif
+}
+
+// Move the LCD cursor to the terminal cursor and draw it
+static void update_cursor()
+{
+#if DISPLAY_SHADOW_BUFFER
+    if (shadow_scroll_pending)
+    {
+        return; // the flush draws the cursor once the LCD has scrolled
+    }
+#endif
+    lcd_move_cursor(column, row);
+    lcd_draw_cursor();
+}
+
+static void erase_line(uint8_t r, uint8_t col_start, uint8_t col_end)
+{
+    sync_scroll();
+#if DISPLAY_SHADOW_BUFFER
+    shadow_erase(r, col_start, col_end);
+#endif
+    lcd_erase_line(r, col_start, col_end);
+}
+
+// Erase in display: 0 = cursor to end of screen, 1 = start of screen to cursor
+static void erase_display(uint8_t mode, uint8_t max_row, uint8_t max_col)
+{
+    sync_scroll();
+
+    // Erase the partial line and the whole lines as one batch of fills
+    uint16_t width = lcd_get_glyph_width();
+    uint16_t colour = lcd_get_background();
+    if (mode == 0)
+    {
+        lcd_rect_t rects[2] = {
+            {colour, column * width, row * GLYPH_HEIGHT, (max_col - column + 1) * width, GLYPH_HEIGHT},
+            {colour, 0, (row + 1) * GLYPH_HEIGHT, (max_col + 1) * width, (max_row - row) * GLYPH_HEIGHT},
+        };
+#if DISPLAY_SHADOW_BUFFER
+        shadow_erase(row, column, max_col);
+        for (uint8_t r = row + 1; r <= max_row; r++)
+        {
+            shadow_erase(r, 0, max_col);
+        }
+#endif
+        lcd_fill_rects(rects, 2);
+    }
+    else
+    {
+        lcd_rect_t rects[2] = {
+            {colour, 0, 0, (max_col + 1) * width, row * GLYPH_HEIGHT},
+            {colour, 0, row * GLYPH_HEIGHT, (column + 1) * width, GLYPH_HEIGHT},
+        };
+#if DISPLAY_SHADOW_BUFFER
+        for (uint8_t r = 0; r < row; r++)
+        {
+            shadow_erase(r, 0, max_col);
+        }
+        shadow_erase(row, 0, column);
+#endif
+        lcd_fill_rects(rects, 2);
+    }
+}
+
+static void clear_screen()
+{
+#if DISPLAY_SHADOW_BUFFER
+    shadow_reset();
+#endif
+    lcd_clear_screen();
+}
+
+// Scroll the scrolling region, positive lines scroll up and negative lines scroll down
+static void scroll(int16_t lines)
+{
+    int16_t region = margin_bottom - margin_top + 1;
+    lines = MAX(-region, MIN(lines, region)); // scrolling further just clears the region
+
+#if DISPLAY_SHADOW_BUFFER
+    if ((lines < 0 && shadow_scroll_pending > 0) || (lines > 0 && shadow_scroll_pending < 0))
+    {
+        shadow_sync_scroll(); // lines blanked by the pending scroll would come back
+    }
+    for (int16_t i = 0; i < lines; i++)
+    {
+        shadow_scroll_up(margin_top, margin_bottom);
+    }
+    for (int16_t i = 0; i > lines; i--)
+    {
+        shadow_scroll_down(margin_top, margin_bottom);
+    }
+    if (shadow_scroll_pending == 0)
+    {
+        shadow_scroll_colour = lcd_get_background();
+    }
+    else if (shadow_scroll_colour != lcd_get_background())
+    {
+        shadow_scroll_mixed = true;
+    }
+    shadow_scroll_pending = MAX(-region, MIN(shadow_scroll_pending + lines, region));
+    shadow_schedule_flush();
+#else
+    lcd_scroll_lines(lines);
+#endif
+}
+
+// Move the cursor down a line, scrolling at the bottom of the scrolling region
+static void line_feed()
+{
+    text_flow = true;
+    if (row == margin_bottom)
+    {
+        scroll(1);
+    }
+    else if (row < MAX_ROW)
+    {
+        row++;
+    }
+}
+
+// Set the scrolling region, rows are 0-based and inclusive
+static void set_margins(uint8_t top, uint8_t bottom)
+{
+    margin_top = top;
+    margin_bottom = bottom;
+
+#if DISPLAY_SHADOW_BUFFER
+    shadow_scroll_pending = 0; // the whole screen is redrawn below
+#endif
+#if DISPLAY_SCROLLBACK
+    frame_forget(); // the LCD scroll is reset
+#endif
+    lcd_define_scrolling(top * GLYPH_HEIGHT, (MAX_ROW - bottom) * GLYPH_HEIGHT);
+#if DISPLAY_SHADOW_BUFFER
+    // Moving the scrolling area moves the text on the LCD, redraw it from the buffer
+    shadow_touch_all();
+    shadow_schedule_flush();
+#endif
+}
+
+static void reset_terminal()
+{
+    // Reset terminal state
+    lcd_set_reverse(false);
+    lcd_set_foreground(FOREGROUND);
+    lcd_set_background(BACKGROUND);
+    lcd_set_underscore(false);
+    lcd_enable_cursor(true);
+    set_g0_charset(CHARSET_ASCII); // reset character set to ASCII
+    set_g1_charset(CHARSET_ASCII);
+    set_margins(0, MAX_ROW); // no scrolling region defined
+    clear_screen();
+    leds = 0;          // reset LED state
+    update_leds(leds); // reset LEDs
 }
 
 //
-//  Display Initialization
+//  Scrollback
+//
+//  display_scrollback() moves a view back through the text history. The view moves the LCD
+//  scroll start address, so the lines still in the frame memory above the screen appear
+//  without drawing anything, and only the lines that are not there are drawn, from the
+//  history. Returning to the live screen redraws the rows the view drew over from the
+//  shadow buffer. Any output returns to the live screen first.
+//
+//  Requests come from the keyboard, so they are counted in scrollback_requested and run
+//  when the terminal emulator is not in the middle of an update. Like the ring indices of
+//  the display pipeline, each count is only written by one side.
 //
 
-void display_init()
+#if DISPLAY_SHADOW_BUFFER && DISPLAY_SCROLLBACK
+static volatile uint16_t scrollback_requested = 0; // lines requested, by display_scrollback()
+static uint16_t scrollback_done = 0;    // lines of those requests already moved
+static uint16_t view_lines = 0;         // lines the view is back from the live screen, 0 = live
+static uint16_t view_live_offset;       // LCD scroll offset of the live screen
+static bool view_cursor;                // the cursor was enabled on the live screen
+
+// Frame memory line shown on a row of the view
+static uint8_t view_slot(uint16_t lines, uint8_t r)
 {
-    // Make sure the LCD is initialized
-    lcd_init();
+    int32_t slot = view_live_offset / GLYPH_HEIGHT + r - lines;
+    return ((slot % FRAME_LINES) + FRAME_LINES) % FRAME_LINES;
+}
 
-    // Set tab stops every 8 columns by default
-    for (int i = 3; i < 64; i += 8)
+// Show the screen as it was the given number of lines ago
+static void view_show(uint16_t lines)
+{
+    lcd_set_scroll_offset((view_live_offset + FRAME_HEIGHT - (lines % FRAME_LINES) * GLYPH_HEIGHT) %
+                          FRAME_HEIGHT);
+
+    for (uint8_t r = 0; r < ROWS; r++)
     {
-        tab_stops[i] = true;
+        uint32_t n = history_count - lines + r; // line numbers past the history are screen rows
+        uint8_t slot = view_slot(lines, r);
+        if (frame_lines[slot] == n)
+        {
+            continue; // already in the frame memory
+        }
+
+        lcd_cell_t cells[DISPLAY_MAX_COLUMNS];
+        if (n < history_count)
+        {
+            history_get(n, cells, shadow_columns);
+        }
+        else
+        {
+            memcpy(cells, shadow_lines[shadow_map[n - history_count]].cells, sizeof(cells));
+        }
+        lcd_putcells(0, r, cells, shadow_columns);
+        frame_lines[slot] = n;
+    }
+    view_lines = lines;
+}
+
+// Leave the live screen, the view starts where it is
+static bool view_begin()
+{
+    if (margin_top != 0 || margin_bottom != MAX_ROW || shadow_columns != lcd_get_columns())
+    {
+        return false; // the frame memory is only used for history with the whole screen scrolling
+    }
+
+    shadow_flush();
+    lcd_erase_cursor();
+    view_cursor = lcd_cursor_enabled();
+    lcd_enable_cursor(false);
+
+    view_live_offset = lcd_get_scroll_offset();
+    for (uint8_t r = 0; r < ROWS; r++)
+    {
+        frame_lines[view_slot(0, r)] = history_count + r;
+    }
+    return true;
+}
+
+// Go back to the live screen
+static void view_end()
+{
+    lcd_set_scroll_offset(view_live_offset);
+    for (uint8_t r = 0; r < ROWS; r++)
+    {
+        if (frame_lines[view_slot(0, r)] != history_count + r)
+        {
+            shadow_line_t *line = &shadow_lines[shadow_map[r]];
+            line->dirty_start = 0;
+            line->dirty_end = shadow_columns - 1;
+            shadow_dirty = true;
+        }
+    }
+    view_lines = 0;
+    shadow_flush();
+
+    lcd_enable_cursor(view_cursor);
+    lcd_move_cursor(column, row);
+    lcd_draw_cursor();
+}
+
+// Run the scrollback requests made since the last call, the shadow buffer must be idle
+static void scrollback_update()
+{
+    int16_t lines = (int16_t)(scrollback_requested - scrollback_done);
+    scrollback_done += lines;
+
+    int32_t target = MAX(0, MIN((int32_t)view_lines + lines, (int32_t)(history_count - history_oldest)));
+    if (target == view_lines || (view_lines == 0 && !view_begin()))
+    {
+        return;
+    }
+
+    if (target == 0)
+    {
+        view_end();
+    }
+    else
+    {
+        view_show(target);
+    }
+}
+#endif
+
+//
+// Display API
+//
+
+bool display_emit_available()
+{
+    return true; // always available for output in this implementation
+}
+
+// Translate a printable character based on the active character set
+static uint8_t translate_glyph(uint8_t ch)
+{
+    if (get_charset() == CHARSET_UK && ch == '#')
+    {
+        // Replace '#' with the pound sign in UK character set
+        ch = 0x1E;
+    }
+    else if (get_charset() == CHARSET_DEC && ch >= 0x5F && ch <= 0x7E)
+    {
+        // Maps characters 0x5F - 0x7E to DEC Special Character Set
+        ch -= 0x5F;
+    }
+    return ch;
+}
+
+static bool is_printable(char ch)
+{
+    return ch >= 0x20 && ch < 0x7F;
+}
+
+// Wrap after the cursor has moved, flushing the shadow buffer if needed
+static void update_position(uint8_t start_column, uint8_t start_row)
+{
+    int max_col = lcd_get_columns() - 1;
+
+    // Handle wrapping and scrolling
+    if (column > max_col) // wrap around at end of the line
+    {
+        column = 0;
+        line_feed();
+    }
+
+    // Flush when the cursor is moved other than by printing and line feeds
+    if ((row != start_row || column != start_column) && !text_flow)
+    {
+        flush();
+    }
+}
+
+// Draw a run of printable characters that fits on the current row
+static void put_run(const char *str, uint8_t len)
+{
+    text_flow = true;
+#if DISPLAY_SHADOW_BUFFER
+    for (uint8_t i = 0; i < len; i++)
+    {
+        shadow_putc(column++, row, translate_glyph(str[i]));
+    }
+#else
+    // Cells rather than a string as the DEC character set maps '_' to glyph 0
+    lcd_cell_t cells[DISPLAY_MAX_COLUMNS];
+    for (uint8_t i = 0; i < len; i++)
+    {
+        cells[i] = lcd_make_cell(translate_glyph(str[i]));
+    }
+    lcd_putcells(column, row, cells, len);
+    column += len;
+#endif
+}
+
+//
+//  Escape sequence parser
+//
+//  Each byte is mapped to a character class and the class and the current state index a
+//  table of transitions, as in the DEC VT500 parser described by Paul Williams. A
+//  transition is the next state and the action to take on the way. Control characters are
+//  executed inside escape and control sequences, CAN and SUB cancel them, and ESC starts a
+//  new one from any state.
+//
+//  Reference: https://vt100.net/emu/dec_ansi_parser
+//
+
+// Character classes
+enum
+{
+    CLASS_CONTROL,      // C0 controls not listed below
+    CLASS_BEL,          // BEL, also ends a string
+    CLASS_CANCEL,       // CAN and SUB
+    CLASS_ESC,          // ESC
+    CLASS_INTERMEDIATE, // 0x20 - 0x2F
+    CLASS_DIGIT,        // 0 - 9
+    CLASS_SEPARATOR,    // ; and :
+    CLASS_PRIVATE,      // < = > ?
+    CLASS_CSI,          // [
+    CLASS_STRING,       // ] P X ^ _ start a string after ESC
+    CLASS_FINAL,        // the rest of 0x40 - 0x7E
+    CLASS_DEL,          // DEL
+    CLASS_HIGH,         // 0x80 - 0xFF
+    CLASS_ST,           // ST (0x9C), ends a string
+    CLASS_COUNT
+};
+
+// Actions taken on a transition
+enum
+{
+    ACTION_NONE,
+    ACTION_PRINT,        // draw the character
+    ACTION_EXECUTE,      // execute the control character
+    ACTION_CANCEL,       // abandon the sequence and draw the error character
+    ACTION_CLEAR,        // start a new escape sequence
+    ACTION_COLLECT,      // remember an intermediate or private marker
+    ACTION_PARAM,        // add a digit or a separator to the parameters
+    ACTION_ESC_DISPATCH, // run the escape sequence
+    ACTION_CSI_DISPATCH, // run the control sequence
+};
+
+static const uint8_t char_class[256] = {
+    [0x00 ... 0x1F] = CLASS_CONTROL,
+    [CHR_BEL] = CLASS_BEL,
+    [CHR_CAN] = CLASS_CANCEL,
+    [CHR_SUB] = CLASS_CANCEL,
+    [CHR_ESC] = CLASS_ESC,
+    [0x20 ... 0x2F] = CLASS_INTERMEDIATE,
+    ['0' ... '9'] = CLASS_DIGIT,
+    [':'] = CLASS_SEPARATOR,
+    [';'] = CLASS_SEPARATOR,
+    ['<' ... '?'] = CLASS_PRIVATE,
+    [0x40 ... 0x7E] = CLASS_FINAL,
+    ['['] = CLASS_CSI,
+    [']'] = CLASS_STRING,
+    ['P'] = CLASS_STRING,
+    ['X'] = CLASS_STRING,
+    ['^'] = CLASS_STRING,
+    ['_'] = CLASS_STRING,
+    [0x7F] = CLASS_DEL,
+    [0x80 ... 0xFF] = CLASS_HIGH,
+    [0x9C] = CLASS_ST,
+};
+
+// A transition packs the action in the high nibble and the next state in the low nibble
+#define T(action, next) (uint8_t)((ACTION_##action << 4) | STATE_##next)
+
+// Transitions shared by the escape and control sequence states
+#define SEQUENCE_COMMON(self)                   \
+    [CLASS_CONTROL] = T(EXECUTE, self),         \
+    [CLASS_BEL] = T(EXECUTE, self),             \
+    [CLASS_CANCEL] = T(CANCEL, NORMAL),         \
+    [CLASS_ESC] = T(CLEAR, ESCAPE),             \
+    [CLASS_DEL] = T(NONE, self),                \
+    [CLASS_HIGH] = T(NONE, NORMAL),             \
+    [CLASS_ST] = T(NONE, NORMAL)
+
+static const uint8_t transitions[STATE_COUNT][CLASS_COUNT] = {
+    [STATE_NORMAL] = {
+        [CLASS_CONTROL] = T(EXECUTE, NORMAL),
+        [CLASS_BEL] = T(EXECUTE, NORMAL),
+        [CLASS_CANCEL] = T(NONE, NORMAL),
+        [CLASS_ESC] = T(CLEAR, ESCAPE),
+        [CLASS_INTERMEDIATE ... CLASS_FINAL] = T(PRINT, NORMAL),
+        [CLASS_DEL] = T(NONE, NORMAL),
+        [CLASS_HIGH] = T(NONE, NORMAL),
+        [CLASS_ST] = T(NONE, NORMAL),
+    },
+    [STATE_ESCAPE] = {
+        SEQUENCE_COMMON(ESCAPE),
+        [CLASS_INTERMEDIATE] = T(COLLECT, ESCAPE_INTERMEDIATE),
+        [CLASS_DIGIT ... CLASS_PRIVATE] = T(ESC_DISPATCH, NORMAL),
+        [CLASS_CSI] = T(NONE, CSI_ENTRY),
+        [CLASS_STRING] = T(NONE, STRING),
+        [CLASS_FINAL] = T(ESC_DISPATCH, NORMAL),
+    },
+    [STATE_ESCAPE_INTERMEDIATE] = {
+        SEQUENCE_COMMON(ESCAPE_INTERMEDIATE),
+        [CLASS_INTERMEDIATE] = T(COLLECT, ESCAPE_INTERMEDIATE),
+        [CLASS_DIGIT ... CLASS_FINAL] = T(ESC_DISPATCH, NORMAL),
+    },
+    [STATE_CSI_ENTRY] = {
+        SEQUENCE_COMMON(CSI_ENTRY),
+        [CLASS_INTERMEDIATE] = T(COLLECT, CSI_INTERMEDIATE),
+        [CLASS_DIGIT ... CLASS_SEPARATOR] = T(PARAM, CSI_PARAM),
+        [CLASS_PRIVATE] = T(COLLECT, CSI_PARAM),
+        [CLASS_CSI ... CLASS_FINAL] = T(CSI_DISPATCH, NORMAL),
+    },
+    [STATE_CSI_PARAM] = {
+        SEQUENCE_COMMON(CSI_PARAM),
+        [CLASS_INTERMEDIATE] = T(COLLECT, CSI_INTERMEDIATE),
+        [CLASS_DIGIT ... CLASS_SEPARATOR] = T(PARAM, CSI_PARAM),
+        [CLASS_PRIVATE] = T(NONE, CSI_IGNORE),
+        [CLASS_CSI ... CLASS_FINAL] = T(CSI_DISPATCH, NORMAL),
+    },
+    [STATE_CSI_INTERMEDIATE] = {
+        SEQUENCE_COMMON(CSI_INTERMEDIATE),
+        [CLASS_INTERMEDIATE] = T(COLLECT, CSI_INTERMEDIATE),
+        [CLASS_DIGIT ... CLASS_PRIVATE] = T(NONE, CSI_IGNORE),
+        [CLASS_CSI ... CLASS_FINAL] = T(CSI_DISPATCH, NORMAL),
+    },
+    [STATE_CSI_IGNORE] = {
+        SEQUENCE_COMMON(CSI_IGNORE),
+        [CLASS_INTERMEDIATE ... CLASS_PRIVATE] = T(NONE, CSI_IGNORE),
+        [CLASS_CSI ... CLASS_FINAL] = T(NONE, NORMAL),
+    },
+    [STATE_STRING] = {
+        [CLASS_CONTROL] = T(NONE, STRING),
+        [CLASS_BEL] = T(NONE, NORMAL),
+        [CLASS_CANCEL] = T(CANCEL, NORMAL),
+        [CLASS_ESC] = T(CLEAR, ESCAPE), // ESC \ (ST) ends the string
+        [CLASS_INTERMEDIATE ... CLASS_HIGH] = T(NONE, STRING),
+        [CLASS_ST] = T(NONE, NORMAL),
+    },
+};
+
+#undef SEQUENCE_COMMON
+#undef T
+
+// Execute a control character
+static void execute(uint8_t ch)
+{
+    switch (ch)
+    {
+    case CHR_BS:
+        column = MAX(0, column - 1); // move cursor back one space (but not before the start of the line)
+        break;
+    case CHR_BEL:
+        ring_bell(); // ring the bell
+        break;
+    case CHR_HT:
+        column = MIN(((column + 8) & ~7), lcd_get_columns() - 1); // move cursor to next tabstop (but not beyond the end of the line)
+        break;
+    case CHR_LF:
+    case CHR_VT:
+    case CHR_FF:
+        line_feed(); // move cursor down one line
+        break;
+    case CHR_CR:
+        column = 0; // move cursor to the start of the line
+        text_flow = true;
+        break;
+    case CHR_SO: // Shift Out - select G1 character set
+        set_charset(G1_CHARSET);
+        break;
+    case CHR_SI: // Shift In - select G0 character set
+        set_charset(G0_CHARSET);
+        break;
+    default:
+        break; // other control characters are ignored
+    }
+}
+
+// Character set selected by the final character of SCS
+static bool select_charset(uint8_t ch, uint8_t *charset)
+{
+    switch (ch)
+    {
+    case 'A': // UK character set
+        *charset = CHARSET_UK;
+        return true;
+    case 'B': // ASCII character set
+        *charset = CHARSET_ASCII;
+        return true;
+    case '0': // DEC Special Character Set
+        *charset = CHARSET_DEC;
+        return true;
+    default:
+        return false; // unknown character set, ignore
+    }
+}
+
+// Run an escape sequence, ch is its final character
+static void esc_dispatch(uint8_t ch)
+{
+    uint8_t charset;
+
+    if (intermediate == '(') // SCS - G0 character set selection
+    {
+        if (select_charset(ch, &charset))
+        {
+            set_g0_charset(charset);
+        }
+        return;
+    }
+    if (intermediate == ')') // SCS - G1 character set selection
+    {
+        if (select_charset(ch, &charset))
+        {
+            set_g1_charset(charset);
+        }
+        return;
+    }
+    if (intermediate != 0)
+    {
+        return; // not supported
+    }
+
+    switch (ch)
+    {
+    case '7': // DECSC – Save Cursor
+        save_column = column;
+        save_row = row;
+        break;
+    case '8': // DECRC – Restore Cursor
+        column = save_column;
+        row = save_row;
+        break;
+    case 'D': // IND – Index
+        line_feed();
+        break;
+    case 'E': // NEL – Next Line
+        column = 0;
+        line_feed();
+        break;
+    case 'H': // HTS – Horizontal Tabulation Set
+        if (column < sizeof(tab_stops))
+        {
+            tab_stops[column] = true; // Set a tab stop at the current column
+        }
+        break;
+    case 'M':         // RI – Reverse Index
+        if (row == margin_top) // scroll at top of the scrolling region
+        {
+            scroll(-1);
+        }
+        else if (row > 0)
+        {
+            row--;
+        }
+        break;
+    case 'c': // RIS – Reset To Initial State
+        column = row = 0;
+        reset_terminal();
+        break;
+    default:
+        // not a valid escape sequence, should we print an error?
+        break;
+    }
+}
+
+// Run a DEC private mode control sequence (CSI ?), ch is its final character
+static void dec_dispatch(uint8_t ch)
+{
+    switch (ch)
+    {
+    case 'h':                    // DECSET - DEC Private Mode Set
+        if (parameters[0] == 25) // DECTCEM - Text Cursor Enable Mode
+        {
+            lcd_enable_cursor(true);
+            lcd_draw_cursor();
+        }
+        else if (parameters[0] == 4264)
+        {
+            // set 64 column mode
+            flush();
+            lcd_set_font(&font_5x10);
+        }
+        break;
+    case 'l':                    // DECRST - DEC Private Mode Reset
+        if (parameters[0] == 25) // DECTCEM - Text Cursor Enable Mode
+        {
+            lcd_enable_cursor(false);
+            lcd_erase_cursor(); // immediately hide cursor
+        }
+        else if (parameters[0] == 4264)
+        {
+            // set 40 column mode
+            flush();
+            lcd_set_font(&font_8x10);
+        }
+        break;
+    case 'm':
+        // Ignore for now
+        break;
+    default:
+        put_glyph(0x01);               // print a error character
+        break;                         // ignore unknown DEC private mode sequences
+    }
+}
+
+// SGR – Select Graphic Rendition
+static void select_graphic_rendition()
+{
+    for (uint8_t i = 0; i <= p_index; i++)
+    {
+        if (parameters[i] == 0) // attributes off
+        {
+            lcd_set_foreground(FOREGROUND);
+            lcd_set_background(BACKGROUND);
+            lcd_set_underscore(false);
+            lcd_set_reverse(false);
+            lcd_set_bold(false);
+        }
+        else if (parameters[i] == 1) // bold
+        {
+            lcd_set_bold(true);
+        }
+        else if (parameters[i] == 2) // dim
+        {
+            lcd_set_foreground(DIM);
+        }
+        // No support for italic (3)
+        else if (parameters[i] == 4) // underline
+        {
+            lcd_set_underscore(true);
+        }
+        // No support for blink (5, 6)
+        else if (parameters[i] == 7) // negative (reverse) image
+        {
+            lcd_set_reverse(true);
+        }
+        else if (parameters[i] == 22) // normal intensity/weight
+        {
+            lcd_set_foreground(FOREGROUND);
+            lcd_set_bold(false);
+        }
+        else if (parameters[i] == 24) // not underlined
+        {
+            lcd_set_underscore(false);
+        }
+        else if (parameters[i] == 27) // positive image
+        {
+            lcd_set_reverse(false);
+        }
+        else if (parameters[i] >= 30 && parameters[i] <= 37) // foreground colour
+        {
+            lcd_set_foreground(palette[parameters[i] - 30]);
+        }
+        else if (parameters[i] == 38 && i + 4 <= p_index && parameters[i + 1] == 2) // foreground truecolor
+        {
+            uint8_t r = parameters[i + 2];
+            uint8_t g = parameters[i + 3];
+            uint8_t b = parameters[i + 4];
+            uint16_t colour = RGB(r, g, b);
+            lcd_set_foreground(colour);
+            i += 4; // Skip the next four parameters (2, r, g, b)
+        }
+        else if (parameters[i] == 38 && i + 2 <= p_index && parameters[i + 1] == 5) // foreground 256-colour
+        {
+            uint8_t colour = parameters[i + 2];
+            lcd_set_foreground(xterm_palette[colour]);
+            i += 2; // Skip the next two parameters (5 and colour)
+        }
+        else if (parameters[i] == 39) // default foreground colour
+        {
+            lcd_set_foreground(FOREGROUND);
+        }
+        else if (parameters[i] >= 40 && parameters[i] <= 47) // background colour
+        {
+            lcd_set_background(palette[parameters[i] - 40]);
+        }
+        else if (parameters[i] == 48 && i + 4 <= p_index && parameters[i + 1] == 2) // background truecolor
+        {
+            uint8_t r = parameters[i + 2];
+            uint8_t g = parameters[i + 3];
+            uint8_t b = parameters[i + 4];
+            uint16_t colour = RGB(r, g, b);
+            lcd_set_background(colour);
+            i += 4; // Skip the next four parameters (2, r, g, b)
+        }
+        else if (parameters[i] == 48 && i + 2 <= p_index && parameters[i + 1] == 5) // background 256-colour
+        {
+            uint8_t colour = parameters[i + 2];
+            lcd_set_background(xterm_palette[colour]);
+            i += 2; // Skip the next two parameters (5 and colour)
+        }
+        else if (parameters[i] == 49) // default background colour
+        {
+            lcd_set_background(BACKGROUND);
+        }
+        else if (parameters[i] >= 90 && parameters[i] <= 97) // bright foreground colour
+        {
+            lcd_set_foreground(bright_palette[parameters[i] - 90]);
+        }
+        else if (parameters[i] >= 100 && parameters[i] <= 107) // bright background colour
+        {
+            lcd_set_background(bright_palette[parameters[i] - 100]);
+        }
+    }
+}
+
+// Run a control sequence, ch is its final character
+static void csi_dispatch(uint8_t ch)
+{
+    int max_row = MAX_ROW;
+    int max_col = lcd_get_columns() - 1;
+
+    if (intermediate != 0)
+    {
+        if (intermediate == '!' && ch == 'p') // DECSTR - Soft Terminal Reset
+        {
+            reset_terminal();
+        }
+        return;
+    }
+    if (private_marker == '?')
+    {
+        dec_dispatch(ch);
+        return;
+    }
+    if (private_marker != 0)
+    {
+        return; // not supported
+    }
+
+    switch (ch)
+    {
+    case 'A': // CUU – Cursor Up
+        row = MAX(0, row - parameters[0]);
+        break;
+    case 'B': // CUD – Cursor Down
+        row = MIN(row + parameters[0], max_row);
+        break;
+    case 'C': // CUF – Cursor Forward
+        column = MIN(column + parameters[0], max_col);
+        break;
+    case 'D': // CUB - Cursor Backward
+        column = MAX(0, column - parameters[0]);
+        break;
+    case 'E': // CNL – CursorNext Line
+        if (parameters[0] == 0)
+        {
+            parameters[0] = 1; // default to 1 if not specified
+        }
+        row = MIN(row + parameters[0], max_row);
+        column = 0;
+        break;
+    case 'F': // CPL – Cursor Previous Line
+        if (parameters[0] == 0)
+        {
+            parameters[0] = 1; // default to 1 if not specified
+        }
+        row = MAX(0, row - parameters[0]);
+        column = 0;
+        break;
+    case 'G': // CHA - Cursor Horizontal Absolute
+        if (parameters[0] == 0)
+        {
+            parameters[0] = 1; // default to 1 if not specified
+        }
+        column = MIN(parameters[0] - 1, max_col);
+        column = MAX(0, column);
+        break;
+
+    case 'H': // CUP – Cursor Position
+    case 'f': // HVP – Horizontal and Vertical Position
+        if (parameters[0] == 0)
+        {
+            parameters[0] = 1; // default to 1 if not specified
+        }
+        if (parameters[1] == 0)
+        {
+            parameters[1] = 1; // default to 1 if not specified
+        }
+        row = MIN(parameters[0] - 1, max_row);
+        column = MIN(parameters[1] - 1, max_col);
+        break;
+    case 'J': // ED – Erase In Display
+        if (parameters[0] == 0 || parameters[0] == 1)
+        {
+            // Erase from cursor to end of screen, or from start of screen to cursor
+            erase_display(parameters[0], max_row, max_col);
+        }
+        else if (parameters[0] == 2) // clear entire screen
+        {
+            clear_screen();
+        }
+        break;
+    case 'K': // EL – Erase In Line
+        if (parameters[0] == 0)
+        {
+            // Erase from cursor to end of line
+            erase_line(row, column, max_col);
+        }
+        else if (parameters[0] == 1)
+        {
+            // Erase from start of line to cursor
+            erase_line(row, 0, column);
+        }
+        else if (parameters[0] == 2) // clear entire line
+        {
+            erase_line(row, 0, max_col);
+        }
+        break;
+    case 'S': // SU - Scroll Up
+        if (parameters[0] == 0)
+        {
+            parameters[0] = 1; // default to 1 if not specified
+        }
+        scroll(MIN(parameters[0], ROWS));
+        break;
+    case 'T': // SD - Scroll Down
+        if (parameters[0] == 0)
+        {
+            parameters[0] = 1; // default to 1 if not specified
+        }
+        scroll(-MIN(parameters[0], ROWS));
+        break;
+    case 'c': // DA - Device Attributes
+        report("\033[?1;c");
+        break;
+    case 'd': // VPA - Vertical Position Absolute
+        if (parameters[0] == 0)
+        {
+            parameters[0] = 1; // default to 1 if not specified
+        }
+        row = MIN(parameters[0] - 1, max_row);
+        break;
+    case 'e': // VPR - Vertical Position Relative
+        if (parameters[0] == 0)
+        {
+            parameters[0] = 1; // default to 1 if not specified
+        }
+        row = MIN(row + parameters[0], max_row);
+        break;
+    case 'g': // TBC – Tabulation Clear
+        if (parameters[0] == 3)
+        {
+            // Clear all tab stops
+            memset(tab_stops, 0, sizeof(tab_stops));
+        }
+        else if (parameters[0] == 0)
+        {
+            // Clear tab stop at current column
+            if (column < sizeof(tab_stops))
+            {
+                tab_stops[column] = false;
+            }
+        }
+        break;
+    case 'l': // RM – Reset Mode
+    case 'h': // SM – Set Mode
+        break;
+    case 'm': // SGR – Select Graphic Rendition
+        select_graphic_rendition();
+        break;
+    case 'n':                   // Device Status Report
+        if (parameters[0] == 5) // DSR - Device Status Report
+        {
+            report("\033[0n");
+        }
+        else if (parameters[0] == 6) // DSR - Device Status Report
+        {
+            char buf[16];
+            snprintf(buf, sizeof(buf), "\033[%d;%dR", row + 1, column + 1);
+            report(buf);
+        }
+        break;
+    case 'q': // DECLL – Load LEDS (DEC Private)
+        for (uint8_t i = 0; i <= p_index; i++)
+        {
+            if (parameters[i] == 0) // turn off all LEDs
+            {
+                leds = 0; // reset LED state
+            }
+            else if (parameters[i] > 0 && parameters[i] <= 8)
+            {
+                leds |= (1 << (parameters[i] - 1));
+            }
+        }
+        update_leds(leds); // update the LEDs
+        break;
+    case 'r': // DECSTBM – Set Top and Bottom Margins
+        if (parameters[0] == 0)
+        {
+            parameters[0] = 1; // default to 1 if not specified
+        }
+        if (parameters[1] == 0)
+        {
+            parameters[1] = ROWS; // default to the bottom of the screen
+        }
+        uint8_t top_row = MIN(parameters[0] - 1, max_row);
+        uint8_t bottom_row = MIN(parameters[1] - 1, max_row);
+        if (bottom_row > top_row)
+        {
+            set_margins(top_row, bottom_row);
+        }
+        else
+        {
+            set_margins(0, max_row); // invalid region, scroll the whole screen
+        }
+        row = top_row;
+        column = 0;
+        break;
+    case 's': // DECSC – Save Cursor (ANSI)
+        save_column = column;
+        save_row = row;
+        break;
+    case 't': // - Lines per page
+        // Not supported, ignore
+        break;
+    case 'u': // DECRC – Restore Cursor (ANSI)
+        column = save_column;
+        row = save_row;
+        break;
+    default:
+        put_glyph(0x02);               // print a error character
+        break;                         // ignore unknown sequences
+    }
+}
+
+// Remember an intermediate character or the private marker of a control sequence
+static void collect(uint8_t ch)
+{
+    if (ch >= '<')
+    {
+        private_marker = ch;
+    }
+    else
+    {
+        intermediate = intermediate == 0 ? ch : 0xFF; // only one intermediate is supported
+    }
+}
+
+// Add a digit or a separator to the control sequence parameters
+static void add_parameter(uint8_t ch)
+{
+    if (ch >= '0' && ch <= '9')
+    {
+        uint32_t value = parameters[p_index] * 10 + (ch - '0'); // accumulate digits
+        parameters[p_index] = MIN(value, UINT16_MAX);
+    }
+    else if (p_index < count_of(parameters) - 1) // delimiter
+    {
+        parameters[++p_index] = 0;
+    }
+}
+
+// Process a single character through the terminal state machine
+static void display_process(char ch)
+{
+    uint8_t c = (uint8_t)ch;
+    uint8_t start_column = column;
+    uint8_t start_row = row;
+
+    text_flow = false;
+
+    uint8_t transition = transitions[state][char_class[c]];
+    uint8_t action = transition >> 4;
+
+#if DISPLAY_DEBUG_CAPTURE
+    if (action == ACTION_CLEAR)
+    {
+        debug_index = 0;
+    }
+    if ((state != STATE_NORMAL || action == ACTION_CLEAR) && debug_index < sizeof(debug) - 1)
+    {
+        debug[debug_index++] = c;
+        debug[debug_index] = 0;
+    }
+#endif
+
+    state = transition & 0x0F;
+    switch (action)
+    {
+    case ACTION_PRINT:
+        put_glyph(translate_glyph(c)); // translate character based on active character set
+        break;
+    case ACTION_EXECUTE:
+        execute(c);
+        break;
+    case ACTION_CANCEL:
+        put_glyph(0x02); // print a error character
+        break;
+    case ACTION_CLEAR:
+        p_index = 0;
+        parameters[0] = parameters[1] = 0; // further parameters are zeroed as they are started
+        intermediate = 0;
+        private_marker = 0;
+        break;
+    case ACTION_COLLECT:
+        collect(c);
+        break;
+    case ACTION_PARAM:
+        add_parameter(c);
+        break;
+    case ACTION_ESC_DISPATCH:
+        esc_dispatch(c);
+        break;
+    case ACTION_CSI_DISPATCH:
+        csi_dispatch(c);
+        break;
+    default:
+        break;
+    }
+
+    update_position(start_column, start_row);
+}
+
+void display_emit(char ch)
+{
+#if DISPLAY_SHADOW_BUFFER
+    shadow_busy = true;
+#if DISPLAY_SCROLLBACK
+    if (view_lines)
+    {
+        view_end(); // output goes back to the live screen
+    }
+#endif
+#endif
+
+    lcd_erase_cursor(); // erase the cursor before processing the character
+    display_process(ch);
+
+    // Update cursor position
+    update_cursor(); // draw the cursor at the new position
+
+#if DISPLAY_SHADOW_BUFFER
+    shadow_busy = false;
+#endif
+}
+
+// Length of the run of printable characters (0x20 - 0x7E) at the start of a buffer
+//
+// Aligned words are checked four characters at a time. A character is not printable if
+// its top bit is set, if adding 1 sets it (DEL) or if subtracting 0x20 borrows (a control
+// character); the first such character in a word is always flagged, as carries and
+// borrows only come from characters that are flagged themselves.
+size_t display_scan_printable(const char *buf, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len && ((uintptr_t)&buf[i] & 3) != 0)
+    {
+        if (!is_printable(buf[i]))
+        {
+            return i;
+        }
+        i++;
+    }
+
+    while (i + 4 <= len)
+    {
+        uint32_t word;
+        memcpy(&word, __builtin_assume_aligned(&buf[i], 4), sizeof(word));
+        if ((word | (word + 0x01010101) | (word - 0x20202020)) & 0x80808080)
+        {
+            break; // the word has a non-printable character, find it below
+        }
+        i += 4;
+    }
+
+    while (i < len && is_printable(buf[i]))
+    {
+        i++;
+    }
+    return i;
+}
+
+// Process a buffer of characters
+//
+// Runs of printable characters are drawn a row at a time, only control characters and
+// escape sequences go through the state machine. The cursor is erased and redrawn once
+// for the whole buffer.
+void display_emit_buffer(const char *buf, size_t len)
+{
+#if DISPLAY_SHADOW_BUFFER
+    shadow_busy = true;
+#if DISPLAY_SCROLLBACK
+    if (view_lines)
+    {
+        view_end(); // output goes back to the live screen
+    }
+#endif
+#endif
+
+    lcd_erase_cursor(); // erase the cursor before processing the buffer
+
+    size_t i = 0;
+    while (i < len)
+    {
+        if (state == STATE_NORMAL && is_printable(buf[i]))
+        {
+            // Draw the longest run of printable characters that fits on the current row
+            uint8_t start_column = column;
+            uint8_t start_row = row;
+            size_t room = MAX(lcd_get_columns() - column, 1);
+            size_t run = 1 + display_scan_printable(&buf[i + 1], MIN(len - i, room) - 1);
+
+            put_run(&buf[i], run);
+            update_position(start_column, start_row);
+            i += run;
+        }
+        else
+        {
+            display_process(buf[i++]);
+        }
+    }
+
+    // Update cursor position
+    update_cursor(); // draw the cursor at the new position
+
+#if DISPLAY_SHADOW_BUFFER
+    shadow_busy = false;
+#endif
+}
+
+// Draw any buffered text on the display
+static void display_flush_buffer()
+{
+#if DISPLAY_SHADOW_BUFFER
+    if (shadow_busy)
+    {
+        return; // interrupted an update, the buffer will be flushed later
+    }
+
+    shadow_busy = true;
+    if (shadow_flush())
+    {
+        lcd_draw_cursor(); // the flush may have drawn over the cursor
+    }
+#if DISPLAY_SCROLLBACK
+    scrollback_update();
+#endif
+    shadow_busy = false;
+#endif
+}
+
+//
+//  Display pipeline on core 1
+//
+//  With DISPLAY_CORE1 enabled, display_write() copies characters into a single-producer,
+//  single-consumer ring and core 1 runs the terminal emulator and the LCD driver. Core 0
+//  only waits when the ring is full. display_flush() is the barrier: it returns once
+//  core 1 has processed everything queued and drawn it on the display.
+//
+//  The ring indices only ever increase; each is written by one core only.
+//
+
+#if DISPLAY_CORE1
+static char ring[DISPLAY_RING_SIZE];
+static volatile uint32_t ring_head = 0;          // next byte to write, owned by core 0
+static volatile uint32_t ring_tail = 0;          // next byte to read, owned by core 1
+static volatile bool flush_requested = false;    // core 0 is waiting in display_flush()
+static volatile bool core1_running = false;
+
+// A scrollback request is waiting to be run
+static bool scrollback_waiting()
+{
+#if DISPLAY_SHADOW_BUFFER && DISPLAY_SCROLLBACK
+    return scrollback_requested != scrollback_done;
+#else
+    return false;
+#endif
+}
+
+static void display_core1_main()
+{
+    absolute_time_t flush_at = at_the_end_of_time;
+
+    core1_running = true;
+    while (true)
+    {
+        uint32_t tail = ring_tail;
+        uint32_t head = ring_head;
+
+        if (head == tail)
+        {
+            // Out of work, flush if asked to or once the buffered text is old enough
+            if (flush_requested || time_reached(flush_at) || scrollback_waiting())
+            {
+                display_flush_buffer();
+                flush_at = at_the_end_of_time;
+                flush_requested = false;
+                __sev();
+            }
+            best_effort_wfe_or_timeout(flush_at);
+            continue;
+        }
+
+        // Process up to the end of the ring in one go
+        __dmb();
+        uint32_t offset = tail % DISPLAY_RING_SIZE;
+        uint32_t count = MIN(head - tail, DISPLAY_RING_SIZE - offset);
+        display_emit_buffer(&ring[offset], count);
+        __dmb();
+        ring_tail = tail + count;
+        __sev(); // wake core 0 if it is waiting for room
+
+        if (is_at_the_end_of_time(flush_at))
+        {
+            flush_at = make_timeout_time_ms(DISPLAY_FLUSH_MS);
+        }
+    }
+}
+
+// Queue characters for core 1, waiting for room if the ring is full
+static void ring_write(const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        uint32_t head = ring_head;
+        uint32_t room = DISPLAY_RING_SIZE - (head - ring_tail);
+        if (room == 0)
+        {
+            __wfe(); // back-pressure, wait for core 1 to catch up
+            continue;
+        }
+
+        uint32_t offset = head % DISPLAY_RING_SIZE;
+        uint32_t count = MIN(MIN(len, room), DISPLAY_RING_SIZE - offset);
+        memcpy(&ring[offset], buf, count);
+        __dmb();
+        ring_head = head + count;
+        __sev();
+
+        buf += count;
+        len -= count;
+    }
+}
+#endif
+
+// Display characters, on core 1 if the display pipeline is running
+void display_write(const char *buf, size_t len)
+{
+#if DISPLAY_CORE1
+    if (core1_running && get_core_num() == 0)
+    {
+        ring_write(buf, len);
+        return;
+    }
+#endif
+    display_emit_buffer(buf, len);
+}
+
+// Make sure everything written so far has been drawn on the display
+void display_flush()
+{
+#if DISPLAY_CORE1
+    if (core1_running && get_core_num() == 0)
+    {
+        flush_requested = true;
+        __sev();
+        while (ring_head != ring_tail || flush_requested)
+        {
+            __wfe();
+        }
+        return;
+    }
+#endif
+    display_flush_buffer();
+}
+
+// Move the view back through the text history by a number of lines, or forward if negative
+//
+// Output returns the view to the live screen. The request runs straight away unless the
+// terminal emulator is busy, then it runs once the update is done.
+void display_scrollback(int16_t lines)
+{
+#if DISPLAY_SHADOW_BUFFER && DISPLAY_SCROLLBACK
+    scrollback_requested += lines;
+    if (DISPLAY_CORE1 || shadow_busy)
+    {
+        // Core 1 runs it once it is out of work, otherwise the flush alarm does
+        shadow_schedule_flush();
+        __sev();
+        return;
+    }
+    display_flush_buffer();
+#endif
+}
+
+// RAM taken by the screen copy, the text history and the core 1 ring, for the mem command
+const uint32_t display_static_bytes = sizeof(parameters)
+#if DISPLAY_SHADOW_BUFFER
+                                      + sizeof(shadow_lines) + sizeof(shadow_map)
+#if DISPLAY_SCROLLBACK
+                                      + sizeof(history) + sizeof(history_pos) + sizeof(frame_lines)
+#endif
+#endif
+#if DISPLAY_CORE1
+                                      + sizeof(ring)
+#endif
+    ;
+
+//
+//  Display Callback Setters
+//
+
+void display_set_led_callback(led_callback_t callback)
+{
+    display_led_callback = callback;
+}
+
+void display_set_bell_callback(bell_callback_t callback)
+{
+    display_bell_callback = callback;
+}
+
+void display_set_report_callback(report_callback_t callback)
+{
+    display_report_callback = callback;
+}
+
+//
+//  Display Initialization
+//
+
+void display_init()
+{
+    // Make sure the LCD is initialized
+    lcd_init();
+
+#if DISPLAY_SHADOW_BUFFER
+    shadow_reset(); // the LCD has been cleared
+#endif
+
+    // Set tab stops every 8 columns by default
+    for (int i = 3; i < 64; i += 8)
+    {
+        tab_stops[i] = true;
+    }
+
+#if DISPLAY_CORE1
+    // Hand the terminal emulator over to core 1
+    multicore_launch_core1(display_core1_main);
+    while (!core1_running)
+    {
+        tight_loop_contents();
     }
+#endif
 }
\ No newline at end of file
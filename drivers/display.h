@@ -3,17 +3,35 @@
 #include "pico/stdlib.h"
 #include "font.h"
 
-// Processing ANSI escape sequences is a small state machine. These
-// are the states.
-#define STATE_NORMAL    (0)             // normal state
+// Shadow text buffer
+#define DISPLAY_SHADOW_BUFFER (1)       // 1 = draw text through a shadow buffer of character cells
+#define DISPLAY_MAX_COLUMNS (64)        // columns in the shadow buffer (64 with the 5x10 font)
+#define DISPLAY_FLUSH_MS    (16)        // maximum time text stays in the shadow buffer
+
+// Scrollback (needs the shadow buffer)
+#define DISPLAY_SCROLLBACK  (1)         // 1 = keep lines that scroll off the screen for scrollback
+#define DISPLAY_HISTORY_LINES (256)     // most lines kept in the history
+#define DISPLAY_HISTORY_BYTES (8192)    // bytes of history text (power of 2)
+#define DISPLAY_SCROLLBACK_STEP (16)    // lines moved by Shift+PageUp/PageDown
+
+// Display pipeline on core 1
+#define DISPLAY_CORE1       (0)         // 1 = run the terminal emulator and LCD driver on core 1
+#define DISPLAY_RING_SIZE   (4096)      // bytes queued for core 1 (power of 2)
+
+// Debugging
+#define DISPLAY_DEBUG_CAPTURE (0)       // 1 = keep the last escape sequence in debug[] for a debugger
+
+// Processing ANSI escape sequences is a small state machine, a subset of the
+// DEC VT500 parser. These are the states.
+#define STATE_NORMAL    (0)             // normal state, printable characters are drawn
 #define STATE_ESCAPE    (1)             // escape character received
-#define STATE_CS        (2)             // control sequence introducer (CSI) received
-#define STATE_DEC       (3)             // DEC private mode sequence (?)
-#define STATE_G0_SET    (4)             // setting G0 character set ESC(
-#define STATE_G1_SET    (5)             // setting G1 character set ESC)
-#define STATE_OSC       (6)             // Operating System Command (OSC)
-#define STATE_OSC_ESC   (7)             // Operating System Command (OSC) ESC
-#define STATE_TMC       (8)             // Terminal Management Control (TMC)
+#define STATE_ESCAPE_INTERMEDIATE (2)   // escape sequence intermediate received, e.g. ESC(
+#define STATE_CSI_ENTRY (3)             // control sequence introducer (CSI) received
+#define STATE_CSI_PARAM (4)             // control sequence parameters
+#define STATE_CSI_INTERMEDIATE (5)      // control sequence intermediate received, e.g. CSI!
+#define STATE_CSI_IGNORE (6)            // malformed control sequence, ignored up to its final
+#define STATE_STRING    (7)             // OSC, DCS, SOS, PM or APC string, ignored
+#define STATE_COUNT     (8)
 
 // Control characters
 #define CHR_BEL         (0x07)          // Bell
@@ -62,4 +80,11 @@ void display_set_led_callback(led_callback_t callback);
 void display_set_bell_callback(bell_callback_t callback);
 void display_set_report_callback(report_callback_t callback);
 bool display_emit_available(void);
-void display_emit(char c);
\ No newline at end of file
+void display_emit(char c);
+void display_emit_buffer(const char *buf, size_t len);
+size_t display_scan_printable(const char *buf, size_t len);
+void display_write(const char *buf, size_t len);
+void display_flush(void);
+void display_scrollback(int16_t lines);
+
+extern const uint32_t display_static_bytes;
\ No newline at end of file
@@ -9,7 +9,13 @@
 //  limited. To support user interrupts, we need to poll the keyboard and
 //  buffer the key events for when needed, except for the user interrupt
 //  where we process it immediately. We use a semaphore to protect access
-//  to the I2C bus and a repeating timer to poll for the key events.
+//  to the I2C bus and a scheduler task (see power.c) to poll for the key events.
+//
+//  Each poll drains every event waiting in the southbridge FIFO. The task
+//  runs fast while keys are being pressed and slows down as the keyboard
+//  goes quiet. A poll is a chain of southbridge requests, each submitted
+//  from the completion callback of the one before, so it never waits for
+//  the bus.
 //
 //  We also provide functions to interact with other features in the system,
 //  such as reading the battery level.
@@ -18,10 +24,13 @@
 #include "pico/stdlib.h"
 
 #include "keyboard.h"
+#include "power.h"
 #include "southbridge.h"
+#include "trace.h"
 
 extern volatile bool user_interrupt;
 keyboard_key_available_callback_t keyboard_key_available_callback = NULL;
+keyboard_scroll_callback_t keyboard_scroll_callback = NULL;
 
 static bool keyboard_initialised = false; // flag to indicate if the keyboard is initialised
 
@@ -33,19 +42,26 @@ static bool key_alt = false;     // alt key state
 static volatile char rx_buffer[KBD_BUFFER_SIZE];
 static volatile uint16_t rx_head = 0;
 static volatile uint16_t rx_tail = 0;
-static repeating_timer_t key_timer;
+static power_task_t key_task;
+static absolute_time_t last_key_time;   // when the last key event was read
+static sb_request_t key_count_request;  // reads the number of events waiting
+static sb_request_t key_event_request;  // reads one event
+static uint8_t key_events_left;         // events still to read in this poll
+static volatile bool key_poll_busy = false;
+#if TRACE_ENABLED
+static uint32_t key_poll_started_us;
+#endif
 
 //
 //  Keyboard Driver
 //
 //  This section implements the keyboard driver, which polls the
 //  keyboard for key events and buffers them for processing. It uses
-//  a repeating timer to poll the keyboard at regular intervals.
+//  a scheduler task to poll the keyboard at regular intervals.
 //
 
-void keyboard_poll()
+static void keyboard_event(uint16_t key)
 {
-    uint16_t key = sb_read_keyboard();
     uint8_t key_state = (key >> 8) & 0xFF;
     uint8_t key_code = key & 0xFF;
 
@@ -73,6 +89,12 @@ void keyboard_poll()
             {
                 // do nothing, processed in the south bridge
             }
+            else if (key_shift && keyboard_scroll_callback &&
+                     (key_code == KEY_PAGE_UP || key_code == KEY_PAGE_DOWN))
+            {
+                // Shift+PageUp/PageDown scroll the display back and forward
+                keyboard_scroll_callback(key_code == KEY_PAGE_UP ? 1 : -1);
+            }
             else
             {
                 // If a key is released, we return the key code
@@ -95,6 +117,10 @@ void keyboard_poll()
                 }
 
                 uint16_t next_head = (rx_head + 1) & (KBD_BUFFER_SIZE - 1);
+                if (next_head == rx_tail)
+                {
+                    return; // buffer full, drop the key
+                }
                 rx_buffer[rx_head] = ch;
                 rx_head = next_head;
 
@@ -119,16 +145,78 @@ void keyboard_poll()
     }
 }
 
-static bool on_keyboard_timer(repeating_timer_t *rt)
+// The poll has read all the events it is going to
+static void key_poll_done(void)
 {
-    if (!sb_available())
+#if TRACE_ENABLED
+    trace_record(TRACE_KEYBOARD_POLL, key_poll_started_us, 0);
+#endif
+    key_poll_busy = false;
+}
+
+static void on_key_event(sb_request_t *request)
+{
+    if (request->ok)
+    {
+        keyboard_event(request->rx[0] << 8 | request->rx[1]);
+        last_key_time = get_absolute_time();
+    }
+    if (!request->ok || --key_events_left == 0 || !sb_submit(request))
     {
-        return true; // if southbridge is not available, skip this timer tick
+        key_poll_done();
     }
+}
 
-    keyboard_poll();
+static void on_key_count(sb_request_t *request)
+{
+    key_events_left = request->ok ? MIN(request->rx[0] & SB_KEY_COUNT_MASK, KEYBOARD_BURST) : 0;
+    if (key_events_left == 0 || !sb_submit(&key_event_request))
+    {
+        key_poll_done();
+    }
+}
 
-    return true; // continue the timer
+// Start reading the events waiting in the FIFO; returns at once and the
+// keys arrive in the buffer from the I2C interrupt
+void keyboard_poll()
+{
+    if (key_poll_busy)
+    {
+        return; // the last poll is still running
+    }
+
+    key_poll_busy = true;
+#if TRACE_ENABLED
+    key_poll_started_us = time_us_32();
+#endif
+    if (!sb_submit(&key_count_request))
+    {
+        key_poll_done();
+    }
+}
+
+// Poll interval for how long the keyboard has been quiet
+static uint32_t keyboard_poll_interval_ms(void)
+{
+    int64_t quiet_ms = absolute_time_diff_us(last_key_time, get_absolute_time()) / 1000;
+    if (quiet_ms < KEYBOARD_ACTIVE_MS)
+    {
+        return KEYBOARD_POLL_FAST_MS;
+    }
+    if (quiet_ms < KEYBOARD_IDLE_MS)
+    {
+        return KEYBOARD_POLL_IDLE_MS;
+    }
+    return KEYBOARD_POLL_MS;
+}
+
+static uint32_t on_keyboard_task(void)
+{
+    if (sb_available())
+    {
+        keyboard_poll(); // if southbridge is not available, skip this tick
+    }
+    return keyboard_poll_interval_ms();
 }
 
 //
@@ -144,7 +232,7 @@ char keyboard_get_key()
 {
     while (!keyboard_key_available())
     {
-        tight_loop_contents();
+        power_wait(); // sleep until the next poll
     }
 
     char ch = rx_buffer[rx_tail];
@@ -162,19 +250,25 @@ void keyboard_set_key_available_callback(keyboard_key_available_callback_t callb
     keyboard_key_available_callback = callback;
 }
 
+void keyboard_set_scroll_callback(keyboard_scroll_callback_t callback)
+{
+    keyboard_scroll_callback = callback;
+}
+
 
 void keyboard_set_background_poll(bool enable)
 {
     if (enable)
     {
-        // Start the repeating timer to poll the keyboard
-        // poll every 100 ms for key events
-        add_repeating_timer_ms(-KEYBOARD_POLL_MS, on_keyboard_timer, NULL, &key_timer);
+        // Start polling the keyboard, at the idle rate until keys are
+        // pressed
+        last_key_time = get_absolute_time();
+        power_task_start(&key_task, on_keyboard_task, KEYBOARD_POLL_IDLE_MS);
     }
     else
     {
-        // Stop the repeating timer
-        cancel_repeating_timer(&key_timer);
+        // Stop polling
+        power_task_stop(&key_task);
     }
 }
 
@@ -192,5 +286,14 @@ void keyboard_init(void)
     // Initialize the south bridge if not already done
     sb_init(); // Initialize the south bridge
 
+    key_count_request.tx[0] = SB_REG_KEY;
+    key_count_request.tx_len = 1;
+    key_count_request.rx_len = 2;
+    key_count_request.callback = on_key_count;
+    key_event_request.tx[0] = SB_REG_FIF;
+    key_event_request.tx_len = 1;
+    key_event_request.rx_len = 2;
+    key_event_request.callback = on_key_event;
+
     keyboard_initialised = true;
 }
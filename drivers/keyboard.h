@@ -51,15 +51,24 @@
 
 // Keyboard defaults
 #define KBD_BUFFER_SIZE     (32)
-#define KEYBOARD_POLL_MS    (100) // poll keyboard every 100 ms
+#define KEYBOARD_POLL_MS    (100) // poll keyboard every 100 ms once idle
+#define KEYBOARD_POLL_FAST_MS (10)  // poll interval while keys are being pressed
+#define KEYBOARD_POLL_IDLE_MS (16)  // poll interval after a short pause
+#define KEYBOARD_ACTIVE_MS  (1000)  // fast polling lasts this long after a key
+#define KEYBOARD_IDLE_MS    (60000) // slow down to KEYBOARD_POLL_MS after this long
+#define KEYBOARD_BURST      (16)    // most FIFO events read per poll
 
 
 // Callback function type for when a key becomes available
 typedef void (*keyboard_key_available_callback_t)(void);
 
+// Callback function type for Shift+PageUp (1) and Shift+PageDown (-1)
+typedef void (*keyboard_scroll_callback_t)(int8_t direction);
+
 // Keyboard Function prototypes
 void keyboard_init(void);
 void keyboard_set_key_available_callback(keyboard_key_available_callback_t callback);
+void keyboard_set_scroll_callback(keyboard_scroll_callback_t callback);
 void keyboard_set_background_poll(bool enable);
 void keyboard_poll(void);
 bool keyboard_key_available(void);
@@ -12,15 +12,23 @@
 //        writing to the display RAM requires the minimum chip select high pulse width of 40ns.
 //
 
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
+#include "pico/critical_section.h"
 #include "hardware/spi.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
 
 #include "lcd.h"
+#include "power.h"
+#include "trace.h"
 
-static bool lcd_initialised = false; // flag to indicate if the LCD is initialised
+static volatile bool lcd_initialised = false; // flag to indicate if the LCD is initialised
 
 static uint16_t lcd_scroll_top = 0;                      // top fixed area for vertical scrolling
 static uint16_t lcd_memory_scroll_height = FRAME_HEIGHT; // scroll area height
@@ -35,24 +43,129 @@ static bool reverse = false;    // reverse video state
 static bool bold = false;       // bold text state
 
 // Text drawing
+//
+// The glyph buffers are double-buffered so that the next cell or line can be
+// rendered while the DMA channel is still sending the previous one to the display.
 const font_t *font = &font_8x10; // default font is 8x10
-static uint16_t char_buffer[8 * GLYPH_HEIGHT] __attribute__((aligned(4)));
-static uint16_t line_buffer[WIDTH * GLYPH_HEIGHT] __attribute__((aligned(4)));
+#if !LCD_GLYPH_CACHE_ENTRIES
+static uint16_t char_buffer[2][8 * GLYPH_HEIGHT] __attribute__((aligned(4)));
+static uint8_t char_buffer_index = 0; // next char_buffer to render into
+#endif
+static uint16_t line_buffer[2][WIDTH * GLYPH_HEIGHT] __attribute__((aligned(4)));
+static uint8_t line_buffer_index = 0; // next line_buffer to render into
+
+// Glyph cache
+//
+// Recently drawn cells are kept fully rendered, keyed by glyph, colours and attributes.
+// Entries are found through a hash table and replaced least recently used first.
+#if LCD_GLYPH_CACHE_ENTRIES
+#define GLYPH_CACHE_NONE (0xFFFF)       // end of a hash chain or the LRU list
 
-// Background processing
-static uint32_t irq_state;
-static repeating_timer_t cursor_timer;
+typedef struct
+{
+    uint16_t pixels[8 * GLYPH_HEIGHT] __attribute__((aligned(4))); // rendered cell, font->width pixels per row
+    uint16_t foreground;                // key: RGB565 foreground colour
+    uint16_t background;                // key: RGB565 background colour
+    uint8_t glyph;                      // key: glyph (font offset)
+    uint8_t attrs;                      // key: LCD_ATTR_* flags
+    bool valid;                         // entry holds a rendered cell
+    uint16_t hash_next;                 // next entry in the same hash bucket
+    uint16_t lru_prev;                  // next more recently used entry
+    uint16_t lru_next;                  // next less recently used entry
+} glyph_cache_entry_t;
+
+// lcd_render_glyph() stores pixel pairs as words, so every entry's pixels must be word aligned
+static_assert(sizeof(glyph_cache_entry_t) % 4 == 0, "glyph cache entries must be a multiple of 4 bytes");
+static_assert(offsetof(glyph_cache_entry_t, pixels) % 4 == 0, "glyph cache pixels must be word aligned");
+
+static glyph_cache_entry_t glyph_cache[LCD_GLYPH_CACHE_ENTRIES] __attribute__((aligned(4)));
+static uint16_t glyph_cache_buckets[LCD_GLYPH_CACHE_ENTRIES]; // first entry in each hash bucket
+static uint16_t glyph_cache_head;       // most recently used entry
+static uint16_t glyph_cache_tail;       // least recently used entry
+static const uint16_t *glyph_cache_sent = NULL; // entry last passed to lcd_blit()
+#endif
+static lcd_glyph_cache_stats_t glyph_cache_stats;
+
+static void lcd_glyph_cache_reset(void);
+
+// DMA transfers
+static int lcd_dma_channel = -1;                 // DMA channel for pixel data, -1 if not claimed
+static volatile bool lcd_dma_active = false;     // a DMA transfer to the display is in flight
+static lcd_dma_callback_t lcd_dma_callback = NULL; // called when a DMA transfer completes
+static dma_channel_config lcd_dma_pixels_config; // DMA configuration for pixel buffers
+static dma_channel_config lcd_dma_fill_config;   // DMA configuration for solid fills
+
+// Solid fills waiting for the DMA channel, in frame memory coordinates
+typedef struct
+{
+    uint16_t colour;
+    uint16_t x0, y0, x1, y1;
+} lcd_fill_t;
+
+static lcd_fill_t lcd_fill_queue[LCD_FILL_QUEUE_SIZE];
+static volatile uint8_t lcd_fill_head = 0; // next fill to send
+static volatile uint8_t lcd_fill_tail = 0; // next free entry
+static uint16_t lcd_fill_colour;           // fixed source address for the fill in flight
 
+// Address window last set on the controller, in frame memory coordinates
+static struct
+{
+    uint16_t x0, y0, x1, y1;
+} lcd_window;
+static bool lcd_window_valid = false;      // lcd_window holds what the controller has
+
+// RAM taken by the pixel buffers, for the mem command
+const uint32_t lcd_static_bytes = sizeof(line_buffer) + sizeof(lcd_fill_queue)
+#if LCD_GLYPH_CACHE_ENTRIES
+                                  + sizeof(glyph_cache) + sizeof(glyph_cache_buckets)
+#else
+                                  + sizeof(char_buffer)
+#endif
+    ;
+
+// Background processing
+//
+// The critical section disables interrupts and takes a spin lock, so the LCD can be
+// driven from either core (see DISPLAY_CORE1) and from the cursor blink task.
+static critical_section_t lcd_lock;
+#if TRACE_ENABLED
+static uint32_t lcd_locked_us;          // when lcd_lock was taken
+static uint32_t lcd_dma_started_us;     // when the DMA transfer in flight started
+static uint32_t lcd_dma_pixels;         // pixels in it
+static trace_event_t lcd_dma_event;     // TRACE_LCD_DMA_FILL or TRACE_LCD_DMA_PIXELS
+#endif
+static power_task_t cursor_task;
+
+static bool lcd_dma_poll(void);
+
+// All access to the SPI bus happens holding lcd_lock. Any DMA transfer
+// in flight, and any queued fills, must finish before the bus can be used for
+// anything else. Interrupts are enabled while waiting.
 static void lcd_disable_interrupts()
 {
-    irq_state = save_and_disable_interrupts();
+    while (true)
+    {
+        critical_section_enter_blocking(&lcd_lock);
+        if (lcd_dma_poll())
+        {
+            break;
+        }
+        critical_section_exit(&lcd_lock);
+        tight_loop_contents();
+    }
+#if TRACE_ENABLED
+    lcd_locked_us = time_us_32();
+#endif
     //gpio_put(3, true);
 }
 
 static void lcd_enable_interrupts()
 {
     //gpio_put(3, false);
-    restore_interrupts(irq_state);
+#if TRACE_ENABLED
+    trace_record(TRACE_LCD_LOCKED, lcd_locked_us, 0);
+#endif
+    critical_section_exit(&lcd_lock);
 }
 
 //
@@ -87,6 +200,7 @@ void lcd_set_font(const font_t *new_font)
 {
     // Set the new font
     font = new_font;
+    lcd_glyph_cache_reset(); // cached cells were rendered with the old font
 }
 
 uint8_t lcd_get_columns(void)
@@ -114,6 +228,12 @@ void lcd_set_foreground(uint16_t colour)
     }
 }
 
+// Get the current background colour (taking reverse video into account)
+uint16_t lcd_get_background(void)
+{
+    return background;
+}
+
 // Set background colour
 void lcd_set_background(uint16_t colour)
 {
@@ -130,69 +250,325 @@ void lcd_set_background(uint16_t colour)
 //
 // Low-level SPI functions
 //
+// Drawing keeps the SPI in 16-bit mode: lcd_set_window() sends its commands as 16-bit
+// frames and its parameters are 16-bit addresses, so only the 8-bit commands and data
+// from lcd_write_cmd() and lcd_write_data() change the frame size, and it is only set
+// when it changes.
+//
+
+static uint8_t lcd_spi_bits = 8;        // SPI frame size, spi_init() sets 8 bits
+
+// Set the SPI frame size if it is not set already, chip select must be high
+static void lcd_spi_format(uint8_t bits)
+{
+    if (lcd_spi_bits != bits)
+    {
+        spi_set_format(LCD_SPI, bits, 0, 0, SPI_MSB_FIRST);
+        lcd_spi_bits = bits;
+    }
+}
+
+// Take chip select low to start a transaction
+//
+// Writing to the display RAM needs chip select high for at least 40ns between
+// transactions, so the pulse is stretched here before chip select goes low.
+static void lcd_select(void)
+{
+    busy_wait_at_least_cycles(LCD_CS_HIGH_CYCLES);
+    gpio_put(LCD_CSX, 0);
+}
 
 // Send a command
 void lcd_write_cmd(uint8_t cmd)
 {
+    lcd_window_valid = false; // the command could change the window or how it is used
+
+    lcd_spi_format(8);
     gpio_put(LCD_DCX, 0); // Command
-    gpio_put(LCD_CSX, 0);
+    lcd_select();
     spi_write_blocking(LCD_SPI, &cmd, 1);
     gpio_put(LCD_CSX, 1);
 }
 
-// Send 8-bit data (byte)
+// Send 8-bit data (bytes) in one transfer
 void lcd_write_data(uint8_t len, ...)
 {
+    uint8_t data[UINT8_MAX];
     va_list args;
     va_start(args, len);
-    gpio_put(LCD_DCX, 1); // Data
-    gpio_put(LCD_CSX, 0);
     for (uint8_t i = 0; i < len; i++)
     {
-        uint8_t data = va_arg(args, int); // get the next byte of data
-        spi_write_blocking(LCD_SPI, &data, 1);
+        data[i] = va_arg(args, int); // get the next byte of data
     }
-    gpio_put(LCD_CSX, 1);
     va_end(args);
+
+    lcd_spi_format(8);
+    gpio_put(LCD_DCX, 1); // Data
+    lcd_select();
+    spi_write_blocking(LCD_SPI, data, len);
+    gpio_put(LCD_CSX, 1);
 }
 
-// Send 16-bit data (half-word)
+// Send 16-bit data (half-words) in one transfer
 void lcd_write16_data(uint8_t len, ...)
 {
+    uint16_t data[UINT8_MAX];
     va_list args;
-
-    // DO NOT MOVE THE spi_set_format() OR THE gpio_put(LCD_DCX) CALLS!
-    // They are placed before the gpio_put(LCD_CSX) to ensure that a minimum
-    // chip select high pulse width is achieved (at least 40ns)
-    spi_set_format(LCD_SPI, 16, 0, 0, SPI_MSB_FIRST);
-
     va_start(args, len);
-    gpio_put(LCD_DCX, 1); // Data
-    gpio_put(LCD_CSX, 0);
     for (uint8_t i = 0; i < len; i++)
     {
-        uint16_t data = va_arg(args, int); // get the next half-word of data
-        spi_write16_blocking(LCD_SPI, &data, 1);
+        data[i] = va_arg(args, int); // get the next half-word of data
     }
-    gpio_put(LCD_CSX, 1);
     va_end(args);
 
-    spi_set_format(LCD_SPI, 8, 0, 0, SPI_MSB_FIRST);
+    lcd_spi_format(16);
+    gpio_put(LCD_DCX, 1); // Data
+    lcd_select();
+    spi_write16_blocking(LCD_SPI, data, len);
+    gpio_put(LCD_CSX, 1);
+}
+
+// Send a command and its 16-bit parameters in 16-bit mode, chip select must be low
+//
+// The command goes out with a NOP in the upper byte of its frame, the controller
+// reads the NOP and then the command.
+static void lcd_write_cmd16(uint8_t cmd, const uint16_t *params, size_t len)
+{
+    uint16_t frame = (LCD_CMD_NOP << 8) | cmd;
+
+    gpio_put(LCD_DCX, 0); // Command
+    spi_write16_blocking(LCD_SPI, &frame, 1);
+    gpio_put(LCD_DCX, 1); // Data
+    if (len > 0)
+    {
+        spi_write16_blocking(LCD_SPI, params, len);
+    }
 }
 
+// Send a buffer of 16-bit data (half-words)
+//
+// The buffer is sent by DMA and this function returns as soon as the transfer has
+// started. The buffer must not be modified until the transfer completes, see
+// lcd_wait_idle(). Chip select is released when the transfer completes.
 void lcd_write16_buf(const uint16_t *buffer, size_t len)
 {
-    // DO NOT MOVE THE spi_set_format() OR THE gpio_put(LCD_DCX) CALLS!
-    // They are placed before the gpio_put(LCD_CSX) to ensure that a minimum
-    // chip select high pulse width is achieved (at least 40ns)
-    spi_set_format(LCD_SPI, 16, 0, 0, SPI_MSB_FIRST);
+    if (len == 0)
+    {
+        return;
+    }
 
+    // Chip select is already low if this follows lcd_set_window()
+    lcd_spi_format(16);
     gpio_put(LCD_DCX, 1); // Data
-    gpio_put(LCD_CSX, 0);
-    spi_write16_blocking(LCD_SPI, buffer, len);
+    lcd_select();
+
+    if (lcd_dma_channel < 0)
+    {
+        // No DMA channel (not initialised yet), fall back to a blocking write
+        spi_write16_blocking(LCD_SPI, buffer, len);
+        gpio_put(LCD_CSX, 1);
+        return;
+    }
+
+    lcd_dma_active = true;
+#if TRACE_ENABLED
+    lcd_dma_started_us = time_us_32();
+    lcd_dma_pixels = len;
+    lcd_dma_event = TRACE_LCD_DMA_PIXELS;
+#endif
+    dma_channel_configure(lcd_dma_channel, &lcd_dma_pixels_config, &spi_get_hw(LCD_SPI)->dr,
+                          buffer, len, true);
+}
+
+//
+//  DMA transfers
+//
+//  Pixel data is sent to the display by a DMA channel feeding the SPI TX FIFO. A
+//  transfer is finished (chip select released and the SPI returned to 8-bit mode)
+//  either by the DMA interrupt or by the next user of the SPI bus, whichever comes
+//  first. Finishing a transfer is idempotent and is always done with interrupts
+//  disabled.
+//
+//  Solid fills are queued and sent from a single colour value without incrementing
+//  the read address. The DMA interrupt starts the next queued fill when the previous
+//  transfer completes.
+//
+
+static void lcd_set_window(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
+
+// Wait for the DMA transfer in flight (if any) to complete and release the bus
+static void lcd_dma_finish(void)
+{
+    if (!lcd_dma_active)
+    {
+        return;
+    }
+
+    dma_channel_wait_for_finish_blocking(lcd_dma_channel);
+    dma_channel_acknowledge_irq0(lcd_dma_channel);
+
+    // The DMA has loaded the last half-word into the FIFO, wait for it to be shifted out
+    while (spi_is_busy(LCD_SPI))
+    {
+        tight_loop_contents();
+    }
+
+    // Discard anything received while transmitting
+    while (spi_is_readable(LCD_SPI))
+    {
+        (void)spi_get_hw(LCD_SPI)->dr;
+    }
+    spi_get_hw(LCD_SPI)->icr = SPI_SSPICR_RORIC_BITS;
+
+    gpio_put(LCD_CSX, 1); // the SPI stays in 16-bit mode for the next transfer
+
+    lcd_dma_active = false;
+#if TRACE_ENABLED
+    trace_record(lcd_dma_event, lcd_dma_started_us, lcd_dma_pixels);
+#endif
+    if (lcd_dma_callback)
+    {
+        lcd_dma_callback();
+    }
+}
+
+// Write a single colour value directly to the SPI bus count times, without a pixel buffer.
+// Only used before the DMA channel has been claimed, following lcd_set_window().
+static void lcd_send_pixels(uint16_t colour, uint32_t count)
+{
+    TRACE_BEGIN(start);
+    for (uint32_t i = 0; i < count; i++)
+        spi_write16_blocking(LCD_SPI, &colour, 1);
     gpio_put(LCD_CSX, 1);
+    TRACE_END(start, TRACE_LCD_SEND_PIXELS, count);
+}
+
+// Start the next queued fill, returns false if there is nothing to send
+static bool lcd_dma_start_fill(void)
+{
+    if (lcd_fill_head == lcd_fill_tail)
+    {
+        return false;
+    }
+
+    lcd_fill_t *fill = &lcd_fill_queue[lcd_fill_head % LCD_FILL_QUEUE_SIZE];
+    uint32_t count = (uint32_t)(fill->x1 - fill->x0 + 1) * (fill->y1 - fill->y0 + 1);
+
+    lcd_set_window(fill->x0, fill->y0, fill->x1, fill->y1);
+    lcd_fill_colour = fill->colour;
+    lcd_fill_head++;
+
+    if (lcd_dma_channel < 0)
+    {
+        lcd_send_pixels(lcd_fill_colour, count);
+        return true;
+    }
+
+    // The window left chip select low and the SPI in 16-bit mode for the pixels
+    lcd_dma_active = true;
+#if TRACE_ENABLED
+    lcd_dma_started_us = time_us_32();
+    lcd_dma_pixels = count;
+    lcd_dma_event = TRACE_LCD_DMA_FILL;
+#endif
+    dma_channel_configure(lcd_dma_channel, &lcd_dma_fill_config, &spi_get_hw(LCD_SPI)->dr,
+                          &lcd_fill_colour, count, true);
+    return true;
+}
+
+// Make progress on transfers without blocking, returns true when the bus is idle.
+// Must be called holding lcd_lock.
+static bool lcd_dma_poll(void)
+{
+    if (lcd_dma_active)
+    {
+        if (dma_channel_is_busy(lcd_dma_channel))
+        {
+            return false;
+        }
+        lcd_dma_finish();
+    }
+
+    // Start the next queued fill, if any
+    return !lcd_dma_start_fill();
+}
+
+// Queue a solid fill in frame memory coordinates, must be called holding lcd_lock
+static void lcd_queue_fill(uint16_t colour, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
+{
+    while ((uint8_t)(lcd_fill_tail - lcd_fill_head) >= LCD_FILL_QUEUE_SIZE)
+    {
+        // The queue is full, wait for the transfer in flight to make room
+        lcd_dma_finish();
+        lcd_dma_start_fill();
+    }
+
+    lcd_fill_t *fill = &lcd_fill_queue[lcd_fill_tail % LCD_FILL_QUEUE_SIZE];
+    fill->colour = colour;
+    fill->x0 = x0;
+    fill->y0 = y0;
+    fill->x1 = x1;
+    fill->y1 = y1;
+    lcd_fill_tail++;
+
+    if (!lcd_dma_active)
+    {
+        lcd_dma_poll();
+    }
+}
+
+static void lcd_dma_irq_handler(void)
+{
+    if (lcd_dma_channel >= 0 && dma_channel_get_irq0_status(lcd_dma_channel))
+    {
+        critical_section_enter_blocking(&lcd_lock);
+        dma_channel_acknowledge_irq0(lcd_dma_channel);
+        lcd_dma_poll(); // completes the transfer and starts the next queued fill
+        critical_section_exit(&lcd_lock);
+    }
+}
+
+static void lcd_dma_init(void)
+{
+    lcd_dma_channel = dma_claim_unused_channel(true);
+
+    // Pixel buffers: 16-bit transfers from an incrementing address into the SPI TX FIFO
+    lcd_dma_pixels_config = dma_channel_get_default_config(lcd_dma_channel);
+    channel_config_set_transfer_data_size(&lcd_dma_pixels_config, DMA_SIZE_16);
+    channel_config_set_read_increment(&lcd_dma_pixels_config, true);
+    channel_config_set_write_increment(&lcd_dma_pixels_config, false);
+    channel_config_set_dreq(&lcd_dma_pixels_config, spi_get_dreq(LCD_SPI, true));
+
+    // Solid fills: the same, but the read address does not increment
+    lcd_dma_fill_config = lcd_dma_pixels_config;
+    channel_config_set_read_increment(&lcd_dma_fill_config, false);
+
+    dma_channel_configure(lcd_dma_channel, &lcd_dma_pixels_config, &spi_get_hw(LCD_SPI)->dr, NULL, 0, false);
+
+    dma_channel_set_irq0_enabled(lcd_dma_channel, true);
+    irq_add_shared_handler(DMA_IRQ_0, lcd_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
+
+// Wait until all transfers to the display have completed
+void lcd_wait_idle(void)
+{
+    lcd_disable_interrupts();
+    lcd_enable_interrupts();
+}
+
+// Set the SPI clock divider again after clk_peri has changed
+void lcd_clock_changed(void)
+{
+    lcd_disable_interrupts();
+    spi_set_baudrate(LCD_SPI, LCD_BAUDRATE);
+    lcd_enable_interrupts();
+}
 
-    spi_set_format(LCD_SPI, 8, 0, 0, SPI_MSB_FIRST);
+// Set a function to call when a DMA transfer to the display completes
+void lcd_set_dma_callback(lcd_dma_callback_t callback)
+{
+    lcd_dma_callback = callback;
 }
 
 //
@@ -200,22 +576,37 @@ void lcd_write16_buf(const uint16_t *buffer, size_t len)
 //
 
 // Select the target of the pixel data in the display RAM that will follow
+//
+// The window and the pixel data are one transaction: chip select is left low and the
+// pixels follow straight after RAMWR. The column and row ranges last set are kept, and
+// CASET or RASET is only sent for a range that changes, so redrawing a cell costs just
+// RAMWR and the next cell along a row costs CASET and RAMWR.
 static void lcd_set_window(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
 {
+    lcd_spi_format(16);
+    lcd_select();
+
     // Set column address (X)
-    lcd_write_cmd(LCD_CMD_CASET);
-    lcd_write_data(4,
-                   UPPER8(x0), LOWER8(x0),
-                   UPPER8(x1), LOWER8(x1));
+    if (!lcd_window_valid || x0 != lcd_window.x0 || x1 != lcd_window.x1)
+    {
+        uint16_t columns[2] = {x0, x1};
+        lcd_write_cmd16(LCD_CMD_CASET, columns, 2);
+        lcd_window.x0 = x0;
+        lcd_window.x1 = x1;
+    }
 
     // Set row address (Y)
-    lcd_write_cmd(LCD_CMD_RASET);
-    lcd_write_data(4,
-                   UPPER8(y0), LOWER8(y0),
-                   UPPER8(y1), LOWER8(y1));
+    if (!lcd_window_valid || y0 != lcd_window.y0 || y1 != lcd_window.y1)
+    {
+        uint16_t rows[2] = {y0, y1};
+        lcd_write_cmd16(LCD_CMD_RASET, rows, 2);
+        lcd_window.y0 = y0;
+        lcd_window.y1 = y1;
+    }
+    lcd_window_valid = true;
 
     // Prepare to write to RAM
-    lcd_write_cmd(LCD_CMD_RAMWR);
+    lcd_write_cmd16(LCD_CMD_RAMWR, NULL, 0);
 }
 
 //
@@ -229,14 +620,19 @@ static void lcd_set_window(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
 //  The pixel data is expected to be in RGB565 format, which is a 16-bit value with the
 //  red component in the upper 5 bits, the green component in the middle 6 bits, and the
 //  blue component in the lower 5 bits.
+//
+//  The pixel data is sent by DMA and lcd_blit() returns once the transfer has started,
+//  so the pixels must be left untouched until lcd_wait_idle() returns (or any other
+//  LCD function is called).
 
 void lcd_blit(const uint16_t *pixels, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
 {
+    TRACE_BEGIN(start);
     lcd_disable_interrupts();
     if (y >= lcd_scroll_top && y < HEIGHT - lcd_scroll_bottom)
     {
         // Adjust y for vertical scroll offset and wrap within memory height
-        uint16_t y_virtual = (lcd_y_offset + y) % lcd_memory_scroll_height;
+        uint16_t y_virtual = (lcd_y_offset + y - lcd_scroll_top) % lcd_memory_scroll_height;
         uint16_t y_end = lcd_scroll_top + y_virtual + height - 1;
         if (y_end >= lcd_scroll_top + lcd_memory_scroll_height)
         {
@@ -252,21 +648,7 @@ void lcd_blit(const uint16_t *pixels, uint16_t x, uint16_t y, uint16_t width, ui
 
     lcd_write16_buf((uint16_t *)pixels, width * height);
     lcd_enable_interrupts();
-}
-
-// Write a single colour value directly to the SPI bus count times, without a pixel buffer.
-static void lcd_send_pixels(uint16_t colour, uint32_t count)
-{
-    // DO NOT MOVE THE spi_set_format() OR THE gpio_put(LCD_DCX) CALLS!
-    // They are placed before the gpio_put(LCD_CSX) to ensure that a minimum
-    // chip select high pulse width is achieved (at least 40ns)
-    spi_set_format(LCD_SPI, 16, 0, 0, SPI_MSB_FIRST);
-    gpio_put(LCD_DCX, 1); // Data
-    gpio_put(LCD_CSX, 0);
-    for (uint32_t i = 0; i < count; i++)
-        spi_write16_blocking(LCD_SPI, &colour, 1);
-    gpio_put(LCD_CSX, 1);
-    spi_set_format(LCD_SPI, 8, 0, 0, SPI_MSB_FIRST);
+    TRACE_END(start, TRACE_LCD_BLIT, width * height);
 }
 
 // Draw a single pixel, clipping to display bounds
@@ -289,37 +671,72 @@ static void lcd_put_hline(uint16_t colour, int16_t x, int16_t y, int16_t width)
     lcd_solid_rectangle(colour, (uint16_t)x, (uint16_t)y, (uint16_t)width, 1);
 }
 
-// Draw a solid rectangle on the display
-void lcd_solid_rectangle(uint16_t colour, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+// Queue a solid rectangle in display coordinates, must be called holding lcd_lock
+//
+// Rows in the fixed areas are frame memory rows and rows in the scrolling area are offset
+// into its ring, so a rectangle crossing a margin is split there.
+static void lcd_queue_rectangle(uint16_t colour, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
 {
-    lcd_disable_interrupts();
+    if (width == 0 || height == 0)
+    {
+        return;
+    }
 
-    if (y >= lcd_scroll_top && y < HEIGHT - lcd_scroll_bottom)
+    uint16_t x_end = x + width - 1;
+    uint16_t y_end = y + height;                        // first row below the rectangle
+    uint16_t scroll_end = HEIGHT - lcd_scroll_bottom;   // first row of the bottom fixed area
+
+    if (y < lcd_scroll_top)
     {
-        uint16_t y_virtual = (lcd_y_offset + y) % lcd_memory_scroll_height;
+        uint16_t rows_end = MIN(y_end, lcd_scroll_top);
+        lcd_queue_fill(colour, x, y, x_end, rows_end - 1);
+        y = rows_end;
+    }
+
+    if (y < y_end && y < scroll_end)
+    {
+        uint16_t rows = MIN(y_end, scroll_end) - y;
+        uint16_t y_virtual = (lcd_y_offset + y - lcd_scroll_top) % lcd_memory_scroll_height;
         uint16_t rows_to_wrap = lcd_memory_scroll_height - y_virtual;
-        uint16_t first_rows = (height <= rows_to_wrap) ? height : rows_to_wrap;
+        uint16_t first_rows = (rows <= rows_to_wrap) ? rows : rows_to_wrap;
 
-        lcd_set_window(x, lcd_scroll_top + y_virtual, x + width - 1,
+        lcd_queue_fill(colour, x, lcd_scroll_top + y_virtual, x_end,
                        lcd_scroll_top + y_virtual + first_rows - 1);
-        lcd_send_pixels(colour, (uint32_t)width * first_rows);
 
-        if (height > rows_to_wrap)
+        if (rows > rows_to_wrap)
         {
             // Rectangle crosses the frame memory wrap boundary — write the remainder
             // from the start of the scroll area
-            uint16_t remaining = height - rows_to_wrap;
-            lcd_set_window(x, lcd_scroll_top, x + width - 1, lcd_scroll_top + remaining - 1);
-            lcd_send_pixels(colour, (uint32_t)width * remaining);
+            lcd_queue_fill(colour, x, lcd_scroll_top, x_end, lcd_scroll_top + rows - first_rows - 1);
         }
+        y += rows;
     }
-    else
+
+    if (y < y_end)
     {
-        lcd_set_window(x, y, x + width - 1, y + height - 1);
-        lcd_send_pixels(colour, (uint32_t)width * height);
+        lcd_queue_fill(colour, x, y, x_end, y_end - 1);
     }
+}
 
-    lcd_enable_interrupts();
+// Draw a solid rectangle on the display
+//
+// The fill is queued and sent by DMA, this function returns without waiting for it.
+void lcd_solid_rectangle(uint16_t colour, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+    critical_section_enter_blocking(&lcd_lock);
+    lcd_queue_rectangle(colour, x, y, width, height);
+    critical_section_exit(&lcd_lock);
+}
+
+// Draw a list of solid rectangles on the display as a single queued job
+void lcd_fill_rects(const lcd_rect_t *rects, size_t count)
+{
+    critical_section_enter_blocking(&lcd_lock);
+    for (size_t i = 0; i < count; i++)
+    {
+        lcd_queue_rectangle(rects[i].colour, rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+    }
+    critical_section_exit(&lcd_lock);
 }
 
 // Draw a circle outline using the Midpoint (Bresenham) circle algorithm
@@ -388,9 +805,16 @@ void lcd_fill_circle(uint16_t colour, uint16_t cx, uint16_t cy, uint16_t radius)
 //  This forum post provides a good explanation of how scrolling on the ST7789P display works:
 //      https://forum.arduino.cc/t/st7735s-scrolling/564506
 //
-//  These functions (lcd_define_scrolling, lcd_scroll_up, and lcd_scroll_down) configure and
-//  set the vertical scrolling area of the display, but it is the responsibility of lcd_blit()
-//  to ensure that the pixel data is written to the correct location in the display RAM.
+//  These functions (lcd_define_scrolling, lcd_scroll_lines, lcd_scroll_up, and lcd_scroll_down)
+//  configure and set the vertical scrolling area of the display, but it is the responsibility
+//  of lcd_blit() to ensure that the pixel data is written to the correct location in the
+//  display RAM. Rows in the scrolling area are offset from the top of the area.
+//
+//  The frame memory has FRAME_HEIGHT rows but the panel only shows the first HEIGHT of
+//  them. Without a bottom fixed area the scrolling area takes the rest of the frame memory,
+//  so the rows that scroll off the top stay there for the scrollback. A bottom fixed area
+//  has to stay on the panel, so the scrolling area then ends where the fixed area starts
+//  and the rows below the panel are given to the bottom fixed area.
 //
 
 void lcd_define_scrolling(uint16_t top_fixed_area, uint16_t bottom_fixed_area)
@@ -405,18 +829,21 @@ void lcd_define_scrolling(uint16_t top_fixed_area, uint16_t bottom_fixed_area)
     }
     
     lcd_scroll_top = top_fixed_area;
-    lcd_memory_scroll_height = FRAME_HEIGHT - (top_fixed_area + bottom_fixed_area);
+    lcd_memory_scroll_height = bottom_fixed_area ? scroll_area : FRAME_HEIGHT - top_fixed_area;
     lcd_scroll_bottom = bottom_fixed_area;
 
+    // The three areas add up to the frame memory height
+    uint16_t memory_bottom = FRAME_HEIGHT - (lcd_scroll_top + lcd_memory_scroll_height);
+
     lcd_disable_interrupts();
     lcd_write_cmd(LCD_CMD_VSCRDEF);
     lcd_write_data(6,
                    UPPER8(lcd_scroll_top),
                    LOWER8(lcd_scroll_top),
-                   UPPER8(scroll_area),
-                   LOWER8(scroll_area),
-                   UPPER8(lcd_scroll_bottom),
-                   LOWER8(lcd_scroll_bottom));
+                   UPPER8(lcd_memory_scroll_height),
+                   LOWER8(lcd_memory_scroll_height),
+                   UPPER8(memory_bottom),
+                   LOWER8(memory_bottom));
     lcd_enable_interrupts();
 
     lcd_scroll_reset(); // Reset the scroll area to the top
@@ -438,19 +865,38 @@ void lcd_scroll_clear()
 {
     lcd_scroll_reset(); // Reset the scroll area to the top
 
-    // Clear the scrolling area
-    lcd_solid_rectangle(background, 0, lcd_scroll_top, WIDTH, lcd_memory_scroll_height);
+    // Clear the whole ring, including the rows that are not on the panel
+    critical_section_enter_blocking(&lcd_lock);
+    lcd_queue_fill(background, 0, lcd_scroll_top, WIDTH - 1, lcd_scroll_top + lcd_memory_scroll_height - 1);
+    critical_section_exit(&lcd_lock);
 }
 
-// Scroll the screen up one line (make space at the bottom)
-void lcd_scroll_up()
+// Scroll the scrolling area by a number of lines in one go
+//
+// Positive lines scroll up (making space at the bottom), negative lines scroll down (making
+// space at the top). The scroll offset is moved once and the exposed band is cleared with
+// a single fill, however many lines are scrolled.
+void lcd_scroll_lines(int16_t lines)
 {
     // Ensure the scroll height is non-zero to avoid division by zero
-    if (lcd_memory_scroll_height == 0) {
-        return; // Exit early if the scroll height is invalid
+    if (lcd_memory_scroll_height == 0 || lines == 0)
+    {
+        return;
+    }
+
+    // Scrolling further than the visible scrolling area just clears it
+    uint16_t visible_height = HEIGHT - (lcd_scroll_top + lcd_scroll_bottom);
+    uint16_t pixels = MIN(abs(lines) * GLYPH_HEIGHT, visible_height);
+
+    // This will rotate the content in the scroll area up or down
+    if (lines > 0)
+    {
+        lcd_y_offset = (lcd_y_offset + pixels) % lcd_memory_scroll_height;
+    }
+    else
+    {
+        lcd_y_offset = (lcd_y_offset + lcd_memory_scroll_height - pixels) % lcd_memory_scroll_height;
     }
-    // This will rotate the content in the scroll area up by one line
-    lcd_y_offset = (lcd_y_offset + GLYPH_HEIGHT) % lcd_memory_scroll_height;
     uint16_t scroll_area_start = lcd_scroll_top + lcd_y_offset;
 
     lcd_disable_interrupts();
@@ -458,28 +904,52 @@ void lcd_scroll_up()
     lcd_write_data(2, UPPER8(scroll_area_start), LOWER8(scroll_area_start));
     lcd_enable_interrupts();
 
-    // Clear the new line at the bottom
-    lcd_solid_rectangle(background, 0, HEIGHT - GLYPH_HEIGHT, WIDTH, GLYPH_HEIGHT);
+    // Clear the new lines at the bottom or the top
+    if (lines > 0)
+    {
+        lcd_solid_rectangle(background, 0, HEIGHT - lcd_scroll_bottom - pixels, WIDTH, pixels);
+    }
+    else
+    {
+        lcd_solid_rectangle(background, 0, lcd_scroll_top, WIDTH, pixels);
+    }
+}
+
+// Offset of the scrolling area in the frame memory, in pixel rows
+uint16_t lcd_get_scroll_offset()
+{
+    return lcd_y_offset;
 }
 
-// Scroll the screen down one line (making space at the top)
-void lcd_scroll_down()
+// Show another part of the frame memory in the scrolling area, nothing is cleared
+//
+// Drawing follows the offset, so rows drawn afterwards land where they are shown.
+void lcd_set_scroll_offset(uint16_t offset)
 {
-    // Ensure lcd_memory_scroll_height is non-zero to avoid division by zero
-    if (lcd_memory_scroll_height == 0) {
-        return; // Safely exit if the scroll height is zero
+    if (lcd_memory_scroll_height == 0)
+    {
+        return;
     }
-    // This will rotate the content in the scroll area down by one line
-    lcd_y_offset = (lcd_y_offset - GLYPH_HEIGHT + lcd_memory_scroll_height) % lcd_memory_scroll_height;
+
+    lcd_y_offset = offset % lcd_memory_scroll_height;
     uint16_t scroll_area_start = lcd_scroll_top + lcd_y_offset;
 
     lcd_disable_interrupts();
     lcd_write_cmd(LCD_CMD_VSCSAD); // Sets where in display RAM the scroll area starts
     lcd_write_data(2, UPPER8(scroll_area_start), LOWER8(scroll_area_start));
     lcd_enable_interrupts();
+}
 
-    // Clear the new line at the top
-    lcd_solid_rectangle(background, 0, lcd_scroll_top, WIDTH, GLYPH_HEIGHT);
+// Scroll the screen up one line (make space at the bottom)
+void lcd_scroll_up()
+{
+    lcd_scroll_lines(1);
+}
+
+// Scroll the screen down one line (making space at the top)
+void lcd_scroll_down()
+{
+    lcd_scroll_lines(-1);
 }
 
 //
@@ -490,7 +960,11 @@ void lcd_scroll_down()
 void lcd_clear_screen()
 {
     lcd_scroll_reset(); // Reset the scrolling area to the top
-    lcd_solid_rectangle(background, 0, 0, WIDTH, FRAME_HEIGHT);
+
+    // Clear the whole frame memory, including the rows that are not on the panel
+    critical_section_enter_blocking(&lcd_lock);
+    lcd_queue_fill(background, 0, 0, WIDTH - 1, FRAME_HEIGHT - 1);
+    critical_section_exit(&lcd_lock);
 }
 
 void lcd_erase_line(uint8_t row, uint8_t col_start, uint8_t col_end)
@@ -498,144 +972,307 @@ void lcd_erase_line(uint8_t row, uint8_t col_start, uint8_t col_end)
     lcd_solid_rectangle(background, col_start * font->width, row * GLYPH_HEIGHT, (col_end - col_start + 1) * font->width, GLYPH_HEIGHT);
 }
 
-// Draw a character at the specified position
-void lcd_putc(uint8_t column, uint8_t row, uint8_t c)
+// Pixel pairs for each 2-bit glyph pattern, built for one foreground/background pair
+//
+// Glyphs are expanded two pixels at a time with 32-bit stores. The table is only
+// rebuilt when the colours change, which is rare while text is being printed.
+typedef uint32_t __attribute__((__may_alias__)) lcd_pixel_pair_t;
+
+static lcd_pixel_pair_t glyph_lut[4] = { 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF }; // built for white on white
+static uint16_t glyph_lut_fg = 0xFFFF;  // colours glyph_lut was built for
+static uint16_t glyph_lut_bg = 0xFFFF;
+
+static inline void lcd_glyph_lut(uint16_t fg, uint16_t bg)
+{
+    if (fg == glyph_lut_fg && bg == glyph_lut_bg)
+    {
+        return;
+    }
+
+    // The left pixel is the higher bit and the lower address (little-endian)
+    glyph_lut[0] = bg | (uint32_t)bg << 16;
+    glyph_lut[1] = bg | (uint32_t)fg << 16;
+    glyph_lut[2] = fg | (uint32_t)bg << 16;
+    glyph_lut[3] = fg | (uint32_t)fg << 16;
+    glyph_lut_fg = fg;
+    glyph_lut_bg = bg;
+}
+
+// Expand one row of an 8-pixel wide glyph (the buffer must be 32-bit aligned)
+static inline void lcd_expand_row8(uint16_t *buffer, uint8_t bits)
+{
+    lcd_pixel_pair_t *pairs = (lcd_pixel_pair_t *)buffer;
+    pairs[0] = glyph_lut[bits >> 6];
+    pairs[1] = glyph_lut[(bits >> 4) & 3];
+    pairs[2] = glyph_lut[(bits >> 2) & 3];
+    pairs[3] = glyph_lut[bits & 3];
+}
+
+// Expand one row of a 5-pixel wide glyph, which may start on an odd pixel
+static inline void lcd_expand_row5(uint16_t *buffer, uint8_t bits, uint16_t fg, uint16_t bg)
+{
+    if ((uintptr_t)buffer & 2)
+    {
+        buffer[0] = (bits & 0x10) ? fg : bg;
+        *(lcd_pixel_pair_t *)(buffer + 1) = glyph_lut[(bits >> 2) & 3];
+        *(lcd_pixel_pair_t *)(buffer + 3) = glyph_lut[bits & 3];
+    }
+    else
+    {
+        *(lcd_pixel_pair_t *)(buffer + 0) = glyph_lut[(bits >> 3) & 3];
+        *(lcd_pixel_pair_t *)(buffer + 2) = glyph_lut[(bits >> 1) & 3];
+        buffer[4] = (bits & 0x01) ? fg : bg;
+    }
+}
+
+// Render a glyph into a pixel buffer with the given colours and attributes
+//
+// The glyph is drawn font->width pixels wide and GLYPH_HEIGHT pixels high, stride is the
+// number of pixels from the start of one row of the buffer to the next. Bold and underscore
+// are applied to each glyph row as a mask before it is expanded into pixels.
+static void lcd_render_glyph(uint16_t *buffer, uint16_t stride, uint8_t c,
+                             uint16_t fg, uint16_t bg, uint8_t attrs)
 {
     const uint8_t *glyph = &font->glyphs[c * GLYPH_HEIGHT];
-    uint16_t *buffer = char_buffer;
+    uint8_t last_row = (attrs & LCD_ATTR_UNDERSCORE) ? 0xFF : glyph[GLYPH_HEIGHT - 1];
+
+    lcd_glyph_lut(fg, bg);
 
     if (font->width == 8)
     {
-        for (uint8_t i = 0; i < GLYPH_HEIGHT; i++, glyph++)
+        // Bold smears each pixel one to the right; shifting by 8 clears the smear
+        uint8_t bold_shift = (attrs & LCD_ATTR_BOLD) ? 1 : 8;
+
+        for (uint8_t i = 0; i < GLYPH_HEIGHT - 1; i++, buffer += stride)
         {
-            if (i < GLYPH_HEIGHT - 1)
-            {
-                // Fill the row with the glyph data
-                *(buffer++) = (*glyph & 0x80) ? foreground : background;
-                *(buffer++) = (*glyph & 0x40) || (bold && (*glyph & 0x80)) ? foreground : background;
-                *(buffer++) = (*glyph & 0x20) || (bold && (*glyph & 0x40)) ? foreground : background;
-                *(buffer++) = (*glyph & 0x10) || (bold && (*glyph & 0x20)) ? foreground : background;
-                *(buffer++) = (*glyph & 0x08) || (bold && (*glyph & 0x10)) ? foreground : background;
-                *(buffer++) = (*glyph & 0x04) || (bold && (*glyph & 0x08)) ? foreground : background;
-                *(buffer++) = (*glyph & 0x02) || (bold && (*glyph & 0x04)) ? foreground : background;
-                *(buffer++) = (*glyph & 0x01) || (bold && (*glyph & 0x02)) ? foreground : background;
-            }
-            else
-            {
-                // The last row is where the underscore is drawn, but if no underscore is set, fill with glyph data
-                *(buffer++) = (*glyph & 0x80) || underscore ? foreground : background;
-                *(buffer++) = (*glyph & 0x40) || underscore ? foreground : background;
-                *(buffer++) = (*glyph & 0x20) || underscore ? foreground : background;
-                *(buffer++) = (*glyph & 0x10) || underscore ? foreground : background;
-                *(buffer++) = (*glyph & 0x08) || underscore ? foreground : background;
-                *(buffer++) = (*glyph & 0x04) || underscore ? foreground : background;
-                *(buffer++) = (*glyph & 0x02) || underscore ? foreground : background;
-                *(buffer++) = (*glyph & 0x01) || underscore ? foreground : background;
-            }
+            uint8_t bits = glyph[i];
+            lcd_expand_row8(buffer, bits | (uint8_t)(bits >> bold_shift));
         }
+        lcd_expand_row8(buffer, last_row); // the underscore is drawn on the last row
     }
     else
     {
-        for (uint8_t i = 0; i < GLYPH_HEIGHT; i++, glyph++)
+        // The 5-pixel font is too narrow for bold
+        for (uint8_t i = 0; i < GLYPH_HEIGHT - 1; i++, buffer += stride)
         {
-            if (i < GLYPH_HEIGHT - 1)
-            {
-                // Fill the row with the glyph data
-                *(buffer++) = (*glyph & 0x10) ? foreground : background;
-                *(buffer++) = (*glyph & 0x08) ? foreground : background;
-                *(buffer++) = (*glyph & 0x04) ? foreground : background;
-                *(buffer++) = (*glyph & 0x02) ? foreground : background;
-                *(buffer++) = (*glyph & 0x01) ? foreground : background;
-            }
-            else
-            {
-                // The last row is where the underscore is drawn, but if no underscore is set, fill with glyph data
-                *(buffer++) = (*glyph & 0x10) || underscore ? foreground : background;
-                *(buffer++) = (*glyph & 0x08) || underscore ? foreground : background;
-                *(buffer++) = (*glyph & 0x04) || underscore ? foreground : background;
-                *(buffer++) = (*glyph & 0x02) || underscore ? foreground : background;
-                *(buffer++) = (*glyph & 0x01) || underscore ? foreground : background;
-            }
+            lcd_expand_row5(buffer, glyph[i], fg, bg);
         }
+        lcd_expand_row5(buffer, last_row, fg, bg); // the underscore is drawn on the last row
+    }
+}
+
+//
+// Glyph cache functions
+//
+
+// Empty the glyph cache
+static void lcd_glyph_cache_reset()
+{
+#if LCD_GLYPH_CACHE_ENTRIES
+    for (uint16_t i = 0; i < LCD_GLYPH_CACHE_ENTRIES; i++)
+    {
+        glyph_cache[i].valid = false;
+        glyph_cache[i].hash_next = GLYPH_CACHE_NONE;
+        glyph_cache[i].lru_prev = i == 0 ? GLYPH_CACHE_NONE : i - 1;
+        glyph_cache[i].lru_next = i == LCD_GLYPH_CACHE_ENTRIES - 1 ? GLYPH_CACHE_NONE : i + 1;
+        glyph_cache_buckets[i] = GLYPH_CACHE_NONE;
     }
+    glyph_cache_head = 0;
+    glyph_cache_tail = LCD_GLYPH_CACHE_ENTRIES - 1;
+#endif
+}
 
-    lcd_blit(char_buffer, column * font->width, row * GLYPH_HEIGHT, font->width, GLYPH_HEIGHT);
+#if LCD_GLYPH_CACHE_ENTRIES
+static inline uint16_t lcd_glyph_cache_hash(uint8_t c, uint16_t fg, uint16_t bg, uint8_t attrs)
+{
+    uint32_t hash = c ^ (attrs << 8) ^ (fg * 0x9E37u) ^ (bg * 0x79B9u);
+    return (hash ^ (hash >> 16)) & (LCD_GLYPH_CACHE_ENTRIES - 1);
 }
 
-// Draw a string at the specified position
-void lcd_putstr(uint8_t column, uint8_t row, const char *str)
+// Move an entry to the front of the LRU list
+static inline void lcd_glyph_cache_touch(uint16_t index)
 {
-    int len = strlen(str);
-    int pos = 0;
-    while (*str)
+    glyph_cache_entry_t *entry = &glyph_cache[index];
+    if (index == glyph_cache_head)
     {
-        uint16_t *buffer = line_buffer + (pos++ * font->width);
-        const uint8_t *glyph = &font->glyphs[*str++ * GLYPH_HEIGHT];
+        return;
+    }
 
-        if (font->width == 8)
-        {
-            for (uint8_t i = 0; i < GLYPH_HEIGHT; i++, glyph++)
-            {
-                if (i < GLYPH_HEIGHT - 1)
-                {
-                    // Fill the row with the glyph data
-                    *(buffer++) = (*glyph & 0x80) ? foreground : background;
-                    *(buffer++) = (*glyph & 0x40) || (bold && (*glyph & 0x80)) ? foreground : background;
-                    *(buffer++) = (*glyph & 0x20) || (bold && (*glyph & 0x40)) ? foreground : background;
-                    *(buffer++) = (*glyph & 0x10) || (bold && (*glyph & 0x20)) ? foreground : background;
-                    *(buffer++) = (*glyph & 0x08) || (bold && (*glyph & 0x10)) ? foreground : background;
-                    *(buffer++) = (*glyph & 0x04) || (bold && (*glyph & 0x08)) ? foreground : background;
-                    *(buffer++) = (*glyph & 0x02) || (bold && (*glyph & 0x04)) ? foreground : background;
-                    *(buffer++) = (*glyph & 0x01) || (bold && (*glyph & 0x02)) ? foreground : background;
-                }
-                else
-                {
-                    // The last row is where the underscore is drawn, but if no underscore is set, fill with glyph data
-                    *(buffer++) = (*glyph & 0x80) || underscore ? foreground : background;
-                    *(buffer++) = (*glyph & 0x40) || underscore ? foreground : background;
-                    *(buffer++) = (*glyph & 0x20) || underscore ? foreground : background;
-                    *(buffer++) = (*glyph & 0x10) || underscore ? foreground : background;
-                    *(buffer++) = (*glyph & 0x08) || underscore ? foreground : background;
-                    *(buffer++) = (*glyph & 0x04) || underscore ? foreground : background;
-                    *(buffer++) = (*glyph & 0x02) || underscore ? foreground : background;
-                    *(buffer++) = (*glyph & 0x01) || underscore ? foreground : background;
-                }
-                buffer += (len - 1) * font->width;
-            }
-        }
-        else
+    // Unlink (the entry is not the head, so it has a previous entry)
+    glyph_cache[entry->lru_prev].lru_next = entry->lru_next;
+    if (entry->lru_next != GLYPH_CACHE_NONE)
+    {
+        glyph_cache[entry->lru_next].lru_prev = entry->lru_prev;
+    }
+    else
+    {
+        glyph_cache_tail = entry->lru_prev;
+    }
+
+    // Push on the front
+    entry->lru_prev = GLYPH_CACHE_NONE;
+    entry->lru_next = glyph_cache_head;
+    glyph_cache[glyph_cache_head].lru_prev = index;
+    glyph_cache_head = index;
+}
+
+// Remove an entry from its hash bucket
+static void lcd_glyph_cache_unhash(uint16_t index)
+{
+    glyph_cache_entry_t *entry = &glyph_cache[index];
+    uint16_t *link = &glyph_cache_buckets[lcd_glyph_cache_hash(entry->glyph, entry->foreground,
+                                                               entry->background, entry->attrs)];
+    while (*link != index)
+    {
+        link = &glyph_cache[*link].hash_next;
+    }
+    *link = entry->hash_next;
+}
+
+// Find a rendered cell, rendering it into the least recently used entry if it is not cached
+static const uint16_t *lcd_glyph_cache_lookup(uint8_t c, uint16_t fg, uint16_t bg, uint8_t attrs)
+{
+    uint16_t bucket = lcd_glyph_cache_hash(c, fg, bg, attrs);
+
+    for (uint16_t index = glyph_cache_buckets[bucket]; index != GLYPH_CACHE_NONE; index = glyph_cache[index].hash_next)
+    {
+        glyph_cache_entry_t *entry = &glyph_cache[index];
+        if (entry->glyph == c && entry->attrs == attrs && entry->foreground == fg && entry->background == bg)
         {
-            for (uint8_t i = 0; i < GLYPH_HEIGHT; i++, glyph++)
-            {
-                if (i < GLYPH_HEIGHT - 1)
-                {
-                    // Fill the row with the glyph data
-                    *(buffer++) = (*glyph & 0x10) ? foreground : background;
-                    *(buffer++) = (*glyph & 0x08) ? foreground : background;
-                    *(buffer++) = (*glyph & 0x04) ? foreground : background;
-                    *(buffer++) = (*glyph & 0x02) ? foreground : background;
-                    *(buffer++) = (*glyph & 0x01) ? foreground : background;
-                }
-                else
-                {
-                    // The last row is where the underscore is drawn, but if no underscore is set, fill with glyph data
-                    *(buffer++) = (*glyph & 0x10) || underscore ? foreground : background;
-                    *(buffer++) = (*glyph & 0x08) || underscore ? foreground : background;
-                    *(buffer++) = (*glyph & 0x04) || underscore ? foreground : background;
-                    *(buffer++) = (*glyph & 0x02) || underscore ? foreground : background;
-                    *(buffer++) = (*glyph & 0x01) || underscore ? foreground : background;
-                }
-                buffer += (len - 1) * font->width;
-            }
+            glyph_cache_stats.hits++;
+            lcd_glyph_cache_touch(index);
+            return entry->pixels;
         }
     }
 
+    // Replace the least recently used entry
+    uint16_t index = glyph_cache_tail;
+    glyph_cache_entry_t *entry = &glyph_cache[index];
+    if (entry->valid)
+    {
+        lcd_glyph_cache_unhash(index);
+    }
+    if (entry->pixels == glyph_cache_sent)
+    {
+        lcd_wait_idle(); // the DMA may still be reading the old cell
+        glyph_cache_sent = NULL;
+    }
+
+    lcd_render_glyph(entry->pixels, font->width, c, fg, bg, attrs);
+    entry->glyph = c;
+    entry->attrs = attrs;
+    entry->foreground = fg;
+    entry->background = bg;
+    entry->valid = true;
+    entry->hash_next = glyph_cache_buckets[bucket];
+    glyph_cache_buckets[bucket] = index;
+    lcd_glyph_cache_touch(index);
+
+    glyph_cache_stats.misses++;
+    return entry->pixels;
+}
+#endif
+
+// Draw a cell into a line of pixels, from the glyph cache if possible
+static void lcd_render_cell(uint16_t *buffer, uint16_t stride, uint8_t c,
+                            uint16_t fg, uint16_t bg, uint8_t attrs)
+{
+#if LCD_GLYPH_CACHE_ENTRIES
+    const uint16_t *pixels = lcd_glyph_cache_lookup(c, fg, bg, attrs);
+    size_t row_size = font->width * sizeof(uint16_t);
+    for (uint8_t i = 0; i < GLYPH_HEIGHT; i++, buffer += stride, pixels += font->width)
+    {
+        memcpy(buffer, pixels, row_size);
+    }
+#else
+    lcd_render_glyph(buffer, stride, c, fg, bg, attrs);
+#endif
+}
+
+// Get the glyph cache hit and miss counters, optionally resetting them
+void lcd_get_glyph_cache_stats(lcd_glyph_cache_stats_t *stats, bool reset)
+{
+    *stats = glyph_cache_stats;
+    if (reset)
+    {
+        glyph_cache_stats.hits = 0;
+        glyph_cache_stats.misses = 0;
+    }
+}
+
+// The current text attributes as LCD_ATTR_* flags
+static uint8_t lcd_attributes(void)
+{
+    return (bold ? LCD_ATTR_BOLD : 0) | (underscore ? LCD_ATTR_UNDERSCORE : 0);
+}
+
+// Make a character cell for a glyph using the current colours and attributes
+lcd_cell_t lcd_make_cell(uint8_t c)
+{
+    lcd_cell_t cell = {
+        .glyph = c,
+        .attrs = lcd_attributes(),
+        .foreground = foreground,
+        .background = background,
+    };
+    return cell;
+}
+
+// Draw a character at the specified position
+void lcd_putc(uint8_t column, uint8_t row, uint8_t c)
+{
+#if LCD_GLYPH_CACHE_ENTRIES
+    // Cached cells are sent straight from the cache
+    const uint16_t *pixels = lcd_glyph_cache_lookup(c, foreground, background, lcd_attributes());
+    glyph_cache_sent = pixels;
+#else
+    uint16_t *pixels = char_buffer[char_buffer_index];
+    char_buffer_index ^= 1;
+
+    lcd_render_glyph(pixels, font->width, c, foreground, background, lcd_attributes());
+#endif
+    lcd_blit(pixels, column * font->width, row * GLYPH_HEIGHT, font->width, GLYPH_HEIGHT);
+}
+
+// Draw a string at the specified position
+void lcd_putstr(uint8_t column, uint8_t row, const char *str)
+{
+    int len = strlen(str);
+    uint16_t *pixels = line_buffer[line_buffer_index];
+    line_buffer_index ^= 1;
+
+    uint8_t attrs = lcd_attributes();
+    for (int pos = 0; pos < len; pos++)
+    {
+        lcd_render_cell(pixels + pos * font->width, len * font->width, (uint8_t)str[pos],
+                        foreground, background, attrs);
+    }
+
     if (len)
     {
-        lcd_blit(line_buffer, column * font->width, row * GLYPH_HEIGHT, font->width * len, GLYPH_HEIGHT);
+        lcd_blit(pixels, column * font->width, row * GLYPH_HEIGHT, font->width * len, GLYPH_HEIGHT);
     }
 }
 
+// Draw a run of character cells, each with its own colours and attributes
+void lcd_putcells(uint8_t column, uint8_t row, const lcd_cell_t *cells, uint8_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    uint16_t *pixels = line_buffer[line_buffer_index];
+    line_buffer_index ^= 1;
+
+    for (uint8_t pos = 0; pos < count; pos++, cells++)
+    {
+        lcd_render_cell(pixels + pos * font->width, count * font->width, cells->glyph,
+                        cells->foreground, cells->background, cells->attrs);
+    }
+
+    lcd_blit(pixels, column * font->width, row * GLYPH_HEIGHT, font->width * count, GLYPH_HEIGHT);
+}
 
 //
 // The cursor
@@ -739,13 +1376,13 @@ void lcd_display_off()
 //
 
 // Blink the cursor at regular intervals
-bool on_cursor_timer(repeating_timer_t *rt)
+static uint32_t on_cursor_task(void)
 {
     static bool cursor_visible = false;
 
     if (!lcd_cursor_enabled())
     {
-        return true; // if the SPI bus is not available or cursor is disabled, do not toggle cursor
+        return 500; // if the SPI bus is not available or cursor is disabled, do not toggle cursor
     }
 
     if (cursor_visible)
@@ -758,15 +1395,93 @@ bool on_cursor_timer(repeating_timer_t *rt)
     }
 
     cursor_visible = !cursor_visible; // Toggle cursor visibility
-    return true;                      // Keep the timer running
+    return 500;                       // Run again in 500 ms
 }
 
-// Initialize the LCD display
-void lcd_init()
+//
+//  Start up
+//
+//  The controller needs long pauses after a reset: 5 ms before the next command and
+//  120 ms before it can leave sleep mode, then 5 ms more after that. lcd_init_start()
+//  resets it and an alarm runs the rest of the sequence, so the other drivers can
+//  start in the meantime. Frame memory can be written while the controller sleeps,
+//  so the screen is cleared during the long pause. lcd_init() waits for the end.
+//
+
+typedef enum
+{
+    LCD_STEP_SWRESET,   // 5 ms after the reset pulse
+    LCD_STEP_CONFIGURE, // 5 ms after the software reset
+    LCD_STEP_SLEEP_OUT, // 120 ms after the software reset
+    LCD_STEP_DISPLAY_ON,// 5 ms after leaving sleep mode
+} lcd_init_step_t;
+
+static bool lcd_started = false;              // lcd_init_start() has run
+static lcd_init_step_t lcd_init_step;         // next step of the start up sequence
+static absolute_time_t lcd_sleep_out_time;    // earliest time sleep mode can end
+
+static int64_t on_lcd_init_alarm(alarm_id_t id, void *user_data)
+{
+    lcd_disable_interrupts();
+    switch (lcd_init_step++)
+    {
+    case LCD_STEP_SWRESET:
+        lcd_write_cmd(LCD_CMD_SWRESET); // reset the commands and parameters to their S/W Reset default values
+        lcd_sleep_out_time = make_timeout_time_ms(120);
+        lcd_enable_interrupts();
+        return -10000; // required to wait at least 5ms
+
+    case LCD_STEP_CONFIGURE:
+        lcd_write_cmd(LCD_CMD_COLMOD); // pixel format set
+        lcd_write_data(1, 0x55);       // 16 bit/pixel (RGB565)
+
+        lcd_write_cmd(LCD_CMD_MADCTL); // memory access control
+        lcd_write_data(1, 0x48);       // BGR colour filter panel, top to bottom, left to right
+
+        lcd_write_cmd(LCD_CMD_INVON); // display inversion on
+
+        lcd_write_cmd(LCD_CMD_EMS); // entry mode set
+        lcd_write_data(1, 0xC6);    // normal display, 16-bit (RGB) to 18-bit (rgb) colour
+                                    //   conversion: r(0) = b(0) = G(0)
+
+        lcd_write_cmd(LCD_CMD_VSCRDEF); // vertical scroll definition
+        lcd_write_data(6,
+                       0x00, 0x00, // top fixed area of 0 pixels
+                       0x01, 0xE0, // scroll area height of 480 pixels, the whole frame memory
+                       0x00, 0x00  // bottom fixed area of 0 pixels
+        );
+        lcd_enable_interrupts();
+
+        // Clear the display RAM garbage while the controller sleeps
+        lcd_clear_screen();
+        return -MAX(absolute_time_diff_us(get_absolute_time(), lcd_sleep_out_time), 1);
+
+    case LCD_STEP_SLEEP_OUT:
+        lcd_write_cmd(LCD_CMD_SLPOUT); // sleep out
+        lcd_enable_interrupts();
+        return -10000; // required to wait at least 5ms
+
+    case LCD_STEP_DISPLAY_ON:
+    default:
+        // Now that the display is initialized, display RAM garbage is cleared,
+        // turn on the display
+        lcd_write_cmd(LCD_CMD_DISPON);
+        lcd_enable_interrupts();
+
+        // Blink the cursor every second (500 ms on, 500 ms off)
+        power_task_start(&cursor_task, on_cursor_task, 500);
+
+        lcd_initialised = true; // Set the initialised flag
+        return 0;
+    }
+}
+
+// Reset the LCD display and start initialising it in the background
+void lcd_init_start()
 {
-    if (lcd_initialised)
+    if (lcd_started)
     {
-        return; // already initialized
+        return; // already started
     }
 
     // initialise GPIO
@@ -792,46 +1507,28 @@ void lcd_init()
     gpio_put(LCD_CSX, 1);
     gpio_put(LCD_RST, 1);
 
-    lcd_disable_interrupts();
-
-    lcd_reset(); // reset the LCD controller
-
-    lcd_write_cmd(LCD_CMD_SWRESET); // reset the commands and parameters to their S/W Reset default values
-    busy_wait_us(10000);                   // required to wait at least 5ms
-
-    lcd_write_cmd(LCD_CMD_COLMOD); // pixel format set
-    lcd_write_data(1, 0x55);       // 16 bit/pixel (RGB565)
-
-    lcd_write_cmd(LCD_CMD_MADCTL); // memory access control
-    lcd_write_data(1, 0x48);       // BGR colour filter panel, top to bottom, left to right
-
-    lcd_write_cmd(LCD_CMD_INVON); // display inversion on
-
-    lcd_write_cmd(LCD_CMD_EMS); // entry mode set
-    lcd_write_data(1, 0xC6);    // normal display, 16-bit (RGB) to 18-bit (rgb) colour
-                                //   conversion: r(0) = b(0) = G(0)
-
-    lcd_write_cmd(LCD_CMD_VSCRDEF); // vertical scroll definition
-    lcd_write_data(6,
-                   0x00, 0x00, // top fixed area of 0 pixels
-                   0x01, 0x40, // scroll area height of 320 pixels
-                   0x00, 0x00  // bottom fixed area of 0 pixels
-    );
-
-    lcd_write_cmd(LCD_CMD_SLPOUT); // sleep out
-    lcd_enable_interrupts();
+    critical_section_init(&lcd_lock);
 
-    busy_wait_us(10000);                  // required to wait at least 5ms
+    // Pixel data is sent using DMA
+    lcd_dma_init();
+    lcd_glyph_cache_reset();
 
-    // Clear the screen
-    lcd_clear_screen();
-
-    // Now that the display is initialized, display RAM garbage is cleared,
-    // turn on the display
-    lcd_display_on();
+    // Blip the reset pin to reset the LCD controller
+    gpio_put(LCD_RST, 0);
+    busy_wait_us(20); // 20µs reset pulse (10µs minimum)
+    gpio_put(LCD_RST, 1);
 
-    // Blink the cursor every second (500 ms on, 500 ms off)
-    add_repeating_timer_ms(-500, on_cursor_timer, NULL, &cursor_timer);
+    lcd_started = true;
+    lcd_init_step = LCD_STEP_SWRESET;
+    add_alarm_in_ms(5, on_lcd_init_alarm, NULL, true); // 5ms required after reset
+}
 
-    lcd_initialised = true; // Set the initialised flag
-}
\ No newline at end of file
+// Initialize the LCD display, waiting for the start up sequence to finish
+void lcd_init()
+{
+    lcd_init_start();
+    while (!lcd_initialised)
+    {
+        power_wait();
+    }
+}
@@ -18,7 +18,10 @@
 // According to the ST7789P datasheet, the maximum SPI clock speed is 62.5 MHz.
 // However, the controller can handle 75 MHz in practice.
 #define LCD_BAUDRATE    (75000000)      // 75 MHz SPI clock speed
+#define LCD_CS_HIGH_CYCLES (16)        // chip select high time, at least 40ns at up to 400 MHz
 #define LCD_I2C_TIMEOUT_US (1000)       // I2C timeout in microseconds
+#define LCD_FILL_QUEUE_SIZE (16)        // solid fills that can be queued for DMA (power of 2)
+#define LCD_GLYPH_CACHE_ENTRIES (128)   // rendered cells kept in RAM (power of 2, 0 = no cache)
 
 // LCD command definitions
 #define LCD_CMD_NOP     (0x00)          // no operation
@@ -70,11 +73,43 @@
 #define UPPER8(x)       ((x) >> 8)      // upper byte of a 16-bit value
 #define LOWER8(x)       ((x) & 0xFF)    // lower byte of a 16-bit value
 
+// A solid rectangle for lcd_fill_rects()
+typedef struct
+{
+    uint16_t colour;                    // RGB565 fill colour
+    uint16_t x, y;                      // top left corner in pixels
+    uint16_t width, height;             // size in pixels
+} lcd_rect_t;
+
+// Character cell attributes
+#define LCD_ATTR_BOLD       (0x01)      // bold text
+#define LCD_ATTR_UNDERSCORE (0x02)      // underscored text
+
+// A character cell for lcd_putcells()
+typedef struct
+{
+    uint8_t glyph;                      // glyph to draw (font offset)
+    uint8_t attrs;                      // LCD_ATTR_* flags
+    uint16_t foreground;                // RGB565 foreground colour
+    uint16_t background;                // RGB565 background colour
+} lcd_cell_t;
+
+// Glyph cache counters for lcd_get_glyph_cache_stats()
+typedef struct
+{
+    uint32_t hits;                      // cells drawn from the cache
+    uint32_t misses;                    // cells rendered from the font
+} lcd_glyph_cache_stats_t;
+
+// Called when a DMA transfer to the display completes (holding the LCD lock)
+typedef void (*lcd_dma_callback_t)(void);
+
 // Function prototypes
 
 // colour and display state functions
 void lcd_set_foreground(uint16_t colour);
 void lcd_set_background(uint16_t colour);
+uint16_t lcd_get_background(void);
 void lcd_set_reverse(bool reverse_on);
 void lcd_set_underscore(bool underscore_on);
 void lcd_set_bold(bool bold_on);
@@ -92,10 +127,14 @@ void lcd_write_cmd(uint8_t cmd);
 void lcd_write_data(uint8_t len, ...);
 void lcd_write16_data(uint8_t len, ...);
 void lcd_write16_buf(const uint16_t *buffer, size_t len);
+void lcd_wait_idle(void);
+void lcd_clock_changed(void);
+void lcd_set_dma_callback(lcd_dma_callback_t callback);
 
 // Display window and drawing functions
 void lcd_blit(const uint16_t *pixels, uint16_t x, uint16_t y, uint16_t width, uint16_t height);
 void lcd_solid_rectangle(uint16_t colour, uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+void lcd_fill_rects(const lcd_rect_t *rects, size_t count);
 void lcd_draw_circle(uint16_t colour, uint16_t cx, uint16_t cy, uint16_t radius);
 void lcd_fill_circle(uint16_t colour, uint16_t cx, uint16_t cy, uint16_t radius);
 
@@ -103,12 +142,18 @@ void lcd_fill_circle(uint16_t colour, uint16_t cx, uint16_t cy, uint16_t radius)
 void lcd_define_scrolling(uint16_t top_fixed_area, uint16_t bottom_fixed_area);
 void lcd_scroll_reset();
 void lcd_scroll_clear();
+void lcd_scroll_lines(int16_t lines);
+uint16_t lcd_get_scroll_offset(void);
+void lcd_set_scroll_offset(uint16_t offset);
 void lcd_scroll_up(void);
 void lcd_scroll_down(void);
 
 // Character and cursor functions
 void lcd_putc(uint8_t column, uint8_t row, uint8_t c);
 void lcd_putstr(uint8_t column, uint8_t row, const char *str);
+void lcd_putcells(uint8_t column, uint8_t row, const lcd_cell_t *cells, uint8_t count);
+lcd_cell_t lcd_make_cell(uint8_t c);
+void lcd_get_glyph_cache_stats(lcd_glyph_cache_stats_t *stats, bool reset);
 void lcd_move_cursor(uint8_t x, uint8_t y);
 void lcd_draw_cursor(void);
 void lcd_erase_cursor(void);
@@ -118,4 +163,7 @@ bool lcd_cursor_enabled(void);
 // Initialization
 void lcd_clear_screen(void);
 void lcd_erase_line(uint8_t row, uint8_t col_start, uint8_t col_end);
+void lcd_init_start(void);
 void lcd_init(void);
+
+extern const uint32_t lcd_static_bytes;
@@ -0,0 +1,197 @@
+//
+//  PicoCalc memory usage
+//
+//  Heap usage comes from newlib's mallinfo(). The stacks are painted with
+//  MEM_STACK_PAINT at start up, and the deepest each has been is the first
+//  word from the bottom that no longer holds the paint. The core 0 stack is
+//  painted up to just below the stack pointer at the time, so mem_init()
+//  should be the first thing main() calls, and the core 1 stack before
+//  core 1 is launched.
+//
+//  With MEM_TRACE_ALLOC, the linker wraps newlib's _malloc_r, _calloc_r and
+//  _realloc_r, which every allocation goes through, and the calls and bytes
+//  are counted by return address. Allocations made inside newlib (stdio
+//  buffers, FILE objects, number formatting) show the newlib function that
+//  made them; calls to malloc() from the firmware all show newlib's malloc().
+//  Look the addresses up with arm-none-eabi-addr2line -f.
+//
+
+#include <malloc.h>
+#include <reent.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "mem.h"
+
+// Linker script symbols
+extern char __StackBottom, __StackTop, __StackOneBottom, __StackOneTop;
+extern char __end__, __HeapLimit;
+
+//
+//  Stacks
+//
+
+static void paint(uint32_t *from, uint32_t *to)
+{
+    for (volatile uint32_t *p = from; p < to; p++)
+    {
+        *p = MEM_STACK_PAINT;
+    }
+}
+
+// Bytes of a stack written since it was painted
+static uint32_t stack_used(const uint32_t *bottom, const uint32_t *top)
+{
+    const uint32_t *p = bottom;
+    while (p < top && *p == MEM_STACK_PAINT)
+    {
+        p++;
+    }
+    return (uint32_t)(top - p) * sizeof(uint32_t);
+}
+
+void mem_get_stack_stats(uint core, mem_stack_stats_t *stats)
+{
+    const uint32_t *bottom = (const uint32_t *)(core == 0 ? &__StackBottom : &__StackOneBottom);
+    const uint32_t *top = (const uint32_t *)(core == 0 ? &__StackTop : &__StackOneTop);
+    stats->size = (uint32_t)(top - bottom) * sizeof(uint32_t);
+    stats->used = stack_used(bottom, top);
+}
+
+//
+//  Heap and static data
+//
+
+void mem_get_heap_stats(mem_heap_stats_t *stats)
+{
+    struct mallinfo info = mallinfo();
+    stats->size = (uint32_t)(&__HeapLimit - &__end__);
+    stats->arena = info.arena;
+    stats->in_use = info.uordblks;
+    stats->high_water = MAX(info.usmblks, info.arena);
+}
+
+// RAM taken before the heap: vectors, code copied to RAM, .data and .bss
+uint32_t mem_get_static_bytes()
+{
+    return (uint32_t)((uintptr_t)&__end__ - SRAM_BASE);
+}
+
+//
+//  Allocation tracer
+//
+
+#if MEM_TRACE_ALLOC
+
+static mem_alloc_site_t alloc_sites[MEM_TRACE_SITES];
+static mem_alloc_site_t alloc_other;        // sites after the table filled up
+static bool alloc_nested = false;           // calloc and realloc call malloc themselves
+
+static void alloc_record(uintptr_t caller, uint32_t bytes)
+{
+    uint32_t save = save_and_disable_interrupts();
+    mem_alloc_site_t *site = &alloc_other;
+    for (uint8_t i = 0; i < MEM_TRACE_SITES; i++)
+    {
+        if (alloc_sites[i].caller == caller || alloc_sites[i].calls == 0)
+        {
+            site = &alloc_sites[i];
+            site->caller = caller;
+            break;
+        }
+    }
+    site->calls++;
+    site->bytes += bytes;
+    restore_interrupts(save);
+}
+
+void *__real__malloc_r(struct _reent *reent, size_t size);
+void *__real__calloc_r(struct _reent *reent, size_t count, size_t size);
+void *__real__realloc_r(struct _reent *reent, void *ptr, size_t size);
+
+void *__wrap__malloc_r(struct _reent *reent, size_t size)
+{
+    if (!alloc_nested)
+    {
+        alloc_record((uintptr_t)__builtin_return_address(0), size);
+    }
+    return __real__malloc_r(reent, size);
+}
+
+void *__wrap__calloc_r(struct _reent *reent, size_t count, size_t size)
+{
+    alloc_record((uintptr_t)__builtin_return_address(0), count * size);
+    alloc_nested = true;
+    void *ptr = __real__calloc_r(reent, count, size);
+    alloc_nested = false;
+    return ptr;
+}
+
+void *__wrap__realloc_r(struct _reent *reent, void *ptr, size_t size)
+{
+    alloc_record((uintptr_t)__builtin_return_address(0), size);
+    alloc_nested = true;
+    ptr = __real__realloc_r(reent, ptr, size);
+    alloc_nested = false;
+    return ptr;
+}
+
+#endif
+
+// Copy the call sites, most calls first; returns the number copied
+uint8_t mem_get_alloc_sites(mem_alloc_site_t *sites, uint8_t max_sites)
+{
+    uint8_t count = 0;
+#if MEM_TRACE_ALLOC
+    uint32_t save = save_and_disable_interrupts();
+    for (uint8_t i = 0; i <= MEM_TRACE_SITES; i++)
+    {
+        const mem_alloc_site_t *site = i < MEM_TRACE_SITES ? &alloc_sites[i] : &alloc_other;
+        if (site->calls == 0)
+        {
+            continue;
+        }
+
+        // Insertion sort, dropping the site with the fewest calls when full
+        uint8_t j = count < max_sites ? count++ : count;
+        while (j > 0 && sites[j - 1].calls < site->calls)
+        {
+            if (j < max_sites)
+            {
+                sites[j] = sites[j - 1];
+            }
+            j--;
+        }
+        if (j < max_sites)
+        {
+            sites[j] = *site;
+        }
+    }
+    restore_interrupts(save);
+#else
+    (void)sites;
+    (void)max_sites;
+#endif
+    return count;
+}
+
+void mem_reset_alloc_sites()
+{
+#if MEM_TRACE_ALLOC
+    uint32_t save = save_and_disable_interrupts();
+    memset(alloc_sites, 0, sizeof(alloc_sites));
+    memset(&alloc_other, 0, sizeof(alloc_other));
+    restore_interrupts(save);
+#endif
+}
+
+// Paint the stacks; call first thing in main(), before core 1 is launched
+void mem_init()
+{
+    volatile uint32_t marker;
+    uint32_t *sp = (uint32_t *)((uintptr_t)&marker - MEM_STACK_MARGIN);
+    paint((uint32_t *)&__StackBottom, sp);
+    paint((uint32_t *)&__StackOneBottom, (uint32_t *)&__StackOneTop);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+#ifndef MEM_TRACE_ALLOC
+#define MEM_TRACE_ALLOC     0              // 1 = count heap allocations by call site, set by CMake
+#endif
+
+#define MEM_STACK_PAINT     (0x5AFE57ACu)  // fills the unused stacks at start up
+#define MEM_STACK_MARGIN    (64)           // bytes below the stack pointer left unpainted
+#define MEM_TRACE_SITES     (16)           // call sites the allocation tracer tells apart
+
+// Heap usage, from mallinfo()
+typedef struct {
+    uint32_t size;          // bytes between the end of .bss and the end of RAM
+    uint32_t arena;         // bytes taken from that region by malloc
+    uint32_t in_use;        // bytes allocated
+    uint32_t high_water;    // most bytes the arena has held
+} mem_heap_stats_t;
+
+// Stack usage of one core
+typedef struct {
+    uint32_t size;          // bytes reserved for the stack
+    uint32_t used;          // deepest the stack has been since mem_init()
+} mem_stack_stats_t;
+
+// Allocations made from one call site
+typedef struct {
+    uintptr_t caller;       // return address of the allocation, 0 for the rest
+    uint32_t calls;
+    uint32_t bytes;         // bytes asked for
+} mem_alloc_site_t;
+
+void mem_init(void);
+void mem_get_heap_stats(mem_heap_stats_t *stats);
+void mem_get_stack_stats(uint core, mem_stack_stats_t *stats);
+uint32_t mem_get_static_bytes(void);
+uint8_t mem_get_alloc_sites(mem_alloc_site_t *sites, uint8_t max_sites);
+void mem_reset_alloc_sites(void);
@@ -0,0 +1,394 @@
+//
+//  PicoCalc Software Mixer
+//
+//  Mixes up to MIXER_VOICES voices into the PCM engine's DMA buffers. Each
+//  voice is a square, triangle, sawtooth, sine or noise oscillator with its
+//  own ADSR envelope, volume and pan. Buffers are rendered in the DMA
+//  interrupt as they come free, MIXER_BLOCK frames at a time and one voice
+//  at a time, so the cost of a buffer depends only on the number of voices
+//  sounding.
+//
+//  Multi-track songs are sequenced here as well: track n plays on voice n
+//  and its notes start on exact sample boundaries.
+//
+
+#include <math.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "audio.h"
+#include "mixer.h"
+
+#define ENV_FULL        (255u << 16)    // envelope level, 8.16 fixed point
+#define SINE_ENTRIES    (256)
+
+typedef enum
+{
+    ENV_IDLE,
+    ENV_ATTACK,
+    ENV_DECAY,
+    ENV_SUSTAIN,
+    ENV_RELEASE,
+} env_stage_t;
+
+typedef struct
+{
+    audio_wave_t wave;
+    uint32_t phase;         // oscillator phase, one cycle is 2^32
+    uint32_t step;          // phase added per frame
+    uint32_t noise;         // LFSR of the noise oscillator
+    int32_t noise_level;    // noise output, changed once per cycle
+    env_stage_t stage;
+    uint32_t level;         // envelope level, up to ENV_FULL
+    uint32_t attack_step;   // envelope change per frame in each stage
+    uint32_t decay_step;
+    uint32_t release_step;
+    uint32_t sustain_level;
+    int32_t left_gain;      // volume and pan, 0-255
+    int32_t right_gain;
+} voice_t;
+
+typedef struct
+{
+    const audio_track_note_t *note; // note playing, NULL once the track has ended
+    uint32_t end;                   // frame the note ends at
+    uint32_t end_ms;                // song time the note ends at
+} track_t;
+
+static voice_t voices[MIXER_VOICES];
+static track_t tracks[MIXER_VOICES];
+static const audio_song_t *song = NULL;  // multi-track song playing, NULL if none
+static uint8_t song_tracks;
+static uint32_t song_frame;              // frames of the song played
+static bool song_mode = false;           // rendering stops when the song ends
+static volatile bool paused = false;
+
+static int16_t sine_table[SINE_ENTRIES];
+static int32_t mix_left[MIXER_BLOCK];
+static int32_t mix_right[MIXER_BLOCK];
+
+// RAM taken by the voices and mixing buffers, for the mem command
+const uint32_t mixer_static_bytes = sizeof(voices) + sizeof(tracks) + sizeof(sine_table) +
+                                    sizeof(mix_left) + sizeof(mix_right);
+
+// Envelope change per frame to cover the full range in `ms`
+static uint32_t envelope_step(uint16_t ms)
+{
+    uint32_t frames = (uint32_t)ms * MIXER_SAMPLE_RATE / 1000;
+    return frames == 0 ? ENV_FULL : MAX(ENV_FULL / frames, 1);
+}
+
+static inline uint32_t ms_to_frames(uint32_t ms)
+{
+    return (uint32_t)((uint64_t)ms * MIXER_SAMPLE_RATE / 1000);
+}
+
+// Start a note on a voice, from whatever level its envelope is at
+static void voice_start(voice_t *voice, uint32_t frequency, const audio_instrument_t *instrument, uint8_t pan)
+{
+    voice->wave = instrument->wave;
+    voice->step = (uint32_t)(((uint64_t)frequency << 32) / MIXER_SAMPLE_RATE);
+    voice->attack_step = envelope_step(instrument->attack_ms);
+    voice->decay_step = envelope_step(instrument->decay_ms);
+    voice->release_step = envelope_step(instrument->release_ms);
+    voice->sustain_level = (uint32_t)instrument->sustain << 16;
+    voice->left_gain = instrument->volume * (255 - pan) / 255;
+    voice->right_gain = instrument->volume * pan / 255;
+    if (voice->noise == 0)
+    {
+        voice->noise = 0xACE1;
+    }
+    voice->stage = ENV_ATTACK;
+}
+
+static void voice_release(voice_t *voice)
+{
+    if (voice->stage != ENV_IDLE)
+    {
+        voice->stage = ENV_RELEASE;
+    }
+}
+
+static inline int32_t voice_oscillator(voice_t *voice)
+{
+    uint32_t phase = voice->phase;
+    voice->phase += voice->step;
+
+    switch (voice->wave)
+    {
+    case AUDIO_WAVE_SQUARE:
+        return (phase & 0x80000000u) ? -32767 : 32767;
+    case AUDIO_WAVE_TRIANGLE:
+    {
+        int32_t x = (int32_t)(phase >> 16);
+        return x < 32768 ? x * 2 - 32768 : 98302 - x * 2;
+    }
+    case AUDIO_WAVE_SAWTOOTH:
+        return (int32_t)(phase >> 16) - 32768;
+    case AUDIO_WAVE_SINE:
+        return sine_table[phase >> 24];
+    case AUDIO_WAVE_NOISE:
+        if (voice->phase < phase)
+        {
+            // New random level each cycle, so the noise follows the pitch
+            voice->noise = (voice->noise >> 1) ^ (-(voice->noise & 1u) & 0xB400u);
+            voice->noise_level = (int32_t)(voice->noise & 0xFFFF) - 32768;
+        }
+        return voice->noise_level;
+    }
+    return 0;
+}
+
+// Advance the envelope one frame and return its level, 0-255
+static inline int32_t voice_envelope(voice_t *voice)
+{
+    switch (voice->stage)
+    {
+    case ENV_ATTACK:
+        voice->level += voice->attack_step;
+        if (voice->level >= ENV_FULL)
+        {
+            voice->level = ENV_FULL;
+            voice->stage = ENV_DECAY;
+        }
+        break;
+    case ENV_DECAY:
+        if (voice->level > voice->sustain_level + voice->decay_step)
+        {
+            voice->level -= voice->decay_step;
+        }
+        else
+        {
+            voice->level = voice->sustain_level;
+            voice->stage = voice->sustain_level ? ENV_SUSTAIN : ENV_IDLE;
+        }
+        break;
+    case ENV_RELEASE:
+        if (voice->level > voice->release_step)
+        {
+            voice->level -= voice->release_step;
+        }
+        else
+        {
+            voice->level = 0;
+            voice->stage = ENV_IDLE;
+        }
+        break;
+    default:
+        break;
+    }
+    return (int32_t)(voice->level >> 16);
+}
+
+// Add `frames` of a voice to the mix
+static void voice_mix(voice_t *voice, uint32_t frames)
+{
+    for (uint32_t i = 0; i < frames && voice->stage != ENV_IDLE; i++)
+    {
+        int32_t sample = voice_oscillator(voice) * voice_envelope(voice) >> 8;
+        mix_left[i] += sample * voice->left_gain >> 8;
+        mix_right[i] += sample * voice->right_gain >> 8;
+    }
+}
+
+static inline uint16_t mix_duty(int32_t sample)
+{
+    sample >>= MIXER_HEADROOM;
+    sample = MAX(MIN(sample, 32767), -32768);
+    return (uint16_t)((sample + 32768) >> (16 - AUDIO_PCM_BITS));
+}
+
+// Mix up to MIXER_BLOCK frames of every voice into the DMA buffers
+static void mix_block(uint16_t *left, uint16_t *right, uint32_t frames)
+{
+    memset(mix_left, 0, frames * sizeof(mix_left[0]));
+    memset(mix_right, 0, frames * sizeof(mix_right[0]));
+    if (!paused)
+    {
+        for (uint v = 0; v < MIXER_VOICES; v++)
+        {
+            voice_mix(&voices[v], frames);
+        }
+    }
+
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        left[i] = mix_duty(mix_left[i]);
+        right[i] = mix_duty(mix_right[i]);
+    }
+}
+
+
+//
+// Multi-track songs
+//
+
+// Start the note a track has reached
+static void track_note(uint8_t index)
+{
+    track_t *track = &tracks[index];
+    if (track->note->duration_ms == 0)
+    {
+        track->note = NULL;
+        voice_release(&voices[index]);
+        return;
+    }
+
+    track->end_ms += track->note->duration_ms;
+    track->end = ms_to_frames(track->end_ms);
+    if (track->note->frequency == SILENCE)
+    {
+        voice_release(&voices[index]);
+    }
+    else
+    {
+        const audio_track_t *part = &song->tracks[index];
+        voice_start(&voices[index], track->note->frequency, part->instrument, part->pan);
+    }
+}
+
+static void song_load(const audio_song_t *next)
+{
+    song = next;
+    song_frame = 0;
+    song_tracks = song ? MIN(song->track_count, MIXER_VOICES) : 0;
+    for (uint8_t i = 0; i < song_tracks; i++)
+    {
+        tracks[i].note = song->tracks[i].notes;
+        tracks[i].end_ms = 0;
+        track_note(i);
+    }
+}
+
+// Start the notes that are due and return the frames until the next one.
+// A song ends once all its tracks have ended and their voices have been
+// released; then the next queued song starts.
+static uint32_t song_update(void)
+{
+    uint32_t until = UINT32_MAX;
+    bool sounding = false;
+
+    for (uint8_t i = 0; i < song_tracks; i++)
+    {
+        track_t *track = &tracks[i];
+        while (track->note && track->end <= song_frame)
+        {
+            track->note++;
+            track_note(i);
+        }
+        if (track->note)
+        {
+            until = MIN(until, track->end - song_frame);
+        }
+        sounding |= track->note != NULL || voices[i].stage != ENV_IDLE;
+    }
+
+    if (!sounding)
+    {
+        song_load(audio_song_next());
+    }
+    return until;
+}
+
+static bool mixer_render(uint16_t *left, uint16_t *right, uint32_t frames)
+{
+    // BREAK stops a song playing in the background
+    extern volatile bool user_interrupt;
+    if (song && user_interrupt)
+    {
+        while (audio_song_next())
+        {
+            // drop the queue
+        }
+        song_load(NULL);
+    }
+
+    for (uint32_t done = 0; done < frames;)
+    {
+        uint32_t n = MIN(frames - done, MIXER_BLOCK);
+        if (song && !paused)
+        {
+            n = MIN(n, song_update());
+        }
+        mix_block(left + done, right + done, n);
+        if (song && !paused)
+        {
+            song_frame += n;
+        }
+        done += n;
+    }
+    return song || !song_mode;
+}
+
+
+//
+// Public API
+//
+
+// Start the mixer with every voice silent. It runs until audio_stop(), or
+// until the song given to mixer_play_song() ends.
+bool mixer_start(void)
+{
+    if (sine_table[SINE_ENTRIES / 4] == 0)
+    {
+        for (uint i = 0; i < SINE_ENTRIES; i++)
+        {
+            sine_table[i] = (int16_t)(32767.0f * sinf(i * 2.0f * (float)M_PI / SINE_ENTRIES));
+        }
+    }
+
+    memset(voices, 0, sizeof(voices));
+    song = NULL;
+    song_tracks = 0;
+    song_mode = false;
+    paused = false;
+    return audio_pcm_start_render(MIXER_SAMPLE_RATE, mixer_render);
+}
+
+// Start a note on a voice; it sounds until mixer_voice_off()
+void mixer_voice_on(uint8_t voice, uint32_t frequency, const audio_instrument_t *instrument, uint8_t pan)
+{
+    if (voice >= MIXER_VOICES || !instrument)
+    {
+        return;
+    }
+
+    uint32_t save = save_and_disable_interrupts();
+    voice_start(&voices[voice], frequency, instrument, pan);
+    restore_interrupts(save);
+}
+
+// Release a voice; it fades out over the instrument's release time
+void mixer_voice_off(uint8_t voice)
+{
+    if (voice >= MIXER_VOICES)
+    {
+        return;
+    }
+
+    uint32_t save = save_and_disable_interrupts();
+    voice_release(&voices[voice]);
+    restore_interrupts(save);
+}
+
+bool mixer_voice_is_active(uint8_t voice)
+{
+    return voice < MIXER_VOICES && voices[voice].stage != ENV_IDLE;
+}
+
+// Play a multi-track song on a started mixer, followed by any songs queued
+// with audio_song_queue(); the mixer stops after the last one
+void mixer_play_song(const audio_song_t *next)
+{
+    uint32_t save = save_and_disable_interrupts();
+    song_mode = true;
+    song_load(next);
+    restore_interrupts(save);
+}
+
+// Hold the song and silence the output, or carry on from where it was
+void mixer_set_paused(bool pause)
+{
+    paused = pause;
+}
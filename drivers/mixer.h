@@ -0,0 +1,17 @@
+#pragma once
+
+#include "audio.h"
+
+#define MIXER_VOICES        (8)     // voices mixed at once, one per song track
+#define MIXER_SAMPLE_RATE   (22050) // output sample rate in Hz
+#define MIXER_BLOCK         (256)   // frames mixed per pass over the voices
+#define MIXER_HEADROOM      (2)     // right shift of the mix, full scale voices before clipping = 1 << MIXER_HEADROOM
+
+bool mixer_start(void);
+void mixer_voice_on(uint8_t voice, uint32_t frequency, const audio_instrument_t *instrument, uint8_t pan);
+void mixer_voice_off(uint8_t voice);
+bool mixer_voice_is_active(uint8_t voice);
+void mixer_play_song(const audio_song_t *song);
+void mixer_set_paused(bool paused);
+
+extern const uint32_t mixer_static_bytes;
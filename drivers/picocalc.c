@@ -5,8 +5,17 @@
 #include "audio.h"
 #include "display.h"
 #include "keyboard.h"
+#include "lcd.h"
+#include "power.h"
+#include "serial.h"
 #include "../fatfs/sdfs.h"
 #include "southbridge.h"
+#include "trace.h"
+#include "picocalc.h"
+
+// Time at which each boot stage finished
+static picocalc_boot_stage_t boot_stages[PICOCALC_BOOT_STAGES];
+static uint8_t boot_stage_count = 0;
 
 // Callback for when characters become available
 static void (*chars_available_callback)(void *) = NULL;
@@ -14,28 +23,26 @@ static void *chars_available_param = NULL;
 
 static void picocalc_out_chars(const char *buf, int length)
 {
-    for (int i = 0; i < length; ++i)
-    {
-        display_emit(buf[i]);
-    }
+    display_write(buf, length);
 }
 
 static void picocalc_out_flush(void)
 {
-    // No flush needed for this driver
+    display_flush();
 }
 
+// Take the keys already buffered, so that getchar_timeout_us() can time out
+// and the other stdio drivers are read too
 static int picocalc_in_chars(char *buf, int length)
 {
+    display_flush(); // show everything written so far before waiting for input
+
     int n = 0;
-    while (n < length)
+    while (n < length && keyboard_key_available())
     {
-        int c = keyboard_get_key();
-        if (c == -1)
-            break; // No key pressed
-        buf[n++] = (char)c;
+        buf[n++] = keyboard_get_key();
     }
-    return n;
+    return n > 0 ? n : PICO_ERROR_NO_DATA;
 }
 
 static void picocalc_set_chars_available_callback(void (*fn)(void *), void *param)
@@ -53,6 +60,12 @@ void picocalc_chars_available_notify(void)
     }
 }
 
+// Shift+PageUp/PageDown move the display through its scrollback
+static void picocalc_scroll(int8_t direction)
+{
+    display_scrollback(direction * DISPLAY_SCROLLBACK_STEP);
+}
+
 stdio_driver_t picocalc_stdio_driver = {
     .out_chars = picocalc_out_chars,
     .out_flush = picocalc_out_flush,
@@ -61,16 +74,70 @@ stdio_driver_t picocalc_stdio_driver = {
     .next = NULL,
 };
 
+// Wait for a character from any stdio driver, sleeping between interrupts
+int picocalc_getchar(void)
+{
+    while (true)
+    {
+        int ch = getchar_timeout_us(0);
+        if (ch != PICO_ERROR_TIMEOUT)
+        {
+            return ch;
+        }
+        power_wait(); // until a key is polled, a character received or any other interrupt
+    }
+}
+
+// Record that a boot stage has finished, the name must stay valid
+void picocalc_boot_stage(const char *name)
+{
+    if (boot_stage_count < PICOCALC_BOOT_STAGES)
+    {
+        boot_stages[boot_stage_count].name = name;
+        boot_stages[boot_stage_count].us = time_us_32();
+        boot_stage_count++;
+    }
+}
+
+uint8_t picocalc_get_boot_stages(const picocalc_boot_stage_t **stages)
+{
+    *stages = boot_stages;
+    return boot_stage_count;
+}
+
+// The LCD controller spends most of its start up waiting, so it is reset
+// first and finishes from an alarm while the other drivers start.
+// display_init() waits for whatever is left. The keyboard starts after the
+// display, as Shift+PageUp/PageDown scroll it.
 void picocalc_init()
 {
+    picocalc_boot_stage("start");
+    trace_init();
+    power_init();
+    lcd_init_start();
+    picocalc_boot_stage("lcd reset");
     sb_init();
+    picocalc_boot_stage("southbridge");
+    audio_init();
+    picocalc_boot_stage("audio");
+    sdfs_init(); // only registers the volume, it is mounted on first use
+    picocalc_boot_stage("sd card");
     display_init();
+    picocalc_boot_stage("display");
     keyboard_init();
     keyboard_set_key_available_callback(picocalc_chars_available_notify);
+    keyboard_set_scroll_callback(picocalc_scroll);
     keyboard_set_background_poll(true);
-    audio_init();
-    sdfs_init();
+    picocalc_boot_stage("keyboard");
 
     stdio_set_driver_enabled(&picocalc_stdio_driver, true);
     stdio_set_translate_crlf(&picocalc_stdio_driver, true);
+
+#if SERIAL_STDIO
+    // Output is sent by DMA, so printf does not wait for the serial port
+    serial_init(UART_BAUDRATE, UART_DATABITS, UART_STOPBITS, UART_PARITY);
+    stdio_set_translate_crlf(&serial_stdio_driver, true);
+    serial_set_stdio(true);
+    picocalc_boot_stage("serial");
+#endif
 }
\ No newline at end of file
@@ -4,10 +4,22 @@
 
 #include "pico/stdio/driver.h"
 
+#define PICOCALC_BOOT_STAGES (12)     // boot stages recorded for the boot command
+
 typedef void (*led_callback_t)(uint8_t);
 
+// A boot stage and the time it finished, in microseconds since power on
+typedef struct
+{
+    const char *name;
+    uint32_t us;
+} picocalc_boot_stage_t;
+
 extern stdio_driver_t picocalc_stdio_driver;
 
 // Function prototypes
 void picocalc_chars_available_notify(void);
 void picocalc_init(void);
+int picocalc_getchar(void);
+void picocalc_boot_stage(const char *name);
+uint8_t picocalc_get_boot_stages(const picocalc_boot_stage_t **stages);
@@ -0,0 +1,258 @@
+//
+//  PicoCalc power manager
+//
+//  Input waits sleep the core with __wfe() until an interrupt arrives
+//  instead of spinning. SEVONPEND is set so that an interrupt raised just
+//  before the __wfe() still ends the wait.
+//
+//  The periodic work of the drivers (keyboard polling, the cursor blink and
+//  battery sampling) runs as tasks from one scheduler tick. The tick is a
+//  single alarm set for the next task due, and every task due within
+//  POWER_COALESCE_MS of it runs at the same time, so tasks with related
+//  periods settle into waking the core together.
+//
+//  While the REPL waits for a command, clk_sys is divided by
+//  POWER_IDLE_DIVIDER. The PLL keeps running so full speed comes back
+//  straight away. clk_peri follows clk_sys: SPI and I2C just run slower
+//  with their dividers unchanged, and the UART divisor is set again for
+//  each change. The clock is not slowed while audio is playing, as its
+//  timing comes from clk_sys.
+//
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "hardware/structs/scb.h"
+
+#include "power.h"
+#include "audio.h"
+#include "serial.h"
+
+static power_task_t *power_tasks = NULL;    // scheduled tasks, in no particular order
+static alarm_id_t tick_alarm = 0;           // alarm for the next tick, 0 if none
+static absolute_time_t tick_time;           // when that alarm fires
+static volatile bool tick_running = false;  // the tick is running tasks
+
+static bool idle_requested = false;         // the REPL is waiting for a command
+static bool clock_slowed = false;           // clk_sys is divided down
+static uint64_t slowed_at_us;               // when clk_sys was divided down
+static power_stats_t power_stats;
+
+//
+//  Scheduler tick
+//
+
+static int64_t on_tick(alarm_id_t id, void *user_data);
+
+// Set the alarm for the earliest task due; called with interrupts disabled
+static void schedule_tick(void)
+{
+    if (tick_running)
+    {
+        return; // the tick schedules itself once it has run its tasks
+    }
+
+    absolute_time_t next = at_the_end_of_time;
+    for (power_task_t *task = power_tasks; task; task = task->next)
+    {
+        if (absolute_time_diff_us(task->due, next) > 0)
+        {
+            next = task->due;
+        }
+    }
+
+    if (tick_alarm > 0)
+    {
+        if (to_us_since_boot(next) == to_us_since_boot(tick_time))
+        {
+            return; // already set
+        }
+        cancel_alarm(tick_alarm);
+        tick_alarm = 0;
+    }
+
+    if (!is_at_the_end_of_time(next))
+    {
+        // Never in the past, so the alarm cannot fire inside add_alarm_at()
+        absolute_time_t soonest = make_timeout_time_us(100);
+        if (absolute_time_diff_us(next, soonest) > 0)
+        {
+            next = soonest;
+        }
+        tick_time = next;
+        tick_alarm = add_alarm_at(next, on_tick, NULL, false);
+    }
+}
+
+static void unlink_task(power_task_t *task)
+{
+    for (power_task_t **link = &power_tasks; *link; link = &(*link)->next)
+    {
+        if (*link == task)
+        {
+            *link = task->next;
+            break;
+        }
+    }
+    task->scheduled = false;
+}
+
+static int64_t on_tick(alarm_id_t id, void *user_data)
+{
+    tick_alarm = 0;
+    tick_running = true;
+    power_stats.ticks++;
+
+    // Run every task due now or within the coalescing window
+    absolute_time_t horizon = make_timeout_time_ms(POWER_COALESCE_MS);
+    power_task_t *task = power_tasks;
+    while (task)
+    {
+        power_task_t *next = task->next;
+        if (absolute_time_diff_us(task->due, horizon) >= 0)
+        {
+            uint32_t delay_ms = task->fn();
+            if (delay_ms == 0)
+            {
+                unlink_task(task);
+            }
+            else
+            {
+                task->due = make_timeout_time_ms(delay_ms);
+            }
+        }
+        task = next;
+    }
+
+    tick_running = false;
+    schedule_tick();
+    return 0; // the next tick is a new alarm
+}
+
+//
+//  Idle clock
+//
+
+// Divide clk_sys, or restore it with a divider of 1
+static void set_clock_divider(uint32_t divider)
+{
+    uint32_t hz = power_stats.sys_hz / divider;
+
+    uint32_t save = save_and_disable_interrupts();
+    clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+                    CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS, power_stats.sys_hz, hz);
+    clock_set_reported_hz(clk_peri, hz); // clk_peri is clk_sys, undivided
+    serial_clock_changed();
+    restore_interrupts(save);
+}
+
+static void clock_slow_down(void)
+{
+    if (clock_slowed || audio_is_playing() || audio_song_is_playing() || audio_pcm_is_playing())
+    {
+        return;
+    }
+
+    serial_flush(); // characters still going out would change speed
+    set_clock_divider(POWER_IDLE_DIVIDER);
+    clock_slowed = true;
+    slowed_at_us = time_us_64();
+}
+
+static void clock_restore(void)
+{
+    if (!clock_slowed)
+    {
+        return;
+    }
+
+    serial_flush();
+    set_clock_divider(1);
+    clock_slowed = false;
+    power_stats.idle_us += time_us_64() - slowed_at_us;
+}
+
+//
+//  Power API
+//
+
+// Run a task after delay_ms, then as often as it asks
+void power_task_start(power_task_t *task, power_task_fn_t fn, uint32_t delay_ms)
+{
+    uint32_t save = save_and_disable_interrupts();
+    task->fn = fn;
+    task->due = make_timeout_time_ms(delay_ms);
+    if (!task->scheduled)
+    {
+        task->next = power_tasks;
+        power_tasks = task;
+        task->scheduled = true;
+    }
+    schedule_tick();
+    restore_interrupts(save);
+}
+
+void power_task_stop(power_task_t *task)
+{
+    uint32_t save = save_and_disable_interrupts();
+    if (task->scheduled)
+    {
+        unlink_task(task);
+        schedule_tick();
+    }
+    restore_interrupts(save);
+}
+
+// Sleep until an interrupt, slowing the clock first if the REPL is idle
+void power_wait()
+{
+    if (idle_requested)
+    {
+        clock_slow_down();
+    }
+
+    uint64_t start = time_us_64();
+    __wfe();
+    power_stats.asleep_us += time_us_64() - start;
+    power_stats.wakeups++;
+}
+
+// The REPL is waiting for a command (true) or running one (false)
+void power_set_idle(bool idle)
+{
+    idle_requested = idle;
+    if (!idle)
+    {
+        clock_restore();
+    }
+}
+
+// Take clk_sys as the new full speed after clock_set_profile(), which
+// leaves clk_sys undivided
+void power_clock_changed()
+{
+    if (clock_slowed)
+    {
+        clock_slowed = false;
+        power_stats.idle_us += time_us_64() - slowed_at_us;
+    }
+    power_stats.sys_hz = clock_get_hz(clk_sys);
+}
+
+void power_get_stats(power_stats_t *stats)
+{
+    *stats = power_stats;
+    stats->idle_hz = power_stats.sys_hz / POWER_IDLE_DIVIDER;
+    if (clock_slowed)
+    {
+        stats->idle_us += time_us_64() - slowed_at_us;
+    }
+}
+
+void power_init()
+{
+    power_stats.sys_hz = clock_get_hz(clk_sys);
+
+    // A pending interrupt ends __wfe() even if it was raised just before
+    scb_hw->scr |= M0PLUS_SCR_SEVONPEND_BITS;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+#define POWER_COALESCE_MS   (8)         // tasks due this soon run on the same tick
+#define POWER_IDLE_DIVIDER  (4)         // clk_sys divider while idle at the prompt
+
+// A periodic task run from the scheduler tick. The function returns the
+// number of milliseconds until it should run again, or 0 to stop.
+typedef uint32_t (*power_task_fn_t)(void);
+
+typedef struct power_task
+{
+    power_task_fn_t fn;
+    absolute_time_t due;        // when the task next runs
+    struct power_task *next;    // next scheduled task
+    bool scheduled;             // the task is in the schedule
+} power_task_t;
+
+// Time spent asleep since boot
+typedef struct
+{
+    uint64_t asleep_us;         // time spent waiting for an interrupt
+    uint64_t idle_us;           // time spent with clk_sys slowed down
+    uint32_t wakeups;           // interrupts that ended a wait
+    uint32_t ticks;             // scheduler ticks
+    uint32_t sys_hz;            // clk_sys at full speed
+    uint32_t idle_hz;           // clk_sys while idle at the prompt
+} power_stats_t;
+
+// Function prototypes
+void power_init(void);
+void power_task_start(power_task_t *task, power_task_fn_t fn, uint32_t delay_ms);
+void power_task_stop(power_task_t *task);
+void power_wait(void);
+void power_set_idle(bool idle);
+void power_get_stats(power_stats_t *stats);
+void power_clock_changed(void);
@@ -7,16 +7,25 @@
 // and emit characters. The driver uses a circular buffer to store received characters
 // and an interrupt handler to process incoming data.
 //
+// Output goes into a ring that a DMA channel copies to the UART, so writes
+// return as soon as the characters are buffered. Input is taken from the
+// UART FIFO when it is half full, or when the line has been idle for 32
+// bit times (the receive timeout). When the input ring is full, the FIFO
+// is left to fill, and with UART_FLOW_CONTROL the UART drops RTS to hold
+// off the sender until there is room.
+//
 
 #include "pico/stdlib.h"
 #include "pico/stdio/driver.h"
 
 #include "hardware/uart.h"
 #include "hardware/irq.h"
+#include "hardware/dma.h"
 
 // #define ENABLE_USER_INTERRUPT
 
 #include "serial.h"
+#include "power.h"
 
 extern volatile bool user_interrupt;
 
@@ -25,16 +34,61 @@ void serial_chars_available_notify(void);
 static volatile uint8_t rx_buffer[UART_BUFFER_SIZE];
 static volatile uint16_t rx_head = 0;
 static volatile uint16_t rx_tail = 0;
+static volatile bool rx_throttled = false;      // RX interrupts off until the ring has room
+static volatile uint32_t rx_overrun_count = 0;  // characters lost in the UART FIFO
+
+static uint8_t tx_buffer[UART_TX_BUFFER_SIZE];
+static volatile uint16_t tx_head = 0;
+static volatile uint16_t tx_tail = 0;
+static volatile uint16_t tx_in_flight = 0;      // characters the DMA is sending from tx_tail
+static int tx_dma = -1;
+static uint serial_baudrate = UART_BAUDRATE;    // rate asked for, kept if clk_peri changes
+
+// RAM taken by the rings, for the mem command
+const uint32_t serial_static_bytes = sizeof(rx_buffer) + sizeof(tx_buffer);
 
 static void (*chars_available_callback)(void *) = NULL;
 static void *chars_available_param = NULL;
 
-// Interrupt handler for UART RX
+//
+// Input
+//
+
+static void rx_enable(bool enable)
+{
+    uint32_t mask = UART_UARTIMSC_RXIM_BITS | UART_UARTIMSC_RTIM_BITS;
+    if (enable)
+    {
+        hw_set_bits(&uart_get_hw(UART_PORT)->imsc, mask);
+    }
+    else
+    {
+        hw_clear_bits(&uart_get_hw(UART_PORT)->imsc, mask);
+    }
+}
+
+// Interrupt handler for UART RX, on the FIFO level or the idle line
 static void on_uart_rx()
 {
+    bool received = false;
+
     while (uart_is_readable(UART_PORT))
     {
-        uint8_t ch = uart_getc(UART_PORT);
+        uint16_t next_head = (rx_head + 1) & (UART_BUFFER_SIZE - 1);
+        if (next_head == rx_tail)
+        {
+            // Ring full: leave the rest in the FIFO until it is read
+            rx_throttled = true;
+            rx_enable(false);
+            break;
+        }
+
+        uint32_t data = uart_get_hw(UART_PORT)->dr;
+        if (data & UART_UARTDR_OE_BITS)
+        {
+            rx_overrun_count++;
+        }
+        uint8_t ch = data & 0xFF;
 #ifdef ENABLE_USER_INTERRUPT
         // Check for user interrupt (Ctrl+C)
         if (ch == 0x03)                 // Ctrl+C
@@ -43,9 +97,13 @@ static void on_uart_rx()
             continue;                   // Skip adding this character to the buffer
         }
 #endif
-        uint16_t next_head = (rx_head + 1) & (UART_BUFFER_SIZE - 1);
         rx_buffer[rx_head] = ch;
         rx_head = next_head;
+        received = true;
+    }
+
+    if (received)
+    {
         serial_chars_available_notify();
     }
 }
@@ -57,50 +115,167 @@ bool serial_input_available()
 
 char serial_get_char()
 {
-    while (!serial_input_available()) {
-        tight_loop_contents();
+    while (!serial_input_available())
+    {
+        power_wait(); // sleep until the RX interrupt
     }
-        
+
     uint8_t ch = rx_buffer[rx_tail];
     rx_tail = (rx_tail + 1) & (UART_BUFFER_SIZE - 1);
+
+    // Take input again once a quarter of the ring is free
+    if (rx_throttled && ((rx_tail - rx_head - 1) & (UART_BUFFER_SIZE - 1)) >= UART_BUFFER_SIZE / 4)
+    {
+        rx_throttled = false;
+        rx_enable(true);
+    }
     return ch;
 }
 
+uint32_t serial_rx_overruns()
+{
+    return rx_overrun_count;
+}
+
+//
+// Output
+//
+
+// Send the characters from tx_tail up to tx_head or the end of the ring;
+// called with interrupts disabled or from the DMA interrupt
+static void tx_start(void)
+{
+    if (tx_in_flight || tx_head == tx_tail)
+    {
+        return;
+    }
+
+    uint16_t end = tx_head > tx_tail ? tx_head : UART_TX_BUFFER_SIZE;
+    tx_in_flight = end - tx_tail;
+    dma_channel_transfer_from_buffer_now(tx_dma, &tx_buffer[tx_tail], tx_in_flight);
+}
+
+static void tx_complete(void)
+{
+    tx_tail = (tx_tail + tx_in_flight) & (UART_TX_BUFFER_SIZE - 1);
+    tx_in_flight = 0;
+    tx_start();
+}
+
+static void on_tx_dma(void)
+{
+    if (tx_dma < 0 || !dma_channel_get_irq1_status(tx_dma))
+    {
+        return;
+    }
+    dma_channel_acknowledge_irq1(tx_dma);
+    tx_complete();
+}
+
+static inline uint16_t tx_space(void)
+{
+    return (tx_tail - tx_head - 1) & (UART_TX_BUFFER_SIZE - 1);
+}
+
+// Wait for room in the ring. If the DMA has finished but its interrupt
+// cannot run (we are in an interrupt ourselves), complete it here.
+static void tx_wait_for_space(void)
+{
+    while (tx_space() == 0)
+    {
+        uint32_t save = save_and_disable_interrupts();
+        if (tx_in_flight && !dma_channel_is_busy(tx_dma))
+        {
+            dma_channel_acknowledge_irq1(tx_dma);
+            tx_complete();
+        }
+        restore_interrupts(save);
+    }
+}
+
 bool serial_output_available()
 {
-    return uart_is_writable(UART_PORT);
+    return tx_space() > 0;
 }
 
 void serial_put_char(char ch)
 {
-    uart_putc(UART_PORT, ch);             // Send the character
+    if (tx_dma < 0)
+    {
+        return; // not initialised
+    }
+
+    tx_wait_for_space();
+    uint32_t save = save_and_disable_interrupts();
+    tx_buffer[tx_head] = ch;
+    tx_head = (tx_head + 1) & (UART_TX_BUFFER_SIZE - 1);
+    tx_start();
+    restore_interrupts(save);
 }
 
+// Wait until everything written has left the UART
+void serial_flush()
+{
+    if (tx_dma < 0)
+    {
+        return;
+    }
+
+    while (tx_head != tx_tail)
+    {
+        uint32_t save = save_and_disable_interrupts();
+        if (tx_in_flight && !dma_channel_is_busy(tx_dma))
+        {
+            dma_channel_acknowledge_irq1(tx_dma);
+            tx_complete();
+        }
+        restore_interrupts(save);
+    }
+    uart_tx_wait_blocking(UART_PORT);
+}
 
 static void serial_out_chars(const char *buf, int length)
 {
-    for (int i = 0; i < length; ++i)
+    if (tx_dma < 0)
     {
-        serial_put_char(buf[i]);
+        return; // not initialised
+    }
+
+    // Copy as much as fits at a time, then let the DMA send it
+    while (length > 0)
+    {
+        tx_wait_for_space();
+
+        uint32_t save = save_and_disable_interrupts();
+        int n = MIN(length, tx_space());
+        for (int i = 0; i < n; i++)
+        {
+            tx_buffer[tx_head] = buf[i];
+            tx_head = (tx_head + 1) & (UART_TX_BUFFER_SIZE - 1);
+        }
+        tx_start();
+        restore_interrupts(save);
+
+        buf += n;
+        length -= n;
     }
 }
 
 static void serial_out_flush(void)
 {
-    // No flush needed for this driver
+    serial_flush();
 }
 
+// Take the characters already received, so that the keyboard is read too
+// and getchar_timeout_us() can time out
 static int serial_in_chars(char *buf, int length)
 {
     int n = 0;
-    while (n < length)
+    while (n < length && serial_input_available())
     {
-        int c = serial_get_char();
-        if (c == -1)
-            break; // No key pressed
-        buf[n++] = (char)c;
+        buf[n++] = serial_get_char();
     }
-    return n;
+    return n > 0 ? n : PICO_ERROR_NO_DATA;
 }
 
 static void serial_set_chars_available_callback(void (*fn)(void *), void *param)
@@ -118,6 +293,8 @@ void serial_chars_available_notify(void)
     }
 }
 
+static bool stdio_enabled = false; // serial_stdio_driver is connected to stdio
+
 stdio_driver_t serial_stdio_driver = {
     .out_chars = serial_out_chars,
     .out_flush = serial_out_flush,
@@ -126,31 +303,90 @@ stdio_driver_t serial_stdio_driver = {
     .next = NULL,
 };
 
+// Change the baud rate once the output has been sent; returns the rate set
+uint serial_set_baudrate(uint baudrate)
+{
+    serial_flush();
+    serial_baudrate = MIN(baudrate, UART_BAUDRATE_MAX);
+    return uart_set_baudrate(UART_PORT, serial_baudrate);
+}
+
+// Set the baud rate divisor again after clk_peri has changed
+void serial_clock_changed()
+{
+    if (tx_dma >= 0)
+    {
+        uart_set_baudrate(UART_PORT, serial_baudrate);
+    }
+}
+
+// Connect the serial port to stdio, or take it off while the line carries
+// something else; returns whether it was connected
+bool serial_set_stdio(bool enabled)
+{
+    bool was_enabled = stdio_enabled;
+    if (!enabled)
+    {
+        serial_flush(); // the console output goes before whatever follows
+    }
+    stdio_set_driver_enabled(&serial_stdio_driver, enabled);
+    stdio_enabled = enabled;
+    return was_enabled;
+}
+
 void serial_init(uint baudrate, uint databits, uint stopbits, uart_parity_t parity)
 {
+    if (tx_dma >= 0)
+    {
+        // Already set up, by the console or an earlier transfer
+        serial_set_baudrate(baudrate);
+        uart_set_format(UART_PORT, databits, stopbits, parity);
+        return;
+    }
+
     // Set up our UART
-    uart_init(UART_PORT, baudrate);
+    serial_baudrate = MIN(baudrate, UART_BAUDRATE_MAX);
+    uart_init(UART_PORT, serial_baudrate);
 
     // Set the TX and RX pins by using the function select on the GPIO
     // Set datasheet for more information on function select
     gpio_set_function(UART_TX, GPIO_FUNC_UART);
     gpio_set_function(UART_RX, GPIO_FUNC_UART);
     
-    // Set UART flow control CTS/RTS, we don't want these, so turn them off
+    // Set UART flow control CTS/RTS, only if the lines are wired
+#if UART_FLOW_CONTROL
+    gpio_set_function(UART_CTS, GPIO_FUNC_UART);
+    gpio_set_function(UART_RTS, GPIO_FUNC_UART);
+    uart_set_hw_flow(UART_PORT, true, true);
+#else
     uart_set_hw_flow(UART_PORT, false, false);
+#endif
 
     // Set our data format
     uart_set_format(UART_PORT, databits, stopbits, parity);
 
-    // Turn off FIFO's - we want to do this character by character
-    uart_set_fifo_enabled(UART_PORT, false);
+    // Use the FIFOs, interrupting when the RX FIFO is half full; RTS also
+    // drops at this level
+    uart_set_fifo_enabled(UART_PORT, true);
+    hw_write_masked(&uart_get_hw(UART_PORT)->ifls, 2 << UART_UARTIFLS_RXIFLSEL_LSB, UART_UARTIFLS_RXIFLSEL_BITS);
+
+    // Output is sent by DMA, paced by the UART
+    tx_dma = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(tx_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, uart_get_dreq(UART_PORT, true));
+    dma_channel_configure(tx_dma, &c, &uart_get_hw(UART_PORT)->dr, tx_buffer, 0, false);
+    dma_channel_set_irq1_enabled(tx_dma, true);
+    irq_add_shared_handler(DMA_IRQ_1, on_tx_dma, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
 
     // Set up a RX interrupt
     // And set up and enable the interrupt handlers
     irq_set_exclusive_handler(UART_IRQ, on_uart_rx);
     irq_set_enabled(UART_IRQ, true);
 
-    // Now enable the UART to send interrupts - RX only
-    uart_set_irq_enables(UART_PORT, true, false);
+    // Now enable the UART to send interrupts - RX level and receive timeout
+    rx_enable(true);
 }
-
@@ -15,15 +15,32 @@
 
 #define UART_TX             0
 #define UART_RX             1
+#define UART_CTS            2
+#define UART_RTS            3
 
-#define UART_BUFFER_SIZE    256
+#define UART_FLOW_CONTROL   0              // 1 when RTS/CTS are wired, for 1-3 Mbaud
+#define UART_BAUDRATE_MAX   3000000
+
+#define UART_BUFFER_SIZE    4096           // RX ring, a power of two
+#define UART_TX_BUFFER_SIZE 4096           // TX ring, a power of two
+
+#ifndef SERIAL_STDIO
+#define SERIAL_STDIO        (1)            // connect stdio to the serial port at boot
+#endif
 
 
 extern stdio_driver_t serial_stdio_driver;
 
 // Function prototypes
 void serial_init(uint baudrate, uint databits, uint stopbits, uart_parity_t parity);
+bool serial_set_stdio(bool enabled);
 bool serial_input_available(void);
 char serial_get_char(void);
 bool serial_output_available(void);
-void serial_put_char(char ch);
\ No newline at end of file
+void serial_put_char(char ch);
+void serial_flush(void);
+uint serial_set_baudrate(uint baudrate);
+void serial_clock_changed(void);
+uint32_t serial_rx_overruns(void);
+
+extern const uint32_t serial_static_bytes;
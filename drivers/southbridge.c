@@ -4,19 +4,58 @@
 //  The PicoCalc on-board processor acts as a "southbridge", managing lower-speed functions
 //  that provides access to the keyboard, battery, and other peripherals.
 //
-
-#include <stdatomic.h>
+//  The bus starts at SB_BAUDRATE. At start up, faster rates are tried and
+//  the fastest one that reads back the same values is kept; if errors
+//  follow, the rate steps back down again.
+//
+//  After that, every transfer goes through a queue of requests that is run
+//  from the I2C interrupt: a request's commands are put in the controller's
+//  FIFO in one go and it completes on the STOP condition of its last
+//  byte, or fails on an abort or a timeout. The keyboard poll and the
+//  telemetry sampler submit requests with completion callbacks and never
+//  wait; the sb_read_* and sb_write_* functions submit a request and wait
+//  for it. The battery level and the backlight values are sampled every
+//  SB_TELEMETRY_MS, so reading them does not touch the bus.
+//
 
 #include "pico/stdlib.h"
 #include "pico/platform.h"
-#include "pico/multicore.h"
 #include "hardware/gpio.h"
 #include "hardware/i2c.h"
+#include "hardware/irq.h"
 
 #include "southbridge.h"
+#include "power.h"
+#include "trace.h"
 
 static bool sb_initialised = false;
-volatile atomic_bool sb_i2c_in_use = false; // flag to indicate if I2C bus is in use
+
+// Bus rates to try, fastest first
+static const uint32_t sb_baudrates[] = {SB_BAUDRATE_MAX, 100000, 50000, 20000, SB_BAUDRATE};
+static uint8_t sb_rate = count_of(sb_baudrates) - 1; // index of the rate in use
+static uint8_t sb_errors = 0;                        // consecutive transfer errors
+
+// Request queue, run from the I2C interrupt
+static sb_request_t *sb_queue[SB_QUEUE_SIZE];
+static volatile uint8_t sb_queue_head = 0;
+static volatile uint8_t sb_queue_count = 0;
+static volatile bool sb_busy = false;                // the request at the head is on the bus
+static uint8_t sb_rx_count;                          // bytes read for it so far
+static alarm_id_t sb_timeout_alarm = -1;
+static bool sb_aborting = false;                     // the timeout has asked for an abort
+#if TRACE_ENABLED
+static uint32_t sb_started_us;                       // when the request at the head went on the bus
+#endif
+
+// Telemetry, refreshed in the background
+static sb_request_t sb_telemetry[3];
+static volatile uint8_t sb_battery = 0;
+static volatile uint8_t sb_lcd_backlight = 0;
+static volatile uint8_t sb_keyboard_backlight = 0;
+static volatile bool sb_battery_valid = false;
+static volatile bool sb_lcd_backlight_valid = false;
+static volatile bool sb_keyboard_backlight_valid = false;
+static power_task_t sb_telemetry_task;
 
 //
 //  Protect access to the "South Bridge"
@@ -25,12 +64,35 @@ volatile atomic_bool sb_i2c_in_use = false; // flag to indicate if I2C bus is in
 //  Is the southbridge available?
 bool sb_available()
 {
-    return atomic_load(&sb_i2c_in_use) == false;
+    return sb_initialised && sb_queue_count < SB_QUEUE_SIZE;
+}
+
+// Is no transfer on the bus? With interrupts disabled, none can start.
+bool sb_is_idle()
+{
+    return !sb_busy;
+}
+
+// Count a transfer error, slowing the bus down if they keep happening
+static void sb_error(void)
+{
+    if (++sb_errors >= SB_ERROR_LIMIT && sb_rate < count_of(sb_baudrates) - 1)
+    {
+        sb_rate++;
+        i2c_set_baudrate(SB_I2C, sb_baudrates[sb_rate]);
+        sb_errors = 0;
+    }
 }
 
+//
+//  Blocking transfers, used only while negotiating the bus rate
+//
+
 static size_t sb_write(const uint8_t *src, size_t len)
 {
+    TRACE_BEGIN(start);
     int result = i2c_write_timeout_us(SB_I2C, SB_ADDR, src, len, false, SB_I2C_TIMEOUT_US * len);
+    TRACE_END(start, TRACE_SB_WRITE, len);
     if (result == PICO_ERROR_GENERIC || result == PICO_ERROR_TIMEOUT)
     {
         // Write error
@@ -41,7 +103,9 @@ static size_t sb_write(const uint8_t *src, size_t len)
 
 static size_t sb_read(uint8_t *dst, size_t len)
 {
+    TRACE_BEGIN(start);
     int result = i2c_read_timeout_us(SB_I2C, SB_ADDR, dst, len, false, SB_I2C_TIMEOUT_US * len);
+    TRACE_END(start, TRACE_SB_READ, len);
     if (result == PICO_ERROR_GENERIC || result == PICO_ERROR_TIMEOUT)
     {
         // Read error
@@ -50,90 +114,394 @@ static size_t sb_read(uint8_t *dst, size_t len)
     return result;
 }
 
+// Read a register; true if both bytes arrived
+static bool sb_read_register(uint8_t reg, uint8_t buffer[2])
+{
+    buffer[0] = reg;
+    return sb_write(buffer, 1) == 1 && sb_read(buffer, 2) == 2;
+}
+
+// Find the fastest rate at which the LCD backlight register reads back the
+// same as at SB_BAUDRATE, every time
+static void sb_negotiate_baudrate(void)
+{
+    uint8_t expected[2];
+    if (!sb_read_register(SB_REG_BKL, expected))
+    {
+        return; // no southbridge, stay at the safe rate
+    }
+
+    for (uint8_t rate = 0; rate < count_of(sb_baudrates) - 1; rate++)
+    {
+        i2c_set_baudrate(SB_I2C, sb_baudrates[rate]);
+        sleep_us(100); // let the southbridge see a quiet bus
+
+        bool ok = true;
+        for (int i = 0; i < SB_PROBE_READS && ok; i++)
+        {
+            uint8_t buffer[2];
+            ok = sb_read_register(SB_REG_BKL, buffer) && buffer[0] == expected[0] && buffer[1] == expected[1];
+        }
+        if (ok)
+        {
+            sb_rate = rate;
+            return;
+        }
+    }
+
+    sb_rate = count_of(sb_baudrates) - 1;
+    i2c_set_baudrate(SB_I2C, SB_BAUDRATE);
+}
+
+uint32_t sb_get_baudrate()
+{
+    return sb_baudrates[sb_rate];
+}
+
+// Set the bus rate divider again after clk_peri has changed; call with
+// interrupts disabled while sb_is_idle()
+void sb_clock_changed()
+{
+    if (sb_initialised)
+    {
+        i2c_set_baudrate(SB_I2C, sb_baudrates[sb_rate]);
+    }
+}
+
+//
+//  Request queue
+//
+
+static void sb_start(void);
+
+// Complete the request at the head of the queue and start the next one
+static void sb_finish(bool ok)
+{
+    if (!sb_busy)
+    {
+        return;
+    }
+    if (sb_timeout_alarm >= 0)
+    {
+        cancel_alarm(sb_timeout_alarm);
+        sb_timeout_alarm = -1;
+    }
+
+    sb_request_t *request = sb_queue[sb_queue_head];
+    sb_queue_head = (sb_queue_head + 1) % SB_QUEUE_SIZE;
+    sb_queue_count--;
+    sb_busy = false;
+#if TRACE_ENABLED
+    trace_record(request->rx_len ? TRACE_SB_READ : TRACE_SB_WRITE, sb_started_us, request->tx_len + request->rx_len);
+#endif
+
+    if (ok)
+    {
+        sb_errors = 0;
+    }
+    else
+    {
+        sb_error();
+    }
+
+    // Done is set first so the callback can submit the request again
+    sb_callback_t callback = request->callback;
+    request->ok = ok;
+    request->done = true;
+    if (callback)
+    {
+        callback(request);
+    }
+
+    if (!sb_busy)
+    {
+        sb_start();
+    }
+}
+
+// A request that has not finished in time is aborted; if even the abort
+// does not finish, the controller is reset
+static int64_t sb_timeout_callback(alarm_id_t id, void *user_data)
+{
+    i2c_hw_t *hw = i2c_get_hw(SB_I2C);
+    if (!sb_aborting)
+    {
+        sb_aborting = true;
+        hw_set_bits(&hw->enable, I2C_IC_ENABLE_ABORT_BITS);
+        return SB_I2C_TIMEOUT_US;
+    }
+
+    sb_timeout_alarm = -1;
+    hw->enable = 0;
+    for (int i = 0; i < 1000 && (hw->enable_status & I2C_IC_ENABLE_STATUS_IC_EN_BITS); i++)
+    {
+        busy_wait_us_32(1);
+    }
+    hw->enable = I2C_IC_ENABLE_ENABLE_BITS;
+    sb_finish(false);
+    return 0;
+}
+
+// Put the commands of the request at the head of the queue in the FIFO
+static void sb_start(void)
+{
+    if (sb_busy || sb_queue_count == 0)
+    {
+        return;
+    }
+
+    sb_request_t *request = sb_queue[sb_queue_head];
+    i2c_hw_t *hw = i2c_get_hw(SB_I2C);
+    sb_busy = true;
+    sb_aborting = false;
+    sb_rx_count = 0;
+#if TRACE_ENABLED
+    sb_started_us = time_us_32();
+#endif
+    (void)hw->clr_intr;
+
+    for (uint8_t i = 0; i < request->tx_len; i++)
+    {
+        bool last = i == request->tx_len - 1;
+        hw->data_cmd = request->tx[i] | (last ? I2C_IC_DATA_CMD_STOP_BITS : 0);
+    }
+    for (uint8_t i = 0; i < request->rx_len; i++)
+    {
+        bool last = i == request->rx_len - 1;
+        hw->data_cmd = I2C_IC_DATA_CMD_CMD_BITS | (last ? I2C_IC_DATA_CMD_STOP_BITS : 0);
+    }
+
+    uint32_t bytes = request->tx_len + request->rx_len;
+    sb_timeout_alarm = add_alarm_in_us(SB_I2C_TIMEOUT_US * bytes, sb_timeout_callback, NULL, true);
+}
+
+static void sb_irq_handler(void)
+{
+    i2c_hw_t *hw = i2c_get_hw(SB_I2C);
+    uint32_t status = hw->intr_stat;
+    sb_request_t *request = sb_busy ? sb_queue[sb_queue_head] : NULL;
+
+    if (status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS)
+    {
+        // The controller has flushed the FIFO
+        (void)hw->clr_tx_abrt;
+        (void)hw->clr_stop_det;
+        while (hw->rxflr > 0)
+        {
+            (void)hw->data_cmd;
+        }
+        sb_finish(false);
+        return;
+    }
+
+    while (hw->rxflr > 0)
+    {
+        uint8_t byte = hw->data_cmd & I2C_IC_DATA_CMD_DAT_BITS;
+        if (request && sb_rx_count < request->rx_len)
+        {
+            request->rx[sb_rx_count++] = byte;
+        }
+    }
+
+    if (status & I2C_IC_INTR_STAT_R_STOP_DET_BITS)
+    {
+        (void)hw->clr_stop_det;
+        // STOP_DET is latched, so the STOPs after the write and after the read
+        // may arrive as one interrupt. The request is done once every byte has
+        // been read and the controller has no commands left and is idle.
+        if (request && sb_rx_count == request->rx_len && hw->txflr == 0 &&
+            !(hw->status & I2C_IC_STATUS_MST_ACTIVITY_BITS))
+        {
+            sb_finish(true);
+        }
+    }
+}
+
+// Queue a request without waiting; returns false if the queue is full
+bool sb_submit(sb_request_t *request)
+{
+    if (!sb_initialised)
+    {
+        return false;
+    }
+
+    uint32_t save = save_and_disable_interrupts();
+    bool queued = sb_queue_count < SB_QUEUE_SIZE;
+    if (queued)
+    {
+        request->done = false;
+        request->ok = false;
+        sb_queue[(sb_queue_head + sb_queue_count) % SB_QUEUE_SIZE] = request;
+        sb_queue_count++;
+        sb_start();
+    }
+    restore_interrupts(save);
+    return queued;
+}
+
+// Queue a request and wait for it; not for use from interrupts
+static bool sb_transfer(uint8_t reg, const uint8_t *value, uint8_t *reply)
+{
+    sb_request_t request = {
+        .tx = {reg, value ? *value : 0},
+        .tx_len = value ? 2 : 1,
+        .rx_len = reply ? 2 : 0,
+    };
+
+    while (!sb_submit(&request))
+    {
+        if (!sb_initialised)
+        {
+            return false;
+        }
+        tight_loop_contents(); // queue full
+    }
+    while (!request.done)
+    {
+        tight_loop_contents();
+    }
+
+    if (reply)
+    {
+        reply[0] = request.rx[0];
+        reply[1] = request.rx[1];
+    }
+    return request.ok;
+}
+
+//
+//  Telemetry
+//
+
+static void sb_telemetry_done(sb_request_t *request)
+{
+    if (!request->ok)
+    {
+        return;
+    }
+
+    switch (request->tx[0])
+    {
+    case SB_REG_BAT:
+        sb_battery = request->rx[1];
+        sb_battery_valid = true;
+        break;
+    case SB_REG_BKL:
+        sb_lcd_backlight = request->rx[1];
+        sb_lcd_backlight_valid = true;
+        break;
+    case SB_REG_BK2:
+        sb_keyboard_backlight = request->rx[1];
+        sb_keyboard_backlight_valid = true;
+        break;
+    }
+}
+
+static uint32_t on_telemetry_task(void)
+{
+    for (int i = 0; i < count_of(sb_telemetry); i++)
+    {
+        if (sb_telemetry[i].done)
+        {
+            sb_submit(&sb_telemetry[i]);
+        }
+    }
+    return SB_TELEMETRY_MS;
+}
+
+static void sb_telemetry_init(void)
+{
+    static const uint8_t registers[count_of(sb_telemetry)] = {SB_REG_BAT, SB_REG_BKL, SB_REG_BK2};
+    for (int i = 0; i < count_of(sb_telemetry); i++)
+    {
+        sb_telemetry[i].tx[0] = registers[i];
+        sb_telemetry[i].tx_len = 1;
+        sb_telemetry[i].rx_len = 2;
+        sb_telemetry[i].callback = sb_telemetry_done;
+        sb_telemetry[i].done = true;
+    }
+    on_telemetry_task();
+    power_task_start(&sb_telemetry_task, on_telemetry_task, SB_TELEMETRY_MS);
+}
+
+//
+//  Southbridge registers
+//
+
 // Read the keyboard
 uint16_t sb_read_keyboard()
 {
     uint8_t buffer[2];
 
-    atomic_store(&sb_i2c_in_use, true);
-    buffer[0] = SB_REG_FIF;             // command to check if key is available
-    if (sb_write(buffer, 1) != 1)
+    if (!sb_transfer(SB_REG_FIF, NULL, buffer)) // command to check if key is available
     {
-        atomic_store(&sb_i2c_in_use, false);
         return 0;
     }
-    if (sb_read(buffer, 2) != 2)
-    {
-        atomic_store(&sb_i2c_in_use, false);
-        return 0;
-    }
-    atomic_store(&sb_i2c_in_use, false);
-
     return buffer[0] << 8 | buffer[1];
 }
 
-uint16_t sb_read_keyboard_state()
+// Read up to `max_events` key events waiting in the FIFO; returns the
+// number read
+uint8_t sb_read_keyboard_events(uint16_t *events, uint8_t max_events)
 {
     uint8_t buffer[2];
+    uint8_t count = 0;
 
-    atomic_store(&sb_i2c_in_use, true);
-    buffer[0] = SB_REG_KEY;             // command to read key state
-    if (sb_write(buffer, 1) != 1)
+    if (sb_transfer(SB_REG_KEY, NULL, buffer))
     {
-        atomic_store(&sb_i2c_in_use, false);
-        return 0;
+        uint8_t waiting = MIN(buffer[0] & SB_KEY_COUNT_MASK, max_events);
+        while (count < waiting && sb_transfer(SB_REG_FIF, NULL, buffer))
+        {
+            events[count++] = buffer[0] << 8 | buffer[1];
+        }
     }
-    if (sb_read(buffer, 2) != 2)
+    return count;
+}
+
+uint16_t sb_read_keyboard_state()
+{
+    uint8_t buffer[2];
+
+    if (!sb_transfer(SB_REG_KEY, NULL, buffer)) // command to read key state
     {
-        atomic_store(&sb_i2c_in_use, false);
         return 0;
     }
-    atomic_store(&sb_i2c_in_use, false);
-
     return buffer[0];
 }
 
-// Read the battery level from the southbridge
+// Read the battery level from the southbridge, as last sampled
 uint8_t sb_read_battery()
 {
     uint8_t buffer[2];
 
-    atomic_store(&sb_i2c_in_use, true);
-    buffer[0] = SB_REG_BAT; // command to read battery level
-    if (sb_write(buffer, 1) != 1)
+    if (sb_battery_valid)
     {
-        atomic_store(&sb_i2c_in_use, false);
-        return 0;
+        return sb_battery;
     }
-    if (sb_read(buffer, 2) != 2)
+    if (!sb_transfer(SB_REG_BAT, NULL, buffer)) // command to read battery level
     {
-        atomic_store(&sb_i2c_in_use, false);
         return 0;
     }
-    atomic_store(&sb_i2c_in_use, false);
-
+    sb_battery = buffer[1];
+    sb_battery_valid = true;
     return buffer[1];
 }
 
-// Read the LCD backlight level
+// Read the LCD backlight level, as last sampled or written
 uint8_t sb_read_lcd_backlight()
 {
     uint8_t buffer[2];
 
-    atomic_store(&sb_i2c_in_use, true);
-    buffer[0] = SB_REG_BKL; // command to read LCD backlight
-    if (sb_write(buffer, 1) != 1)
+    if (sb_lcd_backlight_valid)
     {
-        atomic_store(&sb_i2c_in_use, false);
-        return 0;
+        return sb_lcd_backlight;
     }
-    if (sb_read(buffer, 2) != 2)
+    if (!sb_transfer(SB_REG_BKL, NULL, buffer)) // command to read LCD backlight
     {
-        atomic_store(&sb_i2c_in_use, false);
         return 0;
     }
-    atomic_store(&sb_i2c_in_use, false);
-
+    sb_lcd_backlight = buffer[1];
+    sb_lcd_backlight_valid = true;
     return buffer[1];
 }
 
@@ -142,43 +510,30 @@ uint8_t sb_write_lcd_backlight(uint8_t brightness)
 {
     uint8_t buffer[2];
 
-    atomic_store(&sb_i2c_in_use, true);
-    buffer[0] = SB_REG_BKL | SB_WRITE; // command to write LCD backlight
-    buffer[1] = brightness;
-    if (sb_write(buffer, 2) != 2)
+    if (!sb_transfer(SB_REG_BKL | SB_WRITE, &brightness, buffer)) // command to write LCD backlight
     {
-        atomic_store(&sb_i2c_in_use, false);
         return 0;
     }
-    if (sb_read(buffer, 2) != 2)
-    {
-        atomic_store(&sb_i2c_in_use, false);
-        return 0;
-    }
-    atomic_store(&sb_i2c_in_use, false);
-
+    sb_lcd_backlight = buffer[1];
+    sb_lcd_backlight_valid = true;
     return buffer[1];
 }
 
-// Read the keyboard backlight level
+// Read the keyboard backlight level, as last sampled or written
 uint8_t sb_read_keyboard_backlight()
 {
     uint8_t buffer[2];
 
-    atomic_store(&sb_i2c_in_use, true);
-    buffer[0] = SB_REG_BK2; // command to read keyboard backlight
-    if (sb_write(buffer, 1) != 1)
+    if (sb_keyboard_backlight_valid)
     {
-        atomic_store(&sb_i2c_in_use, false);
-        return 0;
+        return sb_keyboard_backlight;
     }
-    if (sb_read(buffer, 2) != 2)
+    if (!sb_transfer(SB_REG_BK2, NULL, buffer)) // command to read keyboard backlight
     {
-        atomic_store(&sb_i2c_in_use, false);
         return 0;
     }
-    atomic_store(&sb_i2c_in_use, false);
-
+    sb_keyboard_backlight = buffer[1];
+    sb_keyboard_backlight_valid = true;
     return buffer[1];
 }
 
@@ -187,21 +542,12 @@ uint8_t sb_write_keyboard_backlight(uint8_t brightness)
 {
     uint8_t buffer[2];
 
-    atomic_store(&sb_i2c_in_use, true);
-    buffer[0] = SB_REG_BK2 | SB_WRITE; // command to write keyboard backlight
-    buffer[1] = brightness;
-    if (sb_write(buffer, 2) != 2)
+    if (!sb_transfer(SB_REG_BK2 | SB_WRITE, &brightness, buffer)) // command to write keyboard backlight
     {
-        atomic_store(&sb_i2c_in_use, false);
         return 0;
     }
-    if (sb_read(buffer, 2) != 2)
-    {
-        atomic_store(&sb_i2c_in_use, false);
-        return 0;
-    }
-    atomic_store(&sb_i2c_in_use, false);
-
+    sb_keyboard_backlight = buffer[1];
+    sb_keyboard_backlight_valid = true;
     return buffer[1];
 }
 
@@ -209,58 +555,25 @@ bool sb_is_power_off_supported()
 {
     uint8_t buffer[2];
 
-    atomic_store(&sb_i2c_in_use, true);
-    buffer[0] = SB_REG_OFF; // read the power-off register
-    if (sb_write(buffer, 1) != 1)
+    if (!sb_transfer(SB_REG_OFF, NULL, buffer)) // read the power-off register
     {
-        atomic_store(&sb_i2c_in_use, false);
         return false;
     }
-    if (sb_read(buffer, 2) != 2)
-    {
-        atomic_store(&sb_i2c_in_use, false);
-        return false;
-    }
-    atomic_store(&sb_i2c_in_use, false);
-
     return buffer[1] > 0;
 }
 
 bool sb_write_power_off_delay(uint8_t delay_seconds)
 {
-    uint8_t buffer[2];
-
-    atomic_store(&sb_i2c_in_use, true);
-    buffer[0] = SB_REG_OFF | SB_WRITE; // command to write power-off delay
-    buffer[1] = delay_seconds;
-    if (sb_write(buffer, 2) != 2)
-    {
-        atomic_store(&sb_i2c_in_use, false);
-        return false;
-    }
-    atomic_store(&sb_i2c_in_use, false);
-    return true;
+    // command to write power-off delay
+    return sb_transfer(SB_REG_OFF | SB_WRITE, &delay_seconds, NULL);
 }
 
 bool sb_reset(uint8_t delay_seconds)
 {
     uint8_t buffer[2];
 
-    atomic_store(&sb_i2c_in_use, true);
-    buffer[0] = SB_REG_RST | SB_WRITE; // command to reset the PicoCalc
-    buffer[1] = delay_seconds;
-    if (sb_write(buffer, 2) != 2)
-    {
-        atomic_store(&sb_i2c_in_use, false);
-        return false;
-    }
-    if (sb_read(buffer, 2) != 2)
-    {
-        atomic_store(&sb_i2c_in_use, false);
-        return false;
-    }
-    atomic_store(&sb_i2c_in_use, false);
-    return true;
+    // command to reset the PicoCalc
+    return sb_transfer(SB_REG_RST | SB_WRITE, &delay_seconds, buffer);
 }
 
 // Initialize the southbridge
@@ -277,6 +590,20 @@ void sb_init()
     gpio_pull_up(SB_SCL);
     gpio_pull_up(SB_SDA);
 
+    sb_negotiate_baudrate();
+
+    // Hand the controller to the request queue
+    i2c_hw_t *hw = i2c_get_hw(SB_I2C);
+    hw->enable = 0;
+    hw->tar = SB_ADDR;
+    hw->rx_tl = 0; // interrupt on every byte read
+    hw->intr_mask = I2C_IC_INTR_MASK_M_RX_FULL_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS | I2C_IC_INTR_MASK_M_STOP_DET_BITS;
+    hw->enable = I2C_IC_ENABLE_ENABLE_BITS;
+    irq_set_exclusive_handler(SB_I2C_IRQ, sb_irq_handler);
+    irq_set_enabled(SB_I2C_IRQ, true);
+
     // Set the initialised flag
     sb_initialised = true;
+
+    sb_telemetry_init();
 }
@@ -3,6 +3,7 @@
 #include "pico/stdlib.h"
 
 #define SB_I2C              (i2c1)      // I2C interface for the south bridge
+#define SB_I2C_IRQ          (I2C1_IRQ)  // its interrupt
 
 // Raspberry Pi Pico board GPIO pins
 #define SB_SDA              (6)
@@ -10,9 +11,14 @@
 
 
 // Keyboard interface definitions
-#define SB_BAUDRATE       (10000)
+#define SB_BAUDRATE       (10000)      // rate the southbridge always supports
+#define SB_BAUDRATE_MAX   (400000)     // fastest rate tried at start up
 #define SB_ADDR            (0x1F)
 #define SB_I2C_TIMEOUT_US (10000)
+#define SB_PROBE_READS    (8)          // reads that must match to accept a faster rate
+#define SB_ERROR_LIMIT    (3)          // consecutive errors before slowing down
+#define SB_QUEUE_SIZE     (8)          // requests waiting for the bus
+#define SB_TELEMETRY_MS   (2000)       // battery and backlight sampling interval
 
 
 // Keyboard register definitions
@@ -26,12 +32,35 @@
 
 #define SB_WRITE           (0x80)      // write to register
 
+#define SB_KEY_COUNT_MASK  (0x1F)      // events waiting in the FIFO, in SB_REG_KEY
+
+// A bus request: write `tx`, then read `rx_len` bytes into `rx`. The
+// callback, if any, is called from the I2C interrupt when it completes.
+typedef struct sb_request sb_request_t;
+typedef void (*sb_callback_t)(sb_request_t *request);
+
+struct sb_request {
+    uint8_t tx[2];
+    uint8_t tx_len;
+    uint8_t rx[2];
+    uint8_t rx_len;
+    sb_callback_t callback;
+    void *user_data;
+    volatile bool done;         // set when the request completes
+    volatile bool ok;           // all bytes were transferred
+};
+
 // Function prototypes
 void sb_init(void);
+bool sb_submit(sb_request_t *request);
 bool sb_available(void);
+bool sb_is_idle(void);
+void sb_clock_changed(void);
 
 uint16_t sb_read_keyboard(void);
 uint16_t sb_read_keyboard_state(void);
+uint8_t sb_read_keyboard_events(uint16_t *events, uint8_t max_events);
+uint32_t sb_get_baudrate(void);
 uint8_t sb_read_battery(void);
 uint8_t sb_read_lcd_backlight(void);
 uint8_t sb_write_lcd_backlight(uint8_t brightness);
@@ -0,0 +1,162 @@
+//
+// trace.c - Hot-path event tracing
+//
+// Instrumented code marks the start and end of a span with TRACE_BEGIN() and
+// TRACE_END(). Each span goes into a ring of the last TRACE_BUFFER_SIZE
+// events and into per-event totals, which count every span since the last
+// reset. With TRACE_ENABLED set to 0 the macros compile to nothing and the
+// functions here only report that there is nothing to show.
+//
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "trace.h"
+
+#if TRACE_ENABLED
+
+static trace_record_t trace_ring[TRACE_BUFFER_SIZE];
+static uint32_t trace_head = 0;             // events recorded since the reset
+static trace_stats_t trace_stats[TRACE_EVENT_COUNT];
+static spin_lock_t *trace_lock = NULL;      // events come from both cores and interrupts
+static volatile bool trace_paused = false;
+
+#endif
+
+// RAM taken by the event ring, for the mem command
+#if TRACE_ENABLED
+const uint32_t trace_static_bytes = sizeof(trace_ring) + sizeof(trace_stats);
+#else
+const uint32_t trace_static_bytes = 0;
+#endif
+
+static const char *const trace_names[TRACE_EVENT_COUNT] = {
+    [TRACE_LCD_BLIT] = "lcd_blit",
+    [TRACE_LCD_SEND_PIXELS] = "lcd_send_pixels",
+    [TRACE_LCD_DMA_FILL] = "lcd_dma_fill",
+    [TRACE_LCD_DMA_PIXELS] = "lcd_dma_pixels",
+    [TRACE_LCD_LOCKED] = "lcd_locked",
+    [TRACE_SD_CMD] = "sd_cmd",
+    [TRACE_SD_READ] = "sd_read_blocks",
+    [TRACE_SD_WRITE] = "sd_write_blocks",
+    [TRACE_SB_READ] = "sb_read",
+    [TRACE_SB_WRITE] = "sb_write",
+    [TRACE_KEYBOARD_POLL] = "keyboard_poll",
+};
+
+void trace_init(void)
+{
+#if TRACE_ENABLED
+    trace_lock = spin_lock_instance(spin_lock_claim_unused(true));
+#endif
+}
+
+// Record a span that started at start_us and ends now
+void trace_record(trace_event_t event, uint32_t start_us, uint32_t arg)
+{
+#if TRACE_ENABLED
+    uint32_t duration = time_us_32() - start_us;
+    if (trace_lock == NULL || trace_paused)
+    {
+        return;
+    }
+
+    uint32_t save = spin_lock_blocking(trace_lock);
+    trace_record_t *record = &trace_ring[trace_head++ & (TRACE_BUFFER_SIZE - 1)];
+    record->start_us = start_us;
+    record->duration_us = duration;
+    record->arg = arg;
+    record->event = (uint8_t)event;
+    record->core = (uint8_t)get_core_num();
+
+    trace_stats_t *stats = &trace_stats[event];
+    stats->count++;
+    stats->total_us += duration;
+    if (duration > stats->max_us)
+    {
+        stats->max_us = duration;
+    }
+    spin_unlock(trace_lock, save);
+#else
+    (void)event;
+    (void)start_us;
+    (void)arg;
+#endif
+}
+
+// Stop recording, e.g. while the trace is being saved
+void trace_set_paused(bool paused)
+{
+#if TRACE_ENABLED
+    trace_paused = paused;
+#else
+    (void)paused;
+#endif
+}
+
+void trace_reset(void)
+{
+#if TRACE_ENABLED
+    if (trace_lock == NULL)
+    {
+        return;
+    }
+    uint32_t save = spin_lock_blocking(trace_lock);
+    trace_head = 0;
+    memset(trace_stats, 0, sizeof(trace_stats));
+    spin_unlock(trace_lock, save);
+#endif
+}
+
+// Totals for an event since the last reset; false when tracing is compiled out
+bool trace_get_stats(trace_event_t event, trace_stats_t *stats)
+{
+#if TRACE_ENABLED
+    if (trace_lock == NULL)
+    {
+        memset(stats, 0, sizeof(*stats));
+        return true;
+    }
+    uint32_t save = spin_lock_blocking(trace_lock);
+    *stats = trace_stats[event];
+    spin_unlock(trace_lock, save);
+    return true;
+#else
+    memset(stats, 0, sizeof(*stats));
+    (void)event;
+    return false;
+#endif
+}
+
+// Copy up to count of the events still in the ring, oldest first, skipping
+// the first `first` of them; returns the number copied
+uint32_t trace_get_records(trace_record_t *records, uint32_t first, uint32_t count)
+{
+#if TRACE_ENABLED
+    if (trace_lock == NULL)
+    {
+        return 0;
+    }
+    uint32_t save = spin_lock_blocking(trace_lock);
+    uint32_t held = MIN(trace_head, TRACE_BUFFER_SIZE);
+    uint32_t oldest = trace_head - held;
+    uint32_t copied = 0;
+    for (uint32_t i = first; i < held && copied < count; i++)
+    {
+        records[copied++] = trace_ring[(oldest + i) & (TRACE_BUFFER_SIZE - 1)];
+    }
+    spin_unlock(trace_lock, save);
+    return copied;
+#else
+    (void)records;
+    (void)first;
+    (void)count;
+    return 0;
+#endif
+}
+
+const char *trace_event_name(trace_event_t event)
+{
+    return event < TRACE_EVENT_COUNT ? trace_names[event] : "?";
+}
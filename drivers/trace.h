@@ -0,0 +1,59 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED       0              // 1 = record hot-path events for the perf command
+#endif
+
+#define TRACE_BUFFER_SIZE   (512)          // events kept, a power of two
+
+// Traced events; each one is a span with a start time and a duration
+typedef enum {
+    TRACE_LCD_BLIT,         // arg: pixels
+    TRACE_LCD_SEND_PIXELS,  // arg: pixels
+    TRACE_LCD_DMA_FILL,     // solid fill by DMA, start to completion; arg: pixels
+    TRACE_LCD_DMA_PIXELS,   // pixel buffer by DMA, start to completion; arg: pixels
+    TRACE_LCD_LOCKED,       // LCD critical section, interrupts disabled
+    TRACE_SD_CMD,           // arg: command number
+    TRACE_SD_READ,          // arg: sectors
+    TRACE_SD_WRITE,         // arg: sectors
+    TRACE_SB_READ,          // arg: bytes
+    TRACE_SB_WRITE,         // arg: bytes
+    TRACE_KEYBOARD_POLL,
+    TRACE_EVENT_COUNT
+} trace_event_t;
+
+typedef struct {
+    uint32_t start_us;      // time_us_32() at the start of the span
+    uint32_t duration_us;
+    uint32_t arg;
+    uint8_t event;          // trace_event_t
+    uint8_t core;
+} trace_record_t;
+
+typedef struct {
+    uint32_t count;
+    uint64_t total_us;
+    uint32_t max_us;
+} trace_stats_t;
+
+// TRACE_BEGIN(name) declares the start time of a span, TRACE_END(name, event, arg)
+// records it. Both compile to nothing when tracing is disabled.
+#if TRACE_ENABLED
+#define TRACE_BEGIN(name)               uint32_t name = time_us_32()
+#define TRACE_END(name, event, arg)     trace_record((event), (name), (uint32_t)(arg))
+#else
+#define TRACE_BEGIN(name)
+#define TRACE_END(name, event, arg)     ((void)0)
+#endif
+
+void trace_init(void);
+void trace_record(trace_event_t event, uint32_t start_us, uint32_t arg);
+void trace_set_paused(bool paused);
+void trace_reset(void);
+bool trace_get_stats(trace_event_t event, trace_stats_t *stats);
+uint32_t trace_get_records(trace_record_t *records, uint32_t first, uint32_t count);
+const char *trace_event_name(trace_event_t event);
+
+extern const uint32_t trace_static_bytes;
@@ -7,10 +7,178 @@
 #include "sd_card.h"
 #include "sdfs.h"
 #include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include <string.h>
+
+#define CACHE_LINES (SDFS_CACHE_SETS * SDFS_CACHE_WAYS)
 
 FATFS sdfs_volume;
 static bool mounted = false;
-static repeating_timer_t detect_timer;
+
+// Set by the card detect interrupt, cleared when the card is initialised
+static volatile bool card_changed = true;
+static volatile uint32_t detect_edge_ms = 0; // time of the last detect edge
+
+// Sector cache: a line holds one sector. FatFS reads and writes single
+// sectors for the FAT and directories; those go through the cache, larger
+// transfers go straight to the card.
+typedef struct {
+    LBA_t sector;
+    uint32_t used;                  // LRU stamp, larger is more recent
+    bool valid;
+    bool dirty;                     // newer than the card
+} cache_line_t;
+
+static cache_line_t cache_lines[CACHE_LINES];
+static uint8_t cache_data[CACHE_LINES][512] __attribute__((aligned(4)));
+static uint32_t cache_clock = 0;
+static sdfs_cache_stats_t cache_stats;
+
+// RAM taken by the volume and the sector cache, for the mem command
+const uint32_t sdfs_cache_static_bytes = sizeof(sdfs_volume) + sizeof(cache_lines) + sizeof(cache_data);
+
+// ---------------------------------------------------------------------------
+// Card access with retries
+// ---------------------------------------------------------------------------
+
+// Data CRC errors are retried; the driver slows the clock if they persist
+static DRESULT read_sectors(LBA_t sector, UINT count, BYTE *buf)
+{
+    sd_error_t err;
+    int tries = SD_DATA_RETRIES;
+    do {
+        err = sd_read_blocks(sector, count, buf);
+    } while (err == SD_ERR_CRC_DATA && --tries > 0);
+    return err == SD_ERR_NONE ? RES_OK : RES_ERROR;
+}
+
+static DRESULT write_sectors(LBA_t sector, UINT count, const BYTE *buf, const uint8_t *const *blocks)
+{
+    sd_error_t err;
+    int tries = SD_DATA_RETRIES;
+    do {
+        err = blocks ? sd_write_gather(sector, count, blocks)
+                     : sd_write_blocks(sector, count, buf);
+    } while (err == SD_ERR_CRC_DATA && --tries > 0);
+    return err == SD_ERR_NONE ? RES_OK : RES_ERROR;
+}
+
+// ---------------------------------------------------------------------------
+// Sector cache
+// ---------------------------------------------------------------------------
+
+static int cache_find(LBA_t sector)
+{
+    int base = (sector % SDFS_CACHE_SETS) * SDFS_CACHE_WAYS;
+    for (int i = base; i < base + SDFS_CACHE_WAYS; i++) {
+        if (cache_lines[i].valid && cache_lines[i].sector == sector) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void cache_touch(int line)
+{
+    cache_lines[line].used = ++cache_clock;
+}
+
+// Write back the run of adjacent dirty sectors containing `line` with one
+// multi-block write
+static DRESULT cache_write_run(int line)
+{
+    LBA_t first = cache_lines[line].sector;
+    int prev;
+    while (first > 0 && (prev = cache_find(first - 1)) >= 0 && cache_lines[prev].dirty) {
+        first--;
+    }
+
+    static const uint8_t *blocks[CACHE_LINES];
+    int lines[CACHE_LINES];
+    UINT count = 0;
+    int next;
+    while (count < CACHE_LINES && (next = cache_find(first + count)) >= 0 && cache_lines[next].dirty) {
+        lines[count] = next;
+        blocks[count] = cache_data[next];
+        count++;
+    }
+
+    DRESULT res = write_sectors(first, count, NULL, blocks);
+    if (res == RES_OK) {
+        for (UINT i = 0; i < count; i++) {
+            cache_lines[lines[i]].dirty = false;
+        }
+        cache_stats.writebacks += count;
+        cache_stats.write_cmds++;
+    }
+    return res;
+}
+
+static DRESULT cache_flush(void)
+{
+    for (int i = 0; i < CACHE_LINES; i++) {
+        if (cache_lines[i].valid && cache_lines[i].dirty) {
+            DRESULT res = cache_write_run(i);
+            if (res != RES_OK) {
+                return res;
+            }
+        }
+    }
+    return RES_OK;
+}
+
+static void cache_invalidate(void)
+{
+    memset(cache_lines, 0, sizeof(cache_lines));
+}
+
+// Find a line for `sector`, replacing the least recently used line of its set
+static DRESULT cache_allocate(LBA_t sector, int *line)
+{
+    int base = (sector % SDFS_CACHE_SETS) * SDFS_CACHE_WAYS;
+    int victim = base;
+    for (int i = base; i < base + SDFS_CACHE_WAYS; i++) {
+        if (!cache_lines[i].valid) {
+            victim = i;
+            break;
+        }
+        if (cache_lines[i].used < cache_lines[victim].used) {
+            victim = i;
+        }
+    }
+
+    if (cache_lines[victim].valid && cache_lines[victim].dirty) {
+        DRESULT res = cache_write_run(victim);
+        if (res != RES_OK) {
+            return res;
+        }
+    }
+
+    cache_lines[victim].sector = sector;
+    cache_lines[victim].valid = false;
+    cache_lines[victim].dirty = false;
+    *line = victim;
+    return RES_OK;
+}
+
+// Forget cached copies of sectors that are about to be written behind the
+// cache's back
+void sdfs_cache_discard(LBA_t sector, LBA_t count)
+{
+    for (int i = 0; i < CACHE_LINES; i++) {
+        if (cache_lines[i].valid && cache_lines[i].sector - sector < count) {
+            cache_lines[i].valid = false;
+        }
+    }
+}
+
+void sdfs_get_cache_stats(sdfs_cache_stats_t *stats, bool reset)
+{
+    *stats = cache_stats;
+    if (reset) {
+        memset(&cache_stats, 0, sizeof(cache_stats));
+    }
+}
 
 // ---------------------------------------------------------------------------
 // FatFS disk I/O interface
@@ -19,37 +187,124 @@ static repeating_timer_t detect_timer;
 DSTATUS disk_initialize(BYTE pdrv)
 {
     if (pdrv != 0) return STA_NOINIT;
-    return sd_card_init() == SD_ERR_NONE ? 0 : STA_NOINIT;
+    cache_invalidate(); // may be a different card
+
+    // Let the detect switch settle after an insertion
+    while (to_ms_since_boot(get_absolute_time()) - detect_edge_ms < SDFS_DEBOUNCE_MS) {
+        sleep_ms(1);
+    }
+    if (!sd_card_present()) return STA_NOINIT | STA_NODISK;
+
+    card_changed = false; // before init, so an edge during init is not lost
+    if (sd_card_init() != SD_ERR_NONE) {
+        card_changed = true;
+        return STA_NOINIT;
+    }
+    return 0;
 }
 
 DSTATUS disk_status(BYTE pdrv)
 {
     if (pdrv != 0) return STA_NOINIT;
-    if (!sd_card_present()) return STA_NODISK;
+    if (!sd_card_present()) return STA_NOINIT | STA_NODISK;
+    if (card_changed) return STA_NOINIT; // FatFS mounts the volume again
     return 0;
 }
 
 DRESULT disk_read(BYTE pdrv, BYTE *buf, LBA_t sector, UINT count)
 {
     if (pdrv != 0) return RES_PARERR;
-    // Use sd_read_blocks() for any count: issues a single CMD18 when count > 1
-    return sd_read_blocks(sector, count, buf) == SD_ERR_NONE ? RES_OK : RES_ERROR;
+
+    if (count > 1) {
+        // Single CMD18 straight into the caller's buffer, then overlay any
+        // cached sectors that have not been written back yet
+        DRESULT res = read_sectors(sector, count, buf);
+        if (res != RES_OK) return res;
+        for (UINT i = 0; i < count; i++) {
+            int line = cache_find(sector + i);
+            if (line >= 0 && cache_lines[line].dirty) {
+                memcpy(buf + i * 512, cache_data[line], 512);
+            }
+        }
+        return RES_OK;
+    }
+
+    int line = cache_find(sector);
+    if (line >= 0) {
+        cache_stats.hits++;
+    } else {
+        DRESULT res = cache_allocate(sector, &line);
+        if (res != RES_OK) return res;
+        res = read_sectors(sector, 1, cache_data[line]);
+        if (res != RES_OK) return res;
+        cache_lines[line].valid = true;
+        cache_stats.misses++;
+    }
+    cache_touch(line);
+    memcpy(buf, cache_data[line], 512);
+    return RES_OK;
 }
 
 DRESULT disk_write(BYTE pdrv, const BYTE *buf, LBA_t sector, UINT count)
 {
     if (pdrv != 0) return RES_PARERR;
-    // Use sd_write_blocks() for any count: issues a single CMD25 when count > 1
-    return sd_write_blocks(sector, count, buf) == SD_ERR_NONE ? RES_OK : RES_ERROR;
+
+    if (count > 1) {
+        // Single CMD25 straight from the caller's buffer; cached copies
+        // are replaced by what was written. If it fails, dirty lines stay
+        // dirty so the next sync writes them again, and clean lines are
+        // dropped as the card may hold part of the new data.
+        DRESULT res = write_sectors(sector, count, buf, NULL);
+        for (UINT i = 0; i < count; i++) {
+            int line = cache_find(sector + i);
+            if (line >= 0) {
+                if (res == RES_OK) {
+                    memcpy(cache_data[line], buf + i * 512, 512);
+                    cache_lines[line].dirty = false;
+                } else if (!cache_lines[line].dirty) {
+                    cache_lines[line].valid = false;
+                }
+            }
+        }
+        return res;
+    }
+
+    // Whole sector, so a miss does not need to read the card first
+    int line = cache_find(sector);
+    if (line >= 0) {
+        cache_stats.hits++;
+    } else {
+        DRESULT res = cache_allocate(sector, &line);
+        if (res != RES_OK) return res;
+    }
+    memcpy(cache_data[line], buf, 512);
+    cache_lines[line].valid = true;
+    cache_lines[line].dirty = true;
+    cache_touch(line);
+    return RES_OK;
+}
+
+// Erase the whole erase blocks inside the freed sectors first..last.
+// Erasing part of a block would make the card copy out the rest of it.
+static DRESULT trim_sectors(LBA_t first, LBA_t last)
+{
+    LBA_t block = sd_get_erase_sectors();
+    LBA_t start = (first + block - 1) / block * block;
+    LBA_t end = (last + 1) / block * block;
+
+    sdfs_cache_discard(first, last - first + 1); // freed, never write them back
+    if (start >= end) return RES_OK;
+    return sd_erase(start, end - start) == SD_ERR_NONE ? RES_OK : RES_ERROR;
 }
 
 DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buf)
 {
     if (pdrv != 0) return RES_PARERR;
     switch (cmd) {
-        case CTRL_SYNC:       return RES_OK;
+        case CTRL_SYNC:       return cache_flush();
         case GET_SECTOR_SIZE: *(WORD  *)buf = 512; return RES_OK;
-        case GET_BLOCK_SIZE:  *(DWORD *)buf = 1;   return RES_OK;
+        case GET_BLOCK_SIZE:  *(DWORD *)buf = sd_get_erase_sectors(); return RES_OK;
+        case CTRL_TRIM:       return trim_sectors(((LBA_t *)buf)[0], ((LBA_t *)buf)[1]);
         case GET_SECTOR_COUNT: {
             uint32_t n;
             if (sd_get_sector_count(&n) != SD_ERR_NONE) return RES_ERROR;
@@ -64,30 +319,39 @@ DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buf)
 // Mount management and hot-plug
 // ---------------------------------------------------------------------------
 
+// The volume is registered at boot but only mounted when it is first used,
+// always from thread context: FatFS calls disk_status() on every access and
+// mounts again (through disk_initialize()) once the card has changed.
+
 bool sdfs_is_ready(void)
 {
-    if (sd_card_present() && !mounted) {
-        if (f_mount(&sdfs_volume, "", 1) == FR_OK) {
-            mounted = true;
-        }
-    } else if (!sd_card_present() && mounted) {
-        f_mount(NULL, "", 0);
+    if (!sd_card_present()) {
         mounted = false;
+        return false;
+    }
+    if (!mounted || card_changed) {
+        mounted = f_mount(&sdfs_volume, "", 1) == FR_OK;
     }
     return mounted;
 }
 
-static bool sdfs_detect_callback(repeating_timer_t *rt)
+static void sdfs_detect_irq(void)
 {
-    (void)rt;
-    sdfs_is_ready();
-    return true; // keep repeating
+    if (gpio_get_irq_event_mask(SD_DETECT) & (GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE)) {
+        gpio_acknowledge_irq(SD_DETECT, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE);
+        card_changed = true;
+        detect_edge_ms = to_ms_since_boot(get_absolute_time());
+    }
 }
 
 void sdfs_init(void)
 {
     sd_init(); // GPIO/SPI setup
 
-    // Poll every 500 ms for card insertion/removal
-    add_repeating_timer_ms(-500, sdfs_detect_callback, NULL, &detect_timer);
+    f_mount(&sdfs_volume, "", 0); // register only, mounted on first access
+
+    // Card insertion/removal edges mark the card as changed
+    gpio_add_raw_irq_handler(SD_DETECT, sdfs_detect_irq);
+    gpio_set_irq_enabled(SD_DETECT, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
+    irq_set_enabled(IO_IRQ_BANK0, true);
 }
@@ -277,6 +277,12 @@
 #endif
 
 
+/* Bulk tree delete */
+#if FF_USE_RMTREE && (FF_FS_EXFAT || FF_FS_LOCK)
+#error f_rmtree does not support exFAT or file locking
+#endif
+
+
 /* File lock controls */
 #if FF_FS_LOCK
 #if FF_FS_READONLY
@@ -1474,6 +1480,9 @@ static FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 		if (!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) {
 			res = put_fat(fs, clst, 0);		/* Mark the cluster 'free' on the FAT */
 			if (res != FR_OK) return res;
+#if FF_USE_FREEMAP
+			ff_freemap_update(fs, clst, 1, 1);
+#endif
 		}
 		if (fs->free_clst < fs->n_fatent - 2) {	/* Update allocation information if it is valid */
 			fs->free_clst++;
@@ -1606,6 +1615,9 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 					ncl = 2;
 					if (ncl > scl) return 0;	/* No free cluster found? */
 				}
+#if FF_USE_FREEMAP
+				ncl = ff_freemap_skip(fs, ncl, ncl <= scl ? scl : fs->n_fatent - 1);	/* Skip clusters known to be in use */
+#endif
 				cs = get_fat(obj, ncl);			/* Get the cluster status */
 				if (cs == 0) break;				/* Found a free cluster? */
 				if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
@@ -1613,6 +1625,9 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 			}
 		}
 		res = put_fat(fs, ncl, 0xFFFFFFFF);		/* Mark the new cluster 'EOC' */
+#if FF_USE_FREEMAP
+		if (res == FR_OK) ff_freemap_update(fs, ncl, 1, -1);
+#endif
 		if (res == FR_OK && clst != 0) {
 			res = put_fat(fs, clst, ncl);		/* Link it from the previous one if needed */
 		}
@@ -2409,8 +2424,54 @@ static FRESULT dir_read (
 /* Directory handling - Find an object in the directory                  */
 /*-----------------------------------------------------------------------*/
 
-static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
-	DIR* dp					/* Pointer to the directory object with the file name */
+#if FF_USE_DIRCACHE && FF_USE_LFN
+/*-----------------------------------------------------------------------*/
+/* Directory Cache: Case-insensitive hash of a name                      */
+/*-----------------------------------------------------------------------*/
+
+static DWORD name_hash (	/* FNV-1a over the up-cased characters */
+	const WCHAR* name
+)
+{
+	DWORD hash = 2166136261;
+
+	while (*name) hash = (hash ^ ff_wtoupper(*name++)) * 16777619;
+	return hash;
+}
+
+
+#if FF_LFN_UNICODE == 0
+static DWORD name_hash_ascii (	/* Same hash of an ANSI/OEM name, 0 if it is not all ASCII */
+	const TCHAR* name
+)
+{
+	DWORD hash = 2166136261;
+
+	for ( ; *name; name++) {
+		if ((BYTE)*name >= 0x80) return 0;
+		hash = (hash ^ ff_wtoupper((BYTE)*name)) * 16777619;
+	}
+	return hash;
+}
+#endif
+
+
+/* Remember where the entry dp points to was found, under the hash of its name */
+static void dircache_note (
+	DIR* dp,
+	DWORD hash
+)
+{
+	ff_dircache_store(dp->obj.fs, dp->obj.sclust, hash, (dp->blk_ofs != 0xFFFFFFFF) ? dp->blk_ofs : dp->dptr);
+}
+#endif
+
+
+
+static FRESULT dir_find_from (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp,				/* Pointer to the directory object with the file name */
+	DWORD ofs,				/* Offset of the entry to start searching at */
+	DWORD stop				/* Offset to give up at outside an LFN sequence, 0:end of directory */
 )
 {
 	FRESULT res;
@@ -2420,7 +2481,7 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	BYTE attr, ord, sum;
 #endif
 
-	res = dir_sdi(dp, 0);			/* Rewind directory object */
+	res = dir_sdi(dp, ofs);			/* Rewind directory object */
 	if (res != FR_OK) return res;
 #if FF_FS_EXFAT
 	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
@@ -2447,6 +2508,9 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
 #endif
 	do {
+#if FF_USE_LFN
+		if (stop != 0 && dp->dptr >= stop && ord == 0xFF) { res = FR_NO_FILE; break; }	/* Rest was searched already */
+#endif
 		res = move_window(fs, dp->sect);
 		if (res != FR_OK) break;
 		et = dp->dir[DIR_Name];		/* Entry type */
@@ -2484,6 +2548,27 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 }
 
 
+static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp					/* Pointer to the directory object with the file name */
+)
+{
+#if FF_USE_DIRCACHE && FF_USE_LFN
+	FRESULT res;
+	DWORD hash, ofs;
+
+	if (FF_FS_EXFAT && dp->obj.fs->fs_type == FS_EXFAT) return dir_find_from(dp, 0, 0);
+	hash = name_hash(dp->obj.fs->lfnbuf);
+	ofs = ff_dircache_find(dp->obj.fs, dp->obj.sclust, hash);	/* Where the name was found last time, or 0 */
+	res = dir_find_from(dp, ofs, 0);
+	if (res == FR_NO_FILE && ofs != 0) res = dir_find_from(dp, 0, ofs);	/* Stale hint: search the part before it */
+	if (res == FR_OK) dircache_note(dp, hash);
+	return res;
+#else
+	return dir_find_from(dp, 0, 0);
+#endif
+}
+
+
 
 
 #if !FF_FS_READONLY
@@ -3663,6 +3748,9 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 
 	fs->fs_type = (BYTE)fmt;/* FAT sub-type (the filesystem object gets valid) */
 	fs->id = ++Fsid;		/* Volume mount ID */
+#if FF_USE_FREEMAP && !FF_FS_READONLY
+	ff_freemap_reset(fs);	/* Start counting free clusters again */
+#endif
 
 #if FF_USE_LFN == 1			/* Initilize pointers to the static working buffers */
 	fs->lfnbuf = LfnBuf;	/* LFN working buffer */
@@ -4829,6 +4917,13 @@ FRESULT f_readdir (
 			if (res == FR_NO_FILE) res = FR_OK;	/* Ignore end of directory */
 			if (res == FR_OK) {				/* A valid entry is found */
 				get_fileinfo(dp, fno);		/* Get the object information */
+#if FF_USE_DIRCACHE && FF_USE_LFN && FF_LFN_UNICODE == 0
+				if (!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) {	/* Let a later lookup of the name start here */
+					DWORD hash = name_hash_ascii(fno->fname);
+
+					if (hash != 0) dircache_note(dp, hash);
+				}
+#endif
 				res = dir_next(dp, 0);		/* Increment index for next */
 				if (res == FR_NO_FILE) res = FR_OK;	/* Ignore end of directory now */
 			}
@@ -5169,6 +5264,180 @@ FRESULT f_unlink (
 
 
 
+#if FF_USE_RMTREE
+/*-----------------------------------------------------------------------*/
+/* Remove Tree - Free a batch of cluster chains                          */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT rmtree_release (	/* FR_OK(0):succeeded, !=0:error */
+	FFOBJID* obj,		/* Object on the volume */
+	DWORD* chain,		/* Start clusters of the chains */
+	UINT* n_chain		/* Number of chains, 0 when it returns */
+)
+{
+	FRESULT res = FR_OK;
+	UINT i, j;
+	DWORD clst;
+
+
+	for (i = 1; i < *n_chain; i++) {	/* Sort by start cluster, so the FAT sectors are visited in order */
+		clst = chain[i];
+		for (j = i; j > 0 && chain[j - 1] > clst; j--) chain[j] = chain[j - 1];
+		chain[j] = clst;
+	}
+	for (i = 0; i < *n_chain && res == FR_OK; i++) {
+		res = remove_chain(obj, chain[i], 0);
+	}
+	*n_chain = 0;
+	return res;
+}
+
+
+static FRESULT rmtree_queue (	/* FR_OK(0):succeeded, !=0:error */
+	FFOBJID* obj,		/* Object on the volume */
+	DWORD* chain,		/* Start clusters of the chains */
+	UINT* n_chain,		/* Number of chains */
+	DWORD clst			/* Start cluster of the chain to free (0:no chain) */
+)
+{
+	FRESULT res = FR_OK;
+
+
+	if (clst == 0) return FR_OK;	/* Empty file */
+	if (*n_chain == FF_RMTREE_BATCH) res = rmtree_release(obj, chain, n_chain);	/* Batch is full */
+	chain[(*n_chain)++] = clst;
+	return res;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* API: Delete a File or a Directory Tree                                */
+/*-----------------------------------------------------------------------*/
+/* The tree is walked with a stack of directory positions instead of     */
+/* recursion, and nothing is looked up by path again. Entries are marked */
+/* deleted as the walk reads them, so a directory sector is written once */
+/* for all its files. The cluster chains are freed in sorted batches     */
+/* between directory sectors, not once per file.                         */
+
+FRESULT f_rmtree (
+	const TCHAR* path,		/* Pointer to the file or directory path */
+	RMTREE_STAT* st,		/* Removal counts, updated as it goes */
+	void (*progress)(const RMTREE_STAT*)	/* Called after each batch of chains is freed (NULL:none) */
+)
+{
+	FRESULT res, res2;
+	FATFS *fs;
+	DIR dj;
+	struct {
+		DWORD sclust;		/* Start cluster of the parent directory */
+		DWORD dptr;			/* Offset of the SFN entry in the parent */
+		DWORD blk_ofs;		/* Offset of its first LFN entry (0xFFFFFFFF:none) */
+		DWORD clst;			/* Start cluster of the directory */
+	} stack[FF_RMTREE_DEPTH], *top;
+	DWORD chain[FF_RMTREE_BATCH];
+	UINT n_chain = 0, depth = 0;
+	DWORD clst;
+	DEF_NAMEBUFF
+
+
+	st->files = st->dirs = 0;
+	st->bytes = 0;
+
+	/* Get logical drive and mount the volume if needed */
+	res = mount_volume(&path, &fs, FA_WRITE);
+	if (res == FR_OK) {
+		dj.obj.fs = fs;
+		INIT_NAMEBUFF(fs);
+		res = follow_path(&dj, path);	/* Follow the path to the object */
+		if (res == FR_OK) {
+			if (dj.fn[NSFLAG] & (NS_DOT | NS_NONAME)) {
+				res = FR_INVALID_NAME;	/* It must be a real object */
+			} else if (dj.obj.attr & AM_RDO) {
+				res = FR_DENIED;		/* The object must not be read-only */
+			}
+		}
+		if (res == FR_OK && !(dj.obj.attr & AM_DIR)) {	/* A file is removed as f_unlink() does */
+			clst = ld_clust(fs, dj.dir);
+			st->bytes = ld_32(dj.dir + DIR_FileSize);
+			res = dir_remove(&dj);
+			if (res == FR_OK && clst != 0) res = remove_chain(&dj.obj, clst, 0);
+			if (res == FR_OK) st->files = 1;
+		} else if (res == FR_OK) {
+			for (;;) {
+				/* dj points at a directory: go into it */
+				clst = ld_clust(fs, dj.dir);
+				if (clst == 0) { res = FR_INT_ERR; break; }
+				if (depth == FF_RMTREE_DEPTH) { res = FR_NOT_ENOUGH_CORE; break; }	/* Too deeply nested */
+#if FF_FS_RPATH
+				if (clst == fs->cdir) { res = FR_DENIED; break; }	/* Current directory cannot be removed */
+#endif
+				top = &stack[depth++];
+				top->sclust = dj.obj.sclust;
+				top->dptr = dj.dptr;
+				top->blk_ofs = dj.blk_ofs;
+				top->clst = clst;
+				dj.obj.sclust = clst;
+				res = dir_sdi(&dj, 0);
+
+				/* Remove files up to the next sub-directory, leaving each directory that gets empty */
+				while (res == FR_OK) {
+					if (n_chain > FF_RMTREE_BATCH - SS(fs) / SZDIRE && dj.dptr % SS(fs) == 0) {	/* Free the batch between directory sectors */
+						res = rmtree_release(&dj.obj, chain, &n_chain);
+						if (res != FR_OK) break;
+						if (progress) progress(st);
+					}
+					res = DIR_READ_FILE(&dj);
+					if (res == FR_OK) {
+						if (dj.obj.attr & AM_RDO) { res = FR_DENIED; break; }	/* Read-only objects are kept */
+						if (dj.obj.attr & AM_DIR) break;	/* Go into the sub-directory */
+						clst = ld_clust(fs, dj.dir);
+						st->bytes += ld_32(dj.dir + DIR_FileSize);
+						res = dir_remove(&dj);			/* Mark the entry 'deleted' in the window */
+						if (res != FR_OK) break;
+						st->files++;
+						res = rmtree_queue(&dj.obj, chain, &n_chain, clst);
+						if (res == FR_OK) res = dir_next(&dj, 0);
+						if (res == FR_NO_FILE) res = FR_OK;		/* The next read reports the end */
+					} else if (res == FR_NO_FILE) {		/* The directory is empty: remove it from its parent */
+						top = &stack[--depth];
+						dj.obj.sclust = top->sclust;
+						res = dir_sdi(&dj, top->dptr);
+						if (res != FR_OK) break;
+						dj.blk_ofs = top->blk_ofs;
+						res = dir_remove(&dj);
+						if (res != FR_OK) break;
+						st->dirs++;
+						res = rmtree_queue(&dj.obj, chain, &n_chain, top->clst);
+						if (res != FR_OK || depth == 0) break;	/* The whole tree has been removed? */
+						res = dir_next(&dj, 0);
+						if (res == FR_NO_FILE) res = FR_OK;
+					}
+				}
+				if (res != FR_OK || depth == 0) break;
+			}
+			if (n_chain > 0) {	/* Free the rest, even after an error, so no removed entry leaves its chain lost */
+				res2 = rmtree_release(&dj.obj, chain, &n_chain);
+				if (res == FR_OK) res = res2;
+			}
+			if (res == FR_OK && progress) progress(st);
+		}
+		if (res == FR_OK || st->files + st->dirs > 0) {	/* Write back whatever has been removed */
+			res2 = sync_fs(fs);
+			if (res == FR_OK) res = res2;
+		}
+		FREE_NAMEBUFF();
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+#endif	/* FF_USE_RMTREE */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* API: Create a Directory                                               */
 /*-----------------------------------------------------------------------*/
@@ -5804,6 +6073,9 @@ FRESULT f_expand (
 				fs->free_clst -= tcl;
 				fs->fsi_flag |= 1;
 			}
+#if FF_USE_FREEMAP
+			if (fs->fs_type != FS_EXFAT) ff_freemap_update(fs, scl, tcl, -1);
+#endif
 		}
 	}
 
@@ -5814,6 +6086,38 @@ FRESULT f_expand (
 
 
 
+#if FF_USE_SETSIZE && !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Set the Size of a File Written Outside FatFS                          */
+/*-----------------------------------------------------------------------*/
+/* The data went straight to the clusters allocated by f_expand(), so    */
+/* the size must not reach past them. The entry is updated on sync.      */
+
+FRESULT f_setsize (
+	FIL* fp,		/* Pointer to the file object */
+	FSIZE_t fsz		/* File size to record */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
+	if (!(fp->flag & FA_WRITE) || (fsz != 0 && fp->obj.sclust == 0)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode and allocation */
+#if FF_FS_EXFAT
+	if (fs->fs_type != FS_EXFAT && fsz >= 0x100000000) LEAVE_FF(fs, FR_DENIED);	/* Check if in size limit */
+#endif
+	fp->obj.objsize = fsz;
+	fp->flag |= FA_MODIFIED;			/* Set file change flag */
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+#endif /* FF_USE_SETSIZE && !FF_FS_READONLY */
+
+
+
 #if FF_USE_FORWARD
 /*-----------------------------------------------------------------------*/
 /* API: Forward Data to the Stream Directly                              */
@@ -288,6 +288,16 @@ typedef struct {
 
 
 
+/* Removal counts (RMTREE_STAT) reported by f_rmtree() */
+
+typedef struct {
+	DWORD files;		/* Files removed */
+	DWORD dirs;			/* Directories removed */
+	QWORD bytes;		/* Size of the files removed */
+} RMTREE_STAT;
+
+
+
 /* File function return code (FRESULT) */
 
 typedef enum {
@@ -334,6 +344,7 @@ FRESULT f_findfirst (DIR* dp, FILINFO* fno, const TCHAR* path, const TCHAR* patt
 FRESULT f_findnext (DIR* dp, FILINFO* fno);							/* Find next file */
 FRESULT f_mkdir (const TCHAR* path);								/* Create a sub directory */
 FRESULT f_unlink (const TCHAR* path);								/* Delete an existing file or directory */
+FRESULT f_rmtree (const TCHAR* path, RMTREE_STAT* st, void (*progress)(const RMTREE_STAT*));	/* Delete a file or a directory and everything in it */
 FRESULT f_rename (const TCHAR* path_old, const TCHAR* path_new);	/* Rename/Move a file or directory */
 FRESULT f_stat (const TCHAR* path, FILINFO* fno);					/* Get file status */
 FRESULT f_chmod (const TCHAR* path, BYTE attr, BYTE mask);			/* Change attribute of a file/dir */
@@ -346,6 +357,7 @@ FRESULT f_getlabel (const TCHAR* path, TCHAR* label, DWORD* vsn);	/* Get volume
 FRESULT f_setlabel (const TCHAR* label);							/* Set volume label */
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);	/* Forward data to the stream */
 FRESULT f_expand (FIL* fp, FSIZE_t fsz, BYTE opt);					/* Allocate a contiguous block to the file */
+FRESULT f_setsize (FIL* fp, FSIZE_t fsz);							/* Set the size of a file written outside FatFS */
 FRESULT f_mount (FATFS* fs, const TCHAR* path, BYTE opt);			/* Mount/Unmount a logical drive */
 FRESULT f_mkfs (const TCHAR* path, const MKFS_PARM* opt, void* work, UINT len);	/* Create a FAT volume */
 FRESULT f_fdisk (BYTE pdrv, const LBA_t ptbl[], void* work);		/* Divide a physical drive into some partitions */
@@ -402,6 +414,23 @@ void ff_mutex_give (int vol);		/* Unlock sync object */
 #endif
 
 
+/* Free cluster summary (defined in sdfs_freemap.c) */
+
+#if FF_USE_FREEMAP && !FF_FS_READONLY
+void ff_freemap_reset (FATFS* fs);	/* Volume mounted */
+void ff_freemap_update (FATFS* fs, DWORD clst, DWORD count, int delta);	/* Clusters freed (+1) or allocated (-1) */
+DWORD ff_freemap_skip (FATFS* fs, DWORD clst, DWORD stop);	/* First cluster from clst that may be free, up to stop */
+#endif
+
+
+/* Directory entry hints (defined in sdfs_dircache.c) */
+
+#if FF_USE_DIRCACHE
+DWORD ff_dircache_find (FATFS* fs, DWORD dir, DWORD hash);	/* Offset to start looking for a name at, 0 if unknown */
+void ff_dircache_store (FATFS* fs, DWORD dir, DWORD hash, DWORD ofs);	/* Name found at ofs in directory */
+#endif
+
+
 
 
 /*--------------------------------------------------------------*/
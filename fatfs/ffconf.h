@@ -5,8 +5,9 @@
 #define FF_USE_STRFUNC   0
 #define FF_USE_FIND      0
 #define FF_USE_MKFS      0
-#define FF_USE_FASTSEEK  0
-#define FF_USE_EXPAND    0
+#define FF_USE_FASTSEEK  1   // cluster link map tables, see O_FASTSEEK in drivers/clib.h
+#define FF_USE_EXPAND    1   // f_expand, used by sdfs_stream_open()
+#define FF_USE_SETSIZE   1   // f_setsize, used by sdfs_stream_sync() and sdfs_stream_close()
 #define FF_USE_CHMOD     0
 #define FF_USE_LABEL     1   // f_getlabel
 #define FF_USE_FORWARD   0
@@ -22,6 +23,7 @@
 #define FF_MIN_SS        512
 #define FF_MAX_SS        512
 #define FF_LBA64         0
+#define FF_USE_TRIM      1   // erase freed clusters, see CTRL_TRIM in diskio.c
 #define FF_FS_EXFAT      0
 #define FF_FS_NORTC      1
 #define FF_NORTC_MON     1
@@ -29,4 +31,9 @@
 #define FF_NORTC_YEAR    2025
 #define FF_FS_LOCK       0
 #define FF_FS_REENTRANT  0
+#define FF_USE_FREEMAP   1   // free cluster summary, see sdfs_freemap.c
+#define FF_USE_DIRCACHE  1   // directory entry hints, see sdfs_dircache.c
+#define FF_USE_RMTREE    1   // f_rmtree, bulk delete used by rmrf
+#define FF_RMTREE_DEPTH  16  // directory levels f_rmtree can descend
+#define FF_RMTREE_BATCH  64  // cluster chains f_rmtree frees together
 #define FF_CODE_PAGE     437
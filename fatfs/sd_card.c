@@ -5,20 +5,28 @@
 // Supports SDSC (v1 & v2) and SDHC/SDXC. Features:
 //   - CRC7 on command packets, CRC16-CCITT on data blocks (SD_CRC_ENABLED)
 //   - CMD18 multi-block read, CMD25 multi-block write
+//   - DMA data block transfers with the CRC16 computed by the DMA sniffer
 //   - CSD register parsing for card capacity
+//   - SPI clock negotiation from TRAN_SPEED and CMD6 high speed mode, with
+//     automatic step-down on repeated data CRC errors
+//   - CMD32/CMD33/CMD38 erase, with the erase block size from the SD status
 //
 
 #include <string.h>
 #include "pico/stdlib.h"
 #include "hardware/spi.h"
 #include "hardware/gpio.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
 #include "sd_card.h"
 #include "crc.h"
+#include "../drivers/trace.h"
 
 // ---------------------------------------------------------------------------
 // Command numbers (§4.7.4 Detailed Command Description)
 // ---------------------------------------------------------------------------
 #define CMD0   0    // GO_IDLE_STATE        — reset to idle / SPI mode
+#define CMD6   6    // SWITCH_FUNC          — check/switch function (high speed mode)
 #define CMD8   8    // SEND_IF_COND         — voltage check (SDv2 detection)
 #define CMD9   9    // SEND_CSD             — read card-specific data register
 #define CMD12  12   // STOP_TRANSMISSION    — end CMD18 multi-block read
@@ -27,9 +35,13 @@
 #define CMD18  18   // READ_MULTIPLE_BLOCK
 #define CMD24  24   // WRITE_BLOCK
 #define CMD25  25   // WRITE_MULTIPLE_BLOCK
+#define CMD32  32   // ERASE_WR_BLK_START_ADDR — first block to erase
+#define CMD33  33   // ERASE_WR_BLK_END_ADDR   — last block to erase
+#define CMD38  38   // ERASE               — erase the selected blocks
 #define CMD55  55   // APP_CMD             — prefix for ACMD
 #define CMD58  58   // READ_OCR            — read operation conditions register
 #define CMD59  59   // CRC_ON_OFF          — enable/disable CRC checking
+#define ACMD13 13   // SD_STATUS           — read the 64-byte SD status register
 #define ACMD23 23   // SET_WR_BLK_ERASE_COUNT — pre-erase hint before CMD25
 #define ACMD41 41   // SD_SEND_OP_COND     — card init, report power-up status
 
@@ -71,6 +83,22 @@
 // ---------------------------------------------------------------------------
 static bool       is_sdhc           = false;
 static bool       sd_gpio_init_done = false;
+static int        sd_dma_tx         = -1;    // DMA channel feeding SPI TX, -1 if none
+static int        sd_dma_rx         = -1;    // DMA channel draining SPI RX, -1 if none
+static const uint8_t sd_dma_fill    = 0xFF;  // clocked out while reading a block
+static uint8_t    sd_dma_discard;            // bytes received while writing a block
+static uint32_t   sd_baudrate       = 0;     // SPI clock in use after sd_card_init()
+static uint32_t   sd_baudrate_limit = 0;     // fastest clock known to work, kept if clk_peri changes
+static uint8_t    sd_crc_errors     = 0;     // data CRC errors at the current clock
+static uint16_t   sd_good_blocks    = 0;     // good data blocks since the last error was counted or forgiven
+static bool       sd_probing        = false; // probing a clock, do not step down
+static uint8_t    sd_probe_buf[512];         // sector read while probing
+static bool       sd_stream_open    = false; // CMD25 left open by sd_stream_write()
+static uint32_t   sd_stream_next    = 0;     // sector the open CMD25 writes next
+static uint32_t   sd_erase_sectors  = 1;     // erase block (allocation unit) size
+
+// RAM taken by the probe buffer, for the mem command
+const uint32_t    sd_static_bytes   = sizeof(sd_probe_buf);
 
 
 // ---------------------------------------------------------------------------
@@ -93,6 +121,100 @@ static sd_error_t wait_ready(uint32_t ms)
     return SD_ERR_TIMEOUT;
 }
 
+// ---------------------------------------------------------------------------
+// Data block transfers
+// ---------------------------------------------------------------------------
+
+/*
+ * sd_dma_init() — claim a pair of DMA channels for data block transfers.
+ * If two channels are not available, blocks are sent with blocking SPI.
+ */
+static void sd_dma_init(void)
+{
+    sd_dma_tx = dma_claim_unused_channel(false);
+    sd_dma_rx = dma_claim_unused_channel(false);
+    if (sd_dma_tx < 0 || sd_dma_rx < 0) {
+        if (sd_dma_tx >= 0) dma_channel_unclaim(sd_dma_tx);
+        if (sd_dma_rx >= 0) dma_channel_unclaim(sd_dma_rx);
+        sd_dma_tx = sd_dma_rx = -1;
+    }
+}
+
+/*
+ * sd_transfer_block() — clock one 512-byte data block and return its CRC16.
+ *
+ * Reading (tx == NULL): 0xFF is clocked out and the block is received into rx.
+ * Writing (rx == NULL): the block is clocked out from tx and the received
+ * bytes are discarded.
+ *
+ * Paired TX and RX DMA channels keep the SPI FIFOs full, so the block moves
+ * at the SPI line rate with no memset of the buffer beforehand. The DMA
+ * sniffer computes CRC-16/CCITT (the XMODEM form used by SD, §4.5) on the
+ * bytes as they pass, so the CRC is ready as soon as the last byte is clocked.
+ */
+static uint16_t sd_transfer_block(const uint8_t *tx, uint8_t *rx)
+{
+    if (sd_dma_tx < 0) {
+        // No DMA: blocking SPI, then the CRC in software
+        if (tx) {
+            spi_write_blocking(SD_SPI, tx, 512);
+        } else {
+            memset(rx, 0xFF, 512);
+            spi_write_read_blocking(SD_SPI, rx, rx, 512);
+        }
+#if SD_CRC_ENABLED
+        return crc16_ccitt(tx ? tx : rx, 512);
+#else
+        return 0;
+#endif
+    }
+
+    spi_hw_t *hw = spi_get_hw(SD_SPI);
+
+    dma_channel_config c = dma_channel_get_default_config(sd_dma_tx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, spi_get_dreq(SD_SPI, true));
+    channel_config_set_read_increment(&c, tx != NULL);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_sniff_enable(&c, tx != NULL);
+    dma_channel_configure(sd_dma_tx, &c, &hw->dr, tx ? tx : &sd_dma_fill, 512, false);
+
+    c = dma_channel_get_default_config(sd_dma_rx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, spi_get_dreq(SD_SPI, false));
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, rx != NULL);
+    channel_config_set_sniff_enable(&c, rx != NULL);
+    dma_channel_configure(sd_dma_rx, &c, rx ? rx : &sd_dma_discard, &hw->dr, 512, false);
+
+    // Sniff the channel that carries the block data
+    dma_sniffer_enable(tx ? sd_dma_tx : sd_dma_rx, DMA_SNIFF_CTRL_CALC_VALUE_CRC16, false);
+    dma_sniffer_set_data_accumulator(0);
+
+    // Start both together; RX finishing means every byte has been clocked
+    dma_start_channel_mask((1u << sd_dma_tx) | (1u << sd_dma_rx));
+    dma_channel_wait_for_finish_blocking(sd_dma_rx);
+
+    uint16_t crc = (uint16_t)dma_sniffer_get_data_accumulator();
+    dma_sniffer_disable();
+    return crc;
+}
+
+/*
+ * sd_send_crc() — send the CRC16 of a data block, or a dummy CRC if CRC
+ * checking is disabled.
+ */
+static void sd_send_crc(uint16_t crc)
+{
+#if SD_CRC_ENABLED
+    uint8_t crc_bytes[2] = { (uint8_t)(crc >> 8), (uint8_t)(crc & 0xFF) };
+#else
+    (void)crc;
+    uint8_t crc_bytes[2] = {0xFF, 0xFF};
+#endif
+    spi_write_blocking(SD_SPI, crc_bytes, 2);
+}
+
 // ---------------------------------------------------------------------------
 // SD command engine (§7.3.1 — Command Format)
 // ---------------------------------------------------------------------------
@@ -114,6 +236,7 @@ static sd_error_t wait_ready(uint32_t ms)
  */
 static uint8_t sd_cmd(uint8_t cmd, uint32_t arg)
 {
+    TRACE_BEGIN(start);
     uint8_t packet[6];
     packet[0] = 0x40 | (cmd & 0x3F);
     packet[1] = (arg >> 24) & 0xFF;
@@ -146,6 +269,7 @@ static uint8_t sd_cmd(uint8_t cmd, uint32_t arg)
         if (!(r & R1_START_BIT)) break;
     }
 
+    TRACE_END(start, TRACE_SD_CMD, cmd);
     return r;
 }
 
@@ -157,6 +281,35 @@ static sd_error_t r1_to_error(uint8_t r)
     return SD_ERR_CMD;
 }
 
+/*
+ * sd_crc_error() — count a data CRC error and return SD_ERR_CRC_DATA.
+ * After SD_CRC_ERROR_LIMIT errors at one clock, the clock is stepped down
+ * to the next slower rate the SPI can generate, no lower than SD_INIT_BAUD.
+ */
+static sd_error_t sd_crc_error(void)
+{
+    sd_good_blocks = 0;
+    if (!sd_probing && ++sd_crc_errors >= SD_CRC_ERROR_LIMIT && sd_baudrate > SD_INIT_BAUD) {
+        sd_baudrate = spi_set_baudrate(SD_SPI, MAX(sd_baudrate - 1, SD_INIT_BAUD));
+        sd_baudrate_limit = sd_baudrate;
+        sd_crc_errors = 0;
+    }
+    return SD_ERR_CRC_DATA;
+}
+
+/*
+ * sd_crc_good() — count a data block that passed its CRC. Every
+ * SD_CRC_GOOD_BLOCKS good blocks forgive one counted error, so only errors
+ * close together step the clock down, not rare ones over a long uptime.
+ */
+static void sd_crc_good(void)
+{
+    if (sd_crc_errors > 0 && ++sd_good_blocks >= SD_CRC_GOOD_BLOCKS) {
+        sd_crc_errors--;
+        sd_good_blocks = 0;
+    }
+}
+
 /*
  * sd_read_r3r7() — read the 4 trailing bytes of an R3 or R7 response.
  * Must be called immediately after sd_cmd() returned R1 == 0x01 for
@@ -191,6 +344,7 @@ void sd_init(void)
     gpio_set_function(SD_SCK,  GPIO_FUNC_SPI);
     gpio_set_function(SD_MOSI, GPIO_FUNC_SPI);
 
+    sd_dma_init();
     sd_gpio_init_done = true;
 }
 
@@ -205,6 +359,9 @@ bool sd_card_present(void)
 }
 
 
+static void sd_negotiate_baudrate(void);
+static void sd_read_erase_size(void);
+
 /*
  * sd_card_init() — full SD SPI-mode initialisation sequence (§7.2.1).
  *
@@ -224,7 +381,7 @@ bool sd_card_present(void)
  *  9. ACMD41 loop — wait for card to leave idle (SD_INIT_TIMEOUT_MS)
  * 10. CMD58 again — read CCS bit to determine SDHC vs SDSC
  * 11. CMD16(512) — set block length to 512 bytes
- * 12. Switch SPI to SD_FAST_BAUD
+ * 12. Switch SPI to SD_FAST_BAUD, then negotiate a faster clock
  */
 sd_error_t sd_card_init(void)
 {
@@ -234,6 +391,7 @@ sd_error_t sd_card_init(void)
         return SD_ERR_NO_CARD;
 
     spi_init(SD_SPI, SD_INIT_BAUD);
+    sd_stream_open = false;          // a new card has no write in progress
     gpio_put(SD_CS, 1);              // CS HIGH for power-up phase
     busy_wait_us(10000);             // ≥1 ms power-up delay; 10 ms is conservative
 
@@ -322,7 +480,12 @@ sd_error_t sd_card_init(void)
     if (r != 0)
         return SD_ERR_CMD;
 
-    spi_set_baudrate(SD_SPI, SD_FAST_BAUD);
+    sd_baudrate = spi_set_baudrate(SD_SPI, SD_FAST_BAUD);
+    sd_baudrate_limit = sd_baudrate;
+    sd_crc_errors = 0;
+    sd_good_blocks = 0;
+    sd_negotiate_baudrate(); // non-fatal: the card keeps working at SD_FAST_BAUD
+    sd_read_erase_size();    // non-fatal: erase block size stays 1 if unknown
     return SD_ERR_NONE;
 }
 
@@ -363,29 +526,35 @@ sd_error_t sd_read_block(uint32_t sector, uint8_t *buf)
 {
     uint8_t ff = 0xFF;
 
+    sd_error_t err = sd_stream_end(); // finish any streaming write first
+    if (err != SD_ERR_NONE)
+        return err;
+
     uint8_t r = sd_cmd(CMD17, sector);
     if (r & R1_ERROR_MASK) {
         spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
         return r1_to_error(r);
     }
 
-    sd_error_t err = wait_for_data_token(SD_READ_TIMEOUT_MS);
+    err = wait_for_data_token(SD_READ_TIMEOUT_MS);
     if (err != SD_ERR_NONE) {
         spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
         return err;
     }
 
-    memset(buf, 0xFF, 512);
-    spi_write_read_blocking(SD_SPI, buf, buf, 512);
+    uint16_t data_crc = sd_transfer_block(NULL, buf);
 
     uint8_t crc[2] = {0xFF, 0xFF};
     spi_write_read_blocking(SD_SPI, crc, crc, 2);
 
 #if SD_CRC_ENABLED
-    if ((((uint16_t)crc[0] << 8) | crc[1]) != crc16_ccitt(buf, 512))
-        return SD_ERR_CRC_DATA;
+    if ((((uint16_t)crc[0] << 8) | crc[1]) != data_crc)
+        return sd_crc_error();
+#else
+    (void)data_crc;
 #endif
 
+    sd_crc_good();
     return SD_ERR_NONE;
 }
 
@@ -405,6 +574,10 @@ sd_error_t sd_write_block(uint32_t sector, const uint8_t *buf)
 {
     uint8_t ff = 0xFF;
 
+    sd_error_t err = sd_stream_end(); // finish any streaming write first
+    if (err != SD_ERR_NONE)
+        return err;
+
     uint8_t r = sd_cmd(CMD24, sector);
     if (r & R1_ERROR_MASK) {
         spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
@@ -413,16 +586,7 @@ sd_error_t sd_write_block(uint32_t sector, const uint8_t *buf)
 
     spi_write_blocking(SD_SPI, &ff, 1); // Nwr: dummy byte before data token (§7.5.4)
     spi_write_blocking(SD_SPI, (const uint8_t[]){DATA_START_SINGLE}, 1);
-    spi_write_blocking(SD_SPI, buf, 512);
-
-#if SD_CRC_ENABLED
-    uint16_t crc = crc16_ccitt(buf, 512);
-    uint8_t crc_bytes[2] = { (uint8_t)(crc >> 8), (uint8_t)(crc & 0xFF) };
-    spi_write_blocking(SD_SPI, crc_bytes, 2);
-#else
-    uint8_t dummy_crc[2] = {0xFF, 0xFF};
-    spi_write_blocking(SD_SPI, dummy_crc, 2);
-#endif
+    sd_send_crc(sd_transfer_block(buf, NULL));
 
     // Data response token (§7.3.3.1): lower 5 bits encode acceptance
     uint8_t resp;
@@ -430,8 +594,9 @@ sd_error_t sd_write_block(uint32_t sector, const uint8_t *buf)
     resp &= DATA_RESP_MASK;
     spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
 
-    if (resp == DATA_RESP_CRC_ERR)     return SD_ERR_CRC_DATA;
+    if (resp == DATA_RESP_CRC_ERR)     return sd_crc_error();
     if (resp != DATA_RESP_ACCEPTED)    return SD_ERR_WRITE_REJECT;
+    sd_crc_good();
 
     return wait_ready(SD_WRITE_TIMEOUT_MS);
 }
@@ -441,7 +606,7 @@ sd_error_t sd_write_block(uint32_t sector, const uint8_t *buf)
 // ---------------------------------------------------------------------------
 
 /*
- * sd_read_blocks() — read `count` contiguous 512-byte sectors into buf.
+ * read_multi() — read `count` contiguous 512-byte sectors into buf.
  * For count == 1, delegates to sd_read_block().
  * For count > 1, uses CMD18 (READ_MULTIPLE_BLOCK):
  *   CMD18 → R1 → [DATA_START_SINGLE → 512 bytes → CRC16] × count → CMD12
@@ -449,21 +614,25 @@ sd_error_t sd_write_block(uint32_t sector, const uint8_t *buf)
  * CMD12 (STOP_TRANSMISSION) is sent via sd_cmd(); the stuff byte required by
  * §7.5.6 is handled inside sd_cmd() for CMD12.
  * Returns SD_ERR_NONE on success, or a specific error code on failure.
+ * sd_read_blocks() is this call, traced.
  */
-sd_error_t sd_read_blocks(uint32_t sector, uint32_t count, uint8_t *buf)
+static sd_error_t read_multi(uint32_t sector, uint32_t count, uint8_t *buf)
 {
     if (count == 1)
         return sd_read_block(sector, buf);
 
     uint8_t ff = 0xFF;
 
+    sd_error_t err = sd_stream_end(); // finish any streaming write first
+    if (err != SD_ERR_NONE)
+        return err;
+
     uint8_t r = sd_cmd(CMD18, sector);
     if (r & R1_ERROR_MASK) {
         spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
         return r1_to_error(r);
     }
 
-    sd_error_t err = SD_ERR_NONE;
     for (uint32_t i = 0; i < count && err == SD_ERR_NONE; i++) {
         uint8_t *block = buf + (i * 512);
 
@@ -471,16 +640,20 @@ sd_error_t sd_read_blocks(uint32_t sector, uint32_t count, uint8_t *buf)
         if (err != SD_ERR_NONE)
             break;
 
-        memset(block, 0xFF, 512);
-        spi_write_read_blocking(SD_SPI, block, block, 512);
+        uint16_t data_crc = sd_transfer_block(NULL, block);
 
         uint8_t crc[2] = {0xFF, 0xFF};
         spi_write_read_blocking(SD_SPI, crc, crc, 2);
 
 #if SD_CRC_ENABLED
-        if ((((uint16_t)crc[0] << 8) | crc[1]) != crc16_ccitt(block, 512))
-            err = SD_ERR_CRC_DATA;
+        if ((((uint16_t)crc[0] << 8) | crc[1]) != data_crc) {
+            err = sd_crc_error();
+            break;
+        }
+#else
+        (void)data_crc;
 #endif
+        sd_crc_good();
     }
 
     // CMD12 — always send STOP_TRANSMISSION, whether the loop succeeded or aborted
@@ -493,33 +666,34 @@ sd_error_t sd_read_blocks(uint32_t sector, uint32_t count, uint8_t *buf)
     return ready_err;
 }
 
+sd_error_t sd_read_blocks(uint32_t sector, uint32_t count, uint8_t *buf)
+{
+    TRACE_BEGIN(start);
+    sd_error_t err = read_multi(sector, count, buf);
+    TRACE_END(start, TRACE_SD_READ, count);
+    return err;
+}
+
 // ---------------------------------------------------------------------------
 // Public API — multi-block write (CMD25, §7.5.4)
 // ---------------------------------------------------------------------------
 
 /*
- * sd_write_blocks() — write `count` contiguous 512-byte sectors from buf.
- * For count == 1, delegates to sd_write_block().
- * For count > 1, uses CMD25 (WRITE_MULTIPLE_BLOCK):
+ * multi_begin() — start a multi-block write at `sector`:
  *   [ACMD23 pre-erase hint] → CMD25 → R1
- *   → [(Nwr) → DATA_START_MULTI → 512 bytes → CRC16 → data response
- *      → wait busy] × count
- *   → DATA_STOP_TRAN → (dummy) → wait busy
  *
  * ACMD23 is an optional pre-erase hint — failure is non-fatal (§4.3.14).
+ * Its argument is 23 bits wide, so larger hints are clamped.
  */
-sd_error_t sd_write_blocks(uint32_t sector, uint32_t count, const uint8_t *buf)
+static sd_error_t multi_begin(uint32_t sector, uint32_t erase_hint)
 {
-    if (count == 1)
-        return sd_write_block(sector, buf);
-
     uint8_t ff = 0xFF;
 
     // ACMD23 — pre-erase hint (CMD55 + ACMD23); non-fatal if unsupported (§4.3.14)
     uint8_t r = sd_cmd(CMD55, 0);
     spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
     if (!(r & R1_ERROR_MASK)) {
-        sd_cmd(ACMD23, count);
+        sd_cmd(ACMD23, MIN(erase_hint, 0x7FFFFF));
         spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
     }
 
@@ -529,43 +703,147 @@ sd_error_t sd_write_blocks(uint32_t sector, uint32_t count, const uint8_t *buf)
         spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
         return r1_to_error(r);
     }
+    return SD_ERR_NONE;
+}
 
-    sd_error_t err = SD_ERR_NONE;
-    for (uint32_t i = 0; i < count && err == SD_ERR_NONE; i++) {
-        const uint8_t *block = buf + (i * 512);
+/*
+ * multi_put() — send one block of a multi-block write:
+ *   (Nwr) → DATA_START_MULTI → 512 bytes → CRC16 → data response → wait busy
+ */
+static sd_error_t multi_put(const uint8_t *block)
+{
+    uint8_t ff = 0xFF;
 
-        spi_write_blocking(SD_SPI, &ff, 1); // Nwr: dummy byte before data token
-        spi_write_blocking(SD_SPI, (const uint8_t[]){DATA_START_MULTI}, 1);
-        spi_write_blocking(SD_SPI, block, 512);
+    spi_write_blocking(SD_SPI, &ff, 1); // Nwr: dummy byte before data token
+    spi_write_blocking(SD_SPI, (const uint8_t[]){DATA_START_MULTI}, 1);
+    sd_send_crc(sd_transfer_block(block, NULL));
 
-#if SD_CRC_ENABLED
-        uint16_t crc = crc16_ccitt(block, 512);
-        uint8_t crc_bytes[2] = { (uint8_t)(crc >> 8), (uint8_t)(crc & 0xFF) };
-        spi_write_blocking(SD_SPI, crc_bytes, 2);
-#else
-        uint8_t dummy_crc[2] = {0xFF, 0xFF};
-        spi_write_blocking(SD_SPI, dummy_crc, 2);
-#endif
+    uint8_t resp;
+    spi_write_read_blocking(SD_SPI, &ff, &resp, 1);
+    resp &= DATA_RESP_MASK;
+    if (resp == DATA_RESP_CRC_ERR)  return sd_crc_error();
+    if (resp != DATA_RESP_ACCEPTED) return SD_ERR_WRITE_REJECT;
+    sd_crc_good();
 
-        uint8_t resp;
-        spi_write_read_blocking(SD_SPI, &ff, &resp, 1);
-        resp &= DATA_RESP_MASK;
-        if (resp == DATA_RESP_CRC_ERR)  { 
-            err = SD_ERR_CRC_DATA;    
-            break; 
-        }
-        if (resp != DATA_RESP_ACCEPTED) { 
-            err = SD_ERR_WRITE_REJECT; 
-            break; 
-        }
+    return wait_ready(SD_WRITE_TIMEOUT_MS);
+}
 
-        err = wait_ready(SD_WRITE_TIMEOUT_MS);
-    }
+/*
+ * multi_end() — DATA_STOP_TRAN → (dummy) → wait busy. Always sent to
+ * terminate the multi-block write sequence, even after an error.
+ */
+static sd_error_t multi_end(void)
+{
+    uint8_t ff = 0xFF;
 
-    // DATA_STOP_TRAN — always terminate the multi-block write sequence
     spi_write_blocking(SD_SPI, (const uint8_t[]){DATA_STOP_TRAN}, 1);
     spi_write_blocking(SD_SPI, &ff, 1); // dummy byte after stop token
-    return err != SD_ERR_NONE ? err : wait_ready(SD_WRITE_TIMEOUT_MS);
+    return wait_ready(SD_WRITE_TIMEOUT_MS);
+}
+
+/*
+ * sd_write_blocks() — write `count` contiguous 512-byte sectors from buf.
+ * For count == 1, delegates to sd_write_block().
+ * For count > 1, uses CMD25 (WRITE_MULTIPLE_BLOCK):
+ *   multi_begin() → multi_put() × count → multi_end()
+ *
+ * Block i comes from blocks[i] if blocks is given, otherwise buf + i × 512.
+ */
+static sd_error_t write_multi(uint32_t sector, uint32_t count,
+                              const uint8_t *buf, const uint8_t *const *blocks)
+{
+    if (count == 1)
+        return sd_write_block(sector, blocks ? blocks[0] : buf);
+
+    sd_error_t err = sd_stream_end(); // finish any streaming write first
+    if (err != SD_ERR_NONE)
+        return err;
+
+    err = multi_begin(sector, count);
+    if (err != SD_ERR_NONE)
+        return err;
+
+    for (uint32_t i = 0; i < count && err == SD_ERR_NONE; i++)
+        err = multi_put(blocks ? blocks[i] : buf + (i * 512));
+
+    sd_error_t end_err = multi_end();
+    return err != SD_ERR_NONE ? err : end_err;
+}
+
+sd_error_t sd_write_blocks(uint32_t sector, uint32_t count, const uint8_t *buf)
+{
+    TRACE_BEGIN(start);
+    sd_error_t err = write_multi(sector, count, buf, NULL);
+    TRACE_END(start, TRACE_SD_WRITE, count);
+    return err;
+}
+
+/*
+ * sd_write_gather() — like sd_write_blocks(), but the contiguous sectors
+ * come from separate 512-byte buffers, so a cache can write a run of
+ * adjacent sectors with a single CMD25.
+ */
+sd_error_t sd_write_gather(uint32_t sector, uint32_t count, const uint8_t *const *blocks)
+{
+    TRACE_BEGIN(start);
+    sd_error_t err = write_multi(sector, count, NULL, blocks);
+    TRACE_END(start, TRACE_SD_WRITE, count);
+    return err;
+}
+
+// ---------------------------------------------------------------------------
+// Public API — streaming write (open-ended CMD25)
+// ---------------------------------------------------------------------------
+
+/*
+ * sd_stream_write() — write `count` sectors as part of a CMD25 that stays
+ * open between calls, so a steady stream of blocks pays for one command.
+ * A write that does not continue at the sector after the previous one
+ * closes the open CMD25 and starts another. `erase_hint` is the number of
+ * sectors the caller still expects to write from `sector` on, which is
+ * passed to ACMD23 so the card can pre-erase them.
+ *
+ * Any other command (read, single or multi-block write, CSD) first closes
+ * the stream, so the stream can be mixed with normal FatFS traffic.
+ */
+sd_error_t sd_stream_write(uint32_t sector, const uint8_t *buf, uint32_t count, uint32_t erase_hint)
+{
+    sd_error_t err;
+    if (sd_stream_open && sector != sd_stream_next) {
+        err = sd_stream_end();
+        if (err != SD_ERR_NONE)
+            return err;
+    }
+
+    if (!sd_stream_open) {
+        err = multi_begin(sector, MAX(erase_hint, count));
+        if (err != SD_ERR_NONE)
+            return err;
+        sd_stream_open = true;
+        sd_stream_next = sector;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        err = multi_put(buf + (i * 512));
+        if (err != SD_ERR_NONE) {
+            sd_stream_end();
+            return err;
+        }
+        sd_stream_next++;
+    }
+    return SD_ERR_NONE;
+}
+
+/*
+ * sd_stream_end() — close the CMD25 left open by sd_stream_write(), if any,
+ * and wait for the card to finish programming.
+ */
+sd_error_t sd_stream_end(void)
+{
+    if (!sd_stream_open)
+        return SD_ERR_NONE;
+    sd_stream_open = false;
+    return multi_end();
 }
 
 // ---------------------------------------------------------------------------
@@ -593,24 +871,27 @@ sd_error_t sd_write_blocks(uint32_t sector, uint32_t count, const uint8_t *buf)
  *   C_SIZE[21:0] = csd[7][5:0] << 16 | csd[8] << 8 | csd[9]
  *   sectors = (C_SIZE + 1) * 1024
  */
-sd_error_t sd_get_sector_count(uint32_t *count)
+static sd_error_t sd_read_csd(uint8_t csd[16])
 {
     uint8_t ff = 0xFF;
 
+    sd_error_t err = sd_stream_end(); // finish any streaming write first
+    if (err != SD_ERR_NONE)
+        return err;
+
     uint8_t r = sd_cmd(CMD9, 0);
     if (r & R1_ERROR_MASK) {
         spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
         return r1_to_error(r);
     }
 
-    sd_error_t err = wait_for_data_token(SD_READ_TIMEOUT_MS);
+    err = wait_for_data_token(SD_READ_TIMEOUT_MS);
     if (err != SD_ERR_NONE) {
         spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
         return err;
     }
 
-    uint8_t csd[16];
-    memset(csd, 0xFF, sizeof(csd));
+    memset(csd, 0xFF, 16);
     spi_write_read_blocking(SD_SPI, csd, csd, 16);
 
     uint8_t crc[2] = {0xFF, 0xFF};
@@ -621,6 +902,16 @@ sd_error_t sd_get_sector_count(uint32_t *count)
         return SD_ERR_CRC_DATA;
 #endif
 
+    return SD_ERR_NONE;
+}
+
+sd_error_t sd_get_sector_count(uint32_t *count)
+{
+    uint8_t csd[16];
+    sd_error_t err = sd_read_csd(csd);
+    if (err != SD_ERR_NONE)
+        return err;
+
     uint8_t csd_ver = (csd[0] >> 6) & 0x03;
 
     if (csd_ver == 1) {
@@ -645,3 +936,265 @@ sd_error_t sd_get_sector_count(uint32_t *count)
 
     return SD_ERR_NONE;
 }
+
+// ---------------------------------------------------------------------------
+// Public API — erase (CMD32/CMD33/CMD38, §4.3.5)
+// ---------------------------------------------------------------------------
+
+/*
+ * sd_erase() — erase `count` sectors from `sector` on, telling the card's
+ * flash translation layer they no longer hold data:
+ *   CMD32 → R1, CMD33 → R1, CMD38 → R1b (busy until the erase is done)
+ * Long ranges are erased SD_ERASE_CHUNK at a time so each busy
+ * period fits in SD_ERASE_TIMEOUT_MS. Erase addresses are in bytes on
+ * SDSC cards and in sectors on SDHC/SDXC cards.
+ */
+sd_error_t sd_erase(uint32_t sector, uint32_t count)
+{
+    uint8_t ff = 0xFF;
+    uint32_t unit = is_sdhc ? 1 : 512;
+
+    sd_error_t err = sd_stream_end(); // finish any streaming write first
+    if (err != SD_ERR_NONE)
+        return err;
+
+    while (count > 0) {
+        uint32_t n = MIN(count, SD_ERASE_CHUNK);
+
+        uint8_t r = sd_cmd(CMD32, sector * unit);
+        spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
+        if (!(r & R1_ERROR_MASK)) {
+            r = sd_cmd(CMD33, (sector + n - 1) * unit);
+            spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
+        }
+        if (r & R1_ERROR_MASK)
+            return r1_to_error(r);
+
+        r = sd_cmd(CMD38, 0);
+        if (r & R1_ERROR_MASK) {
+            spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
+            return r1_to_error(r);
+        }
+        err = wait_ready(SD_ERASE_TIMEOUT_MS);
+        spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
+        if (err != SD_ERR_NONE)
+            return err;
+
+        sector += n;
+        count -= n;
+    }
+    return SD_ERR_NONE;
+}
+
+/*
+ * sd_read_erase_size() — find the erase block size after initialisation.
+ *
+ * ACMD13 (SD_STATUS) returns R2 — R1 and one status byte — followed by a
+ * 64-byte data block. AU_SIZE, bits [431:428] = status[10] >> 4, gives the
+ * allocation unit: 16 KB << (AU_SIZE - 1) for 1..9, then 8, 12, 16, 24, 32
+ * and 64 MB. Cards without it fall back to the CSD v1 SECTOR_SIZE field
+ * (bits [45:39], in write blocks) when ERASE_BLK_EN is clear. Sizes that
+ * are not a power of two, or above 32768 sectors, are reported as 1.
+ */
+static void sd_read_erase_size(void)
+{
+    static const uint16_t au_large_mb[6] = {8, 12, 16, 24, 32, 64}; // AU_SIZE 0xA..0xF
+    uint8_t ff = 0xFF;
+    uint32_t sectors = 0;
+
+    sd_erase_sectors = 1;
+
+    uint8_t r = sd_cmd(CMD55, 0);
+    spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
+    if (!(r & R1_ERROR_MASK)) {
+        r = sd_cmd(ACMD13, 0);
+        spi_write_blocking(SD_SPI, &ff, 1); // R2 status byte
+        if (!(r & R1_ERROR_MASK) && wait_for_data_token(SD_READ_TIMEOUT_MS) == SD_ERR_NONE) {
+            uint8_t status[64];
+            memset(status, 0xFF, sizeof(status));
+            spi_write_read_blocking(SD_SPI, status, status, sizeof(status));
+
+            uint8_t crc[2] = {0xFF, 0xFF};
+            spi_write_read_blocking(SD_SPI, crc, crc, 2);
+            spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
+
+            uint8_t au = status[10] >> 4;
+            bool valid = true;
+#if SD_CRC_ENABLED
+            valid = (((uint16_t)crc[0] << 8) | crc[1]) == crc16_ccitt(status, sizeof(status));
+#endif
+            if (valid && au >= 1 && au <= 9)
+                sectors = 32u << (au - 1);
+            else if (valid && au >= 0xA)
+                sectors = (uint32_t)au_large_mb[au - 0xA] * 2048;
+        } else {
+            spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
+        }
+    }
+
+    if (sectors == 0) {
+        uint8_t csd[16];
+        if (sd_read_csd(csd) == SD_ERR_NONE && ((csd[0] >> 6) & 0x03) == 0 && !(csd[10] & 0x40))
+            sectors = ((((uint32_t)csd[10] & 0x3F) << 1) | (csd[11] >> 7)) + 1;
+    }
+
+    if (sectors != 0 && sectors <= 32768 && (sectors & (sectors - 1)) == 0)
+        sd_erase_sectors = sectors;
+}
+
+/*
+ * sd_get_erase_sectors() — the card's erase block size in sectors, 1 if it
+ * is unknown.
+ */
+uint32_t sd_get_erase_sectors(void)
+{
+    return sd_erase_sectors;
+}
+
+// ---------------------------------------------------------------------------
+// SPI clock negotiation
+// ---------------------------------------------------------------------------
+
+/*
+ * tran_speed_hz() — decode the CSD TRAN_SPEED byte (§5.3.2) into Hz.
+ *   bits [2:0] = transfer rate unit (100 kbit/s × 10^n)
+ *   bits [6:3] = time value (multiplier × 10)
+ * 0x32 = 25 MHz (default speed), 0x5A = 50 MHz (high speed).
+ */
+static uint32_t tran_speed_hz(uint8_t tran_speed)
+{
+    static const uint8_t  value[16] = {0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80};
+    static const uint32_t unit[4]   = {10000, 100000, 1000000, 10000000}; // unit ÷ 10
+    uint8_t u = tran_speed & 0x07;
+    if (u > 3) return 0; // reserved
+    return unit[u] * value[(tran_speed >> 3) & 0x0F];
+}
+
+/*
+ * sd_switch_high_speed() — switch the card to high speed mode with CMD6
+ * (§4.3.10). CMD6 returns R1 followed by a 64-byte status data block.
+ *   argument 0x80FFFFF1 = mode 1 (switch), function group 1 = high speed
+ *   status byte 16 bits [3:0] = function selected in group 1 (1 = high speed)
+ * Returns true if the card is now in high speed mode. Cards that predate
+ * CMD6 (command class 10 not set in the CSD CCC field) are left alone.
+ */
+static bool sd_switch_high_speed(const uint8_t csd[16])
+{
+    uint8_t ff = 0xFF;
+    uint16_t ccc = ((uint16_t)csd[4] << 4) | (csd[5] >> 4);
+    if (!(ccc & (1u << 10)))
+        return false;
+
+    uint8_t r = sd_cmd(CMD6, 0x80FFFFF1);
+    if (r & R1_ERROR_MASK) {
+        spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
+        return false;
+    }
+
+    if (wait_for_data_token(SD_READ_TIMEOUT_MS) != SD_ERR_NONE) {
+        spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
+        return false;
+    }
+
+    uint8_t status[64];
+    memset(status, 0xFF, sizeof(status));
+    spi_write_read_blocking(SD_SPI, status, status, sizeof(status));
+
+    uint8_t crc[2] = {0xFF, 0xFF};
+    spi_write_read_blocking(SD_SPI, crc, crc, 2);
+    spi_write_blocking(SD_SPI, &ff, 1); // Dummy cycle
+
+#if SD_CRC_ENABLED
+    if ((((uint16_t)crc[0] << 8) | crc[1]) != crc16_ccitt(status, sizeof(status)))
+        return false;
+#endif
+
+    // The switch takes effect within 8 clocks of the status block (§4.3.10.4)
+    return (status[16] & 0x0F) == 0x01;
+}
+
+/*
+ * sd_probe_read() — verify the SPI clock by reading SD_PROBE_SECTOR
+ * SD_PROBE_READS times; every read must pass its CRC and match `expected`.
+ */
+static bool sd_probe_read(uint16_t expected)
+{
+    for (int i = 0; i < SD_PROBE_READS; i++) {
+        if (sd_read_block(SD_PROBE_SECTOR, sd_probe_buf) != SD_ERR_NONE)
+            return false;
+        if (crc16_ccitt(sd_probe_buf, sizeof(sd_probe_buf)) != expected)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * sd_negotiate_baudrate() — raise the SPI clock as far as the card allows.
+ *
+ * The limit is TRAN_SPEED from the CSD, which becomes 50 MHz once the card
+ * has switched to high speed mode, capped at SD_MAX_BAUD. Starting from
+ * SD_FAST_BAUD, each faster clock the SPI can generate (clk_peri divided by
+ * an even number) is tried in turn with verified reads of a known sector.
+ * The first clock that fails ends the search at the last one that worked.
+ */
+static void sd_negotiate_baudrate(void)
+{
+    uint8_t csd[16];
+    if (sd_read_csd(csd) != SD_ERR_NONE)
+        return;
+
+    uint32_t limit = tran_speed_hz(csd[3]);
+    if (sd_switch_high_speed(csd) && sd_read_csd(csd) == SD_ERR_NONE)
+        limit = tran_speed_hz(csd[3]);
+    limit = MIN(limit, SD_MAX_BAUD);
+
+    // Reference copy of the probe sector at the known good clock
+    sd_probing = true;
+    if (sd_read_block(SD_PROBE_SECTOR, sd_probe_buf) != SD_ERR_NONE) {
+        sd_probing = false;
+        return;
+    }
+    uint16_t expected = crc16_ccitt(sd_probe_buf, sizeof(sd_probe_buf));
+
+    uint32_t peri = clock_get_hz(clk_peri);
+    uint32_t good = sd_baudrate;
+    for (uint32_t div = (peri / sd_baudrate) & ~1u; div >= 2; div -= 2) {
+        uint32_t rate = peri / div;
+        if (rate <= good)
+            continue;
+        if (rate > limit)
+            break;
+
+        uint32_t actual = spi_set_baudrate(SD_SPI, rate);
+        if (!sd_probe_read(expected))
+            break;
+        good = actual;
+    }
+
+    sd_baudrate = spi_set_baudrate(SD_SPI, good);
+    sd_baudrate_limit = sd_baudrate;
+    sd_crc_errors = 0;
+    sd_good_blocks = 0;
+    sd_probing = false;
+}
+
+/*
+ * sd_clock_changed() — set the SPI divider again after clk_peri has changed.
+ * The new clock is the fastest one the SPI can generate that is no faster
+ * than the last clock the card worked at, so changes back and forth do not
+ * wear the clock down.
+ */
+void sd_clock_changed(void)
+{
+    if (sd_baudrate != 0)
+        sd_baudrate = spi_set_baudrate(SD_SPI, sd_baudrate_limit);
+}
+
+/*
+ * sd_get_baudrate() — the SPI clock chosen for the card, 0 before
+ * sd_card_init() has succeeded.
+ */
+uint32_t sd_get_baudrate(void)
+{
+    return sd_baudrate;
+}
@@ -10,7 +10,8 @@
 #define SD_MOSI       19
 #define SD_DETECT     22
 #define SD_INIT_BAUD  400000     // 400 kHz — required by spec during card init
-#define SD_FAST_BAUD  25000000   // 25 MHz — normal operation
+#define SD_FAST_BAUD  25000000   // 25 MHz — default speed, starting point for probing
+#define SD_MAX_BAUD   50000000   // 50 MHz — high speed limit, never probe above this
 
 /* ── Driver tunables ─────────────────────────────────────────────── */
 #define SD_CRC_ENABLED      1    // 1 = verify CRC on commands & data blocks
@@ -18,6 +19,13 @@
 #define SD_INIT_TIMEOUT_MS  1000 // ACMD41 loop timeout
 #define SD_READ_TIMEOUT_MS  100  // wait-for-data-token timeout
 #define SD_WRITE_TIMEOUT_MS 500  // wait-for-write-complete timeout
+#define SD_PROBE_SECTOR     0    // sector read to verify each probed clock
+#define SD_PROBE_READS      4    // verified reads needed to accept a clock
+#define SD_CRC_ERROR_LIMIT  4    // data CRC errors at one clock before stepping down
+#define SD_CRC_GOOD_BLOCKS  1024 // good data blocks that forgive one counted CRC error
+#define SD_DATA_RETRIES     3    // attempts per disk_read()/disk_write() on a CRC error
+#define SD_ERASE_CHUNK      8192 // sectors per CMD38, bounds each erase busy period
+#define SD_ERASE_TIMEOUT_MS 2000 // wait-for-erase-complete timeout per CMD38
 
 /* ── Error codes ─────────────────────────────────────────────────── */
 typedef enum {
@@ -43,4 +51,13 @@ sd_error_t   sd_read_block(uint32_t sector, uint8_t *buf);
 sd_error_t   sd_write_block(uint32_t sector, const uint8_t *buf);
 sd_error_t   sd_read_blocks(uint32_t sector, uint32_t count, uint8_t *buf);
 sd_error_t   sd_write_blocks(uint32_t sector, uint32_t count, const uint8_t *buf);
+sd_error_t   sd_write_gather(uint32_t sector, uint32_t count, const uint8_t *const *blocks);
+sd_error_t   sd_stream_write(uint32_t sector, const uint8_t *buf, uint32_t count, uint32_t erase_hint);
+sd_error_t   sd_stream_end(void);
+sd_error_t   sd_erase(uint32_t sector, uint32_t count);
 sd_error_t   sd_get_sector_count(uint32_t *count);
+uint32_t     sd_get_erase_sectors(void);
+uint32_t     sd_get_baudrate(void);
+void         sd_clock_changed(void);
+
+extern const uint32_t sd_static_bytes;
@@ -1,6 +1,41 @@
 #pragma once
 #include "ff.h"
 #include <stdbool.h>
+
+#define SDFS_CACHE_SETS  (8)   // sector cache sets, chosen by sector number
+#define SDFS_CACHE_WAYS  (4)   // sectors per set, least recently used is replaced
+#define SDFS_DEBOUNCE_MS (50)  // card detect settle time before mounting
+#define SDFS_FREEMAP_GROUPS (2048) // free cluster counts kept for the FAT
+#define SDFS_DIRCACHE_ENTRIES (256) // directory entry hints (power of 2)
+
+// Sector cache counters for sdfs_get_cache_stats()
+typedef struct {
+    uint32_t hits;             // sectors found in the cache
+    uint32_t misses;           // sectors read from the card into the cache
+    uint32_t writebacks;       // dirty sectors written to the card
+    uint32_t write_cmds;       // write commands used to write them back
+} sdfs_cache_stats_t;
+
+// A preallocated file written straight to its sectors, see sdfs_stream_open()
+typedef struct {
+    FIL file;
+    LBA_t sector;              // first sector of the file
+    FSIZE_t capacity;          // bytes preallocated
+    FSIZE_t length;            // bytes written so far
+    BYTE partial[512];         // the last sector while it is not full
+} sdfs_stream_t;
+
 extern FATFS sdfs_volume;
+extern const uint32_t sdfs_cache_static_bytes;     // RAM taken by each part, for the mem command
+extern const uint32_t sdfs_freemap_static_bytes;
+extern const uint32_t sdfs_dircache_static_bytes;
 void sdfs_init(void);
 bool sdfs_is_ready(void);
+void sdfs_get_cache_stats(sdfs_cache_stats_t *stats, bool reset);
+void sdfs_cache_discard(LBA_t sector, LBA_t count);
+bool sdfs_background_work(void);
+
+FRESULT sdfs_stream_open(sdfs_stream_t *stream, const char *path, FSIZE_t capacity);
+FRESULT sdfs_stream_write(sdfs_stream_t *stream, const void *data, UINT len, UINT *written);
+FRESULT sdfs_stream_sync(sdfs_stream_t *stream);
+FRESULT sdfs_stream_close(sdfs_stream_t *stream);
@@ -0,0 +1,51 @@
+//
+// sdfs_dircache.c - Directory entry hints for FatFS name lookups
+//
+// FatFS finds a name by reading a directory from the start and comparing
+// every entry. This table remembers, per directory and name hash, where a
+// name was last found, so the next lookup starts at that entry. A hint is
+// only a starting point: if the name is not found from there to the end,
+// FatFS searches the part before it, so a stale or colliding hint never
+// gives a wrong answer and a miss still reads the directory once. FatFS
+// never moves entries, so hints stay useful while files come and go.
+// Listing a directory records a hint for every entry.
+//
+
+#include <string.h>
+#include "ff.h"
+#include "sdfs.h"
+
+typedef struct {
+    DWORD dir;                  // start cluster of the directory
+    DWORD hash;                 // hash of the name
+    DWORD ofs;                  // offset of the entry (its first LFN entry)
+    WORD id;                    // mount ID, 0 = unused
+} hint_t;
+
+static hint_t hints[SDFS_DIRCACHE_ENTRIES];
+
+// RAM taken by the hints, for the mem command
+const uint32_t sdfs_dircache_static_bytes = sizeof(hints);
+
+static hint_t *hint_slot(DWORD dir, DWORD hash)
+{
+    return &hints[(hash ^ (dir * 0x9E3779B1u)) & (SDFS_DIRCACHE_ENTRIES - 1)];
+}
+
+DWORD ff_dircache_find(FATFS *fs, DWORD dir, DWORD hash)
+{
+    hint_t *hint = hint_slot(dir, hash);
+    if (hint->id == fs->id && hint->dir == dir && hint->hash == hash) {
+        return hint->ofs;
+    }
+    return 0;
+}
+
+void ff_dircache_store(FATFS *fs, DWORD dir, DWORD hash, DWORD ofs)
+{
+    hint_t *hint = hint_slot(dir, hash);
+    hint->dir = dir;
+    hint->hash = hash;
+    hint->ofs = ofs;
+    hint->id = fs->id;
+}
@@ -0,0 +1,125 @@
+//
+// sdfs_freemap.c - Free cluster summary for the SD card volume
+//
+// The FAT is divided into groups of clusters and the number of free
+// clusters in each group is counted once after mount, a few FAT sectors at
+// a time from sdfs_background_work(). FatFS reports every cluster it
+// allocates or frees, so the counts stay exact. Cluster allocation skips
+// groups with no free cluster, and once the whole FAT has been counted the
+// free cluster count is handed to FatFS, which writes it to FSINFO on the
+// next sync and answers f_getfree() without scanning.
+//
+
+#include <string.h>
+#include "ff.h"
+#include "diskio.h"
+#include "sdfs.h"
+#include "pico/stdlib.h"
+
+#define STEP_SECTORS    4       // FAT sectors counted per background step
+
+static struct {
+    FATFS *fs;                  // volume being counted, NULL if none
+    WORD id;                    // mount ID of that volume
+    BYTE shift;                 // clusters per group = 1 << shift
+    DWORD counted;              // clusters counted, groups below are exact
+    bool ready;                 // the whole FAT has been counted
+} map;
+
+static uint16_t group_free[SDFS_FREEMAP_GROUPS];
+static BYTE scan_buf[STEP_SECTORS * 512];
+
+// RAM taken by the free map, for the mem command
+const uint32_t sdfs_freemap_static_bytes = sizeof(group_free) + sizeof(scan_buf);
+
+static bool map_valid(FATFS *fs)
+{
+    return map.fs == fs && map.id == fs->id;
+}
+
+// ---------------------------------------------------------------------------
+// FatFS hooks
+// ---------------------------------------------------------------------------
+
+void ff_freemap_reset(FATFS *fs)
+{
+    memset(&map, 0, sizeof(map));
+    memset(group_free, 0, sizeof(group_free));
+
+    // FAT12 volumes are small enough to scan
+    if (fs->fs_type != FS_FAT16 && fs->fs_type != FS_FAT32) return;
+
+    while ((fs->n_fatent >> map.shift) >= SDFS_FREEMAP_GROUPS) map.shift++;
+    if (map.shift >= 16) return; // a free group of 65536 would not fit its count
+
+    map.fs = fs;
+    map.id = fs->id;
+}
+
+void ff_freemap_update(FATFS *fs, DWORD clst, DWORD count, int delta)
+{
+    if (!map_valid(fs)) return;
+
+    // Clusters not counted yet are picked up when they are
+    for (; count > 0 && clst < map.counted; clst++, count--) {
+        group_free[clst >> map.shift] += delta;
+    }
+}
+
+DWORD ff_freemap_skip(FATFS *fs, DWORD clst, DWORD stop)
+{
+    if (!map_valid(fs)) return clst;
+
+    while (clst < stop && clst < map.counted && group_free[clst >> map.shift] == 0) {
+        clst = MIN(((clst >> map.shift) + 1) << map.shift, map.counted);
+    }
+    return MIN(clst, stop);
+}
+
+// ---------------------------------------------------------------------------
+// Background counting
+// ---------------------------------------------------------------------------
+
+bool sdfs_background_work(void)
+{
+    FATFS *fs = &sdfs_volume;
+    if (!map_valid(fs) || map.ready) return false;
+
+    // FatFS may hold a newer FAT sector in its window; count after it syncs
+    if (fs->wflag) return false;
+
+    UINT entry_size = fs->fs_type == FS_FAT32 ? 4 : 2;
+    UINT per_sector = 512 / entry_size;
+    DWORD left = fs->n_fatent - map.counted;
+    UINT count = (UINT)MIN(STEP_SECTORS, (left + per_sector - 1) / per_sector);
+
+    // Multi-sector reads bypass the sector cache but see its dirty sectors
+    if (disk_read(fs->pdrv, scan_buf, fs->fatbase + map.counted / per_sector, count) != RES_OK) {
+        map.fs = NULL;
+        return false;
+    }
+
+    DWORD n = MIN(left, (DWORD)count * per_sector);
+    for (DWORD i = 0; i < n; i++) {
+        DWORD clst = map.counted + i;
+        const BYTE *entry = scan_buf + i * entry_size;
+        DWORD value = entry_size == 4
+            ? ((DWORD)entry[0] | (DWORD)entry[1] << 8 | (DWORD)entry[2] << 16 | (DWORD)(entry[3] & 0x0F) << 24)
+            : ((DWORD)entry[0] | (DWORD)entry[1] << 8);
+        if (clst >= 2 && value == 0) {
+            group_free[clst >> map.shift]++;
+        }
+    }
+    map.counted += n;
+
+    if (map.counted >= fs->n_fatent) {
+        DWORD total = 0;
+        for (int i = 0; i < SDFS_FREEMAP_GROUPS; i++) total += group_free[i];
+        if (fs->free_clst != total) {
+            fs->free_clst = total;
+            fs->fsi_flag |= 1; // FSINFO is rewritten on the next sync
+        }
+        map.ready = true;
+    }
+    return !map.ready;
+}
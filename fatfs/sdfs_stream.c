@@ -0,0 +1,130 @@
+//
+// sdfs_stream.c - Preallocated files written straight to the SD card
+//
+// f_expand() gives the file one contiguous run of clusters up front, so its
+// data sectors are known when it is opened. Writes then go to those sectors
+// with a CMD25 that stays open between calls, without FatFS allocating
+// clusters or touching the FAT. The directory entry gets the real size when
+// the stream is synced or closed, through f_setsize().
+//
+// No firmware command uses streams yet; they are a library for
+// applications that record data, exercised by host/fs_bench.c.
+//
+
+#include <string.h>
+#include "ff.h"
+#include "sd_card.h"
+#include "sdfs.h"
+#include "pico/stdlib.h"
+
+// ---------------------------------------------------------------------------
+// Raw sector writes
+// ---------------------------------------------------------------------------
+
+// Write whole sectors starting at byte offset `at`, which is sector aligned.
+// The pre-erase hint covers the rest of the preallocated area.
+static FRESULT stream_sectors(sdfs_stream_t *stream, FSIZE_t at, const BYTE *buf, UINT count)
+{
+    LBA_t first = (LBA_t)(at / 512);
+    LBA_t total = (LBA_t)((stream->capacity + 511) / 512);
+    sd_error_t err = sd_stream_write(stream->sector + first, buf, count, total - first);
+    return err == SD_ERR_NONE ? FR_OK : FR_DISK_ERR;
+}
+
+// Write out the last sector while it is not full, padded with zeros; it is
+// written again once more data fills it
+static FRESULT stream_partial(sdfs_stream_t *stream)
+{
+    UINT used = (UINT)(stream->length % 512);
+    if (used == 0) return FR_OK;
+
+    memset(stream->partial + used, 0, sizeof(stream->partial) - used);
+    return stream_sectors(stream, stream->length - used, stream->partial, 1);
+}
+
+// ---------------------------------------------------------------------------
+// Public API
+// ---------------------------------------------------------------------------
+
+FRESULT sdfs_stream_open(sdfs_stream_t *stream, const char *path, FSIZE_t capacity)
+{
+    FRESULT res = f_open(&stream->file, path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (res != FR_OK) return res;
+
+    res = f_expand(&stream->file, capacity, 1);
+    if (res != FR_OK) {
+        f_close(&stream->file);
+        f_unlink(path);
+        return res;
+    }
+
+    FATFS *fs = stream->file.obj.fs;
+    stream->sector = fs->database + (LBA_t)(stream->file.obj.sclust - 2) * fs->csize;
+    stream->capacity = capacity;
+    stream->length = 0;
+
+    // Clusters may have belonged to a deleted file that is still cached
+    sdfs_cache_discard(stream->sector, (LBA_t)((capacity + 511) / 512));
+    return FR_OK;
+}
+
+FRESULT sdfs_stream_write(sdfs_stream_t *stream, const void *data, UINT len, UINT *written)
+{
+    const BYTE *src = data;
+    *written = 0;
+    if (len > stream->capacity - stream->length) {
+        len = (UINT)(stream->capacity - stream->length); // full: short write
+    }
+
+    while (len > 0) {
+        UINT used = (UINT)(stream->length % 512);
+        UINT n;
+        FRESULT res;
+
+        if (used == 0 && len >= 512) {
+            // Whole sectors go straight from the caller's buffer
+            n = len & ~511u;
+            res = stream_sectors(stream, stream->length, src, n / 512);
+        } else {
+            n = MIN(len, 512 - used);
+            memcpy(stream->partial + used, src, n);
+            res = FR_OK;
+            if (used + n == 512) {
+                res = stream_sectors(stream, stream->length - used, stream->partial, 1);
+            }
+        }
+        if (res != FR_OK) return res;
+
+        stream->length += n;
+        *written += n;
+        src += n;
+        len -= n;
+    }
+    return FR_OK;
+}
+
+FRESULT sdfs_stream_sync(sdfs_stream_t *stream)
+{
+    FRESULT res = stream_partial(stream);
+    if (res != FR_OK) return res;
+    if (sd_stream_end() != SD_ERR_NONE) return FR_DISK_ERR;
+
+    // Record the size written so far; the rest stays allocated
+    res = f_setsize(&stream->file, stream->length);
+    return res == FR_OK ? f_sync(&stream->file) : res;
+}
+
+FRESULT sdfs_stream_close(sdfs_stream_t *stream)
+{
+    FRESULT res = stream_partial(stream);
+    if (res == FR_OK && sd_stream_end() != SD_ERR_NONE) res = FR_DISK_ERR;
+
+    // Give back the clusters past the data: f_truncate() frees the chain
+    // after the file pointer
+    if (res == FR_OK) res = f_setsize(&stream->file, stream->capacity);
+    if (res == FR_OK) res = f_lseek(&stream->file, stream->length);
+    if (res == FR_OK) res = f_truncate(&stream->file);
+
+    FRESULT close_res = f_close(&stream->file);
+    return res != FR_OK ? res : close_res;
+}
@@ -0,0 +1,211 @@
+//
+// display_bench.c - Terminal emulator micro-benchmarks on the host
+//
+// Feeds ANSI streams through display_write() and reports, per workload, the
+// time taken and what the display driver sent to the (mock) LCD. The counts
+// are exact and repeatable, so they show the effect of a rendering change
+// without hardware; the times are for profiling with the host tools.
+//
+//   display_bench [runs]
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "display.h"
+#include "mock_lcd.h"
+
+#define DEFAULT_RUNS    (9)
+#define MAX_RUNS        (101)
+#define STREAM_SIZE     (256 * 1024)
+
+static char stream[STREAM_SIZE];
+static size_t stream_len;
+
+static void emit(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void emit(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(stream + stream_len, sizeof(stream) - stream_len, fmt, args);
+    va_end(args);
+    if (n > 0 && stream_len + n < sizeof(stream))
+    {
+        stream_len += n;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Workloads, each builds the stream it is measured on
+// ---------------------------------------------------------------------------
+
+// Lines of text that scroll the screen
+static void build_text(int columns)
+{
+    for (int row = 0; row < 2000; row++)
+    {
+        for (int i = 0; i < columns - 1; i++)
+        {
+            emit("%c", ' ' + 1 + (row + i) % 94);
+        }
+        emit("\n");
+    }
+}
+
+// A coloured character at a fixed place, as displaytest() does
+static void build_sgr(int columns)
+{
+    (void)columns;
+    for (int i = 0; i < 10000; i++)
+    {
+        emit("\033[4;3H\033[38;5;%dm%c", 16 + i % 215, 'A' + i % 26);
+    }
+    emit("\033[m");
+}
+
+// Foreground and background changes on every character
+static void build_sgr_mixed(int columns)
+{
+    emit("\033[H");
+    for (int i = 0; i < 4096; i++)
+    {
+        emit("\033[38;5;%d;48;5;%dm%c", i % 256, 255 - i % 256, 'a' + i % 26);
+        if (i % columns == columns - 1)
+        {
+            emit("\r\n");
+        }
+    }
+    emit("\033[m");
+}
+
+// Characters written at scattered positions
+static void build_cursor(int columns)
+{
+    uint32_t seed = 1;
+    for (int i = 0; i < 10000; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        emit("\033[%u;%uH%c", 1 + (seed >> 16) % 32, 1 + (seed >> 8) % columns, '0' + i % 10);
+    }
+}
+
+// A status line redrawn over and over with erase to end of line
+static void build_erase(int columns)
+{
+    (void)columns;
+    for (int i = 0; i < 5000; i++)
+    {
+        emit("\033[%d;1HStatus %d\033[K", 1 + i % 32, i);
+    }
+}
+
+static void build_clear(int columns)
+{
+    for (int i = 0; i < 200; i++)
+    {
+        emit("\033[2J\033[HScreen %d", i);
+        for (int c = 0; c < columns; c++)
+        {
+            emit("=");
+        }
+    }
+}
+
+static void build_attrs(int columns)
+{
+    static const char *const attrs[] = {"0", "1", "4", "7", "1;4", "1;7", "4;7", "1;4;7"};
+    for (int row = 0; row < 1000; row++)
+    {
+        emit("\033[%sm", attrs[row % count_of(attrs)]);
+        for (int i = 0; i < columns - 1; i++)
+        {
+            emit("%c", 'A' + (row + i) % 26);
+        }
+        emit("\033[m\n");
+    }
+}
+
+typedef struct {
+    const char *name;
+    void (*build)(int columns);
+} workload_t;
+
+static const workload_t workloads[] = {
+    {"text", build_text},
+    {"attrs", build_attrs},
+    {"sgr", build_sgr},
+    {"sgr-mixed", build_sgr_mixed},
+    {"cursor", build_cursor},
+    {"erase-line", build_erase},
+    {"clear", build_clear},
+};
+
+// ---------------------------------------------------------------------------
+// Runner
+// ---------------------------------------------------------------------------
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void run(const workload_t *workload, const char *font, const char *font_select, int columns, int runs)
+{
+    uint64_t times[MAX_RUNS];
+    mock_lcd_stats_t stats;
+
+    stream_len = 0;
+    workload->build(columns);
+
+    for (int i = 0; i < runs; i++)
+    {
+        // Start each run from the same state
+        display_write(font_select, strlen(font_select));
+        display_write("\033[m\033[2J\033[H", 10);
+        display_flush();
+        mock_lcd_get_stats(&stats, true);
+
+        uint64_t start = time_us_64();
+        display_write(stream, stream_len);
+        display_flush();
+        times[i] = time_us_64() - start;
+        mock_lcd_get_stats(&stats, false); // the same for every run
+    }
+
+    qsort(times, runs, sizeof(times[0]), compare_u64);
+    uint64_t median = times[runs / 2];
+    printf("%s,%s,%zu,%d,%llu,%llu,%llu,%.1f,%llu,%llu,%llu,%llu,%llu\n",
+           workload->name, font, stream_len, runs,
+           (unsigned long long)median, (unsigned long long)times[0], (unsigned long long)times[runs - 1],
+           median * 1000.0 / stream_len,
+           (unsigned long long)stats.commands, (unsigned long long)stats.pixels,
+           (unsigned long long)stats.windows, (unsigned long long)stats.cells,
+           (unsigned long long)stats.scrolls);
+}
+
+int main(int argc, char **argv)
+{
+    int runs = argc > 1 ? atoi(argv[1]) : DEFAULT_RUNS;
+    if (runs < 1 || runs > MAX_RUNS)
+    {
+        fprintf(stderr, "Usage: display_bench [runs], runs 1 to %d\n", MAX_RUNS);
+        return 1;
+    }
+
+    display_init();
+
+    printf("workload,font,bytes,runs,median_us,min_us,max_us,ns_per_byte,"
+           "lcd_commands,pixels,windows,cells,scrolls\n");
+    for (size_t i = 0; i < count_of(workloads); i++)
+    {
+        run(&workloads[i], "8x10", "\033[?4264l", 40, runs);
+        run(&workloads[i], "5x10", "\033[?4264h", 64, runs);
+    }
+    return 0;
+}
@@ -0,0 +1,301 @@
+//
+// fs_bench.c - FatFS micro-benchmarks on the host
+//
+// Runs file system workloads through FatFS, the sector cache and the sdfs
+// extensions on a disk image, and reports for each one the time taken and
+// the SD commands and sectors it cost. A new image is made for every run
+// unless one is given, so the counts are the same from run to run.
+//
+//   fs_bench [image [size_mb]]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "ff.h"
+#include "sdfs.h"
+#include "mock_sd.h"
+
+#define DEFAULT_IMAGE   "fs_bench.img"
+#define DEFAULT_MB      (256)
+#define CHUNK           (4096)      // bytes per f_read/f_write, as sdbench
+#define LARGE_KB        (8192)      // sequential file size
+#define RANDOM_OPS      (256)
+#define SMALL_FILES     (200)
+#define SMALL_SIZE      (1024)
+#define TREE_DIRS       (4)         // sub-directories of /tree, with SMALL_FILES between them
+
+static uint8_t buffer[CHUNK];
+static sdfs_stream_t stream;
+static DWORD tree_free_clusters;    // free clusters before /tree was made
+
+// ---------------------------------------------------------------------------
+// Workloads, each returns FR_OK or the first error
+// ---------------------------------------------------------------------------
+
+static FRESULT mount(void)
+{
+    if (!sdfs_is_ready())
+        return FR_NOT_READY;
+    while (sdfs_background_work())
+    {
+        // count the free clusters, as the firmware does while idle
+    }
+    return FR_OK;
+}
+
+static FRESULT seq_write(void)
+{
+    FIL file;
+    UINT done;
+    FRESULT res = f_open(&file, "/seq.bin", FA_WRITE | FA_CREATE_ALWAYS);
+    for (int i = 0; res == FR_OK && i < LARGE_KB * 1024 / CHUNK; i++)
+    {
+        memset(buffer, i, sizeof(buffer));
+        res = f_write(&file, buffer, CHUNK, &done);
+    }
+    FRESULT close = res == FR_OK ? f_close(&file) : FR_OK;
+    return res != FR_OK ? res : close;
+}
+
+static FRESULT seq_read(void)
+{
+    FIL file;
+    UINT done;
+    FRESULT res = f_open(&file, "/seq.bin", FA_READ);
+    for (int i = 0; res == FR_OK && i < LARGE_KB * 1024 / CHUNK; i++)
+    {
+        res = f_read(&file, buffer, CHUNK, &done);
+        if (res == FR_OK && (done != CHUNK || buffer[0] != (uint8_t)i))
+            res = FR_INT_ERR; // the data did not come back
+    }
+    if (res == FR_OK)
+        f_close(&file);
+    return res;
+}
+
+static FRESULT rand_read(void)
+{
+    FIL file;
+    UINT done;
+    uint32_t seed = 1;
+    FRESULT res = f_open(&file, "/seq.bin", FA_READ);
+    for (int i = 0; res == FR_OK && i < RANDOM_OPS; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        res = f_lseek(&file, (FSIZE_t)((seed >> 8) % (LARGE_KB * 1024 / CHUNK)) * CHUNK);
+        if (res == FR_OK)
+            res = f_read(&file, buffer, CHUNK, &done);
+    }
+    if (res == FR_OK)
+        f_close(&file);
+    return res;
+}
+
+static FRESULT small_create(void)
+{
+    char path[32];
+    FRESULT res = f_mkdir("/small");
+    memset(buffer, 'x', SMALL_SIZE);
+    for (int i = 0; res == FR_OK && i < SMALL_FILES; i++)
+    {
+        FIL file;
+        UINT done;
+        snprintf(path, sizeof(path), "/small/file%04d.txt", i);
+        res = f_open(&file, path, FA_WRITE | FA_CREATE_NEW);
+        if (res == FR_OK)
+            res = f_write(&file, buffer, SMALL_SIZE, &done);
+        if (res == FR_OK)
+            res = f_close(&file);
+    }
+    return res;
+}
+
+static FRESULT small_list(void)
+{
+    DIR dir;
+    FILINFO info;
+    int count = 0;
+    FRESULT res = f_opendir(&dir, "/small");
+    while (res == FR_OK && (res = f_readdir(&dir, &info)) == FR_OK && info.fname[0])
+    {
+        count++;
+    }
+    if (res == FR_OK)
+        f_closedir(&dir);
+    return res == FR_OK && count != SMALL_FILES ? FR_INT_ERR : res;
+}
+
+static FRESULT small_open(void)
+{
+    char path[32];
+    FRESULT res = FR_OK;
+    for (int i = SMALL_FILES - 1; res == FR_OK && i >= 0; i--)
+    {
+        FIL file;
+        UINT done;
+        snprintf(path, sizeof(path), "/small/file%04d.txt", i);
+        res = f_open(&file, path, FA_READ);
+        if (res == FR_OK)
+            res = f_read(&file, buffer, SMALL_SIZE, &done);
+        if (res == FR_OK)
+            res = f_close(&file);
+    }
+    return res;
+}
+
+static FRESULT small_delete(void)
+{
+    char path[32];
+    FRESULT res = FR_OK;
+    for (int i = 0; res == FR_OK && i < SMALL_FILES; i++)
+    {
+        snprintf(path, sizeof(path), "/small/file%04d.txt", i);
+        res = f_unlink(path);
+    }
+    return res == FR_OK ? f_unlink("/small") : res;
+}
+
+static FRESULT tree_create(void)
+{
+    char path[48];
+    FATFS *fs;
+    FRESULT res = f_getfree("", &tree_free_clusters, &fs);
+    if (res == FR_OK)
+        res = f_mkdir("/tree");
+    memset(buffer, 't', SMALL_SIZE);
+    for (int d = 0; res == FR_OK && d < TREE_DIRS; d++)
+    {
+        snprintf(path, sizeof(path), "/tree/dir%d", d);
+        res = f_mkdir(path);
+        for (int i = 0; res == FR_OK && i < SMALL_FILES / TREE_DIRS; i++)
+        {
+            FIL file;
+            UINT done;
+            snprintf(path, sizeof(path), "/tree/dir%d/capture%04d.txt", d, i);
+            res = f_open(&file, path, FA_WRITE | FA_CREATE_NEW);
+            if (res == FR_OK)
+                res = f_write(&file, buffer, SMALL_SIZE, &done);
+            if (res == FR_OK)
+                res = f_close(&file);
+        }
+    }
+    return res;
+}
+
+static FRESULT tree_remove(void)
+{
+    RMTREE_STAT st;
+    DWORD free_clusters;
+    FATFS *fs;
+    FILINFO info;
+    FRESULT res = f_rmtree("/tree", &st, NULL);
+    if (res == FR_OK && (st.files != SMALL_FILES || st.dirs != TREE_DIRS + 1))
+        res = FR_INT_ERR; // something was missed
+    if (res == FR_OK)
+        res = f_stat("/tree", &info) == FR_NO_FILE ? FR_OK : FR_INT_ERR;
+    if (res == FR_OK)
+        res = f_getfree("", &free_clusters, &fs);
+    return res == FR_OK && free_clusters != tree_free_clusters ? FR_INT_ERR : res;
+}
+
+static FRESULT stream_write(void)
+{
+    UINT done;
+    FRESULT res = sdfs_stream_open(&stream, "/stream.bin", (FSIZE_t)LARGE_KB * 1024);
+    if (res != FR_OK)
+        return res;
+    memset(buffer, 's', sizeof(buffer));
+    for (int i = 0; res == FR_OK && i < LARGE_KB * 1024 / CHUNK; i++)
+    {
+        res = sdfs_stream_write(&stream, buffer, CHUNK, &done);
+    }
+    FRESULT close = sdfs_stream_close(&stream);
+    return res != FR_OK ? res : close;
+}
+
+static FRESULT large_delete(void)
+{
+    FRESULT res = f_unlink("/seq.bin");
+    return res == FR_OK ? f_unlink("/stream.bin") : res;
+}
+
+static FRESULT get_free(void)
+{
+    DWORD free_clusters;
+    FATFS *fs;
+    return f_getfree("", &free_clusters, &fs);
+}
+
+typedef struct {
+    const char *name;
+    FRESULT (*run)(void);
+} workload_t;
+
+static const workload_t workloads[] = {
+    {"mount", mount},
+    {"seq-write", seq_write},
+    {"seq-read", seq_read},
+    {"rand-read", rand_read},
+    {"small-create", small_create},
+    {"small-list", small_list},
+    {"small-open", small_open},
+    {"small-delete", small_delete},
+    {"tree-create", tree_create},
+    {"tree-remove", tree_remove},
+    {"stream-write", stream_write},
+    {"large-delete", large_delete},
+    {"getfree", get_free},
+};
+
+int main(int argc, char **argv)
+{
+    const char *image = argc > 1 ? argv[1] : DEFAULT_IMAGE;
+    uint32_t size_mb = argc > 2 ? (uint32_t)atoi(argv[2]) : DEFAULT_MB;
+    if (argc == 1)
+    {
+        remove(image); // start from a freshly formatted card
+    }
+    if (size_mb < 64 || !mock_sd_open(image, size_mb * 2048))
+    {
+        fprintf(stderr, "Cannot open or create %s (size at least 64 MB)\n", image);
+        return 1;
+    }
+
+    sdfs_init();
+
+    printf("workload,time_us,sd_commands,reads,writes,sectors_read,sectors_written,sectors_erased,"
+           "cache_hits,cache_misses,cache_writebacks\n");
+    for (size_t i = 0; i < count_of(workloads); i++)
+    {
+        mock_sd_stats_t sd;
+        sdfs_cache_stats_t cache;
+        mock_sd_get_stats(&sd, true);
+        sdfs_get_cache_stats(&cache, true);
+
+        uint64_t start = time_us_64();
+        FRESULT res = workloads[i].run();
+        uint64_t elapsed = time_us_64() - start;
+
+        mock_sd_get_stats(&sd, false);
+        sdfs_get_cache_stats(&cache, false);
+        if (res != FR_OK)
+        {
+            fprintf(stderr, "%s: FatFS result %d\n", workloads[i].name, (int)res);
+            mock_sd_close();
+            return 1;
+        }
+        printf("%s,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%lu,%lu,%lu\n", workloads[i].name,
+               (unsigned long long)elapsed, (unsigned long long)sd.commands,
+               (unsigned long long)sd.reads, (unsigned long long)sd.writes,
+               (unsigned long long)sd.sectors_read, (unsigned long long)sd.sectors_written,
+               (unsigned long long)sd.sectors_erased,
+               (unsigned long)cache.hits, (unsigned long)cache.misses, (unsigned long)cache.writebacks);
+    }
+
+    f_unmount("");
+    mock_sd_close();
+    return 0;
+}
@@ -0,0 +1,57 @@
+//
+// host_sdk.c - Host versions of the Pico SDK time functions
+//
+
+#include <time.h>
+
+#include "pico/stdlib.h"
+
+uint64_t time_us_64(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t time_us_32(void)
+{
+    return (uint32_t)time_us_64();
+}
+
+absolute_time_t get_absolute_time(void)
+{
+    return time_us_64();
+}
+
+void sleep_us(uint64_t us)
+{
+    struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000};
+    nanosleep(&ts, NULL);
+}
+
+void sleep_ms(uint32_t ms)
+{
+    sleep_us((uint64_t)ms * 1000);
+}
+
+// Alarms never fire; the benchmarks flush the display themselves. They are
+// weak so that a mock can keep them and run them.
+__attribute__((weak)) alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    (void)us;
+    (void)callback;
+    (void)user_data;
+    (void)fire_if_past;
+    return 1;
+}
+
+__attribute__((weak)) alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    return add_alarm_in_us((uint64_t)ms * 1000, callback, user_data, fire_if_past);
+}
+
+__attribute__((weak)) bool cancel_alarm(alarm_id_t alarm_id)
+{
+    (void)alarm_id;
+    return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+typedef void (*irq_handler_t)(void);
+
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY (0x80)
+
+// Interrupts never happen on the host
+static inline void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority)
+{
+    (void)num;
+    (void)handler;
+    (void)order_priority;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+// SPI, implemented by the LCD controller mock, for the tool that builds lcd.c
+
+typedef struct spi_inst spi_inst_t;
+
+typedef struct
+{
+    volatile uint32_t dr;
+    volatile uint32_t icr;
+} spi_hw_t;
+
+#define spi0                    ((spi_inst_t *)0)
+#define spi1                    ((spi_inst_t *)1)
+#define SPI_MSB_FIRST           (1)
+#define SPI_SSPICR_RORIC_BITS   (0x1u)
+
+uint spi_init(spi_inst_t *spi, uint baudrate);
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate);
+void spi_set_format(spi_inst_t *spi, uint data_bits, uint cpol, uint cpha, uint order);
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len);
+int spi_write16_blocking(spi_inst_t *spi, const uint16_t *src, size_t len);
+bool spi_is_busy(spi_inst_t *spi);
+bool spi_is_readable(spi_inst_t *spi);
+spi_hw_t *spi_get_hw(spi_inst_t *spi);
+uint spi_get_dreq(spi_inst_t *spi, bool is_tx);
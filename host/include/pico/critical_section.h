@@ -0,0 +1,14 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+// The host tools run on one thread, so a critical section does nothing
+
+typedef struct
+{
+    int unused;
+} critical_section_t;
+
+static inline void critical_section_init(critical_section_t *crit_sec) { (void)crit_sec; }
+static inline void critical_section_enter_blocking(critical_section_t *crit_sec) { (void)crit_sec; }
+static inline void critical_section_exit(critical_section_t *crit_sec) { (void)crit_sec; }
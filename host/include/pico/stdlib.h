@@ -0,0 +1,73 @@
+#pragma once
+
+// The parts of the Pico SDK used by the drivers built for the host:
+// times come from the host clock, alarms only fire where a mock runs them
+// and the GPIO and IRQ calls do nothing.
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+#ifndef MIN
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+#define __not_in_flash_func(name) name
+#define __time_critical_func(name) name
+
+#define at_the_end_of_time ((absolute_time_t)UINT64_MAX)
+
+#define GPIO_IRQ_EDGE_FALL  (0x4u)
+#define GPIO_IRQ_EDGE_RISE  (0x8u)
+#define IO_IRQ_BANK0        (13)
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+absolute_time_t get_absolute_time(void);
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past);
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past);
+bool cancel_alarm(alarm_id_t alarm_id);
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t) { return (uint32_t)(t / 1000); }
+static inline uint64_t to_us_since_boot(absolute_time_t t) { return t; }
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) { return (int64_t)(to - from); }
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) { return get_absolute_time() + (uint64_t)ms * 1000; }
+static inline absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us) { return t + us; }
+static inline absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms) { return t + (uint64_t)ms * 1000; }
+static inline bool time_reached(absolute_time_t t) { return get_absolute_time() >= t; }
+
+static inline void tight_loop_contents(void) {}
+static inline void busy_wait_us(uint64_t delay_us) { (void)delay_us; }
+static inline void busy_wait_at_least_cycles(uint32_t minimum_cycles) { (void)minimum_cycles; }
+static inline void __sev(void) {}
+static inline void __wfe(void) {}
+static inline uint get_core_num(void) { return 0; }
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t status) { (void)status; }
+
+#define GPIO_IN             (false)
+#define GPIO_OUT            (true)
+#define GPIO_FUNC_SPI       (1)
+
+// Implemented by the LCD controller mock, for the tool that builds lcd.c
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_set_function(uint gpio, uint fn);
+void gpio_put(uint gpio, bool value);
+
+static inline void gpio_add_raw_irq_handler(uint gpio, void (*handler)(void)) { (void)gpio; (void)handler; }
+static inline void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled) { (void)gpio; (void)events; (void)enabled; }
+static inline uint32_t gpio_get_irq_event_mask(uint gpio) { (void)gpio; return 0; }
+static inline void gpio_acknowledge_irq(uint gpio, uint32_t events) { (void)gpio; (void)events; }
+static inline void irq_set_enabled(uint num, bool enabled) { (void)num; (void)enabled; }
@@ -0,0 +1,119 @@
+//
+// lcd_scroll_test.c - Checks of the LCD driver's hardware scrolling on the host
+//
+// Runs lcd.c on a mock ST7365P and looks at what the panel would show while
+// text scrolls more than the whole frame memory: every line of the scrolling
+// area must show the line last drawn there, and the fixed areas set with
+// lcd_define_scrolling() must not change. Exits with 1 if any check fails.
+//
+//   lcd_scroll_test
+//
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "lcd.h"
+#include "mock_st7365p.h"
+
+#define STATUS_COLOUR   (0xF800)
+#define EDGE            (WIDTH - 1)     // right hand column, text never reaches it
+
+static int failures = 0;
+
+static void check(bool ok, const char *test, const char *what, int n)
+{
+    if (!ok)
+    {
+        printf("%s: %s %d\n", test, what, n);
+        failures++;
+    }
+}
+
+// Colour of the nth line of scrolled text, never the background or a status bar
+static uint16_t line_colour(int n)
+{
+    return 0x0100 + n;
+}
+
+// Draw a text row in one colour, with some text over it
+static void draw_row(uint8_t row, uint16_t colour, const char *text)
+{
+    lcd_solid_rectangle(colour, 0, row * GLYPH_HEIGHT, WIDTH, GLYPH_HEIGHT);
+    lcd_putstr(0, row, text);
+}
+
+// All pixel lines of a text row show the colour on the right hand edge
+static bool row_is(uint8_t row, uint16_t colour)
+{
+    for (uint16_t y = row * GLYPH_HEIGHT; y < (row + 1) * GLYPH_HEIGHT; y++)
+    {
+        if (mock_st7365p_panel_row(y)[EDGE] != colour)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Scroll lines of text through the rows between the margins, with status bars drawn
+// in the rows outside them, and check the screen after every line
+static void test_margins(const char *test, uint8_t top, uint8_t bottom, int lines)
+{
+    lcd_clear_screen();
+    lcd_define_scrolling(top * GLYPH_HEIGHT, (ROWS - 1 - bottom) * GLYPH_HEIGHT);
+    check(mock_st7365p_scroll_valid(), test, "scroll definition", 0);
+
+    for (uint8_t r = 0; r < ROWS; r++)
+    {
+        if (r < top || r > bottom)
+        {
+            draw_row(r, STATUS_COLOUR, "status");
+        }
+    }
+
+    for (int n = 0; n < lines; n++)
+    {
+        lcd_scroll_up();
+        draw_row(bottom, line_colour(n), "scrolled text");
+        lcd_wait_idle();
+
+        check(mock_st7365p_scroll_valid(), test, "scroll start after line", n);
+        for (uint8_t r = 0; r < ROWS; r++)
+        {
+            if (r < top || r > bottom)
+            {
+                check(row_is(r, STATUS_COLOUR), test, "status bar overwritten after line", n);
+            }
+            else if (n - (bottom - r) >= 0)
+            {
+                check(row_is(r, line_colour(n - (bottom - r))), test, "wrong line shown after line", n);
+            }
+        }
+        if (failures)
+        {
+            return; // the first failure says enough
+        }
+    }
+
+    // A rectangle across the bottom margin is split between the areas
+    lcd_solid_rectangle(0x07E0, 0, (bottom - 1) * GLYPH_HEIGHT, WIDTH, (ROWS - bottom + 1) * GLYPH_HEIGHT);
+    lcd_wait_idle();
+    for (uint8_t r = bottom - 1; r < ROWS; r++)
+    {
+        check(row_is(r, 0x07E0), test, "rectangle across the margin missed row", r);
+    }
+}
+
+int main(void)
+{
+    lcd_init();
+
+    int frame_lines = FRAME_HEIGHT / GLYPH_HEIGHT;
+    test_margins("whole screen", 0, ROWS - 1, 3 * frame_lines);
+    test_margins("bottom margin", 0, ROWS - 3, 3 * frame_lines);
+    test_margins("both margins", 1, ROWS - 3, 3 * frame_lines);
+    test_margins("top margin", 2, ROWS - 1, 3 * frame_lines);
+
+    printf("lcd_scroll_test: %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
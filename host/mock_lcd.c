@@ -0,0 +1,303 @@
+//
+// mock_lcd.c - LCD driver stand-in for the host build
+//
+// Implements the lcd.h functions the display driver uses. Nothing is drawn;
+// the commands and pixels the real driver would send are counted instead.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lcd.h"
+#include "mock_lcd.h"
+
+static const font_t *font = &font_8x10;
+static uint16_t foreground = 0xFFFF;
+static uint16_t background = 0x0000;
+static bool reverse = false;
+static bool underscore = false;
+static bool bold = false;
+static bool cursor_enabled = true;
+static uint16_t scroll_height = FRAME_HEIGHT;
+static uint16_t y_offset = 0;
+static mock_lcd_stats_t stats;
+
+static uint8_t cursor_column = 0;
+static uint8_t cursor_row = 0;
+static bool window_valid = false;
+static uint16_t window_x0, window_y0, window_x1, window_y1;
+
+// Count a window as the real driver sends it: CASET and RASET only when the column or
+// row range differs from the one last set, then RAMWR. Rows are in frame memory.
+static void mock_window(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    uint16_t x0 = x, x1 = x + width - 1;
+    uint16_t y0 = (y + y_offset) % scroll_height, y1 = y0 + height - 1;
+
+    if (!window_valid || x0 != window_x0 || x1 != window_x1)
+    {
+        stats.commands++; // CASET
+    }
+    if (!window_valid || y0 != window_y0 || y1 != window_y1)
+    {
+        stats.commands++; // RASET
+    }
+    stats.commands++; // RAMWR
+    window_valid = true;
+    window_x0 = x0;
+    window_x1 = x1;
+    window_y0 = y0;
+    window_y1 = y1;
+
+    stats.windows++;
+    stats.pixels += width * height;
+}
+
+void mock_lcd_get_stats(mock_lcd_stats_t *out, bool reset)
+{
+    *out = stats;
+    if (reset)
+    {
+        memset(&stats, 0, sizeof(stats));
+    }
+}
+
+//
+// Character attributes
+//
+
+void lcd_set_reverse(bool reverse_on)
+{
+    if (reverse != reverse_on)
+    {
+        uint16_t temp = foreground;
+        foreground = background;
+        background = temp;
+    }
+    reverse = reverse_on;
+}
+
+void lcd_set_underscore(bool underscore_on)
+{
+    underscore = underscore_on;
+}
+
+void lcd_set_bold(bool bold_on)
+{
+    bold = bold_on;
+}
+
+void lcd_set_font(const font_t *new_font)
+{
+    font = new_font;
+}
+
+uint8_t lcd_get_columns(void)
+{
+    return WIDTH / font->width;
+}
+
+uint8_t lcd_get_glyph_width(void)
+{
+    return font->width;
+}
+
+void lcd_set_foreground(uint16_t colour)
+{
+    if (reverse)
+        background = colour;
+    else
+        foreground = colour;
+}
+
+void lcd_set_background(uint16_t colour)
+{
+    if (reverse)
+        foreground = colour;
+    else
+        background = colour;
+}
+
+uint16_t lcd_get_background(void)
+{
+    return reverse ? foreground : background;
+}
+
+//
+// Drawing
+//
+
+void lcd_wait_idle(void)
+{
+}
+
+void lcd_blit(const uint16_t *pixels, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+    (void)pixels;
+    mock_window(x, y, width, height);
+}
+
+void lcd_solid_rectangle(uint16_t colour, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+    (void)colour;
+    mock_window(x, y, width, height);
+}
+
+void lcd_fill_rects(const lcd_rect_t *rects, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        mock_window(rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+    }
+}
+
+void lcd_define_scrolling(uint16_t top_fixed_area, uint16_t bottom_fixed_area)
+{
+    uint16_t scroll_area = HEIGHT - (top_fixed_area + bottom_fixed_area);
+    if (scroll_area == 0 || scroll_area > FRAME_HEIGHT)
+        scroll_height = FRAME_HEIGHT;
+    else
+        scroll_height = bottom_fixed_area ? scroll_area : FRAME_HEIGHT - top_fixed_area;
+    y_offset = 0;
+    window_valid = false; // any other command forgets the window
+    stats.commands += 1;  // VSCRDEF
+}
+
+// The offset is kept so that the display driver sees what the real driver reports
+void lcd_scroll_lines(int16_t lines)
+{
+    uint16_t pixels = MIN(abs(lines) * GLYPH_HEIGHT, HEIGHT);
+    y_offset = (y_offset + (lines > 0 ? pixels : scroll_height - pixels % scroll_height)) % scroll_height;
+    window_valid = false;
+    stats.commands += 1; // VSCSA
+    stats.scrolls++;
+}
+
+uint16_t lcd_get_scroll_offset(void)
+{
+    return y_offset;
+}
+
+void lcd_set_scroll_offset(uint16_t offset)
+{
+    y_offset = offset % scroll_height;
+    window_valid = false;
+    stats.commands += 1; // VSCSA
+}
+
+void lcd_scroll_up(void)
+{
+    lcd_scroll_lines(1);
+    mock_window(0, HEIGHT - GLYPH_HEIGHT, WIDTH, GLYPH_HEIGHT); // the new line is cleared
+}
+
+void lcd_scroll_down(void)
+{
+    lcd_scroll_lines(-1);
+    mock_window(0, 0, WIDTH, GLYPH_HEIGHT);
+}
+
+lcd_cell_t lcd_make_cell(uint8_t c)
+{
+    lcd_cell_t cell = {
+        .glyph = c,
+        .attrs = (bold ? LCD_ATTR_BOLD : 0) | (underscore ? LCD_ATTR_UNDERSCORE : 0),
+        .foreground = foreground,
+        .background = background,
+    };
+    return cell;
+}
+
+void lcd_putc(uint8_t column, uint8_t row, uint8_t c)
+{
+    (void)c;
+    stats.cells++;
+    mock_window(column * font->width, row * GLYPH_HEIGHT, font->width, GLYPH_HEIGHT);
+}
+
+void lcd_putstr(uint8_t column, uint8_t row, const char *str)
+{
+    while (*str)
+    {
+        lcd_putc(column++, row, (uint8_t)*str++);
+    }
+}
+
+void lcd_putcells(uint8_t column, uint8_t row, const lcd_cell_t *cells, uint8_t count)
+{
+    (void)cells;
+    if (count == 0)
+    {
+        return;
+    }
+    stats.cells += count;
+    mock_window(column * font->width, row * GLYPH_HEIGHT, (uint32_t)font->width * count, GLYPH_HEIGHT);
+}
+
+void lcd_get_glyph_cache_stats(lcd_glyph_cache_stats_t *cache_stats, bool reset)
+{
+    (void)reset;
+    memset(cache_stats, 0, sizeof(*cache_stats));
+}
+
+//
+// The cursor, a line under the character cell
+//
+
+void lcd_move_cursor(uint8_t x, uint8_t y)
+{
+    cursor_column = x;
+    cursor_row = y;
+}
+
+void lcd_draw_cursor(void)
+{
+    if (cursor_enabled)
+    {
+        mock_window(cursor_column * font->width, cursor_row * GLYPH_HEIGHT + GLYPH_HEIGHT - 1,
+                    font->width, 1);
+    }
+}
+
+void lcd_erase_cursor(void)
+{
+    if (cursor_enabled)
+    {
+        mock_window(cursor_column * font->width, cursor_row * GLYPH_HEIGHT + GLYPH_HEIGHT - 1,
+                    font->width, 1);
+    }
+}
+
+void lcd_enable_cursor(bool cursor_on)
+{
+    cursor_enabled = cursor_on;
+}
+
+bool lcd_cursor_enabled(void)
+{
+    return cursor_enabled;
+}
+
+//
+// Screen
+//
+
+void lcd_clear_screen(void)
+{
+    y_offset = 0;
+    window_valid = false;
+    stats.commands += 1; // scroll reset
+    mock_window(0, 0, WIDTH, HEIGHT);
+}
+
+void lcd_erase_line(uint8_t row, uint8_t col_start, uint8_t col_end)
+{
+    mock_window(col_start * font->width, row * GLYPH_HEIGHT,
+                (uint32_t)(col_end - col_start + 1) * font->width, GLYPH_HEIGHT);
+}
+
+void lcd_init(void)
+{
+    font = &font_8x10;
+    lcd_clear_screen();
+}
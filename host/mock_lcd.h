@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// What the display driver asked the LCD to do. Each window drawn costs the
+// commands the real driver sends to set it: RAMWR, with CASET and RASET only
+// when the column or row range changes; a scroll costs one (VSCSA).
+typedef struct {
+    uint64_t commands;          // LCD commands
+    uint64_t pixels;            // pixels sent
+    uint64_t windows;           // windows drawn
+    uint64_t cells;             // character cells drawn
+    uint64_t scrolls;           // hardware scrolls
+} mock_lcd_stats_t;
+
+void mock_lcd_get_stats(mock_lcd_stats_t *stats, bool reset);
@@ -0,0 +1,328 @@
+//
+// mock_sd.c - SD card driver stand-in for the host build
+//
+// Implements sd_card.h on top of a disk image file. A new image is
+// formatted as a single FAT32 volume, as a card would come, so the host
+// tools need nothing else to run.
+//
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sd_card.h"
+#include "mock_sd.h"
+
+#define SECTOR_SIZE     (512)
+#define RESERVED        (32)        // sectors before the first FAT
+#define ERASE_SECTORS   (8192)      // erase block reported to FatFS
+
+static FILE *image = NULL;
+static uint32_t image_sectors = 0;
+static bool stream_open = false;
+static uint32_t stream_next = 0;
+static mock_sd_stats_t stats;
+
+// ---------------------------------------------------------------------------
+// Image
+// ---------------------------------------------------------------------------
+
+static bool image_write(uint32_t sector, const uint8_t *buf, uint32_t count)
+{
+    return fseeko(image, (off_t)sector * SECTOR_SIZE, SEEK_SET) == 0 &&
+           fwrite(buf, SECTOR_SIZE, count, image) == count;
+}
+
+static bool image_read(uint32_t sector, uint8_t *buf, uint32_t count)
+{
+    if (fseeko(image, (off_t)sector * SECTOR_SIZE, SEEK_SET) != 0)
+        return false;
+    size_t n = fread(buf, SECTOR_SIZE, count, image);
+    memset(buf + n * SECTOR_SIZE, 0, (count - n) * SECTOR_SIZE); // past the end of a sparse file
+    return true;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    put16(p, (uint16_t)v);
+    put16(p + 2, (uint16_t)(v >> 16));
+}
+
+// FAT size and cluster count of the volume with clusters of csize sectors
+static uint32_t image_layout(uint8_t csize, uint32_t *fatsz)
+{
+    uint32_t clusters = 0;
+    *fatsz = 0;
+    for (int i = 0; i < 4; i++) // converges in a couple of rounds
+    {
+        clusters = (image_sectors - RESERVED - 2 * *fatsz) / csize;
+        *fatsz = ((clusters + 2) * 4 + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    }
+    return clusters;
+}
+
+// Write a FAT32 boot sector, FSINFO and empty FATs with the root directory
+// in cluster 2. Clusters are the largest, up to 32 KB as on SDHC cards,
+// that still give a FAT32 cluster count.
+static bool image_format(void)
+{
+    uint8_t csize = 64;
+    uint32_t fatsz;
+    uint32_t clusters = image_layout(csize, &fatsz);
+    while (clusters <= 65525 && csize > 1)
+    {
+        csize /= 2;
+        clusters = image_layout(csize, &fatsz);
+    }
+    if (clusters <= 65525)
+        return false; // too small for FAT32
+
+    uint8_t sector[SECTOR_SIZE] = {0};
+    memcpy(sector, "\xEB\x58\x90" "MSWIN4.1", 11);
+    put16(sector + 11, SECTOR_SIZE);
+    sector[13] = csize;
+    put16(sector + 14, RESERVED);
+    sector[16] = 2;                             // FATs
+    sector[21] = 0xF8;                          // fixed disk
+    put16(sector + 24, 63);
+    put16(sector + 26, 255);
+    put32(sector + 32, image_sectors);
+    put32(sector + 36, fatsz);
+    put32(sector + 44, 2);                      // root directory cluster
+    put16(sector + 48, 1);                      // FSINFO sector
+    put16(sector + 50, 6);                      // backup boot sector
+    sector[64] = 0x80;
+    sector[66] = 0x29;
+    put32(sector + 67, 0x12345678);
+    memcpy(sector + 71, "NO NAME    FAT32   ", 19);
+    put16(sector + 510, 0xAA55);
+    if (!image_write(0, sector, 1) || !image_write(6, sector, 1))
+        return false;
+
+    memset(sector, 0, sizeof(sector));
+    put32(sector, 0x41615252);
+    put32(sector + 484, 0x61417272);
+    put32(sector + 488, 0xFFFFFFFF);            // free count unknown
+    put32(sector + 492, 0xFFFFFFFF);
+    put32(sector + 508, 0xAA550000);
+    if (!image_write(1, sector, 1) || !image_write(7, sector, 1))
+        return false;
+
+    memset(sector, 0, sizeof(sector));
+    put32(sector, 0x0FFFFFF8);
+    put32(sector + 4, 0x0FFFFFFF);
+    put32(sector + 8, 0x0FFFFFFF);              // root directory, one cluster
+    uint8_t zero[SECTOR_SIZE] = {0};
+    for (int fat = 0; fat < 2; fat++)
+    {
+        uint32_t base = RESERVED + fat * fatsz;
+        if (!image_write(base, sector, 1))
+            return false;
+        for (uint32_t s = 1; s < fatsz; s++)
+        {
+            if (!image_write(base + s, zero, 1))
+                return false;
+        }
+    }
+    uint32_t root = RESERVED + 2 * fatsz;
+    for (uint8_t s = 0; s < csize; s++)
+    {
+        if (!image_write(root + s, zero, 1))
+            return false;
+    }
+    return fflush(image) == 0;
+}
+
+// Use the image at path, or create and format one of `sectors` sectors
+bool mock_sd_open(const char *path, uint32_t sectors)
+{
+    mock_sd_close();
+    image = fopen(path, "r+b");
+    if (image)
+    {
+        fseeko(image, 0, SEEK_END);
+        image_sectors = (uint32_t)(ftello(image) / SECTOR_SIZE);
+        return image_sectors > 0;
+    }
+
+    image = fopen(path, "w+b");
+    if (!image)
+        return false;
+    image_sectors = sectors;
+    if (ftruncate(fileno(image), (off_t)sectors * SECTOR_SIZE) != 0 || !image_format())
+    {
+        mock_sd_close();
+        return false;
+    }
+    return true;
+}
+
+void mock_sd_close(void)
+{
+    if (image)
+        fclose(image);
+    image = NULL;
+    image_sectors = 0;
+    stream_open = false;
+}
+
+void mock_sd_get_stats(mock_sd_stats_t *out, bool reset)
+{
+    *out = stats;
+    if (reset)
+        memset(&stats, 0, sizeof(stats));
+}
+
+// ---------------------------------------------------------------------------
+// sd_card.h
+// ---------------------------------------------------------------------------
+
+static bool in_range(uint32_t sector, uint32_t count)
+{
+    return image && sector < image_sectors && count <= image_sectors - sector;
+}
+
+void sd_init(void)
+{
+}
+
+bool sd_card_present(void)
+{
+    return image != NULL;
+}
+
+bool sd_is_sdhc(void)
+{
+    return true;
+}
+
+sd_error_t sd_card_init(void)
+{
+    return image ? SD_ERR_NONE : SD_ERR_NO_CARD;
+}
+
+sd_error_t sd_read_blocks(uint32_t sector, uint32_t count, uint8_t *buf)
+{
+    sd_error_t err = sd_stream_end();
+    if (err != SD_ERR_NONE)
+        return err;
+    if (!in_range(sector, count))
+        return SD_ERR_OOR;
+
+    stats.commands += count == 1 ? 1 : 2;
+    stats.reads++;
+    stats.sectors_read += count;
+    return image_read(sector, buf, count) ? SD_ERR_NONE : SD_ERR_GENERAL;
+}
+
+sd_error_t sd_read_block(uint32_t sector, uint8_t *buf)
+{
+    return sd_read_blocks(sector, 1, buf);
+}
+
+sd_error_t sd_write_blocks(uint32_t sector, uint32_t count, const uint8_t *buf)
+{
+    sd_error_t err = sd_stream_end();
+    if (err != SD_ERR_NONE)
+        return err;
+    if (!in_range(sector, count))
+        return SD_ERR_OOR;
+
+    stats.commands += count == 1 ? 1 : 3;
+    stats.writes++;
+    stats.sectors_written += count;
+    return image_write(sector, buf, count) ? SD_ERR_NONE : SD_ERR_GENERAL;
+}
+
+sd_error_t sd_write_block(uint32_t sector, const uint8_t *buf)
+{
+    return sd_write_blocks(sector, 1, buf);
+}
+
+sd_error_t sd_write_gather(uint32_t sector, uint32_t count, const uint8_t *const *blocks)
+{
+    sd_error_t err = sd_stream_end();
+    if (err != SD_ERR_NONE)
+        return err;
+    if (!in_range(sector, count))
+        return SD_ERR_OOR;
+
+    stats.commands += count == 1 ? 1 : 3;
+    stats.writes++;
+    stats.sectors_written += count;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (!image_write(sector + i, blocks[i], 1))
+            return SD_ERR_GENERAL;
+    }
+    return SD_ERR_NONE;
+}
+
+sd_error_t sd_stream_write(uint32_t sector, const uint8_t *buf, uint32_t count, uint32_t erase_hint)
+{
+    (void)erase_hint;
+    if (!in_range(sector, count))
+        return SD_ERR_OOR;
+    if (stream_open && sector != stream_next)
+        sd_stream_end();
+    if (!stream_open)
+    {
+        stats.commands += 3; // CMD55, ACMD23, CMD25
+        stream_open = true;
+    }
+
+    stats.writes++;
+    stats.sectors_written += count;
+    stream_next = sector + count;
+    return image_write(sector, buf, count) ? SD_ERR_NONE : SD_ERR_GENERAL;
+}
+
+sd_error_t sd_stream_end(void)
+{
+    stream_open = false;
+    return SD_ERR_NONE;
+}
+
+sd_error_t sd_erase(uint32_t sector, uint32_t count)
+{
+    sd_error_t err = sd_stream_end();
+    if (err != SD_ERR_NONE)
+        return err;
+    if (!in_range(sector, count))
+        return SD_ERR_OOR;
+
+    // Erased sectors read back as zeros, as on most cards
+    stats.commands += 3 * ((count + SD_ERASE_CHUNK - 1) / SD_ERASE_CHUNK);
+    stats.sectors_erased += count;
+    uint8_t zero[SECTOR_SIZE] = {0};
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (!image_write(sector + i, zero, 1))
+            return SD_ERR_GENERAL;
+    }
+    return SD_ERR_NONE;
+}
+
+sd_error_t sd_get_sector_count(uint32_t *count)
+{
+    *count = image_sectors;
+    return image ? SD_ERR_NONE : SD_ERR_NO_CARD;
+}
+
+uint32_t sd_get_erase_sectors(void)
+{
+    return ERASE_SECTORS;
+}
+
+uint32_t sd_get_baudrate(void)
+{
+    return SD_FAST_BAUD;
+}
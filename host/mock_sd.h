@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The SD traffic FatFS caused. Commands are counted as the real driver
+// sends them: a multi-block read is CMD18 and CMD12, a multi-block write
+// CMD55, ACMD23 and CMD25, an erase CMD32, CMD33 and CMD38.
+typedef struct {
+    uint64_t commands;          // SD commands
+    uint64_t reads;             // read calls
+    uint64_t writes;            // write calls
+    uint64_t sectors_read;
+    uint64_t sectors_written;
+    uint64_t sectors_erased;
+} mock_sd_stats_t;
+
+bool mock_sd_open(const char *path, uint32_t sectors);
+void mock_sd_close(void);
+void mock_sd_get_stats(mock_sd_stats_t *stats, bool reset);
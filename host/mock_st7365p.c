@@ -0,0 +1,410 @@
+//
+// mock_st7365p.c - LCD controller stand-in for the host build of lcd.c
+//
+// Implements the SPI, DMA and GPIO calls lcd.c makes and decodes what they
+// send as the ST7365P would: commands, their parameters and the pixels
+// written to its frame memory. DMA transfers complete as soon as they are
+// started. The power calls lcd.c makes are here too; power_wait() runs the
+// alarm the driver set, so lcd_init() steps through its start up.
+//
+
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/spi.h"
+
+#include "lcd.h"
+#include "power.h"
+#include "mock_st7365p.h"
+
+static uint16_t frame[FRAME_HEIGHT][WIDTH];
+
+static bool data_mode = false;          // D/CX is high
+static uint8_t spi_bits = 8;
+static spi_hw_t spi_hw;
+
+static uint8_t command = LCD_CMD_NOP;   // command the data belongs to
+static uint8_t params[6];
+static uint8_t param_count = 0;
+
+static uint16_t col_start = 0, col_end = WIDTH - 1;
+static uint16_t row_start = 0, row_end = FRAME_HEIGHT - 1;
+static uint16_t write_col, write_row;   // where the next pixel goes
+
+static uint16_t top_fixed = 0;          // VSCRDEF
+static uint16_t scroll_area = FRAME_HEIGHT;
+static uint16_t bottom_fixed = 0;
+static uint16_t scroll_start = 0;       // VSCSAD
+
+static alarm_callback_t alarm_callback = NULL;
+static void *alarm_user_data = NULL;
+
+//
+// Controller
+//
+
+static void receive_command(uint8_t cmd)
+{
+    command = cmd;
+    param_count = 0;
+
+    switch (cmd)
+    {
+    case LCD_CMD_SWRESET:
+        col_start = 0;
+        col_end = WIDTH - 1;
+        row_start = 0;
+        row_end = FRAME_HEIGHT - 1;
+        top_fixed = 0;
+        scroll_area = FRAME_HEIGHT;
+        bottom_fixed = 0;
+        scroll_start = 0;
+        break;
+    case LCD_CMD_RAMWR:
+        write_col = col_start;
+        write_row = row_start;
+        break;
+    }
+}
+
+static void receive_param(uint8_t byte)
+{
+    if (param_count >= sizeof(params))
+    {
+        return;
+    }
+    params[param_count++] = byte;
+
+    uint16_t first = params[0] << 8 | params[1];
+    uint16_t second = params[2] << 8 | params[3];
+    switch (command)
+    {
+    case LCD_CMD_CASET:
+        if (param_count == 4)
+        {
+            col_start = first;
+            col_end = second;
+        }
+        break;
+    case LCD_CMD_RASET:
+        if (param_count == 4)
+        {
+            row_start = first;
+            row_end = second;
+        }
+        break;
+    case LCD_CMD_VSCRDEF:
+        if (param_count == 6)
+        {
+            top_fixed = first;
+            scroll_area = second;
+            bottom_fixed = params[4] << 8 | params[5];
+        }
+        break;
+    case LCD_CMD_VSCSAD:
+        if (param_count == 2)
+        {
+            scroll_start = first;
+        }
+        break;
+    }
+}
+
+static void receive_pixel(uint16_t pixel)
+{
+    if (write_row > row_end || write_row >= FRAME_HEIGHT)
+    {
+        return; // past the end of the window
+    }
+    if (write_col < WIDTH)
+    {
+        frame[write_row][write_col] = pixel;
+    }
+    if (++write_col > col_end)
+    {
+        write_col = col_start;
+        write_row++;
+    }
+}
+
+// A byte in 8-bit mode
+static void receive8(uint8_t byte)
+{
+    if (!data_mode)
+    {
+        receive_command(byte);
+    }
+    else
+    {
+        receive_param(byte);
+    }
+}
+
+// A half-word in 16-bit mode: commands are a NOP followed by the command,
+// frame memory takes pixels and everything else its parameters high byte first
+static void receive16(uint16_t half_word)
+{
+    if (!data_mode)
+    {
+        receive_command(half_word >> 8);
+        receive_command(half_word & 0xFF);
+    }
+    else if (command == LCD_CMD_RAMWR)
+    {
+        receive_pixel(half_word);
+    }
+    else
+    {
+        receive_param(half_word >> 8);
+        receive_param(half_word & 0xFF);
+    }
+}
+
+const uint16_t *mock_st7365p_panel_row(uint16_t line)
+{
+    uint16_t row = line;
+    if (line >= top_fixed && line < top_fixed + scroll_area)
+    {
+        row = top_fixed + (scroll_start - top_fixed + line - top_fixed) % scroll_area;
+    }
+    return frame[row];
+}
+
+bool mock_st7365p_scroll_valid(void)
+{
+    return top_fixed + scroll_area + bottom_fixed == FRAME_HEIGHT &&
+           scroll_start >= top_fixed && scroll_start < top_fixed + scroll_area;
+}
+
+//
+// GPIO and SPI
+//
+
+void gpio_init(uint gpio)
+{
+    (void)gpio;
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+    (void)gpio;
+    (void)out;
+}
+
+void gpio_set_function(uint gpio, uint fn)
+{
+    (void)gpio;
+    (void)fn;
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    if (gpio == LCD_DCX)
+    {
+        data_mode = value;
+    }
+}
+
+uint spi_init(spi_inst_t *spi, uint baudrate)
+{
+    (void)spi;
+    spi_bits = 8;
+    return baudrate;
+}
+
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate)
+{
+    (void)spi;
+    return baudrate;
+}
+
+void spi_set_format(spi_inst_t *spi, uint data_bits, uint cpol, uint cpha, uint order)
+{
+    (void)spi;
+    (void)cpol;
+    (void)cpha;
+    (void)order;
+    spi_bits = data_bits;
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len)
+{
+    (void)spi;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (spi_bits == 16)
+            receive16(src[i]);
+        else
+            receive8(src[i]);
+    }
+    return (int)len;
+}
+
+int spi_write16_blocking(spi_inst_t *spi, const uint16_t *src, size_t len)
+{
+    (void)spi;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (spi_bits == 16)
+            receive16(src[i]);
+        else
+            receive8((uint8_t)src[i]);
+    }
+    return (int)len;
+}
+
+bool spi_is_busy(spi_inst_t *spi)
+{
+    (void)spi;
+    return false;
+}
+
+bool spi_is_readable(spi_inst_t *spi)
+{
+    (void)spi;
+    return false;
+}
+
+spi_hw_t *spi_get_hw(spi_inst_t *spi)
+{
+    (void)spi;
+    return &spi_hw;
+}
+
+uint spi_get_dreq(spi_inst_t *spi, bool is_tx)
+{
+    (void)spi;
+    (void)is_tx;
+    return 0;
+}
+
+//
+// DMA, one channel that feeds the SPI
+//
+
+int dma_claim_unused_channel(bool required)
+{
+    (void)required;
+    return 0;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    (void)channel;
+    dma_channel_config config = {
+        .size = DMA_SIZE_32,
+        .read_increment = true,
+        .write_increment = false,
+    };
+    return config;
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size)
+{
+    c->size = size;
+}
+
+void channel_config_set_read_increment(dma_channel_config *c, bool incr)
+{
+    c->read_increment = incr;
+}
+
+void channel_config_set_write_increment(dma_channel_config *c, bool incr)
+{
+    c->write_increment = incr;
+}
+
+void channel_config_set_dreq(dma_channel_config *c, uint dreq)
+{
+    c->dreq = dreq;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger)
+{
+    (void)channel;
+    (void)write_addr;
+    if (!trigger || read_addr == NULL)
+    {
+        return;
+    }
+
+    const volatile uint16_t *src = read_addr;
+    for (uint i = 0; i < transfer_count; i++)
+    {
+        receive16(src[config->read_increment ? i : 0]);
+    }
+}
+
+bool dma_channel_is_busy(uint channel)
+{
+    (void)channel;
+    return false;
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel)
+{
+    (void)channel;
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled)
+{
+    (void)channel;
+    (void)enabled;
+}
+
+bool dma_channel_get_irq0_status(uint channel)
+{
+    (void)channel;
+    return false;
+}
+
+void dma_channel_acknowledge_irq0(uint channel)
+{
+    (void)channel;
+}
+
+//
+// Alarms and power, for the start up sequence
+//
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    (void)us;
+    (void)fire_if_past;
+    alarm_callback = callback;
+    alarm_user_data = user_data;
+    return 1;
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    return add_alarm_in_us((uint64_t)ms * 1000, callback, user_data, fire_if_past);
+}
+
+bool cancel_alarm(alarm_id_t alarm_id)
+{
+    (void)alarm_id;
+    alarm_callback = NULL;
+    return true;
+}
+
+// Run the alarm straight away, it is set again if it returns a delay
+void power_wait(void)
+{
+    alarm_callback_t callback = alarm_callback;
+    alarm_callback = NULL;
+    if (callback && callback(1, alarm_user_data) != 0)
+    {
+        alarm_callback = callback;
+    }
+}
+
+// Tasks never run, nothing the test checks depends on the cursor blinking
+void power_task_start(power_task_t *task, power_task_fn_t fn, uint32_t delay_ms)
+{
+    (void)task;
+    (void)fn;
+    (void)delay_ms;
+}
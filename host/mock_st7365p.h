@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Frame memory row shown on a line of the panel, following the vertical
+// scroll definition and start address the driver last sent
+const uint16_t *mock_st7365p_panel_row(uint16_t line);
+
+// The top fixed, scrolling and bottom fixed areas add up to the frame
+// memory and the scroll start address is inside the scrolling area
+bool mock_st7365p_scroll_valid(void);
@@ -6,9 +6,12 @@
 #include "drivers/picocalc.h"
 #include "drivers/display.h"
 #include "drivers/keyboard.h"
+#include "drivers/mem.h"
 #include "drivers/onboard_led.h"
+#include "drivers/power.h"
 
 #include "commands.h"
+#include "fatfs/sdfs.h"
 
 bool power_off_requested = false;
 
@@ -26,12 +29,30 @@ void str_to_lower(char *s) {
     }
 }
 
+// Wait for a key, giving the file system the time in between and
+// sleeping once it has nothing left to do
+static char read_key(void)
+{
+    while (true)
+    {
+        int ch = getchar_timeout_us(0);
+        if (ch != PICO_ERROR_TIMEOUT)
+        {
+            return (char)ch;
+        }
+        if (!sdfs_background_work())
+        {
+            power_wait(); // until a key is read, a timer or any other interrupt
+        }
+    }
+}
+
 void readline(char *buffer, size_t size)
 {
     size_t index = 0;
     while (true)
     {
-        char ch = getchar();
+        char ch = read_key();
         if (ch == 0x04) // Ctrl+D to debug
         {
             printf("Entering debug mode...\n");
@@ -61,6 +82,8 @@ int main()
 {
     char buffer[40];
 
+    mem_init(); // paint the stacks before they are used
+
     // Initialize the LED driver and set the LED callback
     // If the LED driver fails to initialize, we can still run the text starter
     // without LED support, so we pass NULL to picocalc_init.
@@ -78,10 +101,13 @@ int main()
     printf("Type \033[4mhelp\033[0m for a list of commands.\n\n");
 
     // A very simple REPL
+    picocalc_boot_stage("prompt");
     printf("\033[qReady.\n");
     while (true)
     {
+        power_set_idle(true); // run slowly while waiting for a command
         readline(buffer, sizeof(buffer));
+        power_set_idle(false);
         if (strlen(buffer) == 0)
         {
             continue; // Skip empty input
@@ -553,11 +553,55 @@ const audio_note_t notes_ode_to_joy[] = {
     // End marker
     {SILENCE, SILENCE, 0}};
 
+// "Chord Waltz" - Multi-track demo for the mixer: a melody over the
+// C, F and G major chords, each chord note on its own voice
+static const audio_instrument_t instrument_lead = {AUDIO_WAVE_TRIANGLE, 255, 10, 200, 160, 120};
+static const audio_instrument_t instrument_pad = {AUDIO_WAVE_SQUARE, 80, 40, 400, 120, 300};
+static const audio_instrument_t instrument_bass = {AUDIO_WAVE_SINE, 255, 5, 300, 100, 100};
+
+static const audio_track_note_t track_waltz_melody[] = {
+    {PITCH_E5, NOTE_QUARTER}, {PITCH_G5, NOTE_QUARTER}, {PITCH_C6, NOTE_QUARTER},
+    {PITCH_A5, NOTE_QUARTER}, {PITCH_F5, NOTE_QUARTER}, {PITCH_C5, NOTE_QUARTER},
+    {PITCH_B4, NOTE_QUARTER}, {PITCH_D5, NOTE_QUARTER}, {PITCH_G5, NOTE_QUARTER},
+    {PITCH_C5, NOTE_DOTTED_HALF},
+    {0, 0}};
+
+static const audio_track_note_t track_waltz_root[] = {
+    {PITCH_C4, NOTE_DOTTED_HALF}, {PITCH_F4, NOTE_DOTTED_HALF},
+    {PITCH_G4, NOTE_DOTTED_HALF}, {PITCH_C4, NOTE_DOTTED_HALF},
+    {0, 0}};
+
+static const audio_track_note_t track_waltz_third[] = {
+    {PITCH_E4, NOTE_DOTTED_HALF}, {PITCH_A4, NOTE_DOTTED_HALF},
+    {PITCH_B4, NOTE_DOTTED_HALF}, {PITCH_E4, NOTE_DOTTED_HALF},
+    {0, 0}};
+
+static const audio_track_note_t track_waltz_fifth[] = {
+    {PITCH_G4, NOTE_DOTTED_HALF}, {PITCH_C5, NOTE_DOTTED_HALF},
+    {PITCH_D5, NOTE_DOTTED_HALF}, {PITCH_G4, NOTE_DOTTED_HALF},
+    {0, 0}};
+
+static const audio_track_note_t track_waltz_bass[] = {
+    {PITCH_C3, NOTE_QUARTER}, {SILENCE, NOTE_HALF},
+    {PITCH_F3, NOTE_QUARTER}, {SILENCE, NOTE_HALF},
+    {PITCH_G3, NOTE_QUARTER}, {SILENCE, NOTE_HALF},
+    {PITCH_C3, NOTE_DOTTED_HALF},
+    {0, 0}};
+
+static const audio_track_t tracks_chord_waltz[] = {
+    {track_waltz_melody, &instrument_lead, AUDIO_PAN_CENTRE},
+    {track_waltz_root, &instrument_pad, AUDIO_PAN_LEFT},
+    {track_waltz_third, &instrument_pad, AUDIO_PAN_CENTRE},
+    {track_waltz_fifth, &instrument_pad, AUDIO_PAN_RIGHT},
+    {track_waltz_bass, &instrument_bass, AUDIO_PAN_CENTRE},
+};
+
 // Song library for easy access
 const audio_song_t songs[] = {
     {"baa", notes_baa_baa, "Baa Baa Black Sheep"},
     {"birthday", notes_happy_birthday, "Happy Birthday"},
     {"canon", notes_canon_in_d, "Canon in D"},
+    {"chords", NULL, "Chord Waltz (mixer demo)", tracks_chord_waltz, count_of(tracks_chord_waltz)},
     {"elise", notes_fur_elise, "Fur Elise"},
     {"macdonald", notes_old_macdonald, "Old MacDonald Had a Farm"},
     {"mary", notes_mary_lamb, "Mary Had a Little Lamb"},
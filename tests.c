@@ -7,6 +7,8 @@
 #include "fatfs/ff.h"
 #include "fatfs/sdfs.h"
 #include "drivers/lcd.h"
+#include "drivers/display.h"
+#include "drivers/picocalc.h"
 #include "tests.h"
 
 extern volatile bool user_interrupt;
@@ -358,7 +360,9 @@ void audiotest()
 void displaytest()
 {
     int row = 1;
+    lcd_glyph_cache_stats_t cache_stats;
     printf("\033[?25l"); // Hide cursor
+    lcd_get_glyph_cache_stats(&cache_stats, true);
 
     absolute_time_t start_time = get_absolute_time();
 
@@ -420,12 +424,17 @@ void displaytest()
     printf("Average characters per second: %.0f\n", chars_per_second);
     printf("Characters displayed: %d\n", chars);
     printf("Average displayed cps: %.0f\n", displayed_per_second);
+
+    lcd_get_glyph_cache_stats(&cache_stats, false);
+    printf("\nGlyph cache hits: %lu\n", cache_stats.hits);
+    printf("Glyph cache misses: %lu\n", cache_stats.misses);
 }
 
 void lcdtest()
 {
     printf("\033[2J\033[HRunning LCD driver test...\n");
     char *hi = "Hello!";
+    display_flush(); // draw the terminal output before drawing on the LCD directly
 
     for(int i=0; i < 100; i++)
     {
@@ -445,7 +454,7 @@ void keyboardtest()
 {
     while (!user_interrupt)
     {
-        char ch = getchar();
+        char ch = picocalc_getchar();
         printf("You pressed: '%c' - 0%o, %d, 0x%x\n", ch, ch, ch, ch);
     }
 }
@@ -1210,6 +1219,7 @@ void fat32test()
 
 void rectangletest()
 {
+    display_flush(); // draw the terminal output before drawing on the LCD directly
     lcd_enable_cursor(false);
     lcd_clear_screen();
 
@@ -1238,6 +1248,7 @@ void rectangletest()
 
 void circletest()
 {
+    display_flush(); // draw the terminal output before drawing on the LCD directly
     lcd_enable_cursor(false);
     lcd_clear_screen();
 
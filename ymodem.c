@@ -0,0 +1,549 @@
+//
+// ymodem.c - YMODEM-1K file transfer over the serial port
+//
+// ymodem_receive() takes a batch of files from the sender and saves them in
+// the current directory; ymodem_send() sends one file. Blocks are checked
+// with CRC-16.
+//
+// Each received block is acknowledged as soon as its CRC checks out,
+// before it is stored, so the sender's next block arrives in the serial
+// driver's input ring while the card is being written. Blocks are gathered
+// in a YMODEM_BUFFER buffer that goes to f_write() in one call; while it is
+// filled with whole sectors, FatFS passes it to the card as a single
+// multi-block write. A sender that mixes 128 byte blocks in can leave no
+// room for a 1K block, and the buffer is then written short of full.
+// Sending works the other way round: the next buffer is read from the card
+// while the last block of the previous one is still going out by DMA.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "fatfs/ff.h"
+#include "drivers/serial.h"
+#include "ymodem.h"
+
+#define SOH         (0x01)      // 128 byte block
+#define STX         (0x02)      // 1024 byte block
+#define EOT         (0x04)      // end of file
+#define ACK         (0x06)
+#define NAK         (0x15)
+#define CAN         (0x18)      // two in a row cancel the transfer
+#define CRC_MODE    ('C')       // receiver asks for CRC-16 blocks
+#define PAD         (0x1A)      // fills the last block of a file
+
+#define HEADER_SIZE (128)
+
+// receive_block() results other than a block size
+#define BLOCK_EOT       (0)
+#define BLOCK_ERROR     (-1)
+#define BLOCK_CANCEL    (-2)
+
+extern volatile bool user_interrupt;
+
+static uint8_t frame[3 + YMODEM_BLOCK_SIZE + 2];    // one block as sent on the line
+static uint8_t file_buffer[YMODEM_BUFFER];
+static uint16_t crc_table[256];
+static bool serial_ready = false;
+
+// RAM taken by the transfer buffers, for the mem command
+const uint32_t ymodem_static_bytes = sizeof(frame) + sizeof(file_buffer) + sizeof(crc_table);
+
+// ---------------------------------------------------------------------------
+// Line
+// ---------------------------------------------------------------------------
+
+static void line_init(uint32_t baudrate)
+{
+    if (!serial_ready)
+    {
+        serial_init(baudrate, UART_DATABITS, UART_STOPBITS, UART_PARITY);
+        serial_ready = true;
+    }
+    else
+    {
+        serial_set_baudrate(baudrate);
+    }
+
+    // CRC-16/XMODEM, polynomial 0x1021
+    for (int i = 0; i < 256; i++)
+    {
+        uint16_t crc = (uint16_t)(i << 8);
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+        crc_table[i] = crc;
+    }
+}
+
+static uint16_t crc16(const uint8_t *data, uint32_t len)
+{
+    uint16_t crc = 0;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc = (crc << 8) ^ crc_table[(crc >> 8) ^ data[i]];
+    }
+    return crc;
+}
+
+// Next byte from the line, or -1 on timeout or BREAK
+static int line_read(uint32_t timeout_ms)
+{
+    absolute_time_t deadline = make_timeout_time_ms(timeout_ms);
+    while (!serial_input_available())
+    {
+        if (user_interrupt || time_reached(deadline))
+        {
+            return -1;
+        }
+        tight_loop_contents();
+    }
+    return (uint8_t)serial_get_char();
+}
+
+static void line_write(const uint8_t *data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++)
+    {
+        serial_put_char((char)data[i]);
+    }
+}
+
+static void line_send(uint8_t byte)
+{
+    serial_put_char((char)byte);
+}
+
+// Drop what the other end is still sending until the line goes quiet
+static void line_purge(void)
+{
+    while (line_read(YMODEM_TIMEOUT_MS / 4) >= 0)
+    {
+    }
+}
+
+static void line_cancel(void)
+{
+    static const uint8_t cancel[] = {CAN, CAN, CAN, CAN, CAN};
+    line_write(cancel, sizeof(cancel));
+    serial_flush();
+}
+
+// ---------------------------------------------------------------------------
+// Receive
+// ---------------------------------------------------------------------------
+
+// Read a block into frame, leaving its data at frame + 3; returns its size,
+// or BLOCK_EOT, BLOCK_ERROR or BLOCK_CANCEL
+static int receive_block(uint32_t timeout_ms)
+{
+    int c = line_read(timeout_ms);
+    int size;
+    switch (c)
+    {
+    case SOH:
+        size = HEADER_SIZE;
+        break;
+    case STX:
+        size = YMODEM_BLOCK_SIZE;
+        break;
+    case EOT:
+        return BLOCK_EOT;
+    case CAN:
+        return line_read(YMODEM_TIMEOUT_MS) == CAN ? BLOCK_CANCEL : BLOCK_ERROR;
+    default:
+        return BLOCK_ERROR;
+    }
+
+    frame[0] = (uint8_t)c;
+    for (int i = 1; i < 3 + size + 2; i++)
+    {
+        c = line_read(YMODEM_TIMEOUT_MS);
+        if (c < 0)
+        {
+            return BLOCK_ERROR;
+        }
+        frame[i] = (uint8_t)c;
+    }
+
+    uint16_t crc = (uint16_t)(frame[3 + size] << 8 | frame[3 + size + 1]);
+    if (frame[1] != (uint8_t)~frame[2] || crc16(frame + 3, size) != crc)
+    {
+        line_purge();
+        return BLOCK_ERROR;
+    }
+    return size;
+}
+
+// Write the buffer, up to the size given in the header
+static bool receive_flush(FIL *file, uint32_t *fill, uint64_t *left)
+{
+    UINT n = (UINT)MIN((uint64_t)*fill, *left);
+    UINT written;
+    if (n > 0 && (f_write(file, file_buffer, n, &written) != FR_OK || written != n))
+    {
+        return false;
+    }
+    *left -= n;
+    *fill = 0;
+    return true;
+}
+
+// Receive one file's data blocks after its header has been acknowledged
+static ymodem_result_t receive_file(FIL *file, uint64_t size)
+{
+    uint8_t expected = 1;
+    uint32_t fill = 0;
+    uint64_t left = size;
+    int errors = 0;
+
+    line_send(CRC_MODE);
+    for (;;)
+    {
+        if (user_interrupt)
+        {
+            line_cancel();
+            return YMODEM_CANCELLED;
+        }
+
+        int result = receive_block(YMODEM_TIMEOUT_MS);
+        if (result == BLOCK_CANCEL)
+        {
+            return YMODEM_CANCELLED;
+        }
+        if (result == BLOCK_ERROR)
+        {
+            if (++errors > YMODEM_RETRIES)
+            {
+                line_cancel();
+                return YMODEM_TIMEOUT;
+            }
+            line_send(NAK);
+            continue;
+        }
+        errors = 0;
+
+        if (result == BLOCK_EOT)
+        {
+            // The first EOT is answered with NAK, the repeat with ACK
+            line_send(NAK);
+            if (line_read(YMODEM_TIMEOUT_MS) == EOT)
+            {
+                line_send(ACK);
+            }
+            return receive_flush(file, &fill, &left) ? YMODEM_OK : YMODEM_FILE_ERROR;
+        }
+
+        if (frame[1] == (uint8_t)(expected - 1))
+        {
+            line_send(ACK); // our ACK was lost, the block is a repeat
+            continue;
+        }
+        if (frame[1] != expected)
+        {
+            line_cancel();
+            return YMODEM_TIMEOUT;
+        }
+
+        // Let the next block come in while this one is stored
+        line_send(ACK);
+        expected++;
+
+        // After 128 byte blocks the buffer can be short of a 1K block
+        if (fill + result > YMODEM_BUFFER && !receive_flush(file, &fill, &left))
+        {
+            line_cancel();
+            return YMODEM_FILE_ERROR;
+        }
+        memcpy(file_buffer + fill, frame + 3, result);
+        fill += result;
+        if (fill == YMODEM_BUFFER && !receive_flush(file, &fill, &left))
+        {
+            line_cancel();
+            return YMODEM_FILE_ERROR;
+        }
+    }
+}
+
+static ymodem_result_t receive_batch(uint32_t baudrate, ymodem_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    line_init(baudrate);
+    line_purge();
+    absolute_time_t start = get_absolute_time();
+
+    for (;;)
+    {
+        // Ask for the header block until it comes
+        int result = BLOCK_ERROR;
+        uint32_t waited_ms = 0;
+        uint32_t limit_ms = stats->files == 0 ? YMODEM_START_MS : YMODEM_TIMEOUT_MS * YMODEM_RETRIES;
+        while (result == BLOCK_ERROR && waited_ms < limit_ms && !user_interrupt)
+        {
+            line_send(CRC_MODE);
+            result = receive_block(YMODEM_TIMEOUT_MS);
+            waited_ms += YMODEM_TIMEOUT_MS;
+        }
+        if (user_interrupt)
+        {
+            line_cancel();
+            return YMODEM_CANCELLED;
+        }
+        if (result == BLOCK_CANCEL)
+        {
+            return YMODEM_CANCELLED;
+        }
+        if (result <= 0 || frame[1] != 0)
+        {
+            line_cancel();
+            return YMODEM_TIMEOUT;
+        }
+
+        // Header: file name, then its size in decimal; no name ends the batch
+        char *name = (char *)frame + 3;
+        name[result - 1] = '\0';
+        if (name[0] == '\0')
+        {
+            line_send(ACK);
+            break;
+        }
+        char *slash = strrchr(name, '/');
+        const char *base = slash ? slash + 1 : name;
+        uint64_t size = UINT64_MAX;
+        char *size_text = name + strlen(name) + 1;
+        if (size_text < (char *)frame + 3 + result && *size_text)
+        {
+            size = strtoull(size_text, NULL, 10);
+        }
+
+        FIL file;
+        if (f_open(&file, base, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+        {
+            line_cancel();
+            return YMODEM_FILE_ERROR;
+        }
+        line_send(ACK);
+
+        ymodem_result_t status = receive_file(&file, size);
+        stats->bytes += f_size(&file);
+        FRESULT closed = f_close(&file);
+        if (status != YMODEM_OK)
+        {
+            f_unlink(base);
+            stats->elapsed_us = absolute_time_diff_us(start, get_absolute_time());
+            return status;
+        }
+        if (closed != FR_OK)
+        {
+            line_cancel();
+            return YMODEM_FILE_ERROR;
+        }
+        stats->files++;
+    }
+
+    stats->elapsed_us = absolute_time_diff_us(start, get_absolute_time());
+    return YMODEM_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Send
+// ---------------------------------------------------------------------------
+
+// Wait for the receiver to ask for CRC blocks
+static ymodem_result_t send_wait_for_start(uint32_t timeout_ms)
+{
+    absolute_time_t deadline = make_timeout_time_ms(timeout_ms);
+    while (!time_reached(deadline))
+    {
+        int c = line_read(YMODEM_TIMEOUT_MS);
+        if (user_interrupt)
+        {
+            line_cancel();
+            return YMODEM_CANCELLED;
+        }
+        if (c == CRC_MODE)
+        {
+            return YMODEM_OK;
+        }
+        if (c == CAN && line_read(YMODEM_TIMEOUT_MS) == CAN)
+        {
+            return YMODEM_CANCELLED;
+        }
+    }
+    line_cancel();
+    return YMODEM_TIMEOUT;
+}
+
+// Put a block in frame and start sending it
+static void send_frame(uint8_t seq, const uint8_t *data, uint32_t len, uint32_t size)
+{
+    frame[0] = size == HEADER_SIZE ? SOH : STX;
+    frame[1] = seq;
+    frame[2] = (uint8_t)~seq;
+    memcpy(frame + 3, data, len);
+    memset(frame + 3 + len, seq == 0 ? 0 : PAD, size - len);
+    uint16_t crc = crc16(frame + 3, size);
+    frame[3 + size] = (uint8_t)(crc >> 8);
+    frame[3 + size + 1] = (uint8_t)crc;
+    line_write(frame, 3 + size + 2);
+}
+
+// Wait for the block in frame to be acknowledged, sending it again when
+// the receiver asks
+static ymodem_result_t send_wait_for_ack(void)
+{
+    uint32_t size = frame[0] == SOH ? HEADER_SIZE : YMODEM_BLOCK_SIZE;
+    for (int attempt = 0; attempt < YMODEM_RETRIES; attempt++)
+    {
+        int c = line_read(YMODEM_TIMEOUT_MS * 10);
+        if (user_interrupt)
+        {
+            line_cancel();
+            return YMODEM_CANCELLED;
+        }
+        if (c == ACK)
+        {
+            return YMODEM_OK;
+        }
+        if (c == CAN && line_read(YMODEM_TIMEOUT_MS) == CAN)
+        {
+            return YMODEM_CANCELLED;
+        }
+        line_write(frame, 3 + size + 2);
+    }
+    line_cancel();
+    return YMODEM_TIMEOUT;
+}
+
+static ymodem_result_t send_path(const char *path, uint32_t baudrate, ymodem_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    FIL file;
+    if (f_open(&file, path, FA_READ) != FR_OK)
+    {
+        return YMODEM_FILE_ERROR;
+    }
+    line_init(baudrate);
+    line_purge();
+
+    ymodem_result_t status = send_wait_for_start(YMODEM_START_MS);
+    absolute_time_t start = get_absolute_time();
+
+    // Header block: file name and size
+    if (status == YMODEM_OK)
+    {
+        char header[HEADER_SIZE] = {0};
+        const char *slash = strrchr(path, '/');
+        const char *base = slash ? slash + 1 : path;
+        int len = snprintf(header, sizeof(header) - 24, "%s", base);
+        snprintf(header + len + 1, sizeof(header) - len - 1, "%llu", (unsigned long long)f_size(&file));
+        send_frame(0, (const uint8_t *)header, sizeof(header), HEADER_SIZE);
+        status = send_wait_for_ack();
+    }
+    if (status == YMODEM_OK)
+    {
+        status = send_wait_for_start(YMODEM_TIMEOUT_MS * YMODEM_RETRIES);
+    }
+
+    // Data blocks, reading the next buffer while the last block goes out
+    uint8_t seq = 1;
+    UINT fill = 0;
+    UINT offset = 0;
+    if (status == YMODEM_OK && f_read(&file, file_buffer, YMODEM_BUFFER, &fill) != FR_OK)
+    {
+        line_cancel();
+        status = YMODEM_FILE_ERROR;
+    }
+    while (status == YMODEM_OK && offset < fill)
+    {
+        uint32_t len = MIN(fill - offset, YMODEM_BLOCK_SIZE);
+        send_frame(seq++, file_buffer + offset, len, len <= HEADER_SIZE ? HEADER_SIZE : YMODEM_BLOCK_SIZE);
+        offset += len;
+        stats->bytes += len;
+
+        if (offset == fill && fill == YMODEM_BUFFER)
+        {
+            offset = 0;
+            if (f_read(&file, file_buffer, YMODEM_BUFFER, &fill) != FR_OK)
+            {
+                line_cancel();
+                status = YMODEM_FILE_ERROR;
+                break;
+            }
+        }
+        status = send_wait_for_ack();
+    }
+    f_close(&file);
+
+    // End of file, then an empty header to end the batch
+    if (status == YMODEM_OK)
+    {
+        status = YMODEM_TIMEOUT;
+        for (int attempt = 0; attempt < YMODEM_RETRIES; attempt++)
+        {
+            line_send(EOT);
+            if (line_read(YMODEM_TIMEOUT_MS) == ACK)
+            {
+                status = YMODEM_OK;
+                break;
+            }
+        }
+    }
+    if (status == YMODEM_OK)
+    {
+        status = send_wait_for_start(YMODEM_TIMEOUT_MS * YMODEM_RETRIES);
+    }
+    if (status == YMODEM_OK)
+    {
+        static const uint8_t empty[HEADER_SIZE] = {0};
+        send_frame(0, empty, sizeof(empty), HEADER_SIZE);
+        status = send_wait_for_ack();
+        stats->files = status == YMODEM_OK ? 1 : 0;
+    }
+
+    stats->elapsed_us = absolute_time_diff_us(start, get_absolute_time());
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Transfers
+// ---------------------------------------------------------------------------
+//
+// The line carries only the transfer: stdio is taken off the serial port
+// until it is done, then the console gets its own baud rate back.
+//
+
+static bool line_take(void)
+{
+    return serial_set_stdio(false);
+}
+
+static void line_give_back(bool console)
+{
+    if (console)
+    {
+        serial_set_baudrate(UART_BAUDRATE);
+        serial_set_stdio(true);
+    }
+}
+
+// Receive a batch of files into the current directory
+ymodem_result_t ymodem_receive(uint32_t baudrate, ymodem_stats_t *stats)
+{
+    bool console = line_take();
+    ymodem_result_t result = receive_batch(baudrate, stats);
+    line_give_back(console);
+    return result;
+}
+
+ymodem_result_t ymodem_send(const char *path, uint32_t baudrate, ymodem_stats_t *stats)
+{
+    bool console = line_take();
+    ymodem_result_t result = send_path(path, baudrate, stats);
+    line_give_back(console);
+    return result;
+}
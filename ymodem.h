@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define YMODEM_BLOCK_SIZE   (1024)      // data bytes in a 1K block
+#define YMODEM_BUFFER       (8192)      // file data read or written at a time
+#define YMODEM_RETRIES      (10)        // attempts per block before giving up
+#define YMODEM_TIMEOUT_MS   (1000)      // wait for a byte or a reply
+#define YMODEM_START_MS     (60000)     // wait for the other end to start
+
+typedef enum {
+    YMODEM_OK,
+    YMODEM_CANCELLED,       // by the other end or the BREAK key
+    YMODEM_TIMEOUT,         // too many bad or missing blocks
+    YMODEM_FILE_ERROR,      // the file could not be read or written
+} ymodem_result_t;
+
+// Totals of a transfer
+typedef struct {
+    uint32_t files;
+    uint64_t bytes;
+    uint64_t elapsed_us;
+} ymodem_stats_t;
+
+ymodem_result_t ymodem_receive(uint32_t baudrate, ymodem_stats_t *stats);
+ymodem_result_t ymodem_send(const char *path, uint32_t baudrate, ymodem_stats_t *stats);
+
+extern const uint32_t ymodem_static_bytes;